@@ -35,6 +35,7 @@
 #include "proxyutils.h"
 #include "function.h"
 #include "gtype.h"
+#include "gjs_gi_trace.h"
 
 #include <util/log.h>
 
@@ -56,6 +57,8 @@ typedef struct {
     guint allocated_directly : 1;
     guint not_owning_gboxed : 1; /* if set, the JS wrapper does not own
                                     the reference to the C gboxed */
+
+    gsize external_size; /* as reported with gjs_memory_external_add() */
 } Boxed;
 
 static gboolean struct_is_simple(GIStructInfo *info);
@@ -150,10 +153,6 @@ boxed_new_resolve(JSContext *context,
             JSObject *boxed_proto;
             const char *method_name;
 
-#if GJS_VERBOSE_ENABLE_GI_USAGE
-            _gjs_log_info_usage((GIBaseInfo*) method_info);
-#endif
-
             method_name = g_base_info_get_name( (GIBaseInfo*) method_info);
 
             gjs_debug(GJS_DEBUG_GBOXED,
@@ -215,6 +214,34 @@ boxed_get_copy_source(JSContext *context,
     return JS_TRUE;
 }
 
+/* Tell the GC about the native memory held by the gboxed we own, using
+ * the payload size for the types that are just buffers.
+ */
+static void
+boxed_add_external_size(JSContext *context,
+                        Boxed     *priv)
+{
+    if (priv->gboxed == NULL || priv->not_owning_gboxed)
+        return;
+
+    if (priv->gtype == G_TYPE_BYTES)
+        priv->external_size = g_bytes_get_size((GBytes *) priv->gboxed);
+    else if (priv->gtype == G_TYPE_BYTE_ARRAY)
+        priv->external_size = ((GByteArray *) priv->gboxed)->len;
+    else if (priv->gtype == G_TYPE_VARIANT)
+        priv->external_size = g_variant_get_size((GVariant *) priv->gboxed);
+    else
+        priv->external_size = g_struct_info_get_size(priv->info);
+
+    gjs_memory_external_add(context, priv->external_size);
+    GJS_COUNTER_ADD_BYTES(boxed, priv->external_size);
+
+    TRACE(GJS_BOXED_NEW(priv->gboxed,
+                        (char *) g_base_info_get_namespace((GIBaseInfo*) priv->info),
+                        (char *) g_base_info_get_name((GIBaseInfo*) priv->info),
+                        priv->external_size));
+}
+
 static void
 boxed_new_direct(Boxed       *priv)
 {
@@ -442,6 +469,7 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(boxed)
     priv = g_slice_new0(Boxed);
 
     GJS_INC_COUNTER(boxed);
+    GJS_COUNTER_ADD_BYTES(boxed, sizeof(Boxed));
 
     g_assert(priv_from_js(context, object) == NULL);
     JS_SetPrivate(object, priv);
@@ -472,6 +500,7 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(boxed)
 
         if (g_type_is_a (priv->gtype, G_TYPE_BOXED)) {
             priv->gboxed = g_boxed_copy(priv->gtype, source_priv->gboxed);
+            boxed_add_external_size(context, priv);
 
             GJS_NATIVE_CONSTRUCTOR_FINISH(boxed);
             return JS_TRUE;
@@ -479,6 +508,7 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(boxed)
             boxed_new_direct (priv);
             memcpy(priv->gboxed, source_priv->gboxed,
                    g_struct_info_get_size (priv->info));
+            boxed_add_external_size(context, priv);
 
             GJS_NATIVE_CONSTRUCTOR_FINISH(boxed);
             return JS_TRUE;
@@ -496,6 +526,8 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(boxed)
     retval = boxed_new(context, object, priv, argc, argv, &actual_rval);
 
     if (retval) {
+        boxed_add_external_size(context, priv);
+
         if (!JSVAL_IS_VOID (actual_rval))
             JS_SET_RVAL(context, vp, actual_rval);
         else
@@ -531,6 +563,8 @@ boxed_finalize(JSFreeOp *fop,
                 g_assert_not_reached ();
         }
 
+        gjs_memory_external_remove(fop->runtime(), priv->external_size);
+        GJS_COUNTER_REMOVE_BYTES(boxed, priv->external_size);
         priv->gboxed = NULL;
     }
 
@@ -540,6 +574,7 @@ boxed_finalize(JSFreeOp *fop,
     }
 
     GJS_DEC_COUNTER(boxed);
+    GJS_COUNTER_REMOVE_BYTES(boxed, sizeof(Boxed));
     g_slice_free(Boxed, priv);
 }
 
@@ -607,6 +642,7 @@ get_nested_interface_object (JSContext   *context,
 
     GJS_INC_COUNTER(boxed);
     priv = g_slice_new0(Boxed);
+    GJS_COUNTER_ADD_BYTES(boxed, sizeof(Boxed));
     JS_SetPrivate(obj, priv);
     priv->info = (GIBoxedInfo*) interface_info;
     g_base_info_ref( (GIBaseInfo*) priv->info);
@@ -1174,6 +1210,7 @@ gjs_define_boxed_class(JSContext    *context,
 
     GJS_INC_COUNTER(boxed);
     priv = g_slice_new0(Boxed);
+    GJS_COUNTER_ADD_BYTES(boxed, sizeof(Boxed));
     priv->info = info;
     boxed_fill_prototype_info(context, priv);
 
@@ -1221,6 +1258,7 @@ gjs_boxed_from_c_struct(JSContext             *context,
 
     GJS_INC_COUNTER(boxed);
     priv = g_slice_new0(Boxed);
+    GJS_COUNTER_ADD_BYTES(boxed, sizeof(Boxed));
 
     *priv = *proto_priv;
     g_base_info_ref( (GIBaseInfo*) priv->info);
@@ -1247,6 +1285,8 @@ gjs_boxed_from_c_struct(JSContext             *context,
                       "Can't create a Javascript object for %s; no way to copy",
                       g_base_info_get_name( (GIBaseInfo*) priv->info));
         }
+
+        boxed_add_external_size(context, priv);
     }
 
     return obj;
@@ -1320,3 +1360,34 @@ gjs_typecheck_boxed(JSContext     *context,
 
     return result;
 }
+
+/**
+ * gjs_boxed_get_heap_dump_info:
+ * @obj: any JS object
+ * @is_prototype_p: set to whether @obj is the prototype for its type
+ *
+ * Like gjs_object_get_heap_dump_info(), for boxed wrappers.
+ *
+ * Returns: the GType name, or the introspected name of a struct that
+ * has none, or %NULL if @obj isn't a boxed wrapper
+ */
+const char *
+gjs_boxed_get_heap_dump_info(JSObject *obj,
+                             gboolean *is_prototype_p)
+{
+    Boxed *priv;
+
+    if (JS_GetClass(obj) != &gjs_boxed_class)
+        return NULL;
+
+    priv = (Boxed *) JS_GetPrivate(obj);
+    if (priv == NULL || priv->info == NULL)
+        return NULL;
+
+    *is_prototype_p = (priv->gboxed == NULL);
+
+    if (priv->gtype != G_TYPE_NONE)
+        return g_type_name(priv->gtype);
+
+    return g_base_info_get_name((GIBaseInfo *) priv->info);
+}
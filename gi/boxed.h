@@ -57,6 +57,9 @@ JSBool    gjs_typecheck_boxed          (JSContext             *context,
                                         GType                  expected_type,
                                         JSBool                 throw_error);
 
+const char *gjs_boxed_get_heap_dump_info (JSObject *obj,
+                                          gboolean *is_prototype_p);
+
 G_END_DECLS
 
 #endif  /* __GJS_BOXED_H__ */
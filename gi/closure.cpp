@@ -32,12 +32,14 @@
 #include <gjs/gjs-module.h>
 #include <gjs/compat.h>
 #include <gjs/runtime.h>
+#include <gjs/timeline.h>
 
 typedef struct {
     GClosure base;
     JSRuntime *runtime;
     JSContext *context;
     JSObject *obj;
+    const char *timeline_name; /* interned, set when first recorded */
     guint unref_on_global_object_finalized : 1;
 } Closure;
 
@@ -81,6 +83,7 @@ invalidate_js_pointers(Closure *c)
     if (c->obj == NULL)
         return;
 
+    gjs_gc_barrier(c->runtime, c->obj);
     c->obj = NULL;
     c->context = NULL;
     c->runtime = NULL;
@@ -166,6 +169,7 @@ closure_invalidated(gpointer data,
     c = (Closure*) closure;
 
     GJS_DEC_COUNTER(closure);
+    GJS_COUNTER_REMOVE_BYTES(closure, sizeof(Closure));
     gjs_debug_closure("Invalidating closure %p which calls object %p",
                       closure, c->obj);
 
@@ -227,6 +231,7 @@ closure_invalidated(gpointer data,
                                            c->obj,
                                            c);
 
+        gjs_gc_barrier(c->runtime, c->obj);
         c->obj = NULL;
         c->context = NULL;
         c->runtime = NULL;
@@ -244,6 +249,44 @@ closure_set_invalid(gpointer  data,
     self->runtime = NULL;
 
     GJS_DEC_COUNTER(closure);
+    GJS_COUNTER_REMOVE_BYTES(closure, sizeof(Closure));
+}
+
+/* "name file:line", so the timeline tells apart handlers that are
+ * all called "_onSomething"
+ */
+static const char *
+get_timeline_name(JSContext *context,
+                  JSObject  *callable)
+{
+    JSFunction *fun;
+    JSString *id;
+    JSScript *script;
+    char *name = NULL;
+    char *label;
+    const char *interned;
+
+    if (!JS_ObjectIsFunction(context, callable))
+        return "(callable)";
+
+    fun = JS_GetObjectFunction(callable);
+    id = JS_GetFunctionId(fun);
+    if (id == NULL || !gjs_string_to_utf8(context, STRING_TO_JSVAL(id), &name))
+        name = g_strdup("(anonymous)");
+
+    script = JS_GetFunctionScript(context, fun);
+    if (script != NULL && JS_GetScriptFilename(context, script) != NULL)
+        label = g_strdup_printf("%s %s:%u", name,
+                                JS_GetScriptFilename(context, script),
+                                JS_GetScriptBaseLineNumber(context, script));
+    else
+        label = g_strdup(name);
+
+    interned = g_intern_string(label);
+    g_free(label);
+    g_free(name);
+
+    return interned;
 }
 
 void
@@ -255,6 +298,7 @@ gjs_closure_invoke(GClosure *closure,
     Closure *c;
     JSContext *context;
     JSObject *global;
+    gint64 timeline_start;
 
     c = (Closure*) closure;
 
@@ -277,6 +321,10 @@ gjs_closure_invoke(GClosure *closure,
         gjs_log_exception(context);
     }
 
+    timeline_start = gjs_timeline_begin();
+    if (timeline_start != 0 && c->timeline_name == NULL)
+        c->timeline_name = get_timeline_name(context, c->obj);
+
     if (!gjs_call_function_value(context,
                                  NULL, /* "this" object; NULL is some kind of default presumably */
                                  OBJECT_TO_JSVAL(c->obj),
@@ -297,6 +345,7 @@ gjs_closure_invoke(GClosure *closure,
     }
 
  out:
+    gjs_timeline_end("closure", c->timeline_name, timeline_start);
     JS_EndRequest(context);
 }
 
@@ -366,6 +415,7 @@ gjs_closure_new(JSContext  *context,
     c->unref_on_global_object_finalized = FALSE;
 
     GJS_INC_COUNTER(closure);
+    GJS_COUNTER_ADD_BYTES(closure, sizeof(Closure));
 
     if (root_function) {
         /* Fully manage closure lifetime if so asked */
@@ -28,10 +28,13 @@
 #include "object.h"
 #include "boxed.h"
 #include "union.h"
+#include "gjs_gi_trace.h"
+#include "usage.h"
 #include "gerror.h"
 #include <gjs/runtime.h>
 #include <gjs/gjs-module.h>
 #include <gjs/compat.h>
+#include <gjs/profiler.h>
 
 #include <util/log.h>
 
@@ -54,6 +57,8 @@ typedef struct {
     guint8 expected_js_argc;
     guint8 js_out_argc;
     GIFunctionInvoker invoker;
+
+    const char *profile_label; /* interned */
 } Function;
 
 extern struct JSClass gjs_function_class;
@@ -72,6 +77,14 @@ gjs_callback_trampoline_ref(GjsCallbackTrampoline *trampoline)
     trampoline->ref_count++;
 }
 
+/* The trampoline itself, its libffi closure and its parameter table */
+static gsize
+gjs_callback_trampoline_get_size(GjsCallbackTrampoline *trampoline)
+{
+    return sizeof(GjsCallbackTrampoline) + sizeof(ffi_closure) +
+        g_callable_info_get_n_args(trampoline->info) * sizeof(GjsParamType);
+}
+
 void
 gjs_callback_trampoline_unref(GjsCallbackTrampoline *trampoline)
 {
@@ -89,6 +102,9 @@ gjs_callback_trampoline_unref(GjsCallbackTrampoline *trampoline)
             JS_EndRequest(context);
         }
 
+        GJS_DEC_NATIVE_COUNTER(trampoline);
+        GJS_COUNTER_REMOVE_BYTES(trampoline, gjs_callback_trampoline_get_size(trampoline));
+
         g_callable_info_free_closure(trampoline->info, trampoline->closure);
         g_base_info_unref( (GIBaseInfo*) trampoline->info);
         g_free (trampoline->param_types);
@@ -155,6 +171,33 @@ set_return_ffi_arg_from_giargument (GITypeInfo  *ret_type,
     }
 }
 
+/* "Namespace.Class.method", interned since profiles may refer to it
+ * after the function is gone.
+ */
+static const char *
+get_profile_label(GICallableInfo *info)
+{
+    GIBaseInfo *container;
+    const char *interned;
+    char *label;
+
+    container = g_base_info_get_container((GIBaseInfo*) info);
+    if (container != NULL)
+        label = g_strdup_printf("%s.%s.%s",
+                                g_base_info_get_namespace(container),
+                                g_base_info_get_name(container),
+                                g_base_info_get_name((GIBaseInfo*) info));
+    else
+        label = g_strdup_printf("%s.%s",
+                                g_base_info_get_namespace((GIBaseInfo*) info),
+                                g_base_info_get_name((GIBaseInfo*) info));
+
+    interned = g_intern_string(label);
+    g_free(label);
+
+    return interned;
+}
+
 /* This is our main entry point for ffi_closure callbacks.
  * ffi_prep_closure is doing pure magic and replaces the original
  * function call with this one which gives us the ffi arguments,
@@ -177,11 +220,32 @@ gjs_callback_closure(ffi_cif *cif,
     GITypeInfo ret_type;
     gboolean success = FALSE;
     gboolean ret_type_is_void;
+    GjsProfilerNativeCall profile;
+    GjsGIUsageCall usage;
+    const char *trace_ns = NULL;
 
     trampoline = (GjsCallbackTrampoline *) data;
     g_assert(trampoline);
     gjs_callback_trampoline_ref(trampoline);
 
+    profile.active = FALSE;
+    if (gjs_profiler_is_active()) {
+        if (trampoline->profile_label == NULL)
+            trampoline->profile_label = get_profile_label(trampoline->info);
+        gjs_profiler_native_begin(&profile, trampoline->runtime,
+                                  trampoline->profile_label);
+    }
+
+    if (TRACE_ENABLED(GJS_CALLBACK_ENTRY) || TRACE_ENABLED(GJS_CALLBACK_RETURN)) {
+        if (trampoline->profile_label == NULL)
+            trampoline->profile_label = get_profile_label(trampoline->info);
+        trace_ns = g_base_info_get_namespace((GIBaseInfo*) trampoline->info);
+        TRACE(GJS_CALLBACK_ENTRY((char *) trace_ns,
+                                 (char *) trampoline->profile_label + strlen(trace_ns) + 1));
+    }
+
+    gjs_gi_usage_call_begin(&usage);
+
     context = gjs_runtime_get_context(trampoline->runtime);
     JS_BeginRequest(context);
     global = JS_GetGlobalObject(context);
@@ -257,15 +321,22 @@ gjs_callback_closure(ffi_cif *cif,
         this_object = NULL;
     }
 
+    gjs_profiler_native_set_phase(&profile, GJS_PROFILER_PHASE_CALL);
+    gjs_gi_usage_call_enter(&usage);
+
     if (!JS_CallFunctionValue(context,
                               this_object,
                               trampoline->js_function,
                               n_jsargs,
                               jsargs,
                               &rval)) {
+        gjs_gi_usage_call_leave(&usage);
         goto out;
     }
 
+    gjs_gi_usage_call_leave(&usage);
+    gjs_profiler_native_set_phase(&profile, GJS_PROFILER_PHASE_MARSHAL_OUT);
+
     g_callable_info_load_return_type(trampoline->info, &ret_type);
     ret_type_is_void = g_type_info_get_tag (&ret_type) == GI_TYPE_TAG_VOID;
 
@@ -375,6 +446,21 @@ out:
         gjs_g_argument_init_default (context, &ret_type, (GArgument *) result);
     }
 
+    if (gjs_gi_usage_call_is_recording(&usage)) {
+        if (trampoline->profile_label == NULL)
+            trampoline->profile_label = get_profile_label(trampoline->info);
+        gjs_gi_usage_call_end(&usage,
+                              trampoline->is_vfunc ? GJS_GI_USAGE_VFUNC : GJS_GI_USAGE_CALLBACK,
+                              trampoline->profile_label);
+    }
+
+    if (trace_ns != NULL) {
+        TRACE(GJS_CALLBACK_RETURN((char *) trace_ns,
+                                  (char *) trampoline->profile_label + strlen(trace_ns) + 1));
+    }
+
+    gjs_profiler_native_end(&profile);
+
     if (trampoline->scope == GI_SCOPE_TYPE_ASYNC) {
         completed_trampolines = g_slist_prepend(completed_trampolines, trampoline);
     }
@@ -417,6 +503,7 @@ gjs_callback_trampoline_new(JSContext      *context,
     trampoline->info = callable_info;
     g_base_info_ref((GIBaseInfo*)trampoline->info);
     trampoline->js_function = function;
+    trampoline->profile_label = NULL;
     if (!is_vfunc)
         JS_AddValueRoot(context, &trampoline->js_function);
 
@@ -482,6 +569,9 @@ gjs_callback_trampoline_new(JSContext      *context,
     trampoline->scope = scope;
     trampoline->is_vfunc = is_vfunc;
 
+    GJS_INC_NATIVE_COUNTER(trampoline);
+    GJS_COUNTER_ADD_BYTES(trampoline, gjs_callback_trampoline_get_size(trampoline));
+
     return trampoline;
 }
 
@@ -567,12 +657,14 @@ gjs_fill_method_instance (JSContext  *context,
 }
 
 static JSBool
-gjs_invoke_c_function(JSContext      *context,
-                      Function       *function,
-                      JSObject       *obj, /* "this" object */
-                      unsigned        js_argc,
-                      jsval          *js_argv,
-                      jsval          *js_rval)
+gjs_invoke_c_function(JSContext             *context,
+                      Function              *function,
+                      GjsProfilerNativeCall *profile,
+                      GjsGIUsageCall        *usage,
+                      JSObject              *obj, /* "this" object */
+                      unsigned               js_argc,
+                      jsval                 *js_argv,
+                      jsval                 *js_rval)
 {
     /* These first four are arrays which hold argument pointers.
      * @in_arg_cvalues: C values which are passed on input (in or inout)
@@ -894,7 +986,11 @@ gjs_invoke_c_function(JSContext      *context,
         return_value_p = &return_value.v_uint64;
     else
         return_value_p = &return_value.v_long;
+    gjs_profiler_native_set_phase(profile, GJS_PROFILER_PHASE_CALL);
+    gjs_gi_usage_call_enter(usage);
     ffi_call(&(function->invoker.cif), FFI_FN(function->invoker.native_address), return_value_p, ffi_arg_pointers);
+    gjs_gi_usage_call_leave(usage);
+    gjs_profiler_native_set_phase(profile, GJS_PROFILER_PHASE_MARSHAL_OUT);
 
     /* Return value and out arguments are valid only if invocation doesn't
      * return error. In arguments need to be released always.
@@ -1182,6 +1278,62 @@ release:
     }
 }
 
+static JSBool
+gjs_invoke_c_function_profiled(JSContext      *context,
+                               Function       *function,
+                               JSObject       *obj,
+                               unsigned        js_argc,
+                               jsval          *js_argv,
+                               jsval          *js_rval)
+{
+    GjsProfilerNativeCall profile;
+    GjsGIUsageCall usage;
+    const char *trace_ns = NULL;
+    JSBool success;
+
+    profile.active = FALSE;
+    if (gjs_profiler_is_active()) {
+        if (function->profile_label == NULL)
+            function->profile_label = get_profile_label(function->info);
+        gjs_profiler_native_begin(&profile, JS_GetRuntime(context),
+                                  function->profile_label);
+    }
+
+    /* The label is "Namespace.rest", so the probes get the part after
+     * the namespace as the name without building a new string.
+     */
+    if (TRACE_ENABLED(GJS_GI_FUNCTION_ENTRY) || TRACE_ENABLED(GJS_GI_FUNCTION_RETURN)) {
+        if (function->profile_label == NULL)
+            function->profile_label = get_profile_label(function->info);
+        trace_ns = g_base_info_get_namespace((GIBaseInfo*) function->info);
+        TRACE(GJS_GI_FUNCTION_ENTRY((char *) trace_ns,
+                                    (char *) function->profile_label + strlen(trace_ns) + 1));
+    }
+
+    gjs_gi_usage_call_begin(&usage);
+
+    success = gjs_invoke_c_function(context, function, &profile, &usage,
+                                    obj, js_argc, js_argv, js_rval);
+
+    if (gjs_gi_usage_call_is_recording(&usage)) {
+        if (function->profile_label == NULL)
+            function->profile_label = get_profile_label(function->info);
+        gjs_gi_usage_call_end(&usage,
+                              g_base_info_get_type((GIBaseInfo*) function->info) == GI_INFO_TYPE_VFUNC ?
+                              GJS_GI_USAGE_VFUNC : GJS_GI_USAGE_FUNCTION,
+                              function->profile_label);
+    }
+
+    if (trace_ns != NULL) {
+        TRACE(GJS_GI_FUNCTION_RETURN((char *) trace_ns,
+                                     (char *) function->profile_label + strlen(trace_ns) + 1));
+    }
+
+    gjs_profiler_native_end(&profile);
+
+    return success;
+}
+
 static JSBool
 function_call(JSContext *context,
               unsigned   js_argc,
@@ -1203,7 +1355,7 @@ function_call(JSContext *context,
         return JS_TRUE; /* we are the prototype, or have the wrong class */
 
 
-    success = gjs_invoke_c_function(context, priv, object, js_argc, js_argv, &retval);
+    success = gjs_invoke_c_function_profiled(context, priv, object, js_argc, js_argv, &retval);
     if (success)
         JS_SET_RVAL(context, vp, retval);
 
@@ -1241,6 +1393,7 @@ function_finalize(JSFreeOp *fop,
     uninit_cached_function_data(priv);
 
     GJS_DEC_COUNTER(function);
+    GJS_COUNTER_REMOVE_BYTES(function, sizeof(Function));
     g_slice_free(Function, priv);
 }
 
@@ -1601,6 +1754,7 @@ function_new(JSContext      *context,
     priv = g_slice_new0(Function);
 
     GJS_INC_COUNTER(function);
+    GJS_COUNTER_ADD_BYTES(function, sizeof(Function));
 
     g_assert(priv_from_js(context, function) == NULL);
     JS_SetPrivate(function, priv);
@@ -1635,6 +1789,11 @@ gjs_define_function(JSContext      *context,
         goto out;
     }
 
+    if (gjs_gi_usage_is_active())
+        gjs_gi_usage_note_resolve(info_type == GI_INFO_TYPE_VFUNC ?
+                                  GJS_GI_USAGE_VFUNC : GJS_GI_USAGE_FUNCTION,
+                                  get_profile_label(info));
+
     if (info_type == GI_INFO_TYPE_FUNCTION) {
         name = (gchar *) g_base_info_get_name((GIBaseInfo*) info);
         free_name = FALSE;
@@ -1677,7 +1836,7 @@ gjs_invoke_c_function_uncached (JSContext      *context,
   if (!init_cached_function_data (context, &function, 0, info))
     return JS_FALSE;
 
-  result = gjs_invoke_c_function (context, &function, obj, argc, argv, rval);
+  result = gjs_invoke_c_function_profiled (context, &function, obj, argc, argv, rval);
   uninit_cached_function_data (&function);
   return result;
 }
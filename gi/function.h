@@ -50,6 +50,7 @@ typedef struct {
     GIScopeType scope;
     gboolean is_vfunc;
     GjsParamType *param_types;
+    const char *profile_label; /* interned */
 } GjsCallbackTrampoline;
 
 GjsCallbackTrampoline* gjs_callback_trampoline_new(JSContext      *context,
@@ -73,8 +74,6 @@ JSBool    gjs_invoke_c_function_uncached (JSContext      *context,
                                           jsval          *argv,
                                           jsval          *rval);
 
-void     gjs_init_cinvoke_profiling (void);
-
 G_END_DECLS
 
 #endif  /* __GJS_FUNCTION_H__ */
@@ -77,6 +77,7 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(error)
     priv = g_slice_new0(Error);
 
     GJS_INC_COUNTER(gerror);
+    GJS_COUNTER_ADD_BYTES(gerror, sizeof(Error));
 
     g_assert(priv_from_js(context, object) == NULL);
     JS_SetPrivate(object, priv);
@@ -149,6 +150,7 @@ error_finalize(JSFreeOp *fop,
     }
 
     GJS_DEC_COUNTER(gerror);
+    GJS_COUNTER_REMOVE_BYTES(gerror, sizeof(Error));
     g_slice_free(Error, priv);
 }
 
@@ -398,6 +400,7 @@ gjs_define_error_class(JSContext    *context,
 
     GJS_INC_COUNTER(gerror);
     priv = g_slice_new0(Error);
+    GJS_COUNTER_ADD_BYTES(gerror, sizeof(Error));
     priv->info = info;
     g_base_info_ref( (GIBaseInfo*) priv->info);
     priv->domain = g_quark_from_string (g_enum_info_get_error_domain(priv->info));
@@ -511,6 +514,7 @@ gjs_error_from_gerror(JSContext             *context,
 
     GJS_INC_COUNTER(gerror);
     priv = g_slice_new0(Error);
+    GJS_COUNTER_ADD_BYTES(gerror, sizeof(Error));
     JS_SetPrivate(obj, priv);
     priv->info = info;
     priv->domain = proto_priv->domain;
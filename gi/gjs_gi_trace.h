@@ -37,10 +37,15 @@
 #include "gjs_gi_probes.h"
 #define TRACE(probe) probe
 
+/* Guards argument computation that is only worth doing when a tracer is
+ * attached, e.g. TRACE_ENABLED(GJS_SIGNAL_EMIT) */
+#define TRACE_ENABLED(probe) probe ## _ENABLED()
+
 #else
 
 /* Wrap the probe to allow it to be removed when no systemtap available */
 #define TRACE(probe)
+#define TRACE_ENABLED(probe) (0)
 
 #endif
 
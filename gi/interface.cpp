@@ -61,6 +61,7 @@ interface_finalize(JSFreeOp *fop,
         g_base_info_unref((GIBaseInfo*)priv->info);
 
     GJS_DEC_COUNTER(interface);
+    GJS_COUNTER_REMOVE_BYTES(interface, sizeof(Interface));
     g_slice_free(Interface, priv);
 }
 
@@ -201,6 +202,7 @@ gjs_define_interface_class(JSContext       *context,
 
     GJS_INC_COUNTER(interface);
     priv = g_slice_new0(Interface);
+    GJS_COUNTER_ADD_BYTES(interface, sizeof(Interface));
     priv->info = info;
     priv->gtype = g_registered_type_info_get_g_type(priv->info);
     g_base_info_ref((GIBaseInfo*)priv->info);
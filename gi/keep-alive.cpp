@@ -28,6 +28,7 @@
 #include <gjs/gjs-module.h>
 #include <gjs/compat.h>
 #include <gjs/runtime.h>
+#include <gjs/gc-stats.h>
 
 #include <util/log.h>
 #include <util/glib.h>
@@ -38,45 +39,164 @@ typedef struct {
     void *data;
 } Child;
 
+/* Children live by value in a dense array, so tracing is a linear scan;
+ * removal moves the last child into the hole. The index map is an
+ * open-addressing table of (index + 1) into the array, 0 meaning an
+ * empty bucket, with linear probing and backward-shift deletion.
+ */
 typedef struct {
-    GHashTable *children;
+    GArray *children;           /* Child */
+    guint *buckets;
+    guint n_buckets;            /* power of two */
     unsigned int inside_finalize : 1;
     unsigned int inside_trace : 1;
 } KeepAlive;
 
+#define INITIAL_N_BUCKETS 64
+
 extern struct JSClass gjs_keep_alive_class;
 
 GJS_DEFINE_PRIV_FROM_JS(KeepAlive, gjs_keep_alive_class)
 
 static guint
-child_hash(gconstpointer  v)
+child_hash(const Child *child)
 {
-    const Child *child = (const Child *) v;
+    guint hash;
 
-    return
+    hash =
         GPOINTER_TO_UINT(child->notify) ^
         GPOINTER_TO_UINT(child->child) ^
         GPOINTER_TO_UINT(child->data);
+
+    /* the pointers are aligned, spread them over the low bits */
+    return hash * 2654435761u;
 }
 
 static gboolean
-child_equal (gconstpointer  v1,
-             gconstpointer  v2)
+child_equal (const Child *child1,
+             const Child *child2)
 {
-    const Child *child1 = (const Child *) v1;
-    const Child *child2 = (const Child *) v2;
-
     /* notify is most likely to be equal, so check it last */
     return child1->data == child2->data &&
         child1->child == child2->child &&
         child1->notify == child2->notify;
 }
 
+static inline Child *
+child_at(KeepAlive *priv,
+         guint      index)
+{
+    return &g_array_index(priv->children, Child, index);
+}
+
+/* Returns the bucket holding @child, or the empty one it would go in */
+static guint
+find_bucket(KeepAlive   *priv,
+            const Child *child,
+            gboolean    *found_p)
+{
+    guint mask = priv->n_buckets - 1;
+    guint bucket = child_hash(child) & mask;
+
+    while (priv->buckets[bucket] != 0) {
+        if (child_equal(child_at(priv, priv->buckets[bucket] - 1), child)) {
+            *found_p = TRUE;
+            return bucket;
+        }
+        bucket = (bucket + 1) & mask;
+    }
+
+    *found_p = FALSE;
+    return bucket;
+}
+
+static void
+rebuild_buckets(KeepAlive *priv,
+                guint      n_buckets)
+{
+    guint i;
+    gboolean found;
+
+    g_free(priv->buckets);
+    priv->buckets = g_new0(guint, n_buckets);
+    priv->n_buckets = n_buckets;
+
+    for (i = 0; i < priv->children->len; i++)
+        priv->buckets[find_bucket(priv, child_at(priv, i), &found)] = i + 1;
+}
+
+static void
+remove_bucket(KeepAlive *priv,
+              guint      hole)
+{
+    guint mask = priv->n_buckets - 1;
+    guint next = hole;
+
+    /* Pull back later entries of the probe sequence that would
+     * otherwise no longer be found past the hole.
+     */
+    for (;;) {
+        guint ideal;
+
+        next = (next + 1) & mask;
+        if (priv->buckets[next] == 0)
+            break;
+
+        ideal = child_hash(child_at(priv, priv->buckets[next] - 1)) & mask;
+        if (hole <= next ? (hole < ideal && ideal <= next)
+                         : (hole < ideal || ideal <= next))
+            continue;
+
+        priv->buckets[hole] = priv->buckets[next];
+        hole = next;
+    }
+
+    priv->buckets[hole] = 0;
+}
+
 static void
-child_free(void *data)
+keep_alive_insert(KeepAlive   *priv,
+                  const Child *child)
 {
-    Child *child = (Child *) data;
-    g_slice_free(Child, child);
+    guint bucket;
+    gboolean found;
+
+    /* keep the load factor under 3/4 */
+    if ((priv->children->len + 1) * 4 > priv->n_buckets * 3)
+        rebuild_buckets(priv, priv->n_buckets * 2);
+
+    bucket = find_bucket(priv, child, &found);
+    g_return_if_fail(!found);
+
+    g_array_append_vals(priv->children, child, 1);
+    priv->buckets[bucket] = priv->children->len;
+}
+
+static void
+keep_alive_remove(KeepAlive   *priv,
+                  const Child *child)
+{
+    guint bucket;
+    guint index;
+    guint last;
+    gboolean found;
+
+    bucket = find_bucket(priv, child, &found);
+    if (!found)
+        return;
+
+    index = priv->buckets[bucket] - 1;
+    remove_bucket(priv, bucket);
+
+    last = priv->children->len - 1;
+    if (index != last) {
+        *child_at(priv, index) = *child_at(priv, last);
+        bucket = find_bucket(priv, child_at(priv, index), &found);
+        g_assert(found);
+        priv->buckets[bucket] = index + 1;
+    }
+
+    g_array_set_size(priv->children, last);
 }
 
 GJS_NATIVE_CONSTRUCTOR_DEFINE_ABSTRACT(keep_alive)
@@ -86,8 +206,7 @@ keep_alive_finalize(JSFreeOp *fop,
                     JSObject *obj)
 {
     KeepAlive *priv;
-    void *key;
-    void *value;
+    guint i;
 
     priv = (KeepAlive *) JS_GetPrivate(obj);
 
@@ -99,51 +218,50 @@ keep_alive_finalize(JSFreeOp *fop,
 
     priv->inside_finalize = TRUE;
 
-    while (gjs_g_hash_table_steal_one(priv->children,
-                                      &key, &value)) {
-        Child *child = (Child *) value;
+    for (i = 0; i < priv->children->len; i++) {
+        Child *child = child_at(priv, i);
         if (child->notify)
             (* child->notify) (child->child, child->data);
-
-        child_free(child);
     }
 
-    g_hash_table_destroy(priv->children);
+    g_array_free(priv->children, TRUE);
+    g_free(priv->buckets);
     g_slice_free(KeepAlive, priv);
 }
 
-static void
-trace_foreach(void *key,
-              void *value,
-              void *data)
-{
-    Child *child = (Child *) value;
-    JSTracer *tracer = (JSTracer *) data;
-
-    if (child->child != NULL) {
-        jsval val;
-        JS_SET_TRACING_DETAILS(tracer, NULL, "keep-alive", 0);
-        val = OBJECT_TO_JSVAL(child->child);
-        g_assert (JSVAL_TO_TRACEABLE (val));
-        JS_CallValueTracer(tracer, &val, "keep-alive::val");
-    }
-}
-
 static void
 keep_alive_trace(JSTracer *tracer,
                  JSObject *obj)
 {
     KeepAlive *priv;
+    gint64 start = 0;
+    gboolean marking;
+    guint i;
 
     priv = (KeepAlive *) JS_GetPrivate(obj);
 
     if (priv == NULL) /* prototype */
         return;
 
+    /* Heap dumps and the like trace too, only time the real thing */
+    marking = JS_IsGCMarkingTracer(tracer);
+    if (marking)
+        start = g_get_monotonic_time();
+
     g_assert(!priv->inside_trace);
     priv->inside_trace = TRUE;
-    g_hash_table_foreach(priv->children, trace_foreach, tracer);
+    for (i = 0; i < priv->children->len; i++) {
+        Child *child = child_at(priv, i);
+
+        if (child->child != NULL) {
+            JS_CallObjectTracer(tracer, &child->child, "keep-alive");
+        }
+    }
     priv->inside_trace = FALSE;
+
+    if (marking)
+        gjs_gc_stats_note_keep_alive_trace(g_get_monotonic_time() - start,
+                                           priv->children->len);
 }
 
 /* The bizarre thing about this vtable is that it applies to both
@@ -152,7 +270,8 @@ keep_alive_trace(JSTracer *tracer,
  */
 struct JSClass gjs_keep_alive_class = {
     "__private_GjsKeepAlive", /* means "new __private_GjsKeepAlive()" works */
-    JSCLASS_HAS_PRIVATE,
+    JSCLASS_HAS_PRIVATE |
+    JSCLASS_IMPLEMENTS_BARRIERS,
     JS_PropertyStub,
     JS_DeletePropertyStub,
     JS_PropertyStub,
@@ -248,7 +367,9 @@ gjs_keep_alive_new(JSContext *context)
     }
 
     priv = g_slice_new0(KeepAlive);
-    priv->children = g_hash_table_new_full(child_hash, child_equal, NULL, child_free);
+    priv->children = g_array_new(FALSE, FALSE, sizeof(Child));
+    priv->buckets = g_new0(guint, INITIAL_N_BUCKETS);
+    priv->n_buckets = INITIAL_N_BUCKETS;
 
     g_assert(priv_from_js(context, keep_alive) == NULL);
     JS_SetPrivate(keep_alive, priv);
@@ -270,7 +391,7 @@ gjs_keep_alive_add_child(JSContext         *context,
                          void              *data)
 {
     KeepAlive *priv;
-    Child *child;
+    Child child;
 
     g_assert(keep_alive != NULL);
 
@@ -283,18 +404,12 @@ gjs_keep_alive_add_child(JSContext         *context,
     g_return_if_fail(!priv->inside_trace);
     g_return_if_fail(!priv->inside_finalize);
 
-    child = g_slice_new0(Child);
-    child->notify = notify;
-    child->child = obj;
-    child->data = data;
-
-    /* this is sort of an expensive check, probably */
-    g_return_if_fail(g_hash_table_lookup(priv->children, child) == NULL);
+    child.notify = notify;
+    child.child = obj;
+    child.data = data;
 
-    /* this overwrites any identical-by-value previous child,
-     * but there should not be one.
-     */
-    g_hash_table_replace(priv->children, child, child);
+    /* there should not be an identical-by-value previous child */
+    keep_alive_insert(priv, &child);
 }
 
 void
@@ -320,8 +435,9 @@ gjs_keep_alive_remove_child(JSContext         *context,
     child.child = obj;
     child.data = data;
 
-    g_hash_table_remove(priv->children,
-                        &child);
+    gjs_gc_barrier(JS_GetRuntime(context), obj);
+
+    keep_alive_remove(priv, &child);
 }
 
 static JSObject*
@@ -142,6 +142,7 @@ ns_finalize(JSFreeOp *fop,
         g_free(priv->gi_namespace);
 
     GJS_DEC_COUNTER(ns);
+    GJS_COUNTER_REMOVE_BYTES(ns, sizeof(Ns));
     g_slice_free(Ns, priv);
 }
 
@@ -224,6 +225,7 @@ ns_new(JSContext    *context,
     priv = g_slice_new0(Ns);
 
     GJS_INC_COUNTER(ns);
+    GJS_COUNTER_ADD_BYTES(ns, sizeof(Ns));
 
     g_assert(priv_from_js(context, ns) == NULL);
     JS_SetPrivate(ns, priv);
@@ -38,6 +38,8 @@
 #include "keep-alive.h"
 #include "closure.h"
 #include "gjs_gi_trace.h"
+#include "usage.h"
+#include "variant.h"
 
 #include <gjs/gjs-module.h>
 #include <gjs/compat.h>
@@ -259,6 +261,7 @@ object_instance_get_prop(JSContext              *context,
     char *gname;
     GParamSpec *param;
     GValue gvalue = { 0, };
+    GjsGIUsageCall usage;
     JSBool ret = JS_TRUE;
 
     if (!gjs_get_string_id(context, id, &name))
@@ -299,9 +302,13 @@ object_instance_get_prop(JSContext              *context,
                      "Overriding %s with GObject prop %s",
                      name, param->name);
 
+    gjs_gi_usage_call_begin(&usage);
+
     g_value_init(&gvalue, G_PARAM_SPEC_VALUE_TYPE(param));
+    gjs_gi_usage_call_enter(&usage);
     g_object_get_property(priv->gobj, param->name,
                           &gvalue);
+    gjs_gi_usage_call_leave(&usage);
     if (!gjs_value_from_g_value(context, value_p.address(), &gvalue)) {
         g_value_unset(&gvalue);
         ret = JS_FALSE;
@@ -309,6 +316,10 @@ object_instance_get_prop(JSContext              *context,
     }
     g_value_unset(&gvalue);
 
+    if (gjs_gi_usage_call_is_recording(&usage))
+        gjs_gi_usage_call_end(&usage, GJS_GI_USAGE_PROPERTY,
+                              gjs_gi_usage_resolve_property(param));
+
  out:
     g_free(name);
     return ret;
@@ -327,6 +338,7 @@ object_instance_set_prop(JSContext              *context,
     ObjectInstance *priv;
     char *name;
     GParameter param = { NULL, { 0, }};
+    GjsGIUsageCall usage;
     JSBool ret = JS_TRUE;
 
     if (!gjs_get_string_id(context, id, &name))
@@ -343,6 +355,8 @@ object_instance_set_prop(JSContext              *context,
     if (priv->gobj == NULL) /* prototype, not an instance. */
         goto out;
 
+    gjs_gi_usage_call_begin(&usage);
+
     switch (init_g_param_from_property(context, name,
                                        value_p,
                                        G_TYPE_FROM_INSTANCE(priv->gobj),
@@ -356,11 +370,21 @@ object_instance_set_prop(JSContext              *context,
         break;
     }
 
+    gjs_gi_usage_call_enter(&usage);
     g_object_set_property(priv->gobj, param.name,
                           &param.value);
+    gjs_gi_usage_call_leave(&usage);
 
     g_value_unset(&param.value);
 
+    if (gjs_gi_usage_call_is_recording(&usage)) {
+        GParamSpec *pspec;
+
+        pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(priv->gobj), param.name);
+        gjs_gi_usage_call_end(&usage, GJS_GI_USAGE_PROPERTY,
+                              gjs_gi_usage_resolve_property(pspec));
+    }
+
     /* note that the prop will also have been set in JS, which I think
      * is OK, since we hook get and set so will always override that
      * value. We could also use JS_DefineProperty though and specify a
@@ -616,10 +640,6 @@ object_instance_new_resolve(JSContext *context,
                                                   priv, name);
         goto out;
     } else {
-#if GJS_VERBOSE_ENABLE_GI_USAGE
-        _gjs_log_info_usage((GIBaseInfo*) method_info);
-#endif
-
         gjs_debug(GJS_DEBUG_GOBJECT,
                   "Defining method %s in prototype for %s (%s.%s)",
                   g_base_info_get_name( (GIBaseInfo*) method_info),
@@ -1048,6 +1068,8 @@ wrapped_gobj_toggle_notify(gpointer      data,
          * The JSObject is rooted and we need to unroot it so it
          * can be garbage collected
          */
+        TRACE(GJS_OBJECT_TOGGLE_DOWN(gobj, (char *) G_OBJECT_TYPE_NAME(gobj)));
+
         if (gc_blocked) {
             if (G_UNLIKELY (toggle_up_queued || toggle_down_queued)) {
                 g_error("toggling down object %s that's already queued to toggle %s\n",
@@ -1066,6 +1088,8 @@ wrapped_gobj_toggle_notify(gpointer      data,
          * The JSObject associated with the gobject is not rooted,
          * but it needs to be. We'll root it.
          */
+        TRACE(GJS_OBJECT_TOGGLE_UP(gobj, (char *) G_OBJECT_TYPE_NAME(gobj)));
+
         if (gc_blocked && !toggle_down_queued) {
             if (G_UNLIKELY (toggle_up_queued)) {
                 g_error("toggling up object %s that's already queued to toggle up\n",
@@ -1106,6 +1130,7 @@ init_object_private (JSContext *context,
     priv = g_slice_new0(ObjectInstance);
 
     GJS_INC_COUNTER(object);
+    GJS_COUNTER_ADD_BYTES(object, sizeof(ObjectInstance));
 
     g_assert(priv_from_js(context, object) == NULL);
     JS_SetPrivate(object, priv);
@@ -1394,6 +1419,7 @@ object_instance_finalize(JSFreeOp  *fop,
     }
 
     GJS_DEC_COUNTER(object);
+    GJS_COUNTER_REMOVE_BYTES(object, sizeof(ObjectInstance));
     g_slice_free(ObjectInstance, priv);
 }
 
@@ -1534,6 +1560,9 @@ real_connect_func(JSContext *context,
         goto out;
     }
 
+    if (gjs_gi_usage_is_active())
+        gjs_gi_usage_note_resolve(GJS_GI_USAGE_SIGNAL, gjs_gi_usage_signal_name(signal_id));
+
     closure = gjs_closure_new_for_signal(context, JSVAL_TO_OBJECT(argv[1]), "signal callback", signal_id);
     if (closure == NULL)
         goto out;
@@ -1639,6 +1668,7 @@ emit_func(JSContext *context,
     char *signal_name;
     GValue *instance_and_args;
     GValue rvalue = G_VALUE_INIT;
+    GjsGIUsageCall usage;
     unsigned int i;
     gboolean failed;
     jsval retval;
@@ -1685,6 +1715,8 @@ emit_func(JSContext *context,
 
     g_signal_query(signal_id, &signal_query);
 
+    gjs_gi_usage_call_begin(&usage);
+
     if ((argc - 1) != signal_query.n_params) {
         gjs_throw(context, "Signal '%s' on %s requires %d args got %d",
                      signal_name,
@@ -1720,8 +1752,12 @@ emit_func(JSContext *context,
     }
 
     if (!failed) {
+        TRACE(GJS_SIGNAL_EMIT(priv->gobj, (char *) G_OBJECT_TYPE_NAME(priv->gobj),
+                              (char *) signal_query.signal_name));
+        gjs_gi_usage_call_enter(&usage);
         g_signal_emitv(instance_and_args, signal_id, signal_detail,
                        &rvalue);
+        gjs_gi_usage_call_leave(&usage);
     }
 
     if (signal_query.return_type != G_TYPE_NONE) {
@@ -1739,6 +1775,10 @@ emit_func(JSContext *context,
         g_value_unset(&instance_and_args[i]);
     }
 
+    if (gjs_gi_usage_call_is_recording(&usage))
+        gjs_gi_usage_call_end(&usage, GJS_GI_USAGE_SIGNAL_EMISSION,
+                              gjs_gi_usage_signal_name(signal_id));
+
     if (!failed)
         JS_SET_RVAL(context, vp, retval);
 
@@ -1781,7 +1821,8 @@ to_string_func(JSContext *context,
 struct JSClass gjs_object_instance_class = {
     "GObject_Object",
     JSCLASS_HAS_PRIVATE |
-    JSCLASS_NEW_RESOLVE,
+    JSCLASS_NEW_RESOLVE |
+    JSCLASS_IMPLEMENTS_BARRIERS,
     JS_PropertyStub,
     JS_DeletePropertyStub,
     object_instance_get_prop,
@@ -1967,6 +2008,7 @@ gjs_define_object_class(JSContext      *context,
 
     GJS_INC_COUNTER(object);
     priv = g_slice_new0(ObjectInstance);
+    GJS_COUNTER_ADD_BYTES(object, sizeof(ObjectInstance));
     priv->info = info;
     if (info)
         g_base_info_ref((GIBaseInfo*) info);
@@ -2047,6 +2089,11 @@ gjs_object_from_g_object(JSContext    *context,
         g_object_unref(gobj);
 
         g_assert(peek_js_obj(gobj) == obj);
+    } else {
+        /* The wrapper may be held only weakly (toggled down), so
+         * treat handing it out like reading a weak pointer.
+         */
+        gjs_gc_barrier(JS_GetRuntime(context), obj);
     }
 
  out:
@@ -2700,10 +2747,44 @@ gjs_define_private_gi_stuff(JSContext *context,
 
     module = JS_NewObject (context, NULL, NULL, NULL);
 
-    if (!JS_DefineFunctions(context, module, &module_funcs[0]))
+    if (!JS_DefineFunctions(context, module, &module_funcs[0]) ||
+        !gjs_define_variant_funcs(context, module))
         return JS_FALSE;
 
     *module_out = module;
 
     return JS_TRUE;
 }
+
+/**
+ * gjs_object_get_heap_dump_info:
+ * @obj: any JS object
+ * @is_prototype_p: set to whether @obj is the prototype for its type
+ * @toggle_rooted_p: set to whether the toggle reference currently keeps
+ *   @obj alive from the keep-alive object
+ *
+ * Used when writing heap snapshots, so it only peeks at @obj and is
+ * safe to call while tracing.
+ *
+ * Returns: the GType name of the wrapped GObject, or %NULL if @obj
+ * isn't a GObject wrapper
+ */
+const char *
+gjs_object_get_heap_dump_info(JSObject *obj,
+                              gboolean *is_prototype_p,
+                              gboolean *toggle_rooted_p)
+{
+    ObjectInstance *priv;
+
+    if (JS_GetClass(obj) != &gjs_object_instance_class)
+        return NULL;
+
+    priv = (ObjectInstance *) JS_GetPrivate(obj);
+    if (priv == NULL)
+        return NULL;
+
+    *is_prototype_p = (priv->gobj == NULL);
+    *toggle_rooted_p = (priv->keep_alive != NULL);
+
+    return g_type_name(priv->gobj ? G_OBJECT_TYPE(priv->gobj) : priv->gtype);
+}
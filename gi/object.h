@@ -46,6 +46,10 @@ JSBool    gjs_typecheck_object          (JSContext     *context,
 
 void      gjs_object_process_pending_toggles (void);
 
+const char *gjs_object_get_heap_dump_info (JSObject *obj,
+                                           gboolean *is_prototype_p,
+                                           gboolean *toggle_rooted_p);
+
 G_END_DECLS
 
 #endif  /* __GJS_OBJECT_H__ */
@@ -176,6 +176,7 @@ param_finalize(JSFreeOp *fop,
     }
 
     GJS_DEC_COUNTER(param);
+    GJS_COUNTER_REMOVE_BYTES(param, sizeof(Param));
     g_slice_free(Param, priv);
 }
 
@@ -535,6 +536,7 @@ gjs_param_from_g_param(JSContext    *context,
 
     GJS_INC_COUNTER(param);
     priv = g_slice_new0(Param);
+    GJS_COUNTER_ADD_BYTES(param, sizeof(Param));
     JS_SetPrivate(obj, priv);
     priv->gparam = gparam;
     g_param_spec_ref (gparam);
@@ -223,6 +223,7 @@ repo_finalize(JSFreeOp *fop,
         return; /* we are the prototype, not a real instance */
 
     GJS_DEC_COUNTER(repo);
+    GJS_COUNTER_REMOVE_BYTES(repo, sizeof(Repo));
     g_slice_free(Repo, priv);
 }
 
@@ -308,6 +309,7 @@ repo_new(JSContext *context)
     priv = g_slice_new0(Repo);
 
     GJS_INC_COUNTER(repo);
+    GJS_COUNTER_ADD_BYTES(repo, sizeof(Repo));
 
     g_assert(priv_from_js(context, repo) == NULL);
     JS_SetPrivate(repo, priv);
@@ -387,80 +389,11 @@ gjs_define_constant(JSContext      *context,
     return ret;
 }
 
-#if GJS_VERBOSE_ENABLE_GI_USAGE
-void
-_gjs_log_info_usage(GIBaseInfo *info)
-{
-#define DIRECTION_STRING(d) ( ((d) == GI_DIRECTION_IN) ? "IN" : ((d) == GI_DIRECTION_OUT) ? "OUT" : "INOUT" )
-#define TRANSFER_STRING(t) ( ((t) == GI_TRANSFER_NOTHING) ? "NOTHING" : ((t) == GI_TRANSFER_CONTAINER) ? "CONTAINER" : "EVERYTHING" )
-
-    {
-        char *details;
-        GIInfoType info_type;
-        GIBaseInfo *container;
-
-        info_type = g_base_info_get_type(info);
-
-        if (info_type == GI_INFO_TYPE_FUNCTION) {
-            GString *args;
-            int n_args;
-            int i;
-            GITransfer retval_transfer;
-
-            args = g_string_new("{ ");
-
-            n_args = g_callable_info_get_n_args((GICallableInfo*) info);
-            for (i = 0; i < n_args; ++i) {
-                GIArgInfo *arg;
-                GIDirection direction;
-                GITransfer transfer;
-
-                arg = g_callable_info_get_arg((GICallableInfo*)info, i);
-                direction = g_arg_info_get_direction(arg);
-                transfer = g_arg_info_get_ownership_transfer(arg);
-
-                g_string_append_printf(args,
-                                       "{ GI_DIRECTION_%s, GI_TRANSFER_%s }, ",
-                                       DIRECTION_STRING(direction),
-                                       TRANSFER_STRING(transfer));
-
-                g_base_info_unref((GIBaseInfo*) arg);
-            }
-            if (args->len > 2)
-                g_string_truncate(args, args->len - 2); /* chop comma */
-
-            g_string_append(args, " }");
-
-            retval_transfer = g_callable_info_get_caller_owns((GICallableInfo*) info);
-
-            details = g_strdup_printf(".details = { .func = { .retval_transfer = GI_TRANSFER_%s, .n_args = %d, .args = %s } }",
-                                      TRANSFER_STRING(retval_transfer), n_args, args->str);
-            g_string_free(args, TRUE);
-        } else {
-            details = g_strdup_printf(".details = { .nothing = {} }");
-        }
-
-        container = g_base_info_get_container(info);
-
-        gjs_debug_gi_usage("{ GI_INFO_TYPE_%s, \"%s\", \"%s\", \"%s\", %s },",
-                           gjs_info_type_name(info_type),
-                           g_base_info_get_namespace(info),
-                           container ? g_base_info_get_name(container) : "",
-                           g_base_info_get_name(info),
-                           details);
-        g_free(details);
-    }
-}
-#endif /* GJS_VERBOSE_ENABLE_GI_USAGE */
-
 JSBool
 gjs_define_info(JSContext  *context,
                 JSObject   *in_object,
                 GIBaseInfo *info)
 {
-#if GJS_VERBOSE_ENABLE_GI_USAGE
-    _gjs_log_info_usage(info);
-#endif
     switch (g_base_info_get_type(info)) {
     case GI_INFO_TYPE_FUNCTION:
         {
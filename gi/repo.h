@@ -52,10 +52,6 @@ char*       gjs_camel_from_hyphen               (const char     *hyphen_name);
 char*       gjs_hyphen_from_camel               (const char     *camel_name);
 
 
-#if GJS_VERBOSE_ENABLE_GI_USAGE
-void _gjs_log_info_usage(GIBaseInfo *info);
-#endif
-
 G_END_DECLS
 
 #endif  /* __GJS_REPO_H__ */
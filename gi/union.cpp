@@ -98,10 +98,6 @@ union_new_resolve(JSContext *context,
             JSObject *union_proto;
             const char *method_name;
 
-#if GJS_VERBOSE_ENABLE_GI_USAGE
-            _gjs_log_info_usage((GIBaseInfo*) method_info);
-#endif
-
             method_name = g_base_info_get_name( (GIBaseInfo*) method_info);
 
             gjs_debug(GJS_DEBUG_GBOXED,
@@ -201,6 +197,7 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(union)
     priv = g_slice_new0(Union);
 
     GJS_INC_COUNTER(boxed);
+    GJS_COUNTER_ADD_BYTES(boxed, sizeof(Union));
 
     g_assert(priv_from_js(context, object) == NULL);
     JS_SetPrivate(object, priv);
@@ -277,6 +274,7 @@ union_finalize(JSFreeOp *fop,
     }
 
     GJS_DEC_COUNTER(boxed);
+    GJS_COUNTER_REMOVE_BYTES(boxed, sizeof(Union));
     g_slice_free(Union, priv);
 }
 
@@ -382,6 +380,7 @@ gjs_define_union_class(JSContext    *context,
 
     GJS_INC_COUNTER(boxed);
     priv = g_slice_new0(Union);
+    GJS_COUNTER_ADD_BYTES(boxed, sizeof(Union));
     priv->info = info;
     g_base_info_ref( (GIBaseInfo*) priv->info);
     priv->gtype = gtype;
@@ -431,6 +430,7 @@ gjs_union_from_c_union(JSContext    *context,
 
     GJS_INC_COUNTER(boxed);
     priv = g_slice_new0(Union);
+    GJS_COUNTER_ADD_BYTES(boxed, sizeof(Union));
     JS_SetPrivate(obj, priv);
     priv->info = info;
     g_base_info_ref( (GIBaseInfo *) priv->info);
@@ -0,0 +1,332 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include "usage.h"
+
+#include <gio/gio.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+typedef struct {
+    guint64 n_resolved;
+    guint64 n_invoked;
+    gint64 marshal_time;
+    gint64 call_time;
+} GjsGIUsageEntry;
+
+static const char *kind_names[] = {
+    "functions", "vfuncs", "callbacks", "properties", "signals",
+    "signal_emissions"
+};
+
+G_STATIC_ASSERT(G_N_ELEMENTS(kind_names) == GJS_GI_USAGE_N_KINDS);
+
+static gboolean usage_active = FALSE;
+static char *usage_output = NULL;
+
+static GMutex usage_lock;
+/* interned name -> GjsGIUsageEntry, protected by usage_lock */
+static GHashTable *usage_tables[GJS_GI_USAGE_N_KINDS];
+
+static void
+usage_entry_free(GjsGIUsageEntry *entry)
+{
+    g_slice_free(GjsGIUsageEntry, entry);
+}
+
+/* Called with usage_lock held */
+static GjsGIUsageEntry *
+usage_lookup(GjsGIUsageKind  kind,
+             const char     *name)
+{
+    GjsGIUsageEntry *entry;
+
+    entry = (GjsGIUsageEntry *) g_hash_table_lookup(usage_tables[kind], name);
+    if (entry == NULL) {
+        entry = g_slice_new0(GjsGIUsageEntry);
+        g_hash_table_insert(usage_tables[kind], (gpointer) name, entry);
+    }
+
+    return entry;
+}
+
+gboolean
+gjs_gi_usage_is_active(void)
+{
+    return usage_active;
+}
+
+/**
+ * gjs_gi_usage_enable:
+ *
+ * Starts recording GI usage for the rest of the process.
+ */
+void
+gjs_gi_usage_enable(void)
+{
+    int i;
+
+    g_mutex_lock(&usage_lock);
+    if (!usage_active) {
+        for (i = 0; i < GJS_GI_USAGE_N_KINDS; i++)
+            usage_tables[i] = g_hash_table_new_full(NULL, NULL, NULL,
+                                                    (GDestroyNotify) usage_entry_free);
+        usage_active = TRUE;
+    }
+    g_mutex_unlock(&usage_lock);
+}
+
+static void
+dump_usage_at_exit(void)
+{
+    GError *error = NULL;
+
+    if (!gjs_gi_usage_dump(usage_output, &error)) {
+        g_printerr("Failed to write GI usage: %s\n", error->message);
+        g_error_free(error);
+    }
+}
+
+/* Setting GJS_DEBUG_GI_USAGE_OUTPUT records GI usage from the first
+ * context on, and writes it to that file at exit.
+ */
+void
+gjs_gi_usage_init(void)
+{
+    const char *output;
+
+    output = g_getenv("GJS_DEBUG_GI_USAGE_OUTPUT");
+    if (output == NULL || *output == '\0')
+        return;
+
+    g_mutex_lock(&usage_lock);
+    if (usage_output != NULL) {
+        g_mutex_unlock(&usage_lock);
+        return;
+    }
+    usage_output = g_strdup(output);
+    g_mutex_unlock(&usage_lock);
+
+    gjs_gi_usage_enable();
+    atexit(dump_usage_at_exit);
+}
+
+static GQuark
+usage_name_quark (void)
+{
+    static GQuark val = 0;
+    if (!val)
+        val = g_quark_from_static_string ("gjs::gi-usage-name");
+
+    return val;
+}
+
+/* "GtkWidget:visible", by the type that installed the property. The
+ * name is kept on @pspec, and the first time it is asked for counts as
+ * resolving the property; after that, accessing it only counts as a
+ * call.
+ */
+const char *
+gjs_gi_usage_resolve_property(GParamSpec *pspec)
+{
+    char *name;
+    const char *interned;
+
+    interned = (const char *) g_param_spec_get_qdata(pspec, usage_name_quark());
+    if (interned != NULL)
+        return interned;
+
+    name = g_strdup_printf("%s:%s", g_type_name(pspec->owner_type), pspec->name);
+    interned = g_intern_string(name);
+    g_free(name);
+
+    g_param_spec_set_qdata(pspec, usage_name_quark(), (gpointer) interned);
+    gjs_gi_usage_note_resolve(GJS_GI_USAGE_PROPERTY, interned);
+
+    return interned;
+}
+
+/* "GtkWidget::draw", by the type that defined the signal */
+const char *
+gjs_gi_usage_signal_name(guint signal_id)
+{
+    GSignalQuery query;
+    char *name;
+    const char *interned;
+
+    g_signal_query(signal_id, &query);
+    if (query.signal_id == 0)
+        return "(invalid signal)";
+
+    name = g_strdup_printf("%s::%s", g_type_name(query.itype), query.signal_name);
+    interned = g_intern_string(name);
+    g_free(name);
+
+    return interned;
+}
+
+void
+gjs_gi_usage_note_resolve(GjsGIUsageKind  kind,
+                          const char     *name)
+{
+    if (G_LIKELY(!usage_active))
+        return;
+
+    g_mutex_lock(&usage_lock);
+    usage_lookup(kind, name)->n_resolved++;
+    g_mutex_unlock(&usage_lock);
+}
+
+void
+gjs_gi_usage_call_begin(GjsGIUsageCall *call)
+{
+    call->start = G_LIKELY(!usage_active) ? 0 : g_get_monotonic_time();
+    call->call_time = 0;
+}
+
+void
+gjs_gi_usage_call_enter(GjsGIUsageCall *call)
+{
+    if (G_LIKELY(call->start == 0))
+        return;
+
+    call->call_start = g_get_monotonic_time();
+}
+
+void
+gjs_gi_usage_call_leave(GjsGIUsageCall *call)
+{
+    if (G_LIKELY(call->start == 0))
+        return;
+
+    call->call_time += g_get_monotonic_time() - call->call_start;
+}
+
+void
+gjs_gi_usage_call_end(GjsGIUsageCall *call,
+                      GjsGIUsageKind  kind,
+                      const char     *name)
+{
+    GjsGIUsageEntry *entry;
+    gint64 total;
+
+    if (G_LIKELY(call->start == 0))
+        return;
+
+    total = g_get_monotonic_time() - call->start;
+
+    g_mutex_lock(&usage_lock);
+    entry = usage_lookup(kind, name);
+    entry->n_invoked++;
+    entry->call_time += call->call_time;
+    entry->marshal_time += total - call->call_time;
+    g_mutex_unlock(&usage_lock);
+
+    call->start = 0;
+}
+
+static gint
+compare_names(gconstpointer a,
+              gconstpointer b)
+{
+    return strcmp((const char *) a, (const char *) b);
+}
+
+/**
+ * gjs_gi_usage_report_json:
+ *
+ * Returns: (transfer full): what was recorded so far as a JSON object
+ * with one member per kind, each mapping names to resolve and call
+ * counts and times in microseconds, or %NULL if not recording
+ */
+char *
+gjs_gi_usage_report_json(void)
+{
+    GString *json;
+    int i;
+
+    if (!usage_active)
+        return NULL;
+
+    json = g_string_new("{\n");
+    g_string_append_printf(json, "  \"pid\": %u,\n", (guint) getpid());
+    g_string_append_printf(json, "  \"time\": %" G_GINT64_FORMAT,
+                           g_get_real_time());
+
+    g_mutex_lock(&usage_lock);
+
+    for (i = 0; i < GJS_GI_USAGE_N_KINDS; i++) {
+        GList *names, *l;
+
+        g_string_append_printf(json, ",\n  \"%s\": {", kind_names[i]);
+
+        names = g_list_sort(g_hash_table_get_keys(usage_tables[i]), compare_names);
+        for (l = names; l != NULL; l = l->next) {
+            const char *name = (const char *) l->data;
+            GjsGIUsageEntry *entry =
+                (GjsGIUsageEntry *) g_hash_table_lookup(usage_tables[i], name);
+
+            g_string_append_printf(json,
+                                   "%s\n    \"%s\": { \"resolved\": %" G_GUINT64_FORMAT
+                                   ", \"invoked\": %" G_GUINT64_FORMAT
+                                   ", \"marshal_us\": %" G_GINT64_FORMAT
+                                   ", \"call_us\": %" G_GINT64_FORMAT " }",
+                                   l == names ? "" : ",",
+                                   name, entry->n_resolved, entry->n_invoked,
+                                   entry->marshal_time, entry->call_time);
+        }
+        g_string_append(json, names != NULL ? "\n  }" : "}");
+        g_list_free(names);
+    }
+
+    g_mutex_unlock(&usage_lock);
+
+    g_string_append(json, "\n}\n");
+
+    return g_string_free(json, FALSE);
+}
+
+gboolean
+gjs_gi_usage_dump(const char  *filename,
+                  GError     **error)
+{
+    char *json;
+    gboolean ret;
+
+    json = gjs_gi_usage_report_json();
+    if (json == NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_INITIALIZED,
+                    "GI usage is not being recorded; set GJS_DEBUG_GI_USAGE_OUTPUT");
+        return FALSE;
+    }
+
+    ret = g_file_set_contents(filename, json, -1, error);
+    g_free(json);
+
+    return ret;
+}
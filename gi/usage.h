@@ -0,0 +1,82 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GJS_USAGE_H__
+#define __GJS_USAGE_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* Counts how often each GI function, vfunc, callback, property and
+ * signal is resolved and called, and how long goes into marshalling
+ * for it, for the whole process. Recording is off until
+ * gjs_gi_usage_enable(); the calls below cost a test until then.
+ *
+ * Names must be interned: function labels from the profiler, or
+ * gjs_gi_usage_resolve_property() and gjs_gi_usage_signal_name().
+ */
+typedef enum {
+    GJS_GI_USAGE_FUNCTION,
+    GJS_GI_USAGE_VFUNC,
+    GJS_GI_USAGE_CALLBACK,
+    GJS_GI_USAGE_PROPERTY,
+    GJS_GI_USAGE_SIGNAL,            /* handlers: connected, then delivered to */
+    GJS_GI_USAGE_SIGNAL_EMISSION,   /* emitted from JS */
+    GJS_GI_USAGE_N_KINDS
+} GjsGIUsageKind;
+
+/* One call; the time between enter and leave is the call itself,
+ * the rest of the time between begin and end is marshalling.
+ */
+typedef struct {
+    gint64 start;               /* 0 when not recording */
+    gint64 call_start;
+    gint64 call_time;
+} GjsGIUsageCall;
+
+void     gjs_gi_usage_enable    (void);
+gboolean gjs_gi_usage_is_active (void);
+char    *gjs_gi_usage_report_json (void);
+gboolean gjs_gi_usage_dump      (const char     *filename,
+                                 GError        **error);
+void     gjs_gi_usage_init      (void);
+
+const char *gjs_gi_usage_resolve_property (GParamSpec *pspec);
+const char *gjs_gi_usage_signal_name      (guint       signal_id);
+
+void gjs_gi_usage_note_resolve (GjsGIUsageKind  kind,
+                                const char     *name);
+
+void gjs_gi_usage_call_begin (GjsGIUsageCall *call);
+void gjs_gi_usage_call_enter (GjsGIUsageCall *call);
+void gjs_gi_usage_call_leave (GjsGIUsageCall *call);
+void gjs_gi_usage_call_end   (GjsGIUsageCall *call,
+                              GjsGIUsageKind  kind,
+                              const char     *name);
+
+#define gjs_gi_usage_call_is_recording(call) ((call)->start != 0)
+
+G_END_DECLS
+
+#endif /* __GJS_USAGE_H__ */
@@ -35,6 +35,8 @@
 #include "union.h"
 #include "gtype.h"
 #include "gerror.h"
+#include "gjs_gi_trace.h"
+#include "usage.h"
 #include <gjs/gjs-module.h>
 #include <gjs/compat.h>
 #include <gjs/runtime.h>
@@ -65,6 +67,7 @@ closure_marshal(GClosure        *closure,
     jsval rval;
     int i;
     GSignalQuery signal_query = { 0, };
+    GjsGIUsageCall usage;
 
     gjs_debug_marshal(GJS_DEBUG_GCLOSURE,
                       "Marshal closure %p",
@@ -94,6 +97,9 @@ closure_marshal(GClosure        *closure,
     }
     JS_AddValueRoot(context, &rval);
 
+    /* Only recorded for signal handlers, see below */
+    usage.start = 0;
+
     if (marshal_data) {
         /* we are used for a signal handler */
         guint signal_id;
@@ -113,6 +119,9 @@ closure_marshal(GClosure        *closure,
                       "Signal handler being called with wrong number of parameters");
             goto cleanup;
         }
+
+        TRACE(GJS_SIGNAL_DELIVER(closure, (char *) signal_query.signal_name));
+        gjs_gi_usage_call_begin(&usage);
     }
 
     for (i = 0; i < argc; ++i) {
@@ -134,7 +143,9 @@ closure_marshal(GClosure        *closure,
         }
     }
 
+    gjs_gi_usage_call_enter(&usage);
     gjs_closure_invoke(closure, argc, argv, &rval);
+    gjs_gi_usage_call_leave(&usage);
 
     if (return_value != NULL) {
         if (JSVAL_IS_VOID(rval)) {
@@ -151,6 +162,10 @@ closure_marshal(GClosure        *closure,
     }
 
  cleanup:
+    if (gjs_gi_usage_call_is_recording(&usage))
+        gjs_gi_usage_call_end(&usage, GJS_GI_USAGE_SIGNAL,
+                              gjs_gi_usage_signal_name(signal_query.signal_id));
+
     if (argc > 0)
         gjs_unroot_value_locations(context, argv, argc);
     JS_RemoveValueRoot(context, &rval);
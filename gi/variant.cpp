@@ -0,0 +1,1162 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include <string.h>
+
+#include "variant.h"
+#include "boxed.h"
+#include <gjs/gjs-module.h>
+#include <gjs/compat.h>
+#include <gjs/byteArray.h>
+#include <util/log.h>
+#include <girepository.h>
+#include <jsfriendapi.h>
+
+typedef enum {
+    PLAN_BOOLEAN,
+    PLAN_BYTE,
+    PLAN_INT16,
+    PLAN_UINT16,
+    PLAN_INT32,
+    PLAN_UINT32,
+    PLAN_INT64,
+    PLAN_UINT64,
+    PLAN_HANDLE,
+    PLAN_DOUBLE,
+    PLAN_STRING,
+    PLAN_OBJECT_PATH,
+    PLAN_SIGNATURE,
+    PLAN_VARIANT,
+    /* "as", "ay" and arrays of fixed size numbers are packed in one
+     * go rather than per element
+     */
+    PLAN_STRV,
+    PLAN_BYTESTRING,
+    PLAN_FIXED_ARRAY,
+    /* These are built with a GVariantBuilder */
+    PLAN_MAYBE,
+    PLAN_ARRAY,
+    PLAN_DICT,
+    PLAN_TUPLE,
+    PLAN_DICT_ENTRY
+} VariantPlanKind;
+
+/* The compiled form of a type string. Maybes and arrays have their
+ * element type as the only child, a dictionary its entry type; tuples
+ * and dictionary entries have one child per member.
+ */
+typedef struct _VariantPlan VariantPlan;
+struct _VariantPlan {
+    VariantPlanKind kind;
+    GVariantType *type;
+    guint n_children;
+    VariantPlan **children;
+};
+
+/* Signatures come from a fixed set of DBus interfaces in practice, but
+ * don't let a program that makes them up grow the cache forever.
+ */
+#define MAX_CACHED_PLANS 1024
+
+G_LOCK_DEFINE_STATIC(plans);
+static GHashTable *plans = NULL;
+
+static VariantPlan *
+plan_new(const GVariantType *type)
+{
+    VariantPlan *plan;
+    const GVariantType *member;
+    guint i;
+
+    plan = g_slice_new0(VariantPlan);
+    plan->type = g_variant_type_copy(type);
+
+    switch (g_variant_type_peek_string(type)[0]) {
+    case 'b': plan->kind = PLAN_BOOLEAN; break;
+    case 'y': plan->kind = PLAN_BYTE; break;
+    case 'n': plan->kind = PLAN_INT16; break;
+    case 'q': plan->kind = PLAN_UINT16; break;
+    case 'i': plan->kind = PLAN_INT32; break;
+    case 'u': plan->kind = PLAN_UINT32; break;
+    case 'x': plan->kind = PLAN_INT64; break;
+    case 't': plan->kind = PLAN_UINT64; break;
+    case 'h': plan->kind = PLAN_HANDLE; break;
+    case 'd': plan->kind = PLAN_DOUBLE; break;
+    case 's': plan->kind = PLAN_STRING; break;
+    case 'o': plan->kind = PLAN_OBJECT_PATH; break;
+    case 'g': plan->kind = PLAN_SIGNATURE; break;
+    case 'v': plan->kind = PLAN_VARIANT; break;
+
+    case 'm':
+    case 'a':
+        member = g_variant_type_element(type);
+        if (g_variant_type_is_maybe(type))
+            plan->kind = PLAN_MAYBE;
+        else if (g_variant_type_equal(member, G_VARIANT_TYPE_STRING))
+            plan->kind = PLAN_STRV;
+        else if (g_variant_type_equal(member, G_VARIANT_TYPE_BYTE))
+            plan->kind = PLAN_BYTESTRING;
+        else if (strchr("nqiuhxtd", g_variant_type_peek_string(member)[0]))
+            plan->kind = PLAN_FIXED_ARRAY;
+        else if (g_variant_type_is_dict_entry(member))
+            plan->kind = PLAN_DICT;
+        else
+            plan->kind = PLAN_ARRAY;
+
+        plan->n_children = 1;
+        plan->children = g_new(VariantPlan *, 1);
+        plan->children[0] = plan_new(member);
+        break;
+
+    case '(':
+    case '{':
+        plan->kind = g_variant_type_is_tuple(type) ? PLAN_TUPLE : PLAN_DICT_ENTRY;
+        plan->n_children = g_variant_type_n_items(type);
+        plan->children = g_new(VariantPlan *, plan->n_children);
+
+        for (i = 0, member = g_variant_type_first(type);
+             member != NULL;
+             i++, member = g_variant_type_next(member))
+            plan->children[i] = plan_new(member);
+        break;
+
+    default:
+        g_assert_not_reached();
+    }
+
+    return plan;
+}
+
+static void
+plan_free(VariantPlan *plan)
+{
+    guint i;
+
+    for (i = 0; i < plan->n_children; i++)
+        plan_free(plan->children[i]);
+    g_free(plan->children);
+    g_variant_type_free(plan->type);
+    g_slice_free(VariantPlan, plan);
+}
+
+/* Returns the plan for @signature, which must be a valid definite type
+ * string. *@owned_p is set if the plan didn't fit in the cache and the
+ * caller has to free it.
+ */
+static VariantPlan *
+plan_lookup(const char *signature,
+            gboolean   *owned_p)
+{
+    VariantPlan *plan;
+    GVariantType *type;
+
+    G_LOCK(plans);
+
+    if (plans == NULL)
+        plans = g_hash_table_new(g_str_hash, g_str_equal);
+
+    plan = (VariantPlan *) g_hash_table_lookup(plans, signature);
+    if (plan != NULL) {
+        G_UNLOCK(plans);
+        *owned_p = FALSE;
+        return plan;
+    }
+
+    type = g_variant_type_new(signature);
+    plan = plan_new(type);
+    g_variant_type_free(type);
+
+    *owned_p = g_hash_table_size(plans) >= MAX_CACHED_PLANS;
+    if (!*owned_p)
+        g_hash_table_insert(plans,
+                            (gpointer) g_variant_type_peek_string(plan->type),
+                            plan);
+
+    G_UNLOCK(plans);
+
+    gjs_debug(GJS_DEBUG_GBOXED, "Compiled GVariant plan for '%s'", signature);
+
+    return plan;
+}
+
+static GIStructInfo *
+get_variant_info(void)
+{
+    static GIStructInfo *variant_info = NULL;
+
+    if (g_once_init_enter(&variant_info)) {
+        GIBaseInfo *info;
+
+        info = g_irepository_find_by_gtype(NULL, G_TYPE_VARIANT);
+        if (info == NULL &&
+            g_irepository_require(NULL, "GLib", "2.0", (GIRepositoryLoadFlags) 0, NULL))
+            info = g_irepository_find_by_name(NULL, "GLib", "Variant");
+        g_assert(info != NULL);
+
+        g_once_init_leave(&variant_info, (GIStructInfo *) info);
+    }
+
+    return variant_info;
+}
+
+/* Wraps @variant in a GLib.Variant, which takes its own reference */
+static JSBool
+wrap_variant(JSContext *context,
+             GVariant  *variant,
+             jsval     *value_p)
+{
+    JSObject *obj;
+
+    obj = gjs_boxed_from_c_struct(context, get_variant_info(), variant,
+                                  GJS_BOXED_CREATION_NONE);
+    if (obj == NULL)
+        return JS_FALSE;
+
+    *value_p = OBJECT_TO_JSVAL(obj);
+    return JS_TRUE;
+}
+
+static JSBool
+throw_out_of_range(JSContext   *context,
+                   VariantPlan *plan)
+{
+    gjs_throw(context, "value is out of range for GVariant type '%s'",
+              g_variant_type_peek_string(plan->type));
+    return JS_FALSE;
+}
+
+/* Whether @v can be converted to the integer type @type_char without
+ * overflowing. Written as negated comparisons so that NaN fails, and with
+ * exact powers of two since G_MAXINT64 and G_MAXUINT64 round up to the
+ * next one as doubles.
+ */
+static gboolean
+number_fits(char   type_char,
+            double v)
+{
+    switch (type_char) {
+    case 'u':
+        return v >= 0 && v <= G_MAXUINT32;
+    case 'x':
+        return v >= -9223372036854775808.0 && v < 9223372036854775808.0;
+    case 't':
+        return v >= 0 && v < 18446744073709551616.0;
+    default:
+        return TRUE;
+    }
+}
+
+static JSBool
+throw_wrong_type(JSContext   *context,
+                 VariantPlan *plan,
+                 const char  *expected,
+                 jsval        value)
+{
+    gjs_throw_custom(context, "TypeError",
+                     "Expected %s for GVariant type '%s' but got type '%s'",
+                     expected, g_variant_type_peek_string(plan->type),
+                     gjs_get_type_name(value));
+    return JS_FALSE;
+}
+
+static JSBool
+get_length(JSContext   *context,
+           VariantPlan *plan,
+           jsval        value,
+           guint32     *length_p)
+{
+    if (!JSVAL_IS_OBJECT(value) || JSVAL_IS_NULL(value))
+        return throw_wrong_type(context, plan, "an array", value);
+
+    return JS_GetArrayLength(context, JSVAL_TO_OBJECT(value), length_p);
+}
+
+/* Typed arrays. Arrays of 64-bit integers have no typed array of their
+ * own, so they use Float64Array and are converted element by element,
+ * which loses precision above 2^53 just as plain numbers do.
+ */
+static gsize
+fixed_element_size(char type_char)
+{
+    switch (type_char) {
+    case 'n': case 'q': return 2;
+    case 'i': case 'u': case 'h': return 4;
+    default: return 8;
+    }
+}
+
+static gboolean
+typed_array_matches(JSObject *obj,
+                    char      type_char)
+{
+    switch (JS_GetArrayBufferViewType(obj)) {
+    case js::ArrayBufferView::TYPE_INT16:
+        return type_char == 'n';
+    case js::ArrayBufferView::TYPE_UINT16:
+        return type_char == 'q';
+    case js::ArrayBufferView::TYPE_INT32:
+        return type_char == 'i' || type_char == 'h';
+    case js::ArrayBufferView::TYPE_UINT32:
+        return type_char == 'u';
+    case js::ArrayBufferView::TYPE_FLOAT64:
+        return type_char == 'd';
+    default:
+        return FALSE;
+    }
+}
+
+static JSObject *
+new_typed_array(JSContext *context,
+                char       type_char,
+                uint32_t   length)
+{
+    switch (type_char) {
+    case 'n': return JS_NewInt16Array(context, length);
+    case 'q': return JS_NewUint16Array(context, length);
+    case 'i': case 'h': return JS_NewInt32Array(context, length);
+    case 'u': return JS_NewUint32Array(context, length);
+    default: return JS_NewFloat64Array(context, length);
+    }
+}
+
+static JSBool
+pack_children(JSContext       *context,
+              VariantPlan     *plan,
+              jsval            value,
+              GVariantBuilder *builder);
+
+/* A typed array of the matching type is copied in one go, and a
+ * Float64Array is converted in one pass for "ax" and "at". Anything
+ * else goes element by element.
+ */
+static JSBool
+pack_fixed_array(JSContext   *context,
+                 VariantPlan *plan,
+                 jsval        value,
+                 GVariant   **variant_p)
+{
+    VariantPlan *element = plan->children[0];
+    char type_char = g_variant_type_peek_string(element->type)[0];
+    GVariantBuilder builder;
+
+    if (JSVAL_IS_OBJECT(value) && !JSVAL_IS_NULL(value) &&
+        JS_IsTypedArrayObject(JSVAL_TO_OBJECT(value))) {
+        JSObject *obj = JSVAL_TO_OBJECT(value);
+        uint32_t length = JS_GetTypedArrayLength(obj);
+
+        if (typed_array_matches(obj, type_char)) {
+            *variant_p = g_variant_new_fixed_array(element->type,
+                                                   JS_GetArrayBufferViewData(obj),
+                                                   length,
+                                                   fixed_element_size(type_char));
+            return JS_TRUE;
+        }
+
+        if ((type_char == 'x' || type_char == 't') &&
+            JS_GetArrayBufferViewType(obj) == js::ArrayBufferView::TYPE_FLOAT64) {
+            const double *src = (const double *) JS_GetArrayBufferViewData(obj);
+            gint64 *data = g_new(gint64, length);
+            uint32_t i;
+
+            for (i = 0; i < length; i++) {
+                if (!number_fits(type_char, src[i])) {
+                    g_free(data);
+                    return throw_out_of_range(context, element);
+                }
+                data[i] = type_char == 'x' ? (gint64) src[i] : (gint64) (guint64) src[i];
+            }
+
+            *variant_p = g_variant_new_from_data(plan->type, data,
+                                                 length * sizeof(gint64),
+                                                 TRUE, g_free, data);
+            return JS_TRUE;
+        }
+    }
+
+    g_variant_builder_init(&builder, plan->type);
+    if (!pack_children(context, plan, value, &builder)) {
+        g_variant_builder_clear(&builder);
+        return JS_FALSE;
+    }
+    *variant_p = g_variant_builder_end(&builder);
+    return JS_TRUE;
+}
+
+static JSBool
+pack_strv(JSContext   *context,
+          VariantPlan *plan,
+          jsval        value,
+          GVariant   **variant_p)
+{
+    guint32 length, i;
+    char **strv;
+    JSBool ret = JS_FALSE;
+
+    if (!get_length(context, plan, value, &length))
+        return JS_FALSE;
+
+    strv = g_new0(char *, length + 1);
+    for (i = 0; i < length; i++) {
+        jsval elem;
+
+        if (!JS_GetElement(context, JSVAL_TO_OBJECT(value), i, &elem))
+            goto out;
+        if (!JSVAL_IS_STRING(elem)) {
+            throw_wrong_type(context, plan->children[0], "a string", elem);
+            goto out;
+        }
+        if (!gjs_string_to_utf8(context, elem, &strv[i]))
+            goto out;
+    }
+
+    *variant_p = g_variant_new_strv(strv, length);
+    ret = JS_TRUE;
+
+ out:
+    g_strfreev(strv);
+    return ret;
+}
+
+static JSBool
+pack_bytestring(JSContext   *context,
+                VariantPlan *plan,
+                jsval        value,
+                GVariant   **variant_p)
+{
+    GBytes *bytes;
+
+    if (JSVAL_IS_STRING(value)) {
+        char *str;
+
+        if (!gjs_string_to_utf8(context, value, &str))
+            return JS_FALSE;
+        bytes = g_bytes_new_take(str, strlen(str));
+    } else if (JSVAL_IS_OBJECT(value) && !JSVAL_IS_NULL(value) &&
+               gjs_typecheck_bytearray(context, JSVAL_TO_OBJECT(value), JS_FALSE)) {
+        bytes = gjs_byte_array_get_bytes(context, JSVAL_TO_OBJECT(value));
+    } else if (JSVAL_IS_OBJECT(value) && !JSVAL_IS_NULL(value) &&
+               JS_IsTypedArrayObject(JSVAL_TO_OBJECT(value)) &&
+               (JS_GetArrayBufferViewType(JSVAL_TO_OBJECT(value)) == js::ArrayBufferView::TYPE_UINT8 ||
+                JS_GetArrayBufferViewType(JSVAL_TO_OBJECT(value)) == js::ArrayBufferView::TYPE_INT8 ||
+                JS_GetArrayBufferViewType(JSVAL_TO_OBJECT(value)) == js::ArrayBufferView::TYPE_UINT8_CLAMPED)) {
+        bytes = g_bytes_new(JS_GetArrayBufferViewData(JSVAL_TO_OBJECT(value)),
+                            JS_GetTypedArrayByteLength(JSVAL_TO_OBJECT(value)));
+    } else {
+        guint32 length, i;
+        guint8 *data;
+
+        if (!get_length(context, plan, value, &length))
+            return JS_FALSE;
+
+        data = (guint8 *) g_malloc(length);
+        for (i = 0; i < length; i++) {
+            jsval elem;
+            guint32 byte;
+
+            if (!JS_GetElement(context, JSVAL_TO_OBJECT(value), i, &elem) ||
+                !JS_ValueToECMAUint32(context, elem, &byte)) {
+                g_free(data);
+                return JS_FALSE;
+            }
+            if (byte > G_MAXUINT8) {
+                g_free(data);
+                return throw_out_of_range(context, plan->children[0]);
+            }
+            data[i] = byte;
+        }
+        bytes = g_bytes_new_take(data, length);
+    }
+
+    *variant_p = g_variant_new_from_bytes(G_VARIANT_TYPE_BYTESTRING, bytes, TRUE);
+    g_bytes_unref(bytes);
+    return JS_TRUE;
+}
+
+/* Packs the types that aren't built with a builder; the result is
+ * floating.
+ */
+static JSBool
+pack_leaf(JSContext   *context,
+          VariantPlan *plan,
+          jsval        value,
+          GVariant   **variant_p)
+{
+    switch (plan->kind) {
+    case PLAN_BOOLEAN: {
+        JSBool b;
+        if (!JS_ValueToBoolean(context, value, &b))
+            return JS_FALSE;
+        *variant_p = g_variant_new_boolean(b);
+        return JS_TRUE;
+    }
+    case PLAN_BYTE:
+    case PLAN_UINT16: {
+        guint32 i;
+        if (!JS_ValueToECMAUint32(context, value, &i))
+            return JS_FALSE;
+        if (i > (plan->kind == PLAN_BYTE ? G_MAXUINT8 : G_MAXUINT16))
+            return throw_out_of_range(context, plan);
+        *variant_p = plan->kind == PLAN_BYTE ?
+            g_variant_new_byte(i) : g_variant_new_uint16(i);
+        return JS_TRUE;
+    }
+    case PLAN_INT16: {
+        gint32 i;
+        if (!JS_ValueToInt32(context, value, &i))
+            return JS_FALSE;
+        if (i > G_MAXINT16 || i < G_MININT16)
+            return throw_out_of_range(context, plan);
+        *variant_p = g_variant_new_int16(i);
+        return JS_TRUE;
+    }
+    case PLAN_INT32:
+    case PLAN_HANDLE: {
+        gint32 i;
+        if (!JS_ValueToInt32(context, value, &i))
+            return JS_FALSE;
+        *variant_p = plan->kind == PLAN_INT32 ?
+            g_variant_new_int32(i) : g_variant_new_handle(i);
+        return JS_TRUE;
+    }
+    case PLAN_UINT32:
+    case PLAN_INT64:
+    case PLAN_UINT64:
+    case PLAN_DOUBLE: {
+        double v;
+        if (!JS_ValueToNumber(context, value, &v))
+            return JS_FALSE;
+
+        if (!number_fits(g_variant_type_peek_string(plan->type)[0], v))
+            return throw_out_of_range(context, plan);
+
+        if (plan->kind == PLAN_UINT32)
+            *variant_p = g_variant_new_uint32((guint32) v);
+        else if (plan->kind == PLAN_INT64)
+            *variant_p = g_variant_new_int64((gint64) v);
+        else if (plan->kind == PLAN_UINT64)
+            *variant_p = g_variant_new_uint64((guint64) v);
+        else
+            *variant_p = g_variant_new_double(v);
+        return JS_TRUE;
+    }
+    case PLAN_STRING:
+    case PLAN_OBJECT_PATH:
+    case PLAN_SIGNATURE: {
+        char *str;
+        if (!JSVAL_IS_STRING(value))
+            return throw_wrong_type(context, plan, "a string", value);
+        if (!gjs_string_to_utf8(context, value, &str))
+            return JS_FALSE;
+
+        if (plan->kind == PLAN_OBJECT_PATH && !g_variant_is_object_path(str)) {
+            gjs_throw_custom(context, "TypeError", "'%s' is not a valid object path", str);
+            g_free(str);
+            return JS_FALSE;
+        }
+        if (plan->kind == PLAN_SIGNATURE && !g_variant_is_signature(str)) {
+            gjs_throw_custom(context, "TypeError", "'%s' is not a valid signature", str);
+            g_free(str);
+            return JS_FALSE;
+        }
+
+        *variant_p = plan->kind == PLAN_STRING ? g_variant_new_string(str) :
+            plan->kind == PLAN_OBJECT_PATH ? g_variant_new_object_path(str) :
+            g_variant_new_signature(str);
+        g_free(str);
+        return JS_TRUE;
+    }
+    case PLAN_VARIANT: {
+        GVariant *child;
+        if (!JSVAL_IS_OBJECT(value) || JSVAL_IS_NULL(value) ||
+            !gjs_typecheck_boxed(context, JSVAL_TO_OBJECT(value),
+                                 NULL, G_TYPE_VARIANT, JS_FALSE))
+            return throw_wrong_type(context, plan, "a GLib.Variant", value);
+
+        child = (GVariant *) gjs_c_struct_from_boxed(context, JSVAL_TO_OBJECT(value));
+        *variant_p = g_variant_new_variant(child);
+        return JS_TRUE;
+    }
+    case PLAN_STRV:
+        return pack_strv(context, plan, value, variant_p);
+    case PLAN_BYTESTRING:
+        return pack_bytestring(context, plan, value, variant_p);
+    case PLAN_FIXED_ARRAY:
+        return pack_fixed_array(context, plan, value, variant_p);
+    default:
+        g_assert_not_reached();
+    }
+
+    return JS_FALSE;
+}
+
+static gboolean
+plan_uses_builder(VariantPlan *plan)
+{
+    return plan->kind >= PLAN_MAYBE;
+}
+
+/* Adds @value to the container being built in @builder. On failure
+ * the builder may be left with containers open; g_variant_builder_clear()
+ * on the outermost one cleans them up.
+ */
+static JSBool
+pack_into(JSContext       *context,
+          VariantPlan     *plan,
+          jsval            value,
+          GVariantBuilder *builder)
+{
+    GVariant *child;
+
+    if (plan_uses_builder(plan)) {
+        g_variant_builder_open(builder, plan->type);
+        if (!pack_children(context, plan, value, builder))
+            return JS_FALSE;
+        g_variant_builder_close(builder);
+        return JS_TRUE;
+    }
+
+    if (!pack_leaf(context, plan, value, &child))
+        return JS_FALSE;
+    g_variant_builder_add_value(builder, child);
+    return JS_TRUE;
+}
+
+static JSBool
+pack_dict(JSContext       *context,
+          VariantPlan     *plan,
+          jsval            value,
+          GVariantBuilder *builder)
+{
+    VariantPlan *entry = plan->children[0];
+    JSObject *obj;
+    JSObject *props_iter;
+    jsid prop_id;
+
+    if (!JSVAL_IS_OBJECT(value) || JSVAL_IS_NULL(value))
+        return throw_wrong_type(context, plan, "an object", value);
+    obj = JSVAL_TO_OBJECT(value);
+
+    props_iter = JS_NewPropertyIterator(context, obj);
+    if (props_iter == NULL)
+        return JS_FALSE;
+
+    prop_id = JSID_VOID;
+    if (!JS_NextProperty(context, props_iter, &prop_id))
+        return JS_FALSE;
+
+    while (!JSID_IS_VOID(prop_id)) {
+        jsval key, prop_value;
+
+        /* Keys are always strings, as with for...in */
+        if (!JS_IdToValue(context, prop_id, &key) ||
+            !JS_GetPropertyById(context, obj, prop_id, &prop_value))
+            return JS_FALSE;
+        if (!JSVAL_IS_STRING(key)) {
+            JSString *key_str = JS_ValueToString(context, key);
+            if (key_str == NULL)
+                return JS_FALSE;
+            key = STRING_TO_JSVAL(key_str);
+        }
+
+        g_variant_builder_open(builder, entry->type);
+        if (!pack_into(context, entry->children[0], key, builder) ||
+            !pack_into(context, entry->children[1], prop_value, builder))
+            return JS_FALSE;
+        g_variant_builder_close(builder);
+
+        prop_id = JSID_VOID;
+        if (!JS_NextProperty(context, props_iter, &prop_id))
+            return JS_FALSE;
+    }
+
+    return JS_TRUE;
+}
+
+static JSBool
+pack_children(JSContext       *context,
+              VariantPlan     *plan,
+              jsval            value,
+              GVariantBuilder *builder)
+{
+    guint32 length, i;
+
+    switch (plan->kind) {
+    case PLAN_MAYBE:
+        if (JSVAL_IS_NULL(value) || JSVAL_IS_VOID(value))
+            return JS_TRUE;
+        return pack_into(context, plan->children[0], value, builder);
+
+    case PLAN_DICT:
+        return pack_dict(context, plan, value, builder);
+
+    case PLAN_ARRAY:
+    case PLAN_FIXED_ARRAY:
+        if (!get_length(context, plan, value, &length))
+            return JS_FALSE;
+        for (i = 0; i < length; i++) {
+            jsval elem;
+            if (!JS_GetElement(context, JSVAL_TO_OBJECT(value), i, &elem) ||
+                !pack_into(context, plan->children[0], elem, builder))
+                return JS_FALSE;
+        }
+        return JS_TRUE;
+
+    case PLAN_TUPLE:
+    case PLAN_DICT_ENTRY:
+        if (!get_length(context, plan, value, &length))
+            return JS_FALSE;
+        if (length < plan->n_children) {
+            gjs_throw_custom(context, "TypeError",
+                             "Expected %u elements for GVariant type '%s' but got %u",
+                             plan->n_children, g_variant_type_peek_string(plan->type),
+                             length);
+            return JS_FALSE;
+        }
+        /* Like the JS implementation did, ignore extra elements */
+        for (i = 0; i < plan->n_children; i++) {
+            jsval elem;
+            if (!JS_GetElement(context, JSVAL_TO_OBJECT(value), i, &elem) ||
+                !pack_into(context, plan->children[i], elem, builder))
+                return JS_FALSE;
+        }
+        return JS_TRUE;
+
+    default:
+        g_assert_not_reached();
+    }
+
+    return JS_FALSE;
+}
+
+/**
+ * gjs_variant_from_value:
+ * @context: the JS context
+ * @signature: a GVariant type string for a single complete type
+ * @value: the JS value to pack
+ * @variant_p: return location for the new, non-floating, #GVariant
+ *
+ * Packs @value as new GLib.Variant(@signature, @value) would.
+ *
+ * Returns: %JS_FALSE with an exception set if @signature is invalid or
+ * @value doesn't fit it
+ */
+JSBool
+gjs_variant_from_value(JSContext   *context,
+                       const char  *signature,
+                       jsval        value,
+                       GVariant   **variant_p)
+{
+    VariantPlan *plan;
+    GVariant *variant;
+    const char *end;
+    gboolean owned;
+    JSBool ret;
+
+    if (*signature == '\0') {
+        gjs_throw_custom(context, "TypeError", "GVariant signature cannot be empty");
+        return JS_FALSE;
+    }
+    if (!g_variant_type_string_scan(signature, NULL, &end)) {
+        gjs_throw_custom(context, "TypeError", "Invalid GVariant signature '%s'", signature);
+        return JS_FALSE;
+    }
+    if (*end != '\0') {
+        gjs_throw_custom(context, "TypeError",
+                         "Invalid GVariant signature (more than one single complete type)");
+        return JS_FALSE;
+    }
+    if (!g_variant_type_is_definite((const GVariantType *) signature)) {
+        gjs_throw_custom(context, "TypeError",
+                         "GVariant signature '%s' is not a definite type", signature);
+        return JS_FALSE;
+    }
+
+    plan = plan_lookup(signature, &owned);
+
+    if (plan_uses_builder(plan)) {
+        GVariantBuilder builder;
+
+        g_variant_builder_init(&builder, plan->type);
+        ret = pack_children(context, plan, value, &builder);
+        if (ret)
+            variant = g_variant_builder_end(&builder);
+        else
+            g_variant_builder_clear(&builder);
+    } else {
+        ret = pack_leaf(context, plan, value, &variant);
+    }
+
+    if (owned)
+        plan_free(plan);
+
+    if (ret)
+        *variant_p = g_variant_ref_sink(variant);
+    return ret;
+}
+
+static JSBool
+unpack_plan(JSContext   *context,
+            VariantPlan *plan,
+            GVariant    *variant,
+            gboolean     deep,
+            jsval       *value_p);
+
+/* Unpacks a child of a container: deep unpacking recurses, shallow
+ * unpacking wraps the child as it is.
+ */
+static JSBool
+unpack_child(JSContext   *context,
+             VariantPlan *plan,
+             GVariant    *child,
+             gboolean     deep,
+             jsval       *value_p)
+{
+    if (deep)
+        return unpack_plan(context, plan, child, deep, value_p);
+    return wrap_variant(context, child, value_p);
+}
+
+static JSBool
+unpack_dict(JSContext   *context,
+            VariantPlan *plan,
+            GVariant    *variant,
+            gboolean     deep,
+            jsval       *value_p)
+{
+    VariantPlan *entry_plan = plan->children[0];
+    JSObject *obj;
+    GVariantIter iter;
+    GVariant *entry;
+
+    obj = JS_NewObject(context, NULL, NULL, NULL);
+    if (obj == NULL)
+        return JS_FALSE;
+    *value_p = OBJECT_TO_JSVAL(obj);
+
+    g_variant_iter_init(&iter, variant);
+    while ((entry = g_variant_iter_next_value(&iter))) {
+        GVariant *key, *child;
+        jsval key_val, child_val;
+        jsid key_id;
+        JSBool ok;
+
+        key = g_variant_get_child_value(entry, 0);
+        child = g_variant_get_child_value(entry, 1);
+
+        /* The key is always unpacked, or it couldn't be a property name */
+        ok = unpack_plan(context, entry_plan->children[0], key, TRUE, &key_val) &&
+            JS_ValueToId(context, key_val, &key_id) &&
+            unpack_child(context, entry_plan->children[1], child, deep, &child_val) &&
+            JS_DefinePropertyById(context, obj, key_id, child_val,
+                                  NULL, NULL, JSPROP_ENUMERATE);
+
+        g_variant_unref(key);
+        g_variant_unref(child);
+        g_variant_unref(entry);
+
+        if (!ok)
+            return JS_FALSE;
+    }
+
+    return JS_TRUE;
+}
+
+static JSBool
+unpack_array(JSContext   *context,
+             VariantPlan *plan,
+             GVariant    *variant,
+             gboolean     deep,
+             jsval       *value_p)
+{
+    JSObject *array;
+    GVariantIter iter;
+    GVariant *child;
+    guint i;
+
+    array = JS_NewArrayObject(context, 0, NULL);
+    if (array == NULL)
+        return JS_FALSE;
+    *value_p = OBJECT_TO_JSVAL(array);
+
+    g_variant_iter_init(&iter, variant);
+    for (i = 0; (child = g_variant_iter_next_value(&iter)); i++) {
+        VariantPlan *child_plan;
+        jsval child_val;
+        JSBool ok;
+
+        child_plan = plan->kind == PLAN_TUPLE || plan->kind == PLAN_DICT_ENTRY ?
+            plan->children[i] : plan->children[0];
+
+        ok = unpack_child(context, child_plan, child, deep, &child_val) &&
+            JS_DefineElement(context, array, i, child_val,
+                             NULL, NULL, JSPROP_ENUMERATE);
+        g_variant_unref(child);
+
+        if (!ok)
+            return JS_FALSE;
+    }
+
+    return JS_TRUE;
+}
+
+/* Copies the elements into a typed array with a single memcpy(), or
+ * one conversion pass for "ax" and "at"
+ */
+static JSBool
+unpack_fixed_array(JSContext   *context,
+                   VariantPlan *plan,
+                   GVariant    *variant,
+                   jsval       *value_p)
+{
+    char type_char = g_variant_type_peek_string(plan->children[0]->type)[0];
+    gsize element_size = fixed_element_size(type_char);
+    gconstpointer data;
+    gsize length;
+    JSObject *array;
+
+    data = g_variant_get_fixed_array(variant, &length, element_size);
+
+    array = new_typed_array(context, type_char, length);
+    if (array == NULL)
+        return JS_FALSE;
+
+    if (type_char == 'x' || type_char == 't') {
+        double *dest = (double *) JS_GetArrayBufferViewData(array);
+        gsize i;
+
+        for (i = 0; i < length; i++)
+            dest[i] = type_char == 'x' ?
+                (double) ((const gint64 *) data)[i] :
+                (double) ((const guint64 *) data)[i];
+    } else if (length > 0) {
+        memcpy(JS_GetArrayBufferViewData(array), data, length * element_size);
+    }
+
+    *value_p = OBJECT_TO_JSVAL(array);
+    return JS_TRUE;
+}
+
+static JSBool
+unpack_plan(JSContext   *context,
+            VariantPlan *plan,
+            GVariant    *variant,
+            gboolean     deep,
+            jsval       *value_p)
+{
+    switch (plan->kind) {
+    case PLAN_BOOLEAN:
+        *value_p = BOOLEAN_TO_JSVAL(g_variant_get_boolean(variant));
+        return JS_TRUE;
+    case PLAN_BYTE:
+        *value_p = INT_TO_JSVAL(g_variant_get_byte(variant));
+        return JS_TRUE;
+    case PLAN_INT16:
+        *value_p = INT_TO_JSVAL(g_variant_get_int16(variant));
+        return JS_TRUE;
+    case PLAN_UINT16:
+        *value_p = INT_TO_JSVAL(g_variant_get_uint16(variant));
+        return JS_TRUE;
+    case PLAN_INT32:
+        *value_p = INT_TO_JSVAL(g_variant_get_int32(variant));
+        return JS_TRUE;
+    case PLAN_HANDLE:
+        *value_p = INT_TO_JSVAL(g_variant_get_handle(variant));
+        return JS_TRUE;
+    case PLAN_UINT32:
+        return JS_NewNumberValue(context, g_variant_get_uint32(variant), value_p);
+    case PLAN_INT64:
+        return JS_NewNumberValue(context, g_variant_get_int64(variant), value_p);
+    case PLAN_UINT64:
+        return JS_NewNumberValue(context, g_variant_get_uint64(variant), value_p);
+    case PLAN_DOUBLE:
+        return JS_NewNumberValue(context, g_variant_get_double(variant), value_p);
+
+    case PLAN_STRING:
+    case PLAN_OBJECT_PATH:
+    case PLAN_SIGNATURE: {
+        const char *str;
+        gsize length;
+
+        str = g_variant_get_string(variant, &length);
+        return gjs_string_from_utf8(context, str, length, value_p);
+    }
+
+    case PLAN_VARIANT: {
+        GVariant *child = g_variant_get_variant(variant);
+        JSBool ret = wrap_variant(context, child, value_p);
+        g_variant_unref(child);
+        return ret;
+    }
+
+    case PLAN_MAYBE: {
+        GVariant *child = g_variant_get_maybe(variant);
+        JSBool ret;
+
+        if (child == NULL) {
+            *value_p = JSVAL_NULL;
+            return JS_TRUE;
+        }
+
+        ret = unpack_child(context, plan->children[0], child, deep, value_p);
+        g_variant_unref(child);
+        return ret;
+    }
+
+    case PLAN_BYTESTRING: {
+        GBytes *bytes = g_variant_get_data_as_bytes(variant);
+        JSObject *obj = gjs_byte_array_from_bytes(context, bytes);
+
+        g_bytes_unref(bytes);
+        if (obj == NULL)
+            return JS_FALSE;
+        *value_p = OBJECT_TO_JSVAL(obj);
+        return JS_TRUE;
+    }
+
+    case PLAN_DICT:
+        return unpack_dict(context, plan, variant, deep, value_p);
+
+    case PLAN_FIXED_ARRAY:
+        if (deep)
+            return unpack_fixed_array(context, plan, variant, value_p);
+        return unpack_array(context, plan, variant, deep, value_p);
+
+    case PLAN_STRV:
+    case PLAN_ARRAY:
+    case PLAN_TUPLE:
+    case PLAN_DICT_ENTRY:
+        return unpack_array(context, plan, variant, deep, value_p);
+
+    default:
+        g_assert_not_reached();
+    }
+
+    return JS_FALSE;
+}
+
+/**
+ * gjs_variant_to_value:
+ * @context: the JS context
+ * @variant: a #GVariant
+ * @deep: whether to unpack the children of containers too
+ * @value_p: return location for the JS value
+ *
+ * Unpacks @variant as its unpack() or deep_unpack() method would.
+ * Shallow unpacking leaves the children of containers as GLib.Variant;
+ * either way, the contents of "v" values stay packed. Deep unpacking
+ * turns arrays of fixed size numbers into typed arrays, and "ay" is
+ * always a ByteArray sharing the variant's data.
+ *
+ * Returns: %JS_FALSE with an exception set on failure
+ */
+JSBool
+gjs_variant_to_value(JSContext   *context,
+                     GVariant    *variant,
+                     gboolean     deep,
+                     jsval       *value_p)
+{
+    VariantPlan *plan;
+    gboolean owned;
+    JSBool ret;
+
+    plan = plan_lookup(g_variant_get_type_string(variant), &owned);
+    ret = unpack_plan(context, plan, variant, deep, value_p);
+    if (owned)
+        plan_free(plan);
+
+    return ret;
+}
+
+static JSBool
+variant_pack(JSContext *context,
+             unsigned   argc,
+             jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    char *signature;
+    GVariant *variant;
+    jsval retval;
+    JSBool ret;
+
+    if (argc != 2) {
+        gjs_throw(context, "variant_pack() takes a signature and a value");
+        return JS_FALSE;
+    }
+
+    if (!gjs_string_to_utf8(context, argv[0], &signature))
+        return JS_FALSE;
+
+    ret = gjs_variant_from_value(context, signature, argv[1], &variant);
+    g_free(signature);
+    if (!ret)
+        return JS_FALSE;
+
+    ret = wrap_variant(context, variant, &retval);
+    g_variant_unref(variant);
+    if (ret)
+        JS_SET_RVAL(context, vp, retval);
+
+    return ret;
+}
+
+static JSBool
+variant_unpack(JSContext *context,
+               unsigned   argc,
+               jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *obj;
+    gboolean deep;
+    jsval retval;
+
+    if (!gjs_parse_args(context, "variant_unpack", "ob", argc, argv,
+                        "variant", &obj, "deep", &deep))
+        return JS_FALSE;
+
+    if (!gjs_typecheck_boxed(context, obj, NULL, G_TYPE_VARIANT, JS_TRUE))
+        return JS_FALSE;
+
+    if (!gjs_variant_to_value(context, (GVariant *) gjs_c_struct_from_boxed(context, obj),
+                              deep, &retval))
+        return JS_FALSE;
+
+    JS_SET_RVAL(context, vp, retval);
+    return JS_TRUE;
+}
+
+static JSFunctionSpec variant_funcs[] = {
+    { "variant_pack", JSOP_WRAPPER ((JSNative) variant_pack), 2, GJS_MODULE_PROP_FLAGS },
+    { "variant_unpack", JSOP_WRAPPER ((JSNative) variant_unpack), 2, GJS_MODULE_PROP_FLAGS },
+    { NULL },
+};
+
+/* Adds variant_pack() and variant_unpack() to the private _gi module,
+ * for the GLib override.
+ */
+JSBool
+gjs_define_variant_funcs(JSContext *context,
+                         JSObject  *module)
+{
+    return JS_DefineFunctions(context, module, &variant_funcs[0]);
+}
@@ -0,0 +1,53 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GJS_VARIANT_H__
+#define __GJS_VARIANT_H__
+
+#include <glib.h>
+#include "gjs/jsapi-util.h"
+
+G_BEGIN_DECLS
+
+/* Converts between JS values and GVariants the way new GLib.Variant()
+ * and unpack()/deep_unpack() in the GLib override do. Each type string
+ * is compiled once into a plan for the conversion, which is cached for
+ * the life of the process. Arrays of fixed size numbers are copied to
+ * and from typed arrays in bulk.
+ */
+
+JSBool gjs_variant_from_value (JSContext   *context,
+                               const char  *signature,
+                               jsval        value,
+                               GVariant   **variant_p);
+JSBool gjs_variant_to_value   (JSContext   *context,
+                               GVariant    *variant,
+                               gboolean     deep,
+                               jsval       *value_p);
+
+JSBool gjs_define_variant_funcs (JSContext *context,
+                                 JSObject  *module);
+
+G_END_DECLS
+
+#endif  /* __GJS_VARIANT_H__ */
@@ -0,0 +1,151 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <gjs/gjs-module.h>
+#include <gjs/bundle.h>
+#include <util/glib.h>
+
+static char *output = NULL;
+static gboolean bytecode = FALSE;
+
+static GOptionEntry entries[] = {
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write the bundle to FILE", "FILE" },
+    { "bytecode", 'b', 0, G_OPTION_ARG_NONE, &bytecode, "Also store precompiled bytecode for each module", NULL },
+    { NULL }
+};
+
+/* Adds every .js file under @dirname, named by its path relative to
+ * the directory given on the command line.
+ */
+static gboolean
+add_directory(GjsBundleBuilder *builder,
+              JSContext        *context,
+              const char       *dirname,
+              const char       *prefix,
+              GError          **error)
+{
+    GDir *dir;
+    const char *filename;
+    gboolean ret = TRUE;
+
+    dir = g_dir_open(dirname, 0, error);
+    if (dir == NULL)
+        return FALSE;
+
+    while (ret && (filename = g_dir_read_name(dir))) {
+        char *full_path;
+        char *path;
+
+        /* skip hidden files and directories (.svn, .git, ...) */
+        if (filename[0] == '.')
+            continue;
+
+        full_path = g_build_filename(dirname, filename, NULL);
+        path = prefix[0] ? g_strconcat(prefix, "/", filename, NULL) : g_strdup(filename);
+
+        if (g_file_test(full_path, G_FILE_TEST_IS_DIR)) {
+            ret = add_directory(builder, context, full_path, path, error);
+        } else if (g_str_has_suffix(filename, ".js")) {
+            GFile *file;
+            GBytes *source;
+            GBytes *compiled = NULL;
+
+            file = g_file_new_for_path(full_path);
+            source = gjs_g_file_load_bytes(file, error);
+            g_object_unref(file);
+
+            if (source == NULL) {
+                ret = FALSE;
+            } else {
+                if (context != NULL) {
+                    compiled = gjs_bundle_compile_module(context, path, source);
+                    if (compiled == NULL)
+                        g_printerr("Failed to compile %s, storing source only\n",
+                                   full_path);
+                }
+
+                gjs_bundle_builder_add(builder, path, source, compiled);
+
+                g_bytes_unref(source);
+                if (compiled != NULL)
+                    g_bytes_unref(compiled);
+            }
+        }
+
+        g_free(path);
+        g_free(full_path);
+    }
+
+    g_dir_close(dir);
+    return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+    GOptionContext *option_context;
+    GError *error = NULL;
+    GjsContext *js_context = NULL;
+    JSContext *context = NULL;
+    GjsBundleBuilder *builder;
+    int code = 0;
+
+    option_context = g_option_context_new("DIRECTORY - pack a tree of modules into a bundle");
+    g_option_context_add_main_entries(option_context, entries, NULL);
+    if (!g_option_context_parse(option_context, &argc, &argv, &error))
+        g_error("option parsing failed: %s", error->message);
+
+    if (argc != 2 || output == NULL) {
+        char *help = g_option_context_get_help(option_context, TRUE, NULL);
+        g_printerr("%s", help);
+        g_free(help);
+        exit(1);
+    }
+
+    g_option_context_free(option_context);
+
+    if (bytecode) {
+        js_context = gjs_context_new();
+        context = (JSContext *) gjs_context_get_native_context(js_context);
+    }
+
+    builder = gjs_bundle_builder_new(bytecode ? JS_GetImplementationVersion() : NULL);
+
+    if (!add_directory(builder, context, argv[1], "", &error) ||
+        !gjs_bundle_builder_write(builder, output, &error)) {
+        g_printerr("%s\n", error->message);
+        g_clear_error(&error);
+        code = 1;
+    }
+
+    gjs_bundle_builder_free(builder);
+    if (js_context != NULL)
+        g_object_unref(js_context);
+    g_free(output);
+
+    exit(code);
+}
@@ -0,0 +1,789 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "bundle.h"
+#include "compat.h"
+
+#include <util/log.h>
+#include <util/error.h>
+
+#define BUNDLE_MAGIC "GJSBNDL1"
+#define BUNDLE_MAGIC_LEN 8
+#define BUNDLE_HEADER_SIZE (BUNDLE_MAGIC_LEN + 6 * sizeof(guint32))
+#define BUNDLE_ENTRY_SIZE (6 * sizeof(guint32))
+#define BUNDLE_ALIGNMENT 8
+
+/* Entry fields, in units of guint32 from the start of the entry */
+enum {
+    ENTRY_PATH_OFFSET,
+    ENTRY_PATH_LEN,
+    ENTRY_SOURCE_OFFSET,
+    ENTRY_SOURCE_LEN,
+    ENTRY_BYTECODE_OFFSET,
+    ENTRY_BYTECODE_LEN
+};
+
+struct _GjsBundle {
+    volatile int ref_count;
+
+    GBytes *bytes;      /* owns the mapping */
+    const guint8 *data;
+    gsize length;
+
+    guint n_entries;
+    const guint8 *index;
+
+    char *engine;
+};
+
+typedef struct {
+    char *path;
+    GBytes *source;
+    GBytes *bytecode;
+} BuilderEntry;
+
+struct _GjsBundleBuilder {
+    char *engine;
+    GPtrArray *entries;
+};
+
+static GMutex bundles_lock;
+static GHashTable *bundles = NULL;
+
+static inline guint32
+read_uint32(const guint8 *p)
+{
+    guint32 v;
+    memcpy(&v, p, sizeof(v));
+    return GUINT32_FROM_LE(v);
+}
+
+static inline guint32
+entry_field(GjsBundle *bundle,
+            guint      i,
+            int        field)
+{
+    return read_uint32(bundle->index + i * BUNDLE_ENTRY_SIZE +
+                       field * sizeof(guint32));
+}
+
+static inline const char *
+entry_path(GjsBundle *bundle,
+           guint      i,
+           gsize     *len_out)
+{
+    *len_out = entry_field(bundle, i, ENTRY_PATH_LEN);
+    return (const char *) bundle->data + entry_field(bundle, i, ENTRY_PATH_OFFSET);
+}
+
+static inline gboolean
+range_is_valid(GjsBundle *bundle,
+               guint32    offset,
+               guint32    len)
+{
+    return offset <= bundle->length && len <= bundle->length - offset;
+}
+
+/* Orders like strcmp() would if the strings were nul-terminated */
+static int
+compare_paths(const char *a,
+              gsize       a_len,
+              const char *b,
+              gsize       b_len)
+{
+    int res;
+
+    res = memcmp(a, b, MIN(a_len, b_len));
+    if (res != 0)
+        return res;
+
+    return a_len < b_len ? -1 : (a_len > b_len ? 1 : 0);
+}
+
+static gboolean
+validate(GjsBundle *bundle,
+         GError   **error)
+{
+    guint32 index_offset;
+    guint32 engine_offset;
+    guint32 engine_len;
+    guint i;
+
+    if (bundle->length < BUNDLE_HEADER_SIZE ||
+        memcmp(bundle->data, BUNDLE_MAGIC, BUNDLE_MAGIC_LEN) != 0)
+        goto invalid;
+
+    bundle->n_entries = read_uint32(bundle->data + BUNDLE_MAGIC_LEN);
+    index_offset = read_uint32(bundle->data + BUNDLE_MAGIC_LEN + 4);
+    engine_offset = read_uint32(bundle->data + BUNDLE_MAGIC_LEN + 8);
+    engine_len = read_uint32(bundle->data + BUNDLE_MAGIC_LEN + 12);
+
+    if (bundle->n_entries > G_MAXUINT32 / BUNDLE_ENTRY_SIZE ||
+        !range_is_valid(bundle, index_offset,
+                        bundle->n_entries * BUNDLE_ENTRY_SIZE) ||
+        !range_is_valid(bundle, engine_offset, engine_len))
+        goto invalid;
+
+    bundle->index = bundle->data + index_offset;
+    bundle->engine = g_strndup((const char *) bundle->data + engine_offset,
+                               engine_len);
+
+    /* Check everything once here, so lookups can trust the index */
+    for (i = 0; i < bundle->n_entries; i++) {
+        if (!range_is_valid(bundle,
+                            entry_field(bundle, i, ENTRY_PATH_OFFSET),
+                            entry_field(bundle, i, ENTRY_PATH_LEN)) ||
+            !range_is_valid(bundle,
+                            entry_field(bundle, i, ENTRY_SOURCE_OFFSET),
+                            entry_field(bundle, i, ENTRY_SOURCE_LEN)) ||
+            !range_is_valid(bundle,
+                            entry_field(bundle, i, ENTRY_BYTECODE_OFFSET),
+                            entry_field(bundle, i, ENTRY_BYTECODE_LEN)))
+            goto invalid;
+
+        if (i > 0) {
+            const char *prev, *cur;
+            gsize prev_len, cur_len;
+
+            prev = entry_path(bundle, i - 1, &prev_len);
+            cur = entry_path(bundle, i, &cur_len);
+            if (compare_paths(prev, prev_len, cur, cur_len) >= 0)
+                goto invalid;
+        }
+    }
+
+    return TRUE;
+
+ invalid:
+    g_set_error(error, GJS_ERROR, GJS_ERROR_FAILED,
+                "Not a valid module bundle");
+    return FALSE;
+}
+
+/**
+ * gjs_bundle_new:
+ * @filename: the bundle file
+ * @error: return location for a #GError
+ *
+ * Maps @filename and checks its index. The file stays mapped for as
+ * long as the bundle, or any #GBytes returned from it, is alive.
+ *
+ * Returns: a new #GjsBundle, or %NULL on error
+ */
+GjsBundle *
+gjs_bundle_new(const char *filename,
+               GError    **error)
+{
+    GjsBundle *bundle;
+    GMappedFile *mapped;
+    GError *local_error = NULL;
+
+    mapped = g_mapped_file_new(filename, FALSE, error);
+    if (mapped == NULL)
+        return NULL;
+
+    bundle = g_slice_new0(GjsBundle);
+    bundle->ref_count = 1;
+    bundle->bytes = g_mapped_file_get_bytes(mapped);
+    g_mapped_file_unref(mapped);
+
+    bundle->data = (const guint8 *) g_bytes_get_data(bundle->bytes,
+                                                     &bundle->length);
+
+    if (!validate(bundle, &local_error)) {
+        g_propagate_prefixed_error(error, local_error, "%s: ", filename);
+        gjs_bundle_unref(bundle);
+        return NULL;
+    }
+
+    gjs_debug(GJS_DEBUG_IMPORTER,
+              "Opened bundle '%s' with %u modules",
+              filename, bundle->n_entries);
+
+    return bundle;
+}
+
+GjsBundle *
+gjs_bundle_ref(GjsBundle *bundle)
+{
+    g_atomic_int_inc(&bundle->ref_count);
+    return bundle;
+}
+
+void
+gjs_bundle_unref(GjsBundle *bundle)
+{
+    if (!g_atomic_int_dec_and_test(&bundle->ref_count))
+        return;
+
+    g_bytes_unref(bundle->bytes);
+    g_free(bundle->engine);
+    g_slice_free(GjsBundle, bundle);
+}
+
+/**
+ * gjs_bundle_compile_module:
+ * @context: the context to compile in
+ * @path: path of the module inside the bundle, used in error messages
+ *   and stack traces
+ * @source: the module's source
+ *
+ * Compiles @source into bytecode that the importer can run in place of
+ * it, for gjs_bundle_builder_add().
+ *
+ * Returns: the bytecode, or %NULL if @source could not be compiled
+ */
+GBytes *
+gjs_bundle_compile_module(JSContext  *context,
+                          const char *path,
+                          GBytes     *source)
+{
+    const char *script;
+    gssize script_len;
+    gsize len;
+    int start_line_number;
+    void *data;
+    uint32_t data_len;
+    GBytes *ret = NULL;
+
+    script = (const char *) g_bytes_get_data(source, &len);
+    script_len = len;
+    script = gjs_strip_unix_shebang(script, &script_len, &start_line_number);
+
+    JS_BeginRequest(context);
+    JSAutoCompartment ac(context, JS_GetGlobalObject(context));
+
+    /* Compile against a scope like the module object the importer runs
+     * the script with, rather than the global, so the bytecode does not
+     * assume its toplevel names are globals. JS::Evaluate() doesn't
+     * compile-and-go for such a scope either.
+     */
+    JS::CompileOptions options(context);
+    options.setUTF8(true)
+           .setFileAndLine(path, start_line_number)
+           .setSourcePolicy(JS::CompileOptions::LAZY_SOURCE)
+           .setCompileAndGo(false);
+
+    js::RootedObject module_obj(context, JS_NewObject(context, NULL, NULL, NULL));
+    if (!module_obj) {
+        gjs_log_exception(context);
+        JS_EndRequest(context);
+        return NULL;
+    }
+
+    JS::RootedScript compiled(context,
+                              JS::Compile(context, module_obj, options,
+                                          script ? script : "", script_len));
+    if (!compiled) {
+        gjs_log_exception(context);
+        goto out;
+    }
+
+    data = JS_EncodeScript(context, compiled, &data_len);
+    if (data == NULL) {
+        gjs_log_exception(context);
+        goto out;
+    }
+
+    ret = g_bytes_new(data, data_len);
+    JS_free(context, data);
+
+ out:
+    JS_EndRequest(context);
+    return ret;
+}
+
+/**
+ * gjs_bundle_get_for_uri:
+ * @uri: a bundle: URI, as found in an importer search path
+ * @inner_path_out: (out): location for the path inside the bundle
+ *
+ * Finds the bundle named by @uri, opening and mapping it the first time
+ * it is asked for. Bundles stay open for the lifetime of the process,
+ * like the default search path does. Failures are not remembered, so
+ * a bundle that shows up or is fixed later is picked up then.
+ *
+ * Returns: (transfer none): the bundle, or %NULL if @uri is not a
+ * bundle URI or the bundle could not be opened
+ */
+GjsBundle *
+gjs_bundle_get_for_uri(const char  *uri,
+                       const char **inner_path_out)
+{
+    const char *separator;
+    char *filename;
+    GjsBundle *bundle;
+
+    if (!g_str_has_prefix(uri, GJS_BUNDLE_URI_PREFIX))
+        return NULL;
+
+    uri += strlen(GJS_BUNDLE_URI_PREFIX);
+    separator = strchr(uri, GJS_BUNDLE_URI_SEPARATOR);
+    if (separator != NULL) {
+        filename = g_strndup(uri, separator - uri);
+        separator++;
+        while (*separator == '/')
+            separator++;
+        *inner_path_out = separator;
+    } else {
+        filename = g_strdup(uri);
+        *inner_path_out = "";
+    }
+
+    g_mutex_lock(&bundles_lock);
+
+    if (bundles == NULL)
+        bundles = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                        g_free, NULL);
+
+    bundle = (GjsBundle *) g_hash_table_lookup(bundles, filename);
+    if (bundle != NULL) {
+        g_free(filename);
+    } else {
+        GError *error = NULL;
+
+        bundle = gjs_bundle_new(filename, &error);
+        if (bundle != NULL) {
+            /* Pass ownership of filename */
+            g_hash_table_insert(bundles, filename, bundle);
+        } else {
+            gjs_debug(GJS_DEBUG_IMPORTER,
+                      "Failed to open bundle: %s", error->message);
+            g_error_free(error);
+            g_free(filename);
+        }
+    }
+
+    g_mutex_unlock(&bundles_lock);
+
+    return bundle;
+}
+
+guint
+gjs_bundle_get_n_entries(GjsBundle *bundle)
+{
+    return bundle->n_entries;
+}
+
+const char *
+gjs_bundle_get_engine(GjsBundle *bundle)
+{
+    return bundle->engine;
+}
+
+/* Paths inside a bundle never start or end with a slash */
+static gsize
+normalized_length(const char **path)
+{
+    gsize len;
+
+    while (**path == '/')
+        (*path)++;
+
+    len = strlen(*path);
+    while (len > 0 && (*path)[len - 1] == '/')
+        len--;
+
+    return len;
+}
+
+/* Index of the first entry whose path is not less than @key */
+static guint
+lower_bound(GjsBundle  *bundle,
+            const char *key,
+            gsize       key_len)
+{
+    guint lo = 0, hi = bundle->n_entries;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        const char *path;
+        gsize path_len;
+
+        path = entry_path(bundle, mid, &path_len);
+        if (compare_paths(path, path_len, key, key_len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+static inline gboolean
+entry_has_prefix(GjsBundle  *bundle,
+                 guint       i,
+                 const char *prefix,
+                 gsize       prefix_len)
+{
+    const char *path;
+    gsize path_len;
+
+    path = entry_path(bundle, i, &path_len);
+    return path_len >= prefix_len && memcmp(path, prefix, prefix_len) == 0;
+}
+
+static GBytes *
+entry_bytes(GjsBundle *bundle,
+            guint32    offset,
+            guint32    len)
+{
+    return g_bytes_new_from_bytes(bundle->bytes, offset, len);
+}
+
+/**
+ * gjs_bundle_lookup:
+ * @bundle: a #GjsBundle
+ * @path: path of the module inside the bundle, e.g. "foo/bar.js"
+ * @source_out: (out) (allow-none): the module's source
+ * @bytecode_out: (out) (allow-none): the module's bytecode, or %NULL
+ *   if the bundle has none for it
+ *
+ * The returned bytes point straight into the mapped bundle. Bytecode
+ * is returned whatever engine made it; callers must check
+ * gjs_bundle_get_engine() before decoding it.
+ *
+ * Returns: %TRUE if @path is in the bundle
+ */
+gboolean
+gjs_bundle_lookup(GjsBundle  *bundle,
+                  const char *path,
+                  GBytes    **source_out,
+                  GBytes    **bytecode_out)
+{
+    gsize len;
+    guint i;
+
+    len = normalized_length(&path);
+    i = lower_bound(bundle, path, len);
+
+    if (i >= bundle->n_entries ||
+        !entry_has_prefix(bundle, i, path, len) ||
+        entry_field(bundle, i, ENTRY_PATH_LEN) != len)
+        return FALSE;
+
+    if (source_out)
+        *source_out = entry_bytes(bundle,
+                                  entry_field(bundle, i, ENTRY_SOURCE_OFFSET),
+                                  entry_field(bundle, i, ENTRY_SOURCE_LEN));
+
+    if (bytecode_out) {
+        if (entry_field(bundle, i, ENTRY_BYTECODE_LEN) > 0)
+            *bytecode_out = entry_bytes(bundle,
+                                        entry_field(bundle, i, ENTRY_BYTECODE_OFFSET),
+                                        entry_field(bundle, i, ENTRY_BYTECODE_LEN));
+        else
+            *bytecode_out = NULL;
+    }
+
+    return TRUE;
+}
+
+static char *
+directory_prefix(const char *path,
+                 gsize      *prefix_len_out)
+{
+    gsize len;
+
+    len = normalized_length(&path);
+    if (len == 0) {
+        *prefix_len_out = 0;
+        return g_strdup("");
+    }
+
+    *prefix_len_out = len + 1;
+    return g_strdup_printf("%.*s/", (int) len, path);
+}
+
+/**
+ * gjs_bundle_is_directory:
+ * @bundle: a #GjsBundle
+ * @path: a path inside the bundle
+ *
+ * Directories are not stored in the bundle; a path is a directory if
+ * any module lives under it. The root ("") is always a directory.
+ */
+gboolean
+gjs_bundle_is_directory(GjsBundle  *bundle,
+                        const char *path)
+{
+    char *prefix;
+    gsize prefix_len;
+    guint i;
+    gboolean ret;
+
+    prefix = directory_prefix(path, &prefix_len);
+    if (prefix_len == 0) {
+        g_free(prefix);
+        return TRUE;
+    }
+
+    i = lower_bound(bundle, prefix, prefix_len);
+    ret = i < bundle->n_entries && entry_has_prefix(bundle, i, prefix, prefix_len);
+
+    g_free(prefix);
+    return ret;
+}
+
+/**
+ * gjs_bundle_list_directory:
+ * @bundle: a #GjsBundle
+ * @path: a path inside the bundle
+ * @func: called for each file and subdirectory directly in @path
+ * @user_data: data for @func
+ *
+ * Everything under a directory is a contiguous run of the index, so
+ * this only looks at the entries it reports.
+ */
+void
+gjs_bundle_list_directory(GjsBundle         *bundle,
+                          const char        *path,
+                          GjsBundleListFunc  func,
+                          gpointer           user_data)
+{
+    char *prefix;
+    char *last_dir = NULL;
+    gsize prefix_len;
+    guint i;
+
+    prefix = directory_prefix(path, &prefix_len);
+
+    for (i = lower_bound(bundle, prefix, prefix_len);
+         i < bundle->n_entries && entry_has_prefix(bundle, i, prefix, prefix_len);
+         i++) {
+        const char *rest, *slash;
+        gsize rest_len;
+        char *name;
+
+        rest = entry_path(bundle, i, &rest_len);
+        rest += prefix_len;
+        rest_len -= prefix_len;
+
+        slash = (const char *) memchr(rest, '/', rest_len);
+        if (slash == NULL) {
+            name = g_strndup(rest, rest_len);
+            (* func) (name, FALSE, user_data);
+            g_free(name);
+            continue;
+        }
+
+        name = g_strndup(rest, slash - rest);
+        if (last_dir != NULL && strcmp(last_dir, name) == 0) {
+            g_free(name);
+            continue;
+        }
+
+        (* func) (name, TRUE, user_data);
+        g_free(last_dir);
+        last_dir = name;
+    }
+
+    g_free(last_dir);
+    g_free(prefix);
+}
+
+static void
+builder_entry_free(gpointer data)
+{
+    BuilderEntry *entry = (BuilderEntry *) data;
+
+    g_free(entry->path);
+    g_bytes_unref(entry->source);
+    if (entry->bytecode)
+        g_bytes_unref(entry->bytecode);
+    g_slice_free(BuilderEntry, entry);
+}
+
+static int
+builder_entry_compare(gconstpointer a,
+                      gconstpointer b)
+{
+    const BuilderEntry *entry_a = *(const BuilderEntry **) a;
+    const BuilderEntry *entry_b = *(const BuilderEntry **) b;
+
+    return strcmp(entry_a->path, entry_b->path);
+}
+
+/**
+ * gjs_bundle_builder_new:
+ * @engine: (allow-none): identifies the engine that produced any
+ *   bytecode added to the builder; only needed if there is bytecode
+ */
+GjsBundleBuilder *
+gjs_bundle_builder_new(const char *engine)
+{
+    GjsBundleBuilder *builder;
+
+    builder = g_slice_new0(GjsBundleBuilder);
+    builder->engine = g_strdup(engine ? engine : "");
+    builder->entries = g_ptr_array_new_with_free_func(builder_entry_free);
+
+    return builder;
+}
+
+void
+gjs_bundle_builder_add(GjsBundleBuilder *builder,
+                       const char       *path,
+                       GBytes           *source,
+                       GBytes           *bytecode)
+{
+    BuilderEntry *entry;
+
+    g_return_if_fail(path != NULL && source != NULL);
+
+    while (*path == '/')
+        path++;
+
+    entry = g_slice_new0(BuilderEntry);
+    entry->path = g_strdup(path);
+    entry->source = g_bytes_ref(source);
+    entry->bytecode = bytecode ? g_bytes_ref(bytecode) : NULL;
+
+    g_ptr_array_add(builder->entries, entry);
+}
+
+static guint32
+append_blob(GByteArray *out,
+            const void *data,
+            gsize       len)
+{
+    static const guint8 padding[BUNDLE_ALIGNMENT] = { 0 };
+    guint32 offset;
+
+    if (out->len % BUNDLE_ALIGNMENT != 0)
+        g_byte_array_append(out, padding,
+                            BUNDLE_ALIGNMENT - out->len % BUNDLE_ALIGNMENT);
+
+    offset = out->len;
+    g_byte_array_append(out, (const guint8 *) data, len);
+    return offset;
+}
+
+static void
+write_uint32(GByteArray *out,
+             gsize       offset,
+             guint32     value)
+{
+    value = GUINT32_TO_LE(value);
+    memcpy(out->data + offset, &value, sizeof(value));
+}
+
+/**
+ * gjs_bundle_builder_write:
+ * @builder: a #GjsBundleBuilder
+ * @filename: where to write the bundle
+ * @error: return location for a #GError
+ *
+ * Sorts the modules added so far and writes them out as a bundle.
+ * The file is replaced atomically.
+ */
+gboolean
+gjs_bundle_builder_write(GjsBundleBuilder *builder,
+                         const char       *filename,
+                         GError          **error)
+{
+    GByteArray *out;
+    gsize index_offset;
+    guint32 engine_offset;
+    gboolean ret = FALSE;
+    guint i;
+
+    g_ptr_array_sort(builder->entries, builder_entry_compare);
+
+    for (i = 1; i < builder->entries->len; i++) {
+        BuilderEntry *prev = (BuilderEntry *) g_ptr_array_index(builder->entries, i - 1);
+        BuilderEntry *cur = (BuilderEntry *) g_ptr_array_index(builder->entries, i);
+
+        if (strcmp(prev->path, cur->path) == 0) {
+            g_set_error(error, GJS_ERROR, GJS_ERROR_FAILED,
+                        "Module '%s' added to bundle twice", cur->path);
+            return FALSE;
+        }
+    }
+
+    out = g_byte_array_new();
+
+    /* Header and index are filled in once the offsets are known */
+    g_byte_array_set_size(out, BUNDLE_HEADER_SIZE);
+    memset(out->data, 0, out->len);
+    memcpy(out->data, BUNDLE_MAGIC, BUNDLE_MAGIC_LEN);
+
+    index_offset = append_blob(out, NULL, 0);
+    g_byte_array_set_size(out, index_offset + builder->entries->len * BUNDLE_ENTRY_SIZE);
+
+    engine_offset = append_blob(out, builder->engine, strlen(builder->engine));
+
+    write_uint32(out, BUNDLE_MAGIC_LEN, builder->entries->len);
+    write_uint32(out, BUNDLE_MAGIC_LEN + 4, index_offset);
+    write_uint32(out, BUNDLE_MAGIC_LEN + 8, engine_offset);
+    write_uint32(out, BUNDLE_MAGIC_LEN + 12, strlen(builder->engine));
+
+    for (i = 0; i < builder->entries->len; i++) {
+        BuilderEntry *entry = (BuilderEntry *) g_ptr_array_index(builder->entries, i);
+        gsize entry_offset = index_offset + i * BUNDLE_ENTRY_SIZE;
+        gconstpointer data;
+        gsize len;
+        guint32 offset;
+
+        /* Paths are nul-terminated on disk, but the length excludes it */
+        offset = append_blob(out, entry->path, strlen(entry->path) + 1);
+        write_uint32(out, entry_offset + ENTRY_PATH_OFFSET * 4, offset);
+        write_uint32(out, entry_offset + ENTRY_PATH_LEN * 4, strlen(entry->path));
+
+        data = g_bytes_get_data(entry->source, &len);
+        offset = append_blob(out, data, len);
+        write_uint32(out, entry_offset + ENTRY_SOURCE_OFFSET * 4, offset);
+        write_uint32(out, entry_offset + ENTRY_SOURCE_LEN * 4, len);
+
+        if (entry->bytecode) {
+            data = g_bytes_get_data(entry->bytecode, &len);
+            offset = append_blob(out, data, len);
+            write_uint32(out, entry_offset + ENTRY_BYTECODE_OFFSET * 4, offset);
+            write_uint32(out, entry_offset + ENTRY_BYTECODE_LEN * 4, len);
+        }
+
+        if (out->len > G_MAXUINT32) {
+            g_set_error(error, GJS_ERROR, GJS_ERROR_FAILED,
+                        "Bundle would be larger than 4GB");
+            goto out;
+        }
+    }
+
+    ret = g_file_set_contents(filename, (const char *) out->data, out->len, error);
+
+ out:
+    g_byte_array_unref(out);
+    return ret;
+}
+
+void
+gjs_bundle_builder_free(GjsBundleBuilder *builder)
+{
+    g_ptr_array_unref(builder->entries);
+    g_free(builder->engine);
+    g_slice_free(GjsBundleBuilder, builder);
+}
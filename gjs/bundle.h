@@ -0,0 +1,107 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GJS_BUNDLE_H__
+#define __GJS_BUNDLE_H__
+
+#include <glib.h>
+#include "gjs/jsapi-util.h"
+
+G_BEGIN_DECLS
+
+/* A bundle is a single file holding the sources (and optionally the
+ * precompiled bytecode) of a tree of modules, plus an index sorted by
+ * module path, so that the whole application can be opened and mapped
+ * once and every module lookup is a binary search.
+ *
+ * Bundles are mounted on an importer by putting a search path element
+ * of the form
+ *
+ *   bundle:/path/to/app.gjsbundle
+ *
+ * in its searchPath. Subdirectories inside the bundle are addressed as
+ * bundle:/path/to/app.gjsbundle!/sub/dir, which is what sub-importers
+ * for directories in a bundle end up with.
+ *
+ * On disk, all integers are little-endian guint32:
+ *
+ *   header:  "GJSBNDL1" n_entries index_offset engine_offset engine_len
+ *            reserved reserved
+ *   index:   n_entries * (path_offset path_len
+ *                         source_offset source_len
+ *                         bytecode_offset bytecode_len)
+ *   data:    paths, sources and bytecode referenced by the offsets
+ *
+ * The engine string records the SpiderMonkey version the bytecode was
+ * produced with; bytecode is ignored when it does not match.
+ */
+
+#define GJS_BUNDLE_URI_PREFIX "bundle:"
+#define GJS_BUNDLE_URI_SEPARATOR '!'
+
+typedef struct _GjsBundle        GjsBundle;
+typedef struct _GjsBundleBuilder GjsBundleBuilder;
+
+typedef void (* GjsBundleListFunc) (const char *name,
+                                    gboolean    is_directory,
+                                    gpointer    user_data);
+
+GjsBundle *gjs_bundle_new             (const char        *filename,
+                                       GError           **error);
+GjsBundle *gjs_bundle_ref             (GjsBundle         *bundle);
+void       gjs_bundle_unref           (GjsBundle         *bundle);
+
+GjsBundle *gjs_bundle_get_for_uri     (const char        *uri,
+                                       const char       **inner_path_out);
+
+guint      gjs_bundle_get_n_entries   (GjsBundle         *bundle);
+const char*gjs_bundle_get_engine      (GjsBundle         *bundle);
+
+gboolean   gjs_bundle_lookup          (GjsBundle         *bundle,
+                                       const char        *path,
+                                       GBytes           **source_out,
+                                       GBytes           **bytecode_out);
+gboolean   gjs_bundle_is_directory    (GjsBundle         *bundle,
+                                       const char        *path);
+void       gjs_bundle_list_directory  (GjsBundle         *bundle,
+                                       const char        *path,
+                                       GjsBundleListFunc  func,
+                                       gpointer           user_data);
+
+GjsBundleBuilder *gjs_bundle_builder_new   (const char       *engine);
+void              gjs_bundle_builder_add   (GjsBundleBuilder *builder,
+                                            const char       *path,
+                                            GBytes           *source,
+                                            GBytes           *bytecode);
+gboolean          gjs_bundle_builder_write (GjsBundleBuilder *builder,
+                                            const char       *filename,
+                                            GError          **error);
+void              gjs_bundle_builder_free  (GjsBundleBuilder *builder);
+
+GBytes           *gjs_bundle_compile_module (JSContext        *context,
+                                             const char       *path,
+                                             GBytes           *source);
+
+G_END_DECLS
+
+#endif  /* __GJS_BUNDLE_H__ */
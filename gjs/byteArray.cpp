@@ -34,6 +34,7 @@
 typedef struct {
     GByteArray *array;
     GBytes     *bytes;
+    gsize       external_size; /* as reported with gjs_memory_external_add() */
 } ByteArrayInstance;
 
 extern struct JSClass gjs_byte_array_class;
@@ -113,6 +114,31 @@ byte_array_ensure_gbytes (ByteArrayInstance  *priv)
     }
 }
 
+/* Keeps the size reported to the GC in step with the buffer we hold,
+ * call after anything that can change its length.
+ */
+static void
+byte_array_update_external_size(JSContext         *context,
+                                ByteArrayInstance *priv)
+{
+    gsize size;
+
+    if (priv->array)
+        size = priv->array->len;
+    else if (priv->bytes)
+        size = g_bytes_get_size(priv->bytes);
+    else
+        size = 0;
+
+    if (size > priv->external_size)
+        gjs_memory_external_add(context, size - priv->external_size);
+    else
+        gjs_memory_external_remove(JS_GetRuntime(context),
+                                   priv->external_size - size);
+
+    priv->external_size = size;
+}
+
 static JSBool
 gjs_value_to_gsize(JSContext         *context,
                    jsval              value,
@@ -273,6 +299,7 @@ byte_array_length_setter(JSContext *context,
         return JS_FALSE;
     }
     g_byte_array_set_size(priv->array, len);
+    byte_array_update_external_size(context, priv);
     return JS_TRUE;
 }
 
@@ -296,6 +323,7 @@ byte_array_set_index(JSContext         *context,
     if (idx >= priv->array->len) {
         g_byte_array_set_size(priv->array,
                               idx + 1);
+        byte_array_update_external_size(context, priv);
     }
 
     g_array_index(priv->array, guint8, idx) = v;
@@ -385,6 +413,7 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(byte_array)
     priv->array = gjs_g_byte_array_new(preallocated_length);
     g_assert(priv_from_js(context, object) == NULL);
     JS_SetPrivate(object, priv);
+    byte_array_update_external_size(context, priv);
 
     GJS_NATIVE_CONSTRUCTOR_FINISH(byte_array);
 
@@ -409,6 +438,8 @@ byte_array_finalize(JSFreeOp *fop,
         g_clear_pointer(&priv->bytes, g_bytes_unref);
     }
 
+    gjs_memory_external_remove(fop->runtime(), priv->external_size);
+
     g_slice_free(ByteArrayInstance, priv);
 }
 
@@ -649,6 +680,8 @@ from_string_func(JSContext *context,
         g_free(encoded);
     }
 
+    byte_array_update_external_size(context, priv);
+
     JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(obj));
 
     retval = JS_TRUE;
@@ -696,6 +729,7 @@ from_array_func(JSContext *context,
     }
 
     g_byte_array_set_size(priv->array, len);
+    byte_array_update_external_size(context, priv);
 
     for (i = 0; i < len; ++i) {
         jsval elem;
@@ -753,6 +787,7 @@ from_gbytes_func(JSContext *context,
     g_assert (priv != NULL);
 
     priv->bytes = g_bytes_ref(gbytes);
+    byte_array_update_external_size(context, priv);
 
     ret = JS_TRUE;
     JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(obj));
@@ -802,6 +837,7 @@ gjs_byte_array_from_byte_array (JSContext *context,
     priv->array = g_byte_array_new();
     priv->array->data = (guint8*) g_memdup(array->data, array->len);
     priv->array->len = array->len;
+    byte_array_update_external_size(context, priv);
 
     return object;
 }
@@ -829,6 +865,7 @@ gjs_byte_array_from_bytes (JSContext *context,
     g_assert(priv_from_js(context, object) == NULL);
     JS_SetPrivate(object, priv);
     priv->bytes = g_bytes_ref (bytes);
+    byte_array_update_external_size(context, priv);
 
     return object;
 }
@@ -30,6 +30,16 @@
 
 static char **include_path = NULL;
 static char *command = NULL;
+static int max_heap = 0;
+static int stack_quota = 0;
+static char *gc_mode = NULL;
+static gboolean gc_dynamic_heap_growth = FALSE;
+static int gc_high_frequency_time_limit = 0;
+static int gc_high_frequency_low_limit = 0;
+static int gc_high_frequency_high_limit = 0;
+static int gc_heap_growth_min = 0;
+static int gc_heap_growth_max = 0;
+static int gc_low_frequency_heap_growth = 0;
 
 static GOptionEntry entries[] = {
     { "command", 'c', 0, G_OPTION_ARG_STRING, &command, "Program passed in as a string", "COMMAND" },
@@ -37,6 +47,23 @@ static GOptionEntry entries[] = {
     { NULL }
 };
 
+/* All of these map to the GjsContext properties of the same name, with 0
+ * keeping the default.
+ */
+static GOptionEntry runtime_entries[] = {
+    { "max-heap", 0, 0, G_OPTION_ARG_INT, &max_heap, "Limit the JS heap to MB megabytes", "MB" },
+    { "stack-quota", 0, 0, G_OPTION_ARG_INT, &stack_quota, "Allow scripts KB kilobytes of native stack", "KB" },
+    { "gc-mode", 0, 0, G_OPTION_ARG_STRING, &gc_mode, "Collect garbage in MODE: global, compartment or incremental", "MODE" },
+    { "gc-dynamic-heap-growth", 0, 0, G_OPTION_ARG_NONE, &gc_dynamic_heap_growth, "Let the heap grow further between frequent collections", NULL },
+    { "gc-high-frequency-time-limit", 0, 0, G_OPTION_ARG_INT, &gc_high_frequency_time_limit, "Count collections less than MS milliseconds apart as high frequency", "MS" },
+    { "gc-high-frequency-low-limit", 0, 0, G_OPTION_ARG_INT, &gc_high_frequency_low_limit, "Use the maximum heap growth below MB megabytes", "MB" },
+    { "gc-high-frequency-high-limit", 0, 0, G_OPTION_ARG_INT, &gc_high_frequency_high_limit, "Use the minimum heap growth above MB megabytes", "MB" },
+    { "gc-heap-growth-min", 0, 0, G_OPTION_ARG_INT, &gc_heap_growth_min, "Minimum heap growth between high frequency collections", "PERCENT" },
+    { "gc-heap-growth-max", 0, 0, G_OPTION_ARG_INT, &gc_heap_growth_max, "Maximum heap growth between high frequency collections", "PERCENT" },
+    { "gc-low-frequency-heap-growth", 0, 0, G_OPTION_ARG_INT, &gc_low_frequency_heap_growth, "Heap growth between infrequent collections", "PERCENT" },
+    { NULL }
+};
+
 G_GNUC_NORETURN
 static void
 print_help (GOptionContext *context,
@@ -55,9 +82,10 @@ int
 main(int argc, char **argv)
 {
     GOptionContext *context;
+    GOptionGroup *runtime_group;
     GError *error = NULL;
     GjsContext *js_context;
-    char *script;
+    char *script = NULL;
     const char *filename;
     const char *program_name;
     gsize len;
@@ -70,6 +98,13 @@ main(int argc, char **argv)
     g_option_context_set_help_enabled(context, FALSE);
 
     g_option_context_add_main_entries(context, entries, NULL);
+
+    runtime_group = g_option_group_new("runtime",
+                                       "JS runtime and garbage collector options:",
+                                       "Show JS runtime options",
+                                       NULL, NULL);
+    g_option_group_add_entries(runtime_group, runtime_entries);
+    g_option_context_add_group(context, runtime_group);
     if (!g_option_context_parse(context, &argc, &argv, &error))
         g_error("option parsing failed: %s", error->message);
 
@@ -82,6 +117,13 @@ main(int argc, char **argv)
 
     g_option_context_free (context);
 
+    if (max_heap < 0 || stack_quota < 0 ||
+        gc_high_frequency_time_limit < 0 ||
+        gc_high_frequency_low_limit < 0 || gc_high_frequency_high_limit < 0 ||
+        gc_heap_growth_min < 0 || gc_heap_growth_max < 0 ||
+        gc_low_frequency_heap_growth < 0)
+        g_error("option parsing failed: runtime options can't be negative");
+
     setlocale(LC_ALL, "");
 
     if (command != NULL) {
@@ -95,11 +137,10 @@ main(int argc, char **argv)
         filename = "<stdin>";
         program_name = argv[0];
     } else /*if (argc >= 2)*/ {
-        error = NULL;
-        if (!g_file_get_contents(argv[1], &script, &len, &error)) {
-            g_printerr("%s\n", error->message);
-            exit(1);
-        }
+        /* The script file is loaded (mapped, if local) by
+         * gjs_context_eval_file() below.
+         */
+        len = 0;
         filename = argv[1];
         program_name = argv[1];
         argc--;
@@ -109,6 +150,16 @@ main(int argc, char **argv)
     js_context = (GjsContext*) g_object_new(GJS_TYPE_CONTEXT,
                                             "search-path", include_path,
                                             "program-name", program_name,
+                                            "max-heap-bytes", MIN((guint) max_heap, G_MAXUINT / (1024 * 1024)) * 1024 * 1024,
+                                            "native-stack-quota", MIN((guint) stack_quota, G_MAXUINT / 1024) * 1024,
+                                            "gc-mode", gc_mode,
+                                            "gc-dynamic-heap-growth", gc_dynamic_heap_growth,
+                                            "gc-high-frequency-time-limit", (guint) gc_high_frequency_time_limit,
+                                            "gc-high-frequency-low-limit", (guint) gc_high_frequency_low_limit,
+                                            "gc-high-frequency-high-limit", (guint) gc_high_frequency_high_limit,
+                                            "gc-high-frequency-heap-growth-min", (guint) gc_heap_growth_min,
+                                            "gc-high-frequency-heap-growth-max", (guint) gc_heap_growth_max,
+                                            "gc-low-frequency-heap-growth", (guint) gc_low_frequency_heap_growth,
                                             NULL);
 
     /* prepare command line arguments */
@@ -122,8 +173,15 @@ main(int argc, char **argv)
     }
 
     /* evaluate the script */
-    if (!gjs_context_eval(js_context, script, len,
-                          filename, &code, &error)) {
+    if (script == NULL) {
+        if (!gjs_context_eval_file(js_context, filename, &code, &error)) {
+            code = 1;
+            g_printerr("%s\n", error->message);
+            g_clear_error(&error);
+            goto out;
+        }
+    } else if (!gjs_context_eval(js_context, script, len,
+                                 filename, &code, &error)) {
         code = 1;
         g_printerr("%s\n", error->message);
         g_clear_error(&error);
@@ -0,0 +1,439 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include "context-pool.h"
+#include "compat.h"
+#include "jsapi-util.h"
+
+#include <util/log.h>
+
+#include <string.h>
+
+/* Default for gjs_context_pool_set_max_uses(): resetting only clears
+ * globals, so don't let anything else a script changes pile up forever.
+ */
+#define DEFAULT_MAX_USES 100
+
+typedef struct {
+    GjsContext *context;
+    GHashTable *baseline_globals;   /* names of globals right after warmup */
+    guint n_uses;
+} PooledContext;
+
+struct _GjsContextPool {
+    guint size;
+    guint max_uses;
+    char **search_path;
+    char **preload_modules;
+
+    GQueue idle;                /* PooledContext, most recently used first */
+    GHashTable *in_use;         /* GjsContext -> PooledContext */
+    guint refill_id;
+
+    GjsContextPoolStats stats;
+};
+
+static void
+pooled_context_free(PooledContext *pooled)
+{
+    g_hash_table_destroy(pooled->baseline_globals);
+    g_object_unref(pooled->context);
+    g_slice_free(PooledContext, pooled);
+}
+
+/* Returns the names of the own properties of the global object */
+static GPtrArray *
+get_global_names(GjsContext *js_context)
+{
+    JSContext *context;
+    JSObject *global;
+    JSObject *props_iter;
+    jsid prop_id;
+    char *name;
+    GPtrArray *names;
+
+    context = (JSContext *) gjs_context_get_native_context(js_context);
+    global = JS_GetGlobalObject(context);
+    names = g_ptr_array_new_with_free_func(g_free);
+
+    JS_BeginRequest(context);
+    JSAutoCompartment ac(context, global);
+
+    props_iter = JS_NewPropertyIterator(context, global);
+    if (props_iter == NULL) {
+        gjs_log_exception(context);
+        goto out;
+    }
+
+    prop_id = JSID_VOID;
+    if (!JS_NextProperty(context, props_iter, &prop_id))
+        goto out;
+
+    while (!JSID_IS_VOID(prop_id)) {
+        if (gjs_get_string_id(context, prop_id, &name))
+            g_ptr_array_add(names, name);
+
+        prop_id = JSID_VOID;
+        if (!JS_NextProperty(context, props_iter, &prop_id))
+            break;
+    }
+
+ out:
+    JS_EndRequest(context);
+    return names;
+}
+
+static PooledContext *
+pooled_context_new(GjsContextPool *pool,
+                   GError        **error)
+{
+    PooledContext *pooled;
+    GjsContext *context;
+    GPtrArray *names;
+    gint64 start;
+    guint i;
+
+    start = g_get_monotonic_time();
+
+    context = gjs_context_new_with_search_path(pool->search_path);
+    /* Every new context makes itself current; a pooled one only becomes
+     * current when it is acquired.
+     */
+    gjs_context_remove_current(context);
+
+    if (pool->preload_modules != NULL) {
+        gjs_context_prefetch_modules(context, pool->preload_modules);
+
+        for (i = 0; pool->preload_modules[i] != NULL; i++) {
+            char *script = g_strdup_printf("imports.%s;", pool->preload_modules[i]);
+            gboolean ok;
+
+            ok = gjs_context_eval(context, script, -1, "<preload>", NULL, error);
+            g_free(script);
+            if (!ok) {
+                g_object_unref(context);
+                return NULL;
+            }
+        }
+    }
+
+    pooled = g_slice_new0(PooledContext);
+    pooled->context = context;
+    pooled->baseline_globals = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    names = get_global_names(context);
+    for (i = 0; i < names->len; i++)
+        g_hash_table_add(pooled->baseline_globals, g_strdup((const char *) names->pdata[i]));
+    g_ptr_array_free(names, TRUE);
+
+    pool->stats.create_time_total += g_get_monotonic_time() - start;
+
+    return pooled;
+}
+
+/* Returns the context to the state it was in after warmup, as far as
+ * scripts normally notice: globals they added are removed. Modules they
+ * imported stay loaded, as does anything they did to objects that
+ * existed already; max_uses bounds how long that can accumulate.
+ */
+static void
+pooled_context_reset(PooledContext *pooled)
+{
+    JSContext *context;
+    JSObject *global;
+    GPtrArray *names;
+    const char *name;
+    jsval value;
+    guint i;
+
+    names = get_global_names(pooled->context);
+
+    context = (JSContext *) gjs_context_get_native_context(pooled->context);
+    global = JS_GetGlobalObject(context);
+
+    JS_BeginRequest(context);
+    JSAutoCompartment ac(context, global);
+
+    for (i = 0; i < names->len; i++) {
+        name = (const char *) names->pdata[i];
+        if (g_hash_table_contains(pooled->baseline_globals, name))
+            continue;
+
+        /* Globals declared with var or function can't be deleted, so
+         * drop the reference to their value instead.
+         */
+        if (!JS_DeleteProperty2(context, global, name, &value) ||
+            !JSVAL_TO_BOOLEAN(value)) {
+            JS_ClearPendingException(context);
+            value = JSVAL_VOID;
+            if (!JS_SetProperty(context, global, name, &value))
+                JS_ClearPendingException(context);
+        }
+    }
+
+    JS_EndRequest(context);
+    g_ptr_array_free(names, TRUE);
+
+    gjs_context_maybe_gc(pooled->context);
+}
+
+/**
+ * gjs_context_pool_fill:
+ * @pool: a #GjsContextPool
+ *
+ * Creates contexts until @pool has as many idle ones as it was created
+ * with. This is done from an idle callback after the pool runs dry, but
+ * may also be called directly, e.g. where there is no main loop.
+ */
+void
+gjs_context_pool_fill(GjsContextPool *pool)
+{
+    PooledContext *pooled;
+    GError *error = NULL;
+
+    while (g_queue_get_length(&pool->idle) < pool->size) {
+        pooled = pooled_context_new(pool, &error);
+        if (pooled == NULL) {
+            gjs_debug(GJS_DEBUG_CONTEXT,
+                      "Failed to warm up pooled context: %s", error->message);
+            g_clear_error(&error);
+            break;
+        }
+
+        g_queue_push_tail(&pool->idle, pooled);
+    }
+}
+
+static gboolean
+refill_idle(gpointer data)
+{
+    GjsContextPool *pool = (GjsContextPool *) data;
+
+    pool->refill_id = 0;
+    gjs_context_pool_fill(pool);
+
+    return FALSE;
+}
+
+static void
+schedule_refill(GjsContextPool *pool)
+{
+    if (pool->refill_id == 0)
+        pool->refill_id = g_idle_add_full(G_PRIORITY_LOW, refill_idle, pool, NULL);
+}
+
+/**
+ * gjs_context_pool_new:
+ * @size: number of contexts to keep ready
+ * @search_path: (allow-none): search path for the contexts, as for
+ *   gjs_context_new_with_search_path()
+ * @preload_modules: (allow-none): %NULL-terminated list of modules to
+ *   import into each context before handing it out, named as after
+ *   "imports.", e.g. "gi.Gio" or "lang"
+ * @error: return location for a #GError
+ *
+ * Creates a pool holding @size fully initialized contexts. Loading
+ * @preload_modules into the first context has to succeed, otherwise
+ * %NULL is returned and @error is set.
+ *
+ * Returns: the new pool; free it with gjs_context_pool_free()
+ */
+GjsContextPool *
+gjs_context_pool_new(guint                size,
+                     char               **search_path,
+                     const char * const  *preload_modules,
+                     GError             **error)
+{
+    GjsContextPool *pool;
+    PooledContext *pooled;
+
+    pool = g_slice_new0(GjsContextPool);
+    pool->size = size;
+    pool->max_uses = DEFAULT_MAX_USES;
+    pool->search_path = g_strdupv(search_path);
+    pool->preload_modules = g_strdupv((char **) preload_modules);
+    g_queue_init(&pool->idle);
+    pool->in_use = g_hash_table_new(NULL, NULL);
+
+    if (size > 0) {
+        pooled = pooled_context_new(pool, error);
+        if (pooled == NULL) {
+            gjs_context_pool_free(pool);
+            return NULL;
+        }
+        g_queue_push_tail(&pool->idle, pooled);
+
+        gjs_context_pool_fill(pool);
+    }
+
+    return pool;
+}
+
+/**
+ * gjs_context_pool_free:
+ * @pool: a #GjsContextPool
+ *
+ * Destroys @pool and its contexts. Every context acquired from @pool
+ * must have been released first, since the pool owns the only reference
+ * to it.
+ */
+void
+gjs_context_pool_free(GjsContextPool *pool)
+{
+    g_return_if_fail(g_hash_table_size(pool->in_use) == 0);
+
+    if (pool->refill_id != 0)
+        g_source_remove(pool->refill_id);
+
+    g_queue_foreach(&pool->idle, (GFunc) pooled_context_free, NULL);
+    g_queue_clear(&pool->idle);
+
+    g_hash_table_destroy(pool->in_use);
+
+    g_strfreev(pool->search_path);
+    g_strfreev(pool->preload_modules);
+    g_slice_free(GjsContextPool, pool);
+}
+
+/**
+ * gjs_context_pool_acquire:
+ * @pool: a #GjsContextPool
+ * @error: return location for a #GError
+ *
+ * Takes a context out of @pool and makes it the current one, creating a
+ * new context if none are idle. The pool keeps a reference to it; give
+ * it back with gjs_context_pool_release() rather than unreffing it.
+ *
+ * Creating a new context can fail if preloading the modules fails, in
+ * which case %NULL is returned and @error is set.
+ *
+ * Returns: (transfer none): a ready to use context, or %NULL
+ */
+GjsContext *
+gjs_context_pool_acquire(GjsContextPool *pool,
+                         GError        **error)
+{
+    PooledContext *pooled;
+
+    pooled = (PooledContext *) g_queue_pop_head(&pool->idle);
+    if (pooled != NULL) {
+        pool->stats.hits++;
+    } else {
+        pool->stats.misses++;
+        /* Don't hand out a context whose preload failed */
+        pooled = pooled_context_new(pool, error);
+        if (pooled == NULL)
+            return NULL;
+    }
+
+    if (g_queue_is_empty(&pool->idle))
+        schedule_refill(pool);
+
+    pooled->n_uses++;
+    g_hash_table_insert(pool->in_use, pooled->context, pooled);
+    gjs_context_make_current(pooled->context);
+
+    return pooled->context;
+}
+
+/**
+ * gjs_context_pool_release:
+ * @pool: a #GjsContextPool
+ * @context: a context obtained from gjs_context_pool_acquire()
+ *
+ * Gives @context back to @pool. It is reset and kept for reuse if there
+ * is room, or destroyed if the pool is full or the context has reached
+ * the limit set with gjs_context_pool_set_max_uses().
+ */
+void
+gjs_context_pool_release(GjsContextPool *pool,
+                         GjsContext     *context)
+{
+    PooledContext *pooled;
+    gint64 start, elapsed;
+
+    pooled = (PooledContext *) g_hash_table_lookup(pool->in_use, context);
+    g_return_if_fail(pooled != NULL);
+    g_hash_table_remove(pool->in_use, context);
+
+    /* Contexts may be released in any order, so drop this one's entry
+     * rather than whatever was made current last.
+     */
+    gjs_context_remove_current(context);
+
+    if (g_queue_get_length(&pool->idle) >= pool->size) {
+        pool->stats.discards++;
+        pooled_context_free(pooled);
+        return;
+    }
+
+    if (pool->max_uses > 0 && pooled->n_uses >= pool->max_uses) {
+        pool->stats.discards++;
+        pooled_context_free(pooled);
+        schedule_refill(pool);
+        return;
+    }
+
+    start = g_get_monotonic_time();
+    pooled_context_reset(pooled);
+    elapsed = g_get_monotonic_time() - start;
+
+    pool->stats.resets++;
+    pool->stats.reset_time_total += elapsed;
+    pool->stats.reset_time_max = MAX(pool->stats.reset_time_max, elapsed);
+
+    g_queue_push_head(&pool->idle, pooled);
+}
+
+/**
+ * gjs_context_pool_set_max_uses:
+ * @pool: a #GjsContextPool
+ * @max_uses: number of times a context may be handed out before it is
+ *   replaced with a fresh one, or 0 for no limit
+ */
+void
+gjs_context_pool_set_max_uses(GjsContextPool *pool,
+                              guint           max_uses)
+{
+    pool->max_uses = max_uses;
+}
+
+guint
+gjs_context_pool_get_n_idle(GjsContextPool *pool)
+{
+    return g_queue_get_length(&pool->idle);
+}
+
+/**
+ * gjs_context_pool_get_stats:
+ * @pool: a #GjsContextPool
+ * @stats: (out caller-allocates): filled in with the counters so far
+ */
+void
+gjs_context_pool_get_stats(GjsContextPool      *pool,
+                           GjsContextPoolStats *stats)
+{
+    *stats = pool->stats;
+}
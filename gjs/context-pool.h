@@ -0,0 +1,67 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GJS_CONTEXT_POOL_H__
+#define __GJS_CONTEXT_POOL_H__
+
+#if !defined (__GJS_GJS_H__) && !defined (GJS_COMPILATION)
+#error "Only <gjs/gjs.h> can be included directly."
+#endif
+
+#include <gjs/context.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GjsContextPool GjsContextPool;
+
+typedef struct {
+    guint  hits;                /* acquired contexts that were already warm */
+    guint  misses;              /* acquired contexts created on demand */
+    guint  resets;              /* released contexts made ready for reuse */
+    guint  discards;            /* released contexts destroyed instead */
+    gint64 create_time_total;   /* microseconds */
+    gint64 reset_time_total;    /* microseconds */
+    gint64 reset_time_max;      /* microseconds */
+} GjsContextPoolStats;
+
+GjsContextPool *gjs_context_pool_new          (guint                size,
+                                               char               **search_path,
+                                               const char * const  *preload_modules,
+                                               GError             **error);
+void            gjs_context_pool_free         (GjsContextPool      *pool);
+
+GjsContext     *gjs_context_pool_acquire      (GjsContextPool      *pool,
+                                               GError             **error);
+void            gjs_context_pool_release      (GjsContextPool      *pool,
+                                               GjsContext          *context);
+
+void            gjs_context_pool_set_max_uses (GjsContextPool      *pool,
+                                               guint                max_uses);
+void            gjs_context_pool_fill         (GjsContextPool      *pool);
+guint           gjs_context_pool_get_n_idle   (GjsContextPool      *pool);
+void            gjs_context_pool_get_stats    (GjsContextPool      *pool,
+                                               GjsContextPoolStats *stats);
+
+G_END_DECLS
+
+#endif /* __GJS_CONTEXT_POOL_H__ */
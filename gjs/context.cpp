@@ -29,13 +29,20 @@
 #include "importer.h"
 #include "jsapi-util.h"
 #include "profiler.h"
+#include "import-trace.h"
+#include "timeline.h"
+#include "gc-stats.h"
+#include "heap-dump.h"
 #include "native.h"
 #include "byteArray.h"
 #include "compat.h"
 #include "runtime.h"
+#include "mem.h"
 
 #include "gi.h"
 #include "gi/object.h"
+#include "gi/gjs_gi_trace.h"
+#include "gi/usage.h"
 
 #include <modules/modules.h>
 
@@ -58,6 +65,9 @@ static void     gjs_context_set_property      (GObject               *object,
                                                   GParamSpec            *pspec);
 static void gjs_on_context_gc (JSRuntime *rt,
                                JSGCStatus status);
+static void gjs_on_context_gc_slice (JSRuntime                 *rt,
+                                     JS::GCProgress             progress,
+                                     const JS::GCDescription   &desc);
 
 struct _GjsContext {
     GObject parent;
@@ -67,14 +77,39 @@ struct _GjsContext {
     JSObject *global;
 
     GjsProfiler *profiler;
+    GjsImportTrace *import_trace;
+    GjsTimeline *timeline;
+    GjsGCStats *gc_stats;
 
     char *program_name;
+    char *import_trace_output;
+    char *timeline_output;
+    char *gc_mode;
 
     char **search_path;
 
+    /* Starts of the GC events in progress on the timeline */
+    gint64 timeline_gc_cycle_start;
+    gint64 timeline_gc_slice_start;
+
     guint idle_emit_gc_id;
+    guint gc_slice_id;
+    guint gc_slice_budget;
+
+    /* Runtime tuning, 0 leaves the built-in default */
+    guint max_heap_bytes;
+    guint native_stack_quota;
+    guint stack_chunk_size;
+    guint gc_high_frequency_time_limit;
+    guint gc_high_frequency_low_limit;
+    guint gc_high_frequency_high_limit;
+    guint gc_high_frequency_heap_growth_min;
+    guint gc_high_frequency_heap_growth_max;
+    guint gc_low_frequency_heap_growth;
 
     guint gc_notifications_enabled : 1;
+    guint incremental_gc : 1;
+    guint gc_dynamic_heap_growth : 1;
 };
 
 struct _GjsContextClass {
@@ -95,8 +130,38 @@ enum {
     PROP_SEARCH_PATH,
     PROP_GC_NOTIFICATIONS,
     PROP_PROGRAM_NAME,
+    PROP_IMPORT_TRACE_OUTPUT,
+    PROP_TIMELINE_OUTPUT,
+    PROP_INCREMENTAL_GC,
+    PROP_GC_SLICE_BUDGET,
+    PROP_MAX_HEAP_BYTES,
+    PROP_NATIVE_STACK_QUOTA,
+    PROP_STACK_CHUNK_SIZE,
+    PROP_GC_MODE,
+    PROP_GC_DYNAMIC_HEAP_GROWTH,
+    PROP_GC_HIGH_FREQUENCY_TIME_LIMIT,
+    PROP_GC_HIGH_FREQUENCY_LOW_LIMIT,
+    PROP_GC_HIGH_FREQUENCY_HIGH_LIMIT,
+    PROP_GC_HIGH_FREQUENCY_HEAP_GROWTH_MIN,
+    PROP_GC_HIGH_FREQUENCY_HEAP_GROWTH_MAX,
+    PROP_GC_LOW_FREQUENCY_HEAP_GROWTH,
 };
 
+/* Milliseconds; the same as SpiderMonkey's own default */
+#define DEFAULT_GC_SLICE_BUDGET 10
+
+/* What gjs has always used when the properties are left at 0. The
+ * runtime is always created with RUNTIME_MAX_BYTES, since that also sets
+ * the malloc bytes GC trigger; the heap limit only goes to JSGC_MAX_BYTES.
+ */
+#define RUNTIME_MAX_BYTES          (32 * 1024 * 1024)
+#define DEFAULT_MAX_HEAP_BYTES     0xffffffff
+#define DEFAULT_NATIVE_STACK_QUOTA (1024 * 1024)
+#define DEFAULT_STACK_CHUNK_SIZE   8192
+
+/* Collections kept for gjs_context_get_gc_records() */
+#define GC_RECORD_CAPACITY 128
+
 
 static GMutex gc_idle_lock;
 static GMutex contexts_lock;
@@ -324,6 +389,168 @@ gjs_context_class_init(GjsContextClass *klass)
                                     PROP_PROGRAM_NAME,
                                     pspec);
 
+    pspec = g_param_spec_string("import-trace-output",
+                                "Import trace output",
+                                "File to write import timings to on destruction; "
+                                "Chrome trace JSON if it ends in .json",
+                                NULL,
+                                (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_IMPORT_TRACE_OUTPUT,
+                                    pspec);
+
+    pspec = g_param_spec_string("timeline-output",
+                                "Timeline output",
+                                "Prefix of the Chrome trace JSON files to write the "
+                                "timeline of evaluation, imports, closures and GC to",
+                                NULL,
+                                (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_TIMELINE_OUTPUT,
+                                    pspec);
+
+    pspec = g_param_spec_boolean("incremental-gc",
+                                 "Incremental GC",
+                                 "Whether gjs_context_maybe_gc() collects in slices during idle time",
+                                 FALSE,
+                                 (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_INCREMENTAL_GC,
+                                    pspec);
+
+    pspec = g_param_spec_uint("gc-slice-budget",
+                              "GC slice budget",
+                              "Milliseconds each incremental GC slice may take",
+                              1, G_MAXUINT, DEFAULT_GC_SLICE_BUDGET,
+                              (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
+    g_object_class_install_property(object_class,
+                                    PROP_GC_SLICE_BUDGET,
+                                    pspec);
+
+    pspec = g_param_spec_uint("max-heap-bytes",
+                              "Maximum heap size",
+                              "Bytes the JS GC heap may grow to, 0 for no limit",
+                              0, G_MAXUINT, 0,
+                              (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_MAX_HEAP_BYTES,
+                                    pspec);
+
+    pspec = g_param_spec_uint("native-stack-quota",
+                              "Native stack quota",
+                              "Bytes of C stack scripts may use before a "
+                              "\"too much recursion\" error, 0 for the default",
+                              0, G_MAXUINT, 0,
+                              (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_NATIVE_STACK_QUOTA,
+                                    pspec);
+
+    pspec = g_param_spec_uint("stack-chunk-size",
+                              "Stack chunk size",
+                              "Size of the chunks the JS context's temporary "
+                              "pool is allocated in, 0 for the default",
+                              0, G_MAXUINT, 0,
+                              (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_STACK_CHUNK_SIZE,
+                                    pspec);
+
+    pspec = g_param_spec_string("gc-mode",
+                                "GC mode",
+                                "\"global\", \"compartment\" or \"incremental\"; "
+                                "\"incremental\" is the same as setting incremental-gc",
+                                NULL,
+                                (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_GC_MODE,
+                                    pspec);
+
+    pspec = g_param_spec_boolean("gc-dynamic-heap-growth",
+                                 "Dynamic heap growth",
+                                 "Whether the heap size that triggers a GC depends "
+                                 "on how often collections happen",
+                                 FALSE,
+                                 (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_GC_DYNAMIC_HEAP_GROWTH,
+                                    pspec);
+
+    pspec = g_param_spec_uint("gc-high-frequency-time-limit",
+                              "High frequency GC time limit",
+                              "Milliseconds between collections below which "
+                              "GCs count as high frequency, 0 for the default",
+                              0, G_MAXUINT, 0,
+                              (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_GC_HIGH_FREQUENCY_TIME_LIMIT,
+                                    pspec);
+
+    pspec = g_param_spec_uint("gc-high-frequency-low-limit",
+                              "High frequency GC low limit",
+                              "Heap size in MB below which high frequency GCs "
+                              "use the maximum heap growth, 0 for the default",
+                              0, G_MAXUINT, 0,
+                              (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_GC_HIGH_FREQUENCY_LOW_LIMIT,
+                                    pspec);
+
+    pspec = g_param_spec_uint("gc-high-frequency-high-limit",
+                              "High frequency GC high limit",
+                              "Heap size in MB above which high frequency GCs "
+                              "use the minimum heap growth, 0 for the default",
+                              0, G_MAXUINT, 0,
+                              (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_GC_HIGH_FREQUENCY_HIGH_LIMIT,
+                                    pspec);
+
+    pspec = g_param_spec_uint("gc-high-frequency-heap-growth-min",
+                              "High frequency minimum heap growth",
+                              "Percentage the heap may grow to before the next "
+                              "high frequency GC on a large heap, 0 for the default",
+                              0, G_MAXUINT, 0,
+                              (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_GC_HIGH_FREQUENCY_HEAP_GROWTH_MIN,
+                                    pspec);
+
+    pspec = g_param_spec_uint("gc-high-frequency-heap-growth-max",
+                              "High frequency maximum heap growth",
+                              "Percentage the heap may grow to before the next "
+                              "high frequency GC on a small heap, 0 for the default",
+                              0, G_MAXUINT, 0,
+                              (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_GC_HIGH_FREQUENCY_HEAP_GROWTH_MAX,
+                                    pspec);
+
+    pspec = g_param_spec_uint("gc-low-frequency-heap-growth",
+                              "Low frequency heap growth",
+                              "Percentage the heap may grow to before the next "
+                              "GC when collections are rare, 0 for the default",
+                              0, G_MAXUINT, 0,
+                              (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_GC_LOW_FREQUENCY_HEAP_GROWTH,
+                                    pspec);
+
     signals[SIGNAL_GC] = g_signal_new("gc", G_TYPE_FROM_CLASS(klass),
                                       G_SIGNAL_RUN_LAST, 0,
                                       NULL, NULL,
@@ -356,10 +583,25 @@ gjs_context_dispose(GObject *object)
         js_context->profiler = NULL;
     }
 
+    if (js_context->import_trace) {
+        gjs_import_trace_free(js_context->import_trace);
+        js_context->import_trace = NULL;
+    }
+
+    if (js_context->timeline) {
+        gjs_timeline_free(js_context->timeline);
+        js_context->timeline = NULL;
+    }
+
     if (js_context->global != NULL) {
         js_context->global = NULL;
     }
 
+    if (js_context->gc_slice_id > 0) {
+        g_source_remove(js_context->gc_slice_id);
+        js_context->gc_slice_id = 0;
+    }
+
     if (js_context->context != NULL) {
 
         gjs_debug(GJS_DEBUG_CONTEXT,
@@ -369,10 +611,13 @@ gjs_context_dispose(GObject *object)
          * that we may not have the JS_GetPrivate() to access the
          * context
          */
+        gjs_gc_stats_set_reason(js_context->gc_stats, "destroy");
         JS_GC(js_context->runtime);
+        JS::SetGCSliceCallback(js_context->runtime, NULL);
 
         gjs_object_process_pending_toggles();
 
+        gjs_importer_forget_prefetched_modules(js_context->context);
         JS_DestroyContext(js_context->context);
         js_context->context = NULL;
     }
@@ -382,6 +627,7 @@ gjs_context_dispose(GObject *object)
 
         /* Cleans up data as well as destroying the runtime. */
         JS_DestroyRuntime(js_context->runtime);
+        gjs_memory_external_forget_runtime(js_context->runtime);
         js_context->runtime = NULL;
     }
 
@@ -410,6 +656,20 @@ gjs_context_finalize(GObject *object)
         js_context->program_name = NULL;
     }
 
+    g_free(js_context->import_trace_output);
+    js_context->import_trace_output = NULL;
+
+    g_free(js_context->timeline_output);
+    js_context->timeline_output = NULL;
+
+    g_free(js_context->gc_mode);
+    js_context->gc_mode = NULL;
+
+    if (js_context->gc_stats != NULL) {
+        gjs_gc_stats_free(js_context->gc_stats);
+        js_context->gc_stats = NULL;
+    }
+
     g_mutex_lock(&contexts_lock);
     context_stack = g_list_remove_all(context_stack, object);
     all_contexts = g_list_remove(all_contexts, object);
@@ -534,21 +794,114 @@ static JSLocaleCallbacks gjs_locale_callbacks =
     gjs_locale_to_unicode
 };
 
+static void
+set_gc_parameter_if_given(JSRuntime    *runtime,
+                          JSGCParamKey  key,
+                          guint         value)
+{
+    if (value != 0)
+        JS_SetGCParameter(runtime, key, value);
+}
+
+/* "incremental-gc" and "gc-mode" both say whether the GC is incremental;
+ * either one asking for it is enough, and "gc-mode" reads back as the
+ * mode actually used.
+ */
+static JSGCMode
+gjs_context_resolve_gc_mode(GjsContext *js_context)
+{
+    JSGCMode mode = JSGC_MODE_GLOBAL;
+
+    if (js_context->gc_mode == NULL || strcmp(js_context->gc_mode, "global") == 0) {
+        mode = JSGC_MODE_GLOBAL;
+    } else if (strcmp(js_context->gc_mode, "compartment") == 0) {
+        mode = JSGC_MODE_COMPARTMENT;
+    } else if (strcmp(js_context->gc_mode, "incremental") == 0) {
+        mode = JSGC_MODE_INCREMENTAL;
+    } else {
+        g_warning("Unknown GC mode '%s', using global GC", js_context->gc_mode);
+    }
+
+    if (js_context->incremental_gc) {
+        if (js_context->gc_mode != NULL && mode != JSGC_MODE_INCREMENTAL)
+            g_warning("GC mode '%s' ignored, incremental-gc is set", js_context->gc_mode);
+        mode = JSGC_MODE_INCREMENTAL;
+    }
+
+    js_context->incremental_gc = (mode == JSGC_MODE_INCREMENTAL);
+
+    g_free(js_context->gc_mode);
+    switch (mode) {
+    case JSGC_MODE_COMPARTMENT:
+        js_context->gc_mode = g_strdup("compartment");
+        break;
+    case JSGC_MODE_INCREMENTAL:
+        js_context->gc_mode = g_strdup("incremental");
+        break;
+    default:
+        js_context->gc_mode = g_strdup("global");
+        break;
+    }
+
+    return mode;
+}
+
 static void
 gjs_context_constructed(GObject *object)
 {
     GjsContext *js_context = GJS_CONTEXT(object);
     guint32 options_flags;
+    guint max_heap_bytes;
+    JSGCMode gc_mode;
+    gint64 timeline_start, timeline_importer_start;
 
     G_OBJECT_CLASS(gjs_context_parent_class)->constructed(object);
 
-    js_context->runtime = JS_NewRuntime(32*1024*1024 /* max bytes */, JS_USE_HELPER_THREADS);
-    JS_SetNativeStackQuota(js_context->runtime, 1024*1024);
+    /* Start the timeline first so that it covers our own startup */
+    js_context->timeline = gjs_timeline_new(js_context->timeline_output);
+    timeline_start = gjs_timeline_begin();
+
+    max_heap_bytes = js_context->max_heap_bytes ?
+        js_context->max_heap_bytes : DEFAULT_MAX_HEAP_BYTES;
+
+    js_context->gc_stats = gjs_gc_stats_new(GC_RECORD_CAPACITY);
+
+    js_context->runtime = JS_NewRuntime(RUNTIME_MAX_BYTES, JS_USE_HELPER_THREADS);
     if (js_context->runtime == NULL)
         g_error("Failed to create javascript runtime");
-    JS_SetGCParameter(js_context->runtime, JSGC_MAX_BYTES, 0xffffffff);
-
-    js_context->context = JS_NewContext(js_context->runtime, 8192 /* stack chunk size */);
+    JS_SetNativeStackQuota(js_context->runtime,
+                           js_context->native_stack_quota ?
+                           js_context->native_stack_quota : DEFAULT_NATIVE_STACK_QUOTA);
+    JS_SetGCParameter(js_context->runtime, JSGC_MAX_BYTES, max_heap_bytes);
+
+    gc_mode = gjs_context_resolve_gc_mode(js_context);
+    JS_SetGCParameter(js_context->runtime, JSGC_MODE, gc_mode);
+    if (gc_mode == JSGC_MODE_INCREMENTAL)
+        JS_SetGCParameter(js_context->runtime, JSGC_SLICE_TIME_BUDGET,
+                          js_context->gc_slice_budget);
+
+    /* The high and low frequency settings only matter with dynamic heap
+     * growth; they tune how far the heap may grow past the last
+     * collection depending on how often collections are happening.
+     */
+    if (js_context->gc_dynamic_heap_growth)
+        JS_SetGCParameter(js_context->runtime, JSGC_DYNAMIC_HEAP_GROWTH, 1);
+    set_gc_parameter_if_given(js_context->runtime, JSGC_HIGH_FREQUENCY_TIME_LIMIT,
+                              js_context->gc_high_frequency_time_limit);
+    set_gc_parameter_if_given(js_context->runtime, JSGC_HIGH_FREQUENCY_LOW_LIMIT,
+                              js_context->gc_high_frequency_low_limit);
+    set_gc_parameter_if_given(js_context->runtime, JSGC_HIGH_FREQUENCY_HIGH_LIMIT,
+                              js_context->gc_high_frequency_high_limit);
+    set_gc_parameter_if_given(js_context->runtime, JSGC_HIGH_FREQUENCY_HEAP_GROWTH_MIN,
+                              js_context->gc_high_frequency_heap_growth_min);
+    set_gc_parameter_if_given(js_context->runtime, JSGC_HIGH_FREQUENCY_HEAP_GROWTH_MAX,
+                              js_context->gc_high_frequency_heap_growth_max);
+    set_gc_parameter_if_given(js_context->runtime, JSGC_LOW_FREQUENCY_HEAP_GROWTH,
+                              js_context->gc_low_frequency_heap_growth);
+
+    js_context->context = JS_NewContext(js_context->runtime,
+                                        js_context->stack_chunk_size ?
+                                        js_context->stack_chunk_size : DEFAULT_STACK_CHUNK_SIZE);
     if (js_context->context == NULL)
         g_error("Failed to create javascript context");
 
@@ -619,6 +972,8 @@ gjs_context_constructed(GObject *object)
                            4, GJS_MODULE_PROP_FLAGS))
         g_error("Failed to define printerr function");
 
+    timeline_importer_start = gjs_timeline_begin();
+
     /* We create the global-to-runtime root importer with the
      * passed-in search path. If someone else already created
      * the root importer, this is a no-op.
@@ -637,9 +992,19 @@ gjs_context_constructed(GObject *object)
                                   js_context->global))
         g_error("Failed to point 'imports' property at root importer");
 
+    gjs_timeline_end("startup", "importer", timeline_importer_start);
+
     js_context->profiler = gjs_profiler_new(js_context->runtime);
+    js_context->import_trace = gjs_import_trace_new(js_context->runtime,
+                                                    js_context->import_trace_output);
+    gjs_gi_usage_init();
+    gjs_memory_init_dump_signal();
+    gjs_heap_dump_init_signal();
 
     JS_SetGCCallback(js_context->runtime, gjs_on_context_gc);
+    JS::SetGCSliceCallback(js_context->runtime, gjs_on_context_gc_slice);
+
+    gjs_timeline_end("startup", "context", timeline_start);
 
     JS_EndRequest(js_context->context);
 
@@ -665,6 +1030,51 @@ gjs_context_get_property (GObject     *object,
     case PROP_PROGRAM_NAME:
         g_value_set_string(value, js_context->program_name);
         break;
+    case PROP_IMPORT_TRACE_OUTPUT:
+        g_value_set_string(value, js_context->import_trace_output);
+        break;
+    case PROP_TIMELINE_OUTPUT:
+        g_value_set_string(value, js_context->timeline_output);
+        break;
+    case PROP_INCREMENTAL_GC:
+        g_value_set_boolean(value, js_context->incremental_gc);
+        break;
+    case PROP_GC_SLICE_BUDGET:
+        g_value_set_uint(value, js_context->gc_slice_budget);
+        break;
+    case PROP_MAX_HEAP_BYTES:
+        g_value_set_uint(value, js_context->max_heap_bytes);
+        break;
+    case PROP_NATIVE_STACK_QUOTA:
+        g_value_set_uint(value, js_context->native_stack_quota);
+        break;
+    case PROP_STACK_CHUNK_SIZE:
+        g_value_set_uint(value, js_context->stack_chunk_size);
+        break;
+    case PROP_GC_MODE:
+        g_value_set_string(value, js_context->gc_mode);
+        break;
+    case PROP_GC_DYNAMIC_HEAP_GROWTH:
+        g_value_set_boolean(value, js_context->gc_dynamic_heap_growth);
+        break;
+    case PROP_GC_HIGH_FREQUENCY_TIME_LIMIT:
+        g_value_set_uint(value, js_context->gc_high_frequency_time_limit);
+        break;
+    case PROP_GC_HIGH_FREQUENCY_LOW_LIMIT:
+        g_value_set_uint(value, js_context->gc_high_frequency_low_limit);
+        break;
+    case PROP_GC_HIGH_FREQUENCY_HIGH_LIMIT:
+        g_value_set_uint(value, js_context->gc_high_frequency_high_limit);
+        break;
+    case PROP_GC_HIGH_FREQUENCY_HEAP_GROWTH_MIN:
+        g_value_set_uint(value, js_context->gc_high_frequency_heap_growth_min);
+        break;
+    case PROP_GC_HIGH_FREQUENCY_HEAP_GROWTH_MAX:
+        g_value_set_uint(value, js_context->gc_high_frequency_heap_growth_max);
+        break;
+    case PROP_GC_LOW_FREQUENCY_HEAP_GROWTH:
+        g_value_set_uint(value, js_context->gc_low_frequency_heap_growth);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
         break;
@@ -691,6 +1101,54 @@ gjs_context_set_property (GObject      *object,
     case PROP_PROGRAM_NAME:
         js_context->program_name = g_value_dup_string(value);
         break;
+    case PROP_IMPORT_TRACE_OUTPUT:
+        js_context->import_trace_output = g_value_dup_string(value);
+        break;
+    case PROP_TIMELINE_OUTPUT:
+        js_context->timeline_output = g_value_dup_string(value);
+        break;
+    case PROP_INCREMENTAL_GC:
+        js_context->incremental_gc = g_value_get_boolean(value);
+        break;
+    case PROP_GC_SLICE_BUDGET:
+        js_context->gc_slice_budget = g_value_get_uint(value);
+        if (js_context->runtime != NULL && js_context->incremental_gc)
+            JS_SetGCParameter(js_context->runtime, JSGC_SLICE_TIME_BUDGET,
+                              js_context->gc_slice_budget);
+        break;
+    case PROP_MAX_HEAP_BYTES:
+        js_context->max_heap_bytes = g_value_get_uint(value);
+        break;
+    case PROP_NATIVE_STACK_QUOTA:
+        js_context->native_stack_quota = g_value_get_uint(value);
+        break;
+    case PROP_STACK_CHUNK_SIZE:
+        js_context->stack_chunk_size = g_value_get_uint(value);
+        break;
+    case PROP_GC_MODE:
+        js_context->gc_mode = g_value_dup_string(value);
+        break;
+    case PROP_GC_DYNAMIC_HEAP_GROWTH:
+        js_context->gc_dynamic_heap_growth = g_value_get_boolean(value);
+        break;
+    case PROP_GC_HIGH_FREQUENCY_TIME_LIMIT:
+        js_context->gc_high_frequency_time_limit = g_value_get_uint(value);
+        break;
+    case PROP_GC_HIGH_FREQUENCY_LOW_LIMIT:
+        js_context->gc_high_frequency_low_limit = g_value_get_uint(value);
+        break;
+    case PROP_GC_HIGH_FREQUENCY_HIGH_LIMIT:
+        js_context->gc_high_frequency_high_limit = g_value_get_uint(value);
+        break;
+    case PROP_GC_HIGH_FREQUENCY_HEAP_GROWTH_MIN:
+        js_context->gc_high_frequency_heap_growth_min = g_value_get_uint(value);
+        break;
+    case PROP_GC_HIGH_FREQUENCY_HEAP_GROWTH_MAX:
+        js_context->gc_high_frequency_heap_growth_max = g_value_get_uint(value);
+        break;
+    case PROP_GC_LOW_FREQUENCY_HEAP_GROWTH:
+        js_context->gc_low_frequency_heap_growth = g_value_get_uint(value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
         break;
@@ -712,6 +1170,28 @@ gjs_context_new_with_search_path(char** search_path)
                          NULL);
 }
 
+/* Sources with a higher priority, such as input and redraws, keep a
+ * G_PRIORITY_LOW idle from being dispatched at all, so slices never
+ * delay them by more than one budget.
+ */
+static gboolean
+gjs_context_gc_slice(gpointer data)
+{
+    GjsContext *js_context = (GjsContext*) data;
+
+    if (JS::IsIncrementalGCInProgress(js_context->runtime)) {
+        JS::PrepareForIncrementalGC(js_context->runtime);
+        JS::IncrementalGC(js_context->runtime, JS::gcreason::API,
+                          js_context->gc_slice_budget);
+    }
+
+    if (JS::IsIncrementalGCInProgress(js_context->runtime))
+        return TRUE;
+
+    js_context->gc_slice_id = 0;
+    return FALSE;
+}
+
 /**
  * gjs_context_maybe_gc:
  * @context: a #GjsContext
@@ -732,11 +1212,57 @@ gjs_context_new_with_search_path(char** search_path)
  *
  * A good time to call this function is when your application
  * transitions to an idle state.
+ *
+ * If the context was created with #GjsContext:incremental-gc set, the
+ * collection is instead started here and carried on in slices of at
+ * most #GjsContext:gc-slice-budget milliseconds from a low priority
+ * idle callback, so it only runs while the main loop has nothing more
+ * urgent to do. A full blocking collection is only done if memory keeps
+ * growing faster than the slices can keep up with.
  */ 
 void
 gjs_context_maybe_gc (GjsContext  *context)
 {
-    gjs_maybe_gc(context->context);
+    gboolean under_pressure;
+
+    gjs_gc_stats_set_reason(context->gc_stats, "maybe-gc");
+
+    if (!context->incremental_gc) {
+        gjs_maybe_gc(context->context);
+        gjs_gc_stats_set_reason(context->gc_stats, NULL);
+        return;
+    }
+
+    JS_MaybeGC(context->context);
+    gjs_gc_stats_set_reason(context->gc_stats, NULL);
+
+    if (!gjs_gc_memory_grew(context->runtime, &under_pressure))
+        return;
+
+    if (under_pressure) {
+        gjs_debug(GJS_DEBUG_CONTEXT, "Memory pressure, finishing GC now");
+        gjs_gc_stats_set_reason(context->gc_stats, "pressure");
+        if (JS::IsIncrementalGCInProgress(context->runtime))
+            JS::FinishIncrementalGC(context->runtime, JS::gcreason::API);
+        else
+            JS_GC(context->runtime);
+        gjs_gc_stats_set_reason(context->gc_stats, NULL);
+        return;
+    }
+
+    if (!JS::IsIncrementalGCInProgress(context->runtime)) {
+        gjs_gc_stats_set_reason(context->gc_stats, "maybe-gc");
+        JS::PrepareForFullGC(context->runtime);
+        JS::IncrementalGC(context->runtime, JS::gcreason::API,
+                          context->gc_slice_budget);
+        gjs_gc_stats_set_reason(context->gc_stats, NULL);
+    }
+
+    if (JS::IsIncrementalGCInProgress(context->runtime) &&
+        context->gc_slice_id == 0)
+        context->gc_slice_id = g_idle_add_full(G_PRIORITY_LOW,
+                                               gjs_context_gc_slice,
+                                               context, NULL);
 }
 
 /**
@@ -749,7 +1275,94 @@ gjs_context_maybe_gc (GjsContext  *context)
 void
 gjs_context_gc (GjsContext  *context)
 {
+    gjs_gc_stats_set_reason(context->gc_stats, "api");
     JS_GC(context->runtime);
+    gjs_gc_stats_set_reason(context->gc_stats, NULL);
+}
+
+/**
+ * gjs_context_get_gc_records:
+ * @context: a #GjsContext
+ * @records: (out caller-allocates) (array length=n_records): records to fill
+ * @n_records: size of @records
+ *
+ * Gets statistics about the most recent garbage collections in
+ * @context, oldest first. Only the last 128 collections are kept; the
+ * #GjsGCRecord.id field tells whether any were missed between calls.
+ *
+ * Returns: the number of records filled in
+ */
+guint
+gjs_context_get_gc_records (GjsContext  *context,
+                            GjsGCRecord *records,
+                            guint        n_records)
+{
+    g_return_val_if_fail(GJS_IS_CONTEXT(context), 0);
+
+    return gjs_gc_stats_get_records(context->gc_stats, records, n_records);
+}
+
+/**
+ * gjs_context_dump_heap:
+ * @context: a #GjsContext
+ * @filename: file to write the snapshot to
+ * @error: return location for a #GError
+ *
+ * Writes a snapshot of everything alive in the JS heap of @context,
+ * with the references between things and which GObject or boxed type
+ * the wrappers are for, to look for what keeps leaked wrappers alive.
+ * A full GC is done first. Two snapshots of the same process can be
+ * compared line by line, see gjs/heap-dump.cpp for the format.
+ *
+ * Setting GJS_DEBUG_HEAP_OUTPUT makes SIGUSR2 write a snapshot of every
+ * context to a file named after it.
+ *
+ * Returns: %FALSE if @filename couldn't be written
+ */
+gboolean
+gjs_context_dump_heap (GjsContext  *context,
+                       const char  *filename,
+                       GError     **error)
+{
+    gboolean ret;
+
+    g_return_val_if_fail(GJS_IS_CONTEXT(context), FALSE);
+
+    JS_BeginRequest(context->context);
+    gjs_gc_stats_set_reason(context->gc_stats, "heap-dump");
+    ret = gjs_dump_heap(context->context, filename, error);
+    gjs_gc_stats_set_reason(context->gc_stats, NULL);
+    JS_EndRequest(context->context);
+
+    return ret;
+}
+
+/**
+ * gjs_context_dump_timeline:
+ * @context: a #GjsContext
+ * @error: return location for a #GError
+ *
+ * Writes the events recorded since the last dump to a new file, when
+ * the #GjsContext:timeline-output property or $GJS_DEBUG_TIMELINE_OUTPUT
+ * made @context record a timeline. What is still recorded when the
+ * context goes away is written then.
+ *
+ * Returns: %FALSE if no timeline is being recorded or the file couldn't
+ * be written
+ */
+gboolean
+gjs_context_dump_timeline (GjsContext  *context,
+                           GError     **error)
+{
+    g_return_val_if_fail(GJS_IS_CONTEXT(context), FALSE);
+
+    if (context->timeline == NULL) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_NOT_INITIALIZED,
+                            "No timeline is being recorded");
+        return FALSE;
+    }
+
+    return gjs_timeline_dump(context->timeline, error);
 }
 
 static gboolean
@@ -792,6 +1405,45 @@ gjs_on_context_gc (JSRuntime *rt,
     }
 }
 
+static void
+gjs_on_context_gc_slice (JSRuntime                 *rt,
+                         JS::GCProgress             progress,
+                         const JS::GCDescription   &desc)
+{
+    JSContext *context = gjs_runtime_get_context(rt);
+    GjsContext *gjs_context = (GjsContext*) JS_GetContextPrivate(context);
+
+    switch (progress) {
+    case JS::GC_CYCLE_BEGIN:
+    case JS::GC_SLICE_BEGIN:
+        if (progress == JS::GC_CYCLE_BEGIN) {
+            TRACE(GJS_GC_BEGIN(JS_GetGCParameter(rt, JSGC_BYTES)));
+            gjs_context->timeline_gc_cycle_start = gjs_timeline_begin();
+        }
+        gjs_context->timeline_gc_slice_start = gjs_timeline_begin();
+        gjs_gc_stats_slice_begin(gjs_context->gc_stats, rt,
+                                 progress == JS::GC_CYCLE_BEGIN);
+        /* The profiler refers to scripts the GC may finalize */
+        if (gjs_context->profiler)
+            gjs_profiler_gc_begin(gjs_context->profiler);
+        break;
+    case JS::GC_SLICE_END:
+    case JS::GC_CYCLE_END:
+        gjs_gc_stats_slice_end(gjs_context->gc_stats, rt,
+                               progress == JS::GC_CYCLE_END);
+        gjs_timeline_end("gc", "GC slice", gjs_context->timeline_gc_slice_start);
+        gjs_context->timeline_gc_slice_start = 0;
+        if (progress == JS::GC_CYCLE_END) {
+            TRACE(GJS_GC_END(JS_GetGCParameter(rt, JSGC_BYTES)));
+            gjs_timeline_end("gc", "GC", gjs_context->timeline_gc_cycle_start);
+            gjs_context->timeline_gc_cycle_start = 0;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
 /**
  * gjs_context_get_all:
  *
@@ -837,8 +1489,10 @@ gjs_context_eval(GjsContext   *js_context,
 {
     gboolean ret = FALSE;
     jsval retval;
+    gint64 timeline_start;
 
     g_object_ref(G_OBJECT(js_context));
+    timeline_start = gjs_timeline_begin();
 
     if (!gjs_eval_with_scope(js_context->context,
                              js_context->global,
@@ -864,6 +1518,7 @@ gjs_context_eval(GjsContext   *js_context,
     ret = TRUE;
 
  out:
+    gjs_timeline_end("eval", filename ? filename : "<eval>", timeline_start);
     g_object_unref(G_OBJECT(js_context));
     return ret;
 }
@@ -874,21 +1529,20 @@ gjs_context_eval_file(GjsContext    *js_context,
                       int           *exit_status_p,
                       GError       **error)
 {
-    char     *script = NULL;
+    GBytes   *script_bytes = NULL;
+    const char *script;
     gsize    script_len;
     gboolean ret = TRUE;
 
     GFile *file = g_file_new_for_commandline_arg(filename);
 
-    if (!g_file_query_exists(file, NULL)) {
+    script_bytes = gjs_g_file_load_bytes(file, error);
+    if (script_bytes == NULL) {
         ret = FALSE;
         goto out;
     }
 
-    if (!g_file_load_contents(file, NULL, &script, &script_len, NULL, error)) {
-        ret = FALSE;
-        goto out;
-    }
+    script = (const char *) g_bytes_get_data(script_bytes, &script_len);
 
     if (!gjs_context_eval(js_context, script, script_len, filename, exit_status_p, error)) {
         ret = FALSE;
@@ -896,7 +1550,8 @@ gjs_context_eval_file(GjsContext    *js_context,
     }
 
 out:
-    g_free(script);
+    if (script_bytes != NULL)
+        g_bytes_unref(script_bytes);
     g_object_unref(file);
     return ret;
 }
@@ -924,6 +1579,25 @@ gjs_context_define_string_array(GjsContext  *js_context,
     return TRUE;
 }
 
+/**
+ * gjs_context_prefetch_modules:
+ * @js_context: a #GjsContext
+ * @module_ids: %NULL-terminated list of module names, dotted as in
+ *   "imports.ui.main" but without the "imports." prefix
+ *
+ * Starts loading the given modules on worker threads while the caller
+ * carries on; they are still only run when something imports them.
+ * Useful at startup, for modules that are known to be needed soon.
+ */
+void
+gjs_context_prefetch_modules(GjsContext          *js_context,
+                             const char * const  *module_ids)
+{
+    JSAutoCompartment ac(js_context->context, js_context->global);
+
+    gjs_importer_prefetch_modules(js_context->context, module_ids);
+}
+
 GjsContext *
 gjs_context_get_current(void)
 {
@@ -962,3 +1636,19 @@ gjs_context_make_current(GjsContext *context)
 {
     gjs_context_push(context);
 }
+
+/**
+ * gjs_context_remove_current:
+ * @js_context: a #GjsContext
+ *
+ * Removes one entry for @js_context from the stack of current contexts,
+ * wherever it is. Unlike gjs_context_pop(), this does not assume that
+ * @js_context was the last one made current.
+ */
+void
+gjs_context_remove_current(GjsContext *context)
+{
+    g_mutex_lock(&contexts_lock);
+    context_stack = g_list_remove(context_stack, context);
+    g_mutex_unlock(&contexts_lock);
+}
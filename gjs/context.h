@@ -42,6 +42,53 @@ typedef struct _GjsContextClass GjsContextClass;
 #define GJS_IS_CONTEXT_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE ((klass), GJS_TYPE_CONTEXT))
 #define GJS_CONTEXT_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), GJS_TYPE_CONTEXT, GjsContextClass))
 
+/**
+ * GjsGCRecord:
+ * @id: number of the collection in the context, starting at 1
+ * @start_time: monotonic time the collection started, in microseconds
+ * @end_time: monotonic time the collection finished, in microseconds
+ * @pause_time: microseconds spent in the GC, summed over all slices
+ * @max_slice_time: microseconds taken by the longest slice
+ * @reason: what asked for the collection, such as "api", "maybe-gc",
+ *   "pressure" or "engine" for one SpiderMonkey started by itself
+ * @heap_bytes_before: GC heap size when the collection started
+ * @heap_bytes_after: GC heap size when it finished
+ * @n_slices: 1 for a non-incremental collection
+ * @n_finalized_objects: GObject wrappers finalized
+ * @n_finalized_boxed: boxed and union wrappers finalized
+ * @n_finalized_gerrors: GError wrappers finalized
+ * @n_finalized_closures: closures finalized
+ * @n_finalized_functions: function wrappers finalized
+ * @n_finalized_params: GParamSpec wrappers finalized
+ * @n_finalized_total: all wrappers counted by gjs finalized
+ * @keep_alive_trace_time: microseconds spent marking keep-alive children
+ * @n_keep_alive_traced: keep-alive children marked, counted once per
+ *   keep-alive object traced
+ *
+ * Statistics about one garbage collection, see
+ * gjs_context_get_gc_records().
+ */
+typedef struct {
+    guint64     id;
+    gint64      start_time;
+    gint64      end_time;
+    gint64      pause_time;
+    gint64      max_slice_time;
+    const char *reason;
+    gsize       heap_bytes_before;
+    gsize       heap_bytes_after;
+    guint       n_slices;
+    guint       n_finalized_objects;
+    guint       n_finalized_boxed;
+    guint       n_finalized_gerrors;
+    guint       n_finalized_closures;
+    guint       n_finalized_functions;
+    guint       n_finalized_params;
+    guint       n_finalized_total;
+    gint64      keep_alive_trace_time;
+    guint       n_keep_alive_traced;
+} GjsGCRecord;
+
 GType           gjs_context_get_type             (void) G_GNUC_CONST;
 
 GjsContext*     gjs_context_new                  (void);
@@ -61,6 +108,8 @@ gboolean        gjs_context_define_string_array  (GjsContext  *js_context,
                                                   gssize         array_length,
                                                   const char   **array_values,
                                                   GError       **error);
+void            gjs_context_prefetch_modules     (GjsContext          *js_context,
+                                                  const char * const  *module_ids);
 
 GList*          gjs_context_get_all              (void);
 
@@ -68,6 +117,7 @@ GjsContext     *gjs_context_get_current          (void);
 void            gjs_context_make_current         (GjsContext *js_context);
 void            gjs_context_push                 (GjsContext *js_context);
 GjsContext     *gjs_context_pop                  (void);
+void            gjs_context_remove_current       (GjsContext *js_context);
 
 void*           gjs_context_get_native_context   (GjsContext *js_context);
 
@@ -77,6 +127,17 @@ void            gjs_context_maybe_gc              (GjsContext  *context);
 
 void            gjs_context_gc                    (GjsContext  *context);
 
+guint           gjs_context_get_gc_records        (GjsContext  *context,
+                                                   GjsGCRecord *records,
+                                                   guint        n_records);
+
+gboolean        gjs_context_dump_heap             (GjsContext  *context,
+                                                   const char  *filename,
+                                                   GError     **error);
+
+gboolean        gjs_context_dump_timeline         (GjsContext  *context,
+                                                   GError     **error);
+
 void            gjs_dumpstack                     (void);
 
 G_END_DECLS
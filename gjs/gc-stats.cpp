@@ -0,0 +1,246 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include "gc-stats.h"
+#include "mem.h"
+
+#include <util/log.h>
+
+#include <string.h>
+
+typedef struct {
+    guint objects;
+    guint boxed;
+    guint gerrors;
+    guint closures;
+    guint functions;
+    guint params;
+    guint total;
+} GjsFinalizedCounts;
+
+typedef struct {
+    gint64 keep_alive_trace_time;
+    guint n_keep_alive_traced;
+} GjsTraceCounts;
+
+/* Marking happens on the thread running the collection, which is the
+ * one owning the runtime; keep the totals per thread so contexts in
+ * different threads don't mix.
+ */
+static GPrivate trace_counts_key = G_PRIVATE_INIT(g_free);
+
+struct _GjsGCStats {
+    /* Records are written from the GC callbacks on the JS thread, but
+     * may be read from anywhere.
+     */
+    GMutex lock;
+
+    GjsGCRecord *records;
+    guint capacity;
+    guint64 n_completed;
+
+    const char *reason;
+
+    gboolean in_cycle;
+    GjsGCRecord current;
+    gint64 slice_start;
+    GjsFinalizedCounts finalized_at_start;
+    GjsTraceCounts traced_at_start;
+};
+
+static GjsTraceCounts *
+get_trace_counts(void)
+{
+    GjsTraceCounts *counts = (GjsTraceCounts *) g_private_get(&trace_counts_key);
+
+    if (G_UNLIKELY(counts == NULL)) {
+        counts = g_new0(GjsTraceCounts, 1);
+        g_private_set(&trace_counts_key, counts);
+    }
+
+    return counts;
+}
+
+void
+gjs_gc_stats_note_keep_alive_trace(gint64 trace_time,
+                                   guint  n_traced)
+{
+    GjsTraceCounts *counts = get_trace_counts();
+
+    counts->keep_alive_trace_time += trace_time;
+    counts->n_keep_alive_traced += n_traced;
+}
+
+static void
+get_finalized_counts(GjsFinalizedCounts *counts)
+{
+    counts->objects = GJS_GET_FINALIZED(object);
+    counts->boxed = GJS_GET_FINALIZED(boxed);
+    counts->gerrors = GJS_GET_FINALIZED(gerror);
+    counts->closures = GJS_GET_FINALIZED(closure);
+    counts->functions = GJS_GET_FINALIZED(function);
+    counts->params = GJS_GET_FINALIZED(param);
+    counts->total = GJS_GET_FINALIZED(everything);
+}
+
+GjsGCStats *
+gjs_gc_stats_new(guint capacity)
+{
+    GjsGCStats *self;
+
+    g_return_val_if_fail(capacity > 0, NULL);
+
+    self = g_slice_new0(GjsGCStats);
+    g_mutex_init(&self->lock);
+    self->records = g_new0(GjsGCRecord, capacity);
+    self->capacity = capacity;
+
+    return self;
+}
+
+void
+gjs_gc_stats_free(GjsGCStats *self)
+{
+    g_mutex_clear(&self->lock);
+    g_free(self->records);
+    g_slice_free(GjsGCStats, self);
+}
+
+void
+gjs_gc_stats_set_reason(GjsGCStats *self,
+                        const char *reason)
+{
+    self->reason = reason;
+}
+
+void
+gjs_gc_stats_slice_begin(GjsGCStats *self,
+                         JSRuntime  *runtime,
+                         gboolean    first)
+{
+    self->slice_start = g_get_monotonic_time();
+
+    /* A cycle we never saw the start of, e.g. one that was already
+     * running when we were hooked up, is recorded from here.
+     */
+    if (first || !self->in_cycle) {
+        memset(&self->current, 0, sizeof(GjsGCRecord));
+        self->current.start_time = self->slice_start;
+        self->current.reason = self->reason ? self->reason : "engine";
+        self->current.heap_bytes_before = JS_GetGCParameter(runtime, JSGC_BYTES);
+        get_finalized_counts(&self->finalized_at_start);
+        self->traced_at_start = *get_trace_counts();
+        self->in_cycle = TRUE;
+    }
+}
+
+void
+gjs_gc_stats_slice_end(GjsGCStats *self,
+                       JSRuntime  *runtime,
+                       gboolean    last)
+{
+    GjsGCRecord *record = &self->current;
+    GjsFinalizedCounts now;
+    GjsTraceCounts *traced;
+    gint64 slice_time;
+
+    if (!self->in_cycle)
+        return;
+
+    record->end_time = g_get_monotonic_time();
+    slice_time = record->end_time - self->slice_start;
+    record->pause_time += slice_time;
+    record->max_slice_time = MAX(record->max_slice_time, slice_time);
+    record->n_slices++;
+
+    if (!last)
+        return;
+
+    record->heap_bytes_after = JS_GetGCParameter(runtime, JSGC_BYTES);
+
+    get_finalized_counts(&now);
+    record->n_finalized_objects = now.objects - self->finalized_at_start.objects;
+    record->n_finalized_boxed = now.boxed - self->finalized_at_start.boxed;
+    record->n_finalized_gerrors = now.gerrors - self->finalized_at_start.gerrors;
+    record->n_finalized_closures = now.closures - self->finalized_at_start.closures;
+    record->n_finalized_functions = now.functions - self->finalized_at_start.functions;
+    record->n_finalized_params = now.params - self->finalized_at_start.params;
+    record->n_finalized_total = now.total - self->finalized_at_start.total;
+
+    traced = get_trace_counts();
+    record->keep_alive_trace_time =
+        traced->keep_alive_trace_time - self->traced_at_start.keep_alive_trace_time;
+    record->n_keep_alive_traced =
+        traced->n_keep_alive_traced - self->traced_at_start.n_keep_alive_traced;
+
+    g_mutex_lock(&self->lock);
+    record->id = ++self->n_completed;
+    self->records[(record->id - 1) % self->capacity] = *record;
+    g_mutex_unlock(&self->lock);
+
+    gjs_debug(GJS_DEBUG_CONTEXT,
+              "GC %" G_GUINT64_FORMAT " (%s): %" G_GINT64_FORMAT " us in %u slices, "
+              "heap %" G_GSIZE_FORMAT " -> %" G_GSIZE_FORMAT " bytes, "
+              "%u wrappers finalized, %" G_GINT64_FORMAT " us tracing "
+              "%u keep-alive children",
+              record->id, record->reason, record->pause_time, record->n_slices,
+              record->heap_bytes_before, record->heap_bytes_after,
+              record->n_finalized_total, record->keep_alive_trace_time,
+              record->n_keep_alive_traced);
+
+    self->in_cycle = FALSE;
+}
+
+/**
+ * gjs_gc_stats_get_records:
+ * @self: a #GjsGCStats
+ * @records: (out caller-allocates): array to fill
+ * @n_records: size of @records
+ *
+ * Copies up to @n_records of the most recent collections into
+ * @records, oldest first.
+ *
+ * Returns: the number of records copied
+ */
+guint
+gjs_gc_stats_get_records(GjsGCStats  *self,
+                         GjsGCRecord *records,
+                         guint        n_records)
+{
+    guint64 first;
+    guint64 id;
+    guint n;
+
+    g_mutex_lock(&self->lock);
+
+    n = (guint) MIN(self->n_completed, (guint64) MIN(n_records, self->capacity));
+    first = self->n_completed - n + 1;
+    for (id = first; id <= self->n_completed; id++)
+        records[id - first] = self->records[(id - 1) % self->capacity];
+
+    g_mutex_unlock(&self->lock);
+
+    return n;
+}
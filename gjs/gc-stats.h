@@ -0,0 +1,66 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GJS_GC_STATS_H__
+#define __GJS_GC_STATS_H__
+
+#include <glib.h>
+#include "context.h"
+#include "jsapi-util.h"
+
+G_BEGIN_DECLS
+
+/* Keeps the last few GjsGCRecords of a runtime in a ring buffer, fed
+ * from its GC slice callback.
+ */
+typedef struct _GjsGCStats GjsGCStats;
+
+GjsGCStats *gjs_gc_stats_new  (guint       capacity);
+void        gjs_gc_stats_free (GjsGCStats *self);
+
+/* @reason must be a static string; it is used for collections started
+ * until it is set back to NULL.
+ */
+void gjs_gc_stats_set_reason  (GjsGCStats *self,
+                               const char *reason);
+
+void gjs_gc_stats_slice_begin (GjsGCStats *self,
+                               JSRuntime  *runtime,
+                               gboolean    first);
+void gjs_gc_stats_slice_end   (GjsGCStats *self,
+                               JSRuntime  *runtime,
+                               gboolean    last);
+
+/* Called by roots that gjs traces itself, from the marking tracer.
+ * The time is added to whatever collection is running on this thread.
+ */
+void gjs_gc_stats_note_keep_alive_trace (gint64 trace_time,
+                                         guint  n_traced);
+
+guint gjs_gc_stats_get_records (GjsGCStats  *self,
+                                GjsGCRecord *records,
+                                guint        n_records);
+
+G_END_DECLS
+
+#endif /* __GJS_GC_STATS_H__ */
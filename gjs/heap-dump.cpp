@@ -0,0 +1,330 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include "heap-dump.h"
+#include "context.h"
+#include <gi/object.h>
+#include <gi/boxed.h>
+
+#include <util/log.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* Heap snapshots are written one line per record, so two of them can
+ * be compared with line-based tools while the process keeps running:
+ *
+ *   # gjs heap snapshot 1 pid PID time USEC
+ *   R ADDRESS NAME                  a root and what rooted it
+ *   N ADDRESS KIND DESCRIPTION      a live GC thing...
+ *   E FROM TO NAME                  ...followed by its outgoing edges
+ *
+ * Object descriptions are the JSClass name, with "gobject=TYPE" or
+ * "boxed=TYPE" for GI wrappers, "prototype" for the per-type
+ * prototypes, and "toggle-root" on GObject wrappers that are being
+ * kept alive by their toggle reference.
+ */
+
+typedef struct {
+    void *thing;
+    JSGCTraceKind kind;
+} PendingThing;
+
+typedef struct {
+    JSTracer base;              /* must be first */
+    FILE *fp;
+    GHashTable *visited;
+    GQueue pending;             /* PendingThing */
+    void *source;               /* NULL while tracing roots */
+} HeapDumper;
+
+static char *heap_dump_output = NULL;
+static guint heap_dump_counter = 0;
+static guint heap_dump_idle = 0;
+static struct sigaction chained_sigaction;
+
+static const char *
+trace_kind_name(JSGCTraceKind kind)
+{
+    switch (kind) {
+    case JSTRACE_OBJECT:
+        return "object";
+    case JSTRACE_STRING:
+        return "string";
+    case JSTRACE_SCRIPT:
+        return "script";
+    case JSTRACE_LAZY_SCRIPT:
+        return "lazy_script";
+    case JSTRACE_IONCODE:
+        return "ioncode";
+    case JSTRACE_SHAPE:
+        return "shape";
+    case JSTRACE_BASE_SHAPE:
+        return "base_shape";
+    case JSTRACE_TYPE_OBJECT:
+        return "type_object";
+    default:
+        return "unknown";
+    }
+}
+
+/* Same as JS_GetTraceEdgeName(), which is only there in debug builds
+ * of SpiderMonkey.
+ */
+static void
+get_edge_name(JSTracer *trc,
+              char     *buf,
+              size_t    size)
+{
+    if (trc->debugPrinter != NULL)
+        trc->debugPrinter(trc, buf, size);
+    else if (trc->debugPrintIndex != (size_t) -1)
+        g_snprintf(buf, size, "%s[%" G_GSIZE_FORMAT "]",
+                   (const char *) trc->debugPrintArg, trc->debugPrintIndex);
+    else
+        g_snprintf(buf, size, "%s", (const char *) trc->debugPrintArg);
+}
+
+static void
+heap_dumper_trace(JSTracer      *trc,
+                  void         **thingp,
+                  JSGCTraceKind  kind)
+{
+    HeapDumper *self = (HeapDumper *) trc;
+    void *thing = *thingp;
+    char edge_name[256];
+
+    if (thing == NULL)
+        return;
+
+    get_edge_name(trc, edge_name, sizeof(edge_name));
+
+    if (self->source == NULL)
+        fprintf(self->fp, "R %p %s\n", thing, edge_name);
+    else
+        fprintf(self->fp, "E %p %p %s\n", self->source, thing, edge_name);
+
+    if (!g_hash_table_contains(self->visited, thing)) {
+        PendingThing *pending = g_slice_new(PendingThing);
+
+        g_hash_table_add(self->visited, thing);
+        pending->thing = thing;
+        pending->kind = kind;
+        g_queue_push_tail(&self->pending, pending);
+    }
+}
+
+static void
+write_object_description(FILE     *fp,
+                         JSObject *obj)
+{
+    const char *type_name;
+    gboolean is_prototype = FALSE;
+    gboolean toggle_rooted = FALSE;
+
+    fprintf(fp, " %s", JS_GetClass(obj)->name);
+
+    type_name = gjs_object_get_heap_dump_info(obj, &is_prototype, &toggle_rooted);
+    if (type_name != NULL) {
+        fprintf(fp, " gobject=%s", type_name);
+    } else {
+        type_name = gjs_boxed_get_heap_dump_info(obj, &is_prototype);
+        if (type_name != NULL)
+            fprintf(fp, " boxed=%s", type_name);
+    }
+
+    if (is_prototype)
+        fputs(" prototype", fp);
+    if (toggle_rooted)
+        fputs(" toggle-root", fp);
+}
+
+static void
+write_thing(HeapDumper   *self,
+            PendingThing *pending)
+{
+    fprintf(self->fp, "N %p %s", pending->thing, trace_kind_name(pending->kind));
+
+    if (pending->kind == JSTRACE_OBJECT)
+        write_object_description(self->fp, (JSObject *) pending->thing);
+    else if (pending->kind == JSTRACE_STRING)
+        fprintf(self->fp, " length=%" G_GSIZE_FORMAT,
+                JS_GetStringLength((JSString *) pending->thing));
+
+    fputc('\n', self->fp);
+
+    self->source = pending->thing;
+    JS_TraceChildren(&self->base, pending->thing, pending->kind);
+}
+
+/**
+ * gjs_dump_heap:
+ * @context: the JS context
+ * @filename: file to write the snapshot to
+ * @error: return location for a #GError
+ *
+ * Collects garbage, then writes every GC thing still alive in the
+ * runtime of @context, with the edges between them, to @filename.
+ *
+ * Returns: %FALSE if @filename couldn't be written
+ */
+gboolean
+gjs_dump_heap(JSContext   *context,
+              const char  *filename,
+              GError     **error)
+{
+    JSRuntime *runtime = JS_GetRuntime(context);
+    HeapDumper dumper;
+    PendingThing *pending;
+    gint64 start;
+    guint n_things = 0;
+    gboolean ret;
+
+    dumper.fp = fopen(filename, "w");
+    if (dumper.fp == NULL) {
+        int errsv = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errsv),
+                    "Failed to open %s: %s", filename, g_strerror(errsv));
+        return FALSE;
+    }
+
+    /* Only what is really reachable, and no incremental GC half done */
+    JS_GC(runtime);
+
+    start = g_get_monotonic_time();
+    fprintf(dumper.fp, "# gjs heap snapshot 1 pid %u time %" G_GINT64_FORMAT "\n",
+            (guint) getpid(), g_get_real_time());
+
+    JS_TracerInit(&dumper.base, runtime, heap_dumper_trace);
+    dumper.visited = g_hash_table_new(NULL, NULL);
+    g_queue_init(&dumper.pending);
+    dumper.source = NULL;
+
+    /* Nothing here allocates GC things, so no GC can run under us */
+    JS_TraceRuntime(&dumper.base);
+
+    while ((pending = (PendingThing *) g_queue_pop_head(&dumper.pending)) != NULL) {
+        write_thing(&dumper, pending);
+        g_slice_free(PendingThing, pending);
+        n_things++;
+    }
+
+    g_hash_table_destroy(dumper.visited);
+
+    ret = !ferror(dumper.fp);
+    if (fclose(dumper.fp) != 0)
+        ret = FALSE;
+
+    if (!ret) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_IO,
+                    "Failed to write heap snapshot to %s", filename);
+        return FALSE;
+    }
+
+    gjs_debug(GJS_DEBUG_CONTEXT,
+              "Wrote %u GC things to %s in %" G_GINT64_FORMAT " us",
+              n_things, filename, g_get_monotonic_time() - start);
+
+    return TRUE;
+}
+
+static gboolean
+dump_heap_idle(gpointer user_data)
+{
+    GList *contexts;
+    GList *l;
+
+    heap_dump_idle = 0;
+
+    contexts = gjs_context_get_all();
+    for (l = contexts; l != NULL; l = l->next) {
+        GjsContext *js_context = (GjsContext *) l->data;
+        char *filename;
+        GError *error = NULL;
+
+        filename = g_strdup_printf("%s.%u.%u",
+                                   heap_dump_output,
+                                   (guint) getpid(),
+                                   heap_dump_counter);
+        heap_dump_counter += 1;
+
+        if (!gjs_context_dump_heap(js_context, filename, &error)) {
+            g_printerr("%s\n", error->message);
+            g_error_free(error);
+        }
+
+        g_free(filename);
+        g_object_unref(js_context);
+    }
+    g_list_free(contexts);
+
+    return FALSE;
+}
+
+static void
+dump_heap_signal_handler(int signum)
+{
+    if (heap_dump_idle == 0)
+        heap_dump_idle = g_idle_add_full(G_PRIORITY_HIGH_IDLE,
+                                         dump_heap_idle,
+                                         NULL, NULL);
+
+    /* GJS_DEBUG_MEMORY_OUTPUT may have SIGUSR2 too */
+    if (chained_sigaction.sa_handler != SIG_DFL &&
+        chained_sigaction.sa_handler != SIG_IGN &&
+        chained_sigaction.sa_handler != NULL)
+        chained_sigaction.sa_handler(signum);
+}
+
+/**
+ * gjs_heap_dump_init_signal:
+ *
+ * If GJS_DEBUG_HEAP_OUTPUT is set, makes SIGUSR2 write a heap snapshot
+ * of every context to a file named after it, the process ID and a
+ * counter, from the main loop.
+ */
+void
+gjs_heap_dump_init_signal(void)
+{
+    const char *output;
+    struct sigaction sa;
+
+    if (heap_dump_output != NULL)
+        return;
+
+    output = g_getenv("GJS_DEBUG_HEAP_OUTPUT");
+    if (output == NULL || *output == '\0')
+        return;
+
+    heap_dump_output = g_strdup(output);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = dump_heap_signal_handler;
+    sigaction(SIGUSR2, &sa, &chained_sigaction);
+}
@@ -0,0 +1,416 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include "import-trace.h"
+
+#include <util/log.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+typedef struct _GjsImportNode GjsImportNode;
+
+typedef struct {
+    GjsImportPhase phase;
+    gint64 start;
+    gint64 end;
+} GjsImportSegment;
+
+struct _GjsImportNode {
+    GjsImportNode *parent;
+    GPtrArray *children;        /* GjsImportNode, owned */
+
+    char *name;
+    char *file;
+    gboolean success;
+
+    gint64 start;
+    gint64 end;
+
+    GjsImportPhase phase;
+    gint64 phase_start;
+    GArray *segments;           /* GjsImportSegment, for the Chrome trace */
+
+    /* Inclusive time spent in each phase, and how much of that went
+     * to imports nested inside it.
+     */
+    gint64 phase_time[GJS_IMPORT_N_PHASES];
+    gint64 nested_time[GJS_IMPORT_N_PHASES];
+};
+
+struct _GjsImportTrace {
+    JSRuntime *runtime;
+    char *output;
+    gint64 start;
+
+    GPtrArray *roots;           /* GjsImportNode, owned */
+    GjsImportNode *current;
+};
+
+static const char *phase_names[] = {
+    "resolve", "read", "compile", "execute"
+};
+
+G_STATIC_ASSERT(G_N_ELEMENTS(phase_names) == GJS_IMPORT_N_PHASES);
+
+static void
+import_node_free(GjsImportNode *node)
+{
+    g_ptr_array_free(node->children, TRUE);
+    g_array_free(node->segments, TRUE);
+    g_free(node->name);
+    g_free(node->file);
+    g_slice_free(GjsImportNode, node);
+}
+
+static void
+import_node_close_phase(GjsImportNode *node,
+                        gint64         now)
+{
+    GjsImportSegment segment;
+
+    node->phase_time[node->phase] += now - node->phase_start;
+
+    segment.phase = node->phase;
+    segment.start = node->phase_start;
+    segment.end = now;
+    g_array_append_val(node->segments, segment);
+}
+
+static inline GjsImportTrace *
+get_trace(JSContext *context)
+{
+    return gjs_runtime_get_import_trace(JS_GetRuntime(context));
+}
+
+void
+gjs_import_trace_begin(JSContext  *context,
+                       const char *module_name)
+{
+    GjsImportTrace *self = get_trace(context);
+    GjsImportNode *node;
+
+    if (G_LIKELY(self == NULL))
+        return;
+
+    node = g_slice_new0(GjsImportNode);
+    node->parent = self->current;
+    node->children = g_ptr_array_new_with_free_func((GDestroyNotify) import_node_free);
+    node->segments = g_array_new(FALSE, FALSE, sizeof(GjsImportSegment));
+    node->name = g_strdup(module_name);
+    node->start = g_get_monotonic_time();
+    node->phase = GJS_IMPORT_PHASE_RESOLVE;
+    node->phase_start = node->start;
+
+    if (node->parent != NULL)
+        g_ptr_array_add(node->parent->children, node);
+    else
+        g_ptr_array_add(self->roots, node);
+
+    self->current = node;
+}
+
+void
+gjs_import_trace_set_file(JSContext  *context,
+                          const char *full_path)
+{
+    GjsImportTrace *self = get_trace(context);
+
+    if (G_LIKELY(self == NULL) || self->current == NULL)
+        return;
+
+    g_free(self->current->file);
+    self->current->file = g_strdup(full_path);
+}
+
+void
+gjs_import_trace_phase(JSContext      *context,
+                       GjsImportPhase  phase)
+{
+    GjsImportTrace *self = get_trace(context);
+    GjsImportNode *node;
+    gint64 now;
+
+    if (G_LIKELY(self == NULL) || self->current == NULL)
+        return;
+
+    node = self->current;
+    if (node->phase == phase)
+        return;
+
+    now = g_get_monotonic_time();
+    import_node_close_phase(node, now);
+    node->phase = phase;
+    node->phase_start = now;
+}
+
+static void
+import_trace_end(GjsImportTrace *self,
+                 gboolean        success)
+{
+    GjsImportNode *node;
+    gint64 now;
+
+    node = self->current;
+    now = g_get_monotonic_time();
+    import_node_close_phase(node, now);
+    node->end = now;
+    node->success = success;
+
+    if (node->parent != NULL)
+        node->parent->nested_time[node->parent->phase] += node->end - node->start;
+
+    self->current = node->parent;
+}
+
+void
+gjs_import_trace_end(JSContext *context,
+                     gboolean   success)
+{
+    GjsImportTrace *self = get_trace(context);
+
+    if (G_LIKELY(self == NULL) || self->current == NULL)
+        return;
+
+    import_trace_end(self, success);
+}
+
+/* Ends the current import as failed, or forgets it altogether if it
+ * never got as far as finding a file.
+ */
+void
+gjs_import_trace_cancel(JSContext *context)
+{
+    GjsImportTrace *self = get_trace(context);
+    GjsImportNode *node;
+    GPtrArray *siblings;
+
+    if (G_LIKELY(self == NULL) || self->current == NULL)
+        return;
+
+    node = self->current;
+    if (node->file != NULL) {
+        import_trace_end(self, FALSE);
+        return;
+    }
+
+    self->current = node->parent;
+    siblings = node->parent != NULL ? node->parent->children : self->roots;
+    g_ptr_array_remove(siblings, node);
+}
+
+static void
+dump_tree_node(FILE          *fp,
+               GjsImportNode *node,
+               int            depth)
+{
+    gint64 total, nested;
+    int i;
+    guint j;
+
+    total = node->end - node->start;
+    nested = 0;
+    for (i = 0; i < GJS_IMPORT_N_PHASES; i++)
+        nested += node->nested_time[i];
+
+    /* total self resolve read compile execute execute-self module */
+    fprintf(fp, "%9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f  %*s%s%s%s%s%s\n",
+            total / 1000.,
+            (total - nested) / 1000.,
+            node->phase_time[GJS_IMPORT_PHASE_RESOLVE] / 1000.,
+            node->phase_time[GJS_IMPORT_PHASE_READ] / 1000.,
+            node->phase_time[GJS_IMPORT_PHASE_COMPILE] / 1000.,
+            node->phase_time[GJS_IMPORT_PHASE_EXECUTE] / 1000.,
+            (node->phase_time[GJS_IMPORT_PHASE_EXECUTE] -
+             node->nested_time[GJS_IMPORT_PHASE_EXECUTE]) / 1000.,
+            depth * 2, "",
+            node->name,
+            node->file ? " (" : "",
+            node->file ? node->file : "",
+            node->file ? ")" : "",
+            node->success ? "" : " FAILED");
+
+    for (j = 0; j < node->children->len; j++)
+        dump_tree_node(fp, (GjsImportNode *) node->children->pdata[j], depth + 1);
+}
+
+static void
+dump_json_string(FILE       *fp,
+                 const char *str)
+{
+    const char *p;
+
+    fputc('"', fp);
+    for (p = str; *p != '\0'; p++) {
+        switch (*p) {
+        case '"':
+            fputs("\\\"", fp);
+            break;
+        case '\\':
+            fputs("\\\\", fp);
+            break;
+        default:
+            if ((guchar) *p < 0x20)
+                fprintf(fp, "\\u%04x", (guchar) *p);
+            else
+                fputc(*p, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static void
+dump_chrome_node(FILE          *fp,
+                 GjsImportTrace *self,
+                 GjsImportNode *node,
+                 gboolean      *first)
+{
+    guint pid = (guint) getpid();
+    int i;
+    guint j;
+
+    /* Complete ("X") events nest by time, so the viewer shows the
+     * importer chain as a flame graph, with the phases underneath.
+     */
+    fprintf(fp, "%s\n{\"name\":", *first ? "" : ",");
+    *first = FALSE;
+    dump_json_string(fp, node->name);
+    fprintf(fp, ",\"cat\":\"import\",\"ph\":\"X\",\"pid\":%u,\"tid\":1,"
+            "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ",\"args\":{",
+            pid, node->start - self->start, node->end - node->start);
+    fputs("\"file\":", fp);
+    dump_json_string(fp, node->file ? node->file : "");
+    fprintf(fp, ",\"success\":%s", node->success ? "true" : "false");
+    for (i = 0; i < GJS_IMPORT_N_PHASES; i++) {
+        fprintf(fp, ",\"%s_us\":%" G_GINT64_FORMAT ",\"%s_self_us\":%" G_GINT64_FORMAT,
+                phase_names[i], node->phase_time[i],
+                phase_names[i], node->phase_time[i] - node->nested_time[i]);
+    }
+    fputs("}}", fp);
+
+    for (j = 0; j < node->segments->len; j++) {
+        GjsImportSegment *segment = &g_array_index(node->segments, GjsImportSegment, j);
+
+        fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"import.phase\",\"ph\":\"X\","
+                "\"pid\":%u,\"tid\":1,"
+                "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT "}",
+                phase_names[segment->phase], pid,
+                segment->start - self->start, segment->end - segment->start);
+    }
+
+    for (j = 0; j < node->children->len; j++)
+        dump_chrome_node(fp, self, (GjsImportNode *) node->children->pdata[j], first);
+}
+
+/* Writes the trace recorded so far to the output file, as Chrome trace
+ * event JSON (for chrome://tracing) if its name ends in ".json" and as
+ * an indented text tree otherwise. Times in the tree are milliseconds.
+ */
+void
+gjs_import_trace_dump(GjsImportTrace *self)
+{
+    FILE *fp;
+    gboolean first = TRUE;
+    guint i;
+
+    fp = fopen(self->output, "w");
+    if (!fp) {
+        gjs_debug(GJS_DEBUG_IMPORTER,
+                  "Could not open import trace output '%s'", self->output);
+        return;
+    }
+
+    if (g_str_has_suffix(self->output, ".json")) {
+        fputs("{\"traceEvents\":[", fp);
+        for (i = 0; i < self->roots->len; i++)
+            dump_chrome_node(fp, self, (GjsImportNode *) self->roots->pdata[i], &first);
+        fputs("\n],\"displayTimeUnit\":\"ms\"}\n", fp);
+    } else {
+        fprintf(fp, "%9s %9s %9s %9s %9s %9s %9s  %s\n",
+                "total", "self", "resolve", "read", "compile", "execute", "exec-self",
+                "module");
+        for (i = 0; i < self->roots->len; i++)
+            dump_tree_node(fp, (GjsImportNode *) self->roots->pdata[i], 0);
+    }
+
+    fclose(fp);
+}
+
+/**
+ * gjs_import_trace_new:
+ * @runtime: the runtime whose imports to trace
+ * @output: file to write the trace to when it is freed, or %NULL to
+ *   use $GJS_DEBUG_IMPORT_TRACE_OUTPUT
+ *
+ * Returns: a new trace that records every import into @runtime from
+ * now on, or %NULL if no output was given or @runtime is already being
+ * traced.
+ */
+GjsImportTrace *
+gjs_import_trace_new(JSRuntime  *runtime,
+                     const char *output)
+{
+    GjsImportTrace *self;
+
+    if (output == NULL)
+        output = g_getenv("GJS_DEBUG_IMPORT_TRACE_OUTPUT");
+    if (output == NULL || *output == '\0')
+        return NULL;
+
+    if (gjs_runtime_get_import_trace(runtime) != NULL) {
+        gjs_debug(GJS_DEBUG_IMPORTER,
+                  "Import trace already running, not tracing to '%s'", output);
+        return NULL;
+    }
+
+    self = g_slice_new0(GjsImportTrace);
+    self->output = g_strdup(output);
+    self->start = g_get_monotonic_time();
+    self->roots = g_ptr_array_new_with_free_func((GDestroyNotify) import_node_free);
+    self->runtime = runtime;
+
+    gjs_runtime_set_import_trace(runtime, self);
+
+    return self;
+}
+
+void
+gjs_import_trace_free(GjsImportTrace *self)
+{
+    /* Close imports still in progress, e.g. when exiting from a module */
+    while (self->current != NULL)
+        import_trace_end(self, FALSE);
+
+    gjs_import_trace_dump(self);
+
+    g_assert(gjs_runtime_get_import_trace(self->runtime) == self);
+    gjs_runtime_set_import_trace(self->runtime, NULL);
+
+    g_ptr_array_free(self->roots, TRUE);
+    g_free(self->output);
+    g_slice_free(GjsImportTrace, self);
+}
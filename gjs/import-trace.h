@@ -0,0 +1,64 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GJS_IMPORT_TRACE_H__
+#define __GJS_IMPORT_TRACE_H__
+
+#include <glib.h>
+#include "gjs/jsapi-util.h"
+
+G_BEGIN_DECLS
+
+/* Records where the time goes when modules are imported into a
+ * runtime. The gjs_import_trace_* calls the importer makes are no-ops
+ * when the runtime of @context has no trace.
+ */
+typedef struct _GjsImportTrace GjsImportTrace;
+
+typedef enum {
+    GJS_IMPORT_PHASE_RESOLVE,   /* walking the search path */
+    GJS_IMPORT_PHASE_READ,      /* mapping the file or bundle entry */
+    GJS_IMPORT_PHASE_COMPILE,   /* decoding bytecode */
+    GJS_IMPORT_PHASE_EXECUTE,   /* evaluating the module; for source, this
+                                 * includes parsing it */
+    GJS_IMPORT_N_PHASES
+} GjsImportPhase;
+
+GjsImportTrace *gjs_import_trace_new  (JSRuntime      *runtime,
+                                       const char     *output);
+void            gjs_import_trace_free (GjsImportTrace *self);
+void            gjs_import_trace_dump (GjsImportTrace *self);
+
+void gjs_import_trace_begin    (JSContext      *context,
+                                const char     *module_name);
+void gjs_import_trace_set_file (JSContext      *context,
+                                const char     *full_path);
+void gjs_import_trace_phase    (JSContext      *context,
+                                GjsImportPhase  phase);
+void gjs_import_trace_end      (JSContext      *context,
+                                gboolean        success);
+void gjs_import_trace_cancel   (JSContext      *context);
+
+G_END_DECLS
+
+#endif /* __GJS_IMPORT_TRACE_H__ */
@@ -30,6 +30,10 @@
 #include <gjs/importer.h>
 #include <gjs/compat.h>
 #include <gjs/runtime.h>
+#include <gjs/bundle.h>
+#include <gjs/import-trace.h>
+#include <gjs/timeline.h>
+#include <gi/gjs_gi_trace.h>
 
 #include <gio/gio.h>
 
@@ -256,22 +260,589 @@ create_module_object(JSContext *context)
     return JS_NewObject(context, NULL, NULL, NULL);
 }
 
+/* Module paths are either anything GFile understands, or paths inside
+ * a bundle (see bundle.h). These helpers hide the difference from the
+ * rest of the importer.
+ */
+static char *
+build_module_path(const char *dirname,
+                  const char *name)
+{
+    /* The root of a bundle is just "bundle:/path/to/file" */
+    if (g_str_has_prefix(dirname, GJS_BUNDLE_URI_PREFIX) &&
+        strchr(dirname, GJS_BUNDLE_URI_SEPARATOR) == NULL)
+        return g_strdup_printf("%s%c/%s", dirname, GJS_BUNDLE_URI_SEPARATOR, name);
+
+    return g_build_filename(dirname, name, NULL);
+}
+
+static gboolean
+module_path_is_directory(const char *full_path)
+{
+    GjsBundle *bundle;
+    const char *inner_path;
+    GFile *gfile;
+    gboolean ret;
+
+    if (g_str_has_prefix(full_path, GJS_BUNDLE_URI_PREFIX)) {
+        bundle = gjs_bundle_get_for_uri(full_path, &inner_path);
+        return bundle != NULL && gjs_bundle_is_directory(bundle, inner_path);
+    }
+
+    gfile = g_file_new_for_commandline_arg(full_path);
+    ret = g_file_query_file_type(gfile, (GFileQueryInfoFlags) 0, NULL) == G_FILE_TYPE_DIRECTORY;
+    g_object_unref(gfile);
+
+    return ret;
+}
+
+static gboolean
+module_path_exists(const char *full_path)
+{
+    GjsBundle *bundle;
+    const char *inner_path;
+    GFile *gfile;
+    gboolean ret;
+
+    if (g_str_has_prefix(full_path, GJS_BUNDLE_URI_PREFIX)) {
+        bundle = gjs_bundle_get_for_uri(full_path, &inner_path);
+        return bundle != NULL && gjs_bundle_lookup(bundle, inner_path, NULL, NULL);
+    }
+
+    gfile = g_file_new_for_commandline_arg(full_path);
+    ret = g_file_query_exists(gfile, NULL);
+    g_object_unref(gfile);
+
+    return ret;
+}
+
+/* Returns the source of the module at @full_path, and its precompiled
+ * bytecode if it comes from a bundle that has bytecode made by this
+ * version of SpiderMonkey. Local files are mapped rather than read, so
+ * the source is compiled straight out of the page cache.
+ */
+static GBytes *
+load_module_source(const char  *full_path,
+                   GBytes     **bytecode_out,
+                   char       **parse_name_out,
+                   GError     **error)
+{
+    GjsBundle *bundle;
+    const char *inner_path;
+    GBytes *source;
+    GFile *gfile;
+
+    *bytecode_out = NULL;
+
+    if (g_str_has_prefix(full_path, GJS_BUNDLE_URI_PREFIX)) {
+        bundle = gjs_bundle_get_for_uri(full_path, &inner_path);
+        if (bundle == NULL ||
+            !gjs_bundle_lookup(bundle, inner_path, &source, bytecode_out)) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                        "No module '%s' in bundle", full_path);
+            return NULL;
+        }
+
+        if (*bytecode_out != NULL &&
+            strcmp(gjs_bundle_get_engine(bundle), JS_GetImplementationVersion()) != 0) {
+            gjs_debug(GJS_DEBUG_IMPORTER,
+                      "Ignoring bytecode for '%s' made by %s",
+                      full_path, gjs_bundle_get_engine(bundle));
+            g_bytes_unref(*bytecode_out);
+            *bytecode_out = NULL;
+        }
+
+        *parse_name_out = g_strdup(full_path);
+        return source;
+    }
+
+    gfile = g_file_new_for_commandline_arg(full_path);
+    source = gjs_g_file_load_bytes(gfile, error);
+    if (source != NULL)
+        *parse_name_out = g_file_get_parse_name(gfile);
+    g_object_unref(gfile);
+
+    return source;
+}
+
+/* Returns TRUE if the bytecode could be decoded, in which case
+ * *result_p says whether running it succeeded. Otherwise the caller
+ * should fall back to the source.
+ */
+static gboolean
+eval_module_bytecode(JSContext *context,
+                     JSObject  *module_obj,
+                     GBytes    *bytecode,
+                     JSBool    *result_p)
+{
+    gconstpointer data;
+    gsize len;
+    jsval retval = JSVAL_VOID;
+
+    data = g_bytes_get_data(bytecode, &len);
+
+    JS_BeginRequest(context);
+    JSAutoCompartment ac(context, module_obj);
+
+    JS::RootedScript script(context, JS_DecodeScript(context, data, len, NULL, NULL));
+    if (!script) {
+        JS_ClearPendingException(context);
+        JS_EndRequest(context);
+        return FALSE;
+    }
+
+    gjs_import_trace_phase(context, GJS_IMPORT_PHASE_EXECUTE);
+    *result_p = JS_ExecuteScript(context, module_obj, script, &retval);
+    if (!*result_p)
+        gjs_log_exception(context);
+
+    JS_EndRequest(context);
+    return TRUE;
+}
+
+/* Module prefetching.
+ *
+ * gjs_importer_prefetch_modules() hands a list of module ids to a pool
+ * of worker threads, which resolve them against the root importer's
+ * search path, map them and convert them to UTF-16. When the module is
+ * later imported, import_file() picks up the converted text and only the
+ * parse and execution are left for the main thread. Modules are still
+ * run lazily, in whatever order the imports happen.
+ *
+ * Each context has its own table, since a module is imported once per
+ * context. Entries stay in it once they have been consumed or have
+ * failed to load, so that a worker which resolves a path late does not
+ * load a module the context has already imported; the table goes away
+ * with the context (see gjs_importer_forget_prefetched_modules()).
+ */
+typedef enum {
+    PREFETCH_LOADING,
+    PREFETCH_READY,
+    PREFETCH_DONE
+} PrefetchState;
+
+typedef struct {
+    PrefetchState state;
+    gunichar2 *chars;
+    glong n_chars;
+    int start_line_number;
+    char *parse_name;
+} PrefetchedModule;
+
+typedef struct {
+    guint ref_count;
+    GHashTable *modules;
+    /* Jobs that have not yet decided which file they are loading */
+    guint unresolved;
+    /* The context has gone away */
+    gboolean forgotten;
+} PrefetchTable;
+
+typedef struct {
+    PrefetchTable *table;
+    char **search_path;
+    char *module_id;
+} PrefetchJob;
+
+/* Everything below is protected by prefetch_lock */
+static GMutex prefetch_lock;
+static GCond prefetch_cond;
+static GThreadPool *prefetch_pool = NULL;
+/* JSContext -> PrefetchTable */
+static GHashTable *prefetch_tables = NULL;
+
+/* Number of entries in prefetch_tables, written with prefetch_lock
+ * held but read without it, so that importing in a process that never
+ * prefetched does not take the lock. A context only gets a table from
+ * its own thread, so seeing 0 means it has none.
+ */
+static volatile gint n_prefetch_tables = 0;
+
+static void
+prefetched_module_free(PrefetchedModule *module)
+{
+    g_free(module->chars);
+    g_free(module->parse_name);
+    g_slice_free(PrefetchedModule, module);
+}
+
+static PrefetchTable *
+prefetch_table_new(void)
+{
+    PrefetchTable *table = g_slice_new0(PrefetchTable);
+
+    table->ref_count = 1;
+    table->modules = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                           (GDestroyNotify) prefetched_module_free);
+    return table;
+}
+
+/* Called with prefetch_lock held. Workers hold a reference, so a table
+ * outlives its context until the jobs queued for it have run.
+ */
+static void
+prefetch_table_unref(PrefetchTable *table)
+{
+    if (--table->ref_count > 0)
+        return;
+
+    g_hash_table_destroy(table->modules);
+    g_slice_free(PrefetchTable, table);
+}
+
+/* Mirrors the lookup done by do_import() for a dotted module id like
+ * "ui.main": the leading components name sub-importers, whose search
+ * path is every directory of that name, and the last component is
+ * the first "<name>.js" found. Returns NULL if the id names a
+ * sub-importer or cannot be found; symbols exported from __init__.js
+ * are not prefetched.
+ */
+static char *
+resolve_module_id(char       **search_path,
+                  const char  *module_id)
+{
+    char **components;
+    char *filename;
+    char *full_path;
+    char *ret = NULL;
+    GPtrArray *dirs;
+    GPtrArray *subdirs;
+    guint n_components;
+    guint i, j;
+
+    components = g_strsplit(module_id, ".", -1);
+    n_components = g_strv_length(components);
+    if (n_components == 0)
+        goto out_components;
+
+    dirs = g_ptr_array_new_with_free_func(g_free);
+    for (i = 0; search_path[i] != NULL; i++) {
+        if (search_path[i][0] != '\0')
+            g_ptr_array_add(dirs, g_strdup(search_path[i]));
+    }
+
+    for (i = 0; i + 1 < n_components; i++) {
+        subdirs = g_ptr_array_new_with_free_func(g_free);
+        for (j = 0; j < dirs->len; j++) {
+            full_path = build_module_path((const char *) dirs->pdata[j],
+                                          components[i]);
+            if (module_path_is_directory(full_path))
+                g_ptr_array_add(subdirs, full_path);
+            else
+                g_free(full_path);
+        }
+        g_ptr_array_free(dirs, TRUE);
+        dirs = subdirs;
+    }
+
+    filename = g_strdup_printf("%s.js", components[n_components - 1]);
+    for (j = 0; j < dirs->len; j++) {
+        const char *dirname = (const char *) dirs->pdata[j];
+
+        /* A directory earlier in the path shadows the file */
+        full_path = build_module_path(dirname, components[n_components - 1]);
+        if (module_path_is_directory(full_path)) {
+            g_free(full_path);
+            break;
+        }
+        g_free(full_path);
+
+        full_path = build_module_path(dirname, filename);
+        if (module_path_exists(full_path)) {
+            ret = full_path;
+            break;
+        }
+        g_free(full_path);
+    }
+    g_free(filename);
+
+    g_ptr_array_free(dirs, TRUE);
+ out_components:
+    g_strfreev(components);
+    return ret;
+}
+
+static void
+prefetch_module_thread(gpointer data,
+                       gpointer user_data)
+{
+    PrefetchJob *job = (PrefetchJob *) data;
+    PrefetchTable *table = job->table;
+    PrefetchedModule *module;
+    char *full_path;
+    char *parse_name = NULL;
+    GBytes *source;
+    GBytes *bytecode = NULL;
+    const char *script;
+    gsize len = 0;
+    gssize script_len;
+    gunichar2 *chars = NULL;
+    glong n_chars = 0;
+    int start_line_number = 1;
+
+    full_path = resolve_module_id(job->search_path, job->module_id);
+
+    g_mutex_lock(&prefetch_lock);
+    table->unresolved--;
+    if (full_path == NULL || table->forgotten ||
+        g_hash_table_lookup(table->modules, full_path) != NULL) {
+        g_mutex_unlock(&prefetch_lock);
+        g_free(full_path);
+        goto out;
+    }
+    module = g_slice_new0(PrefetchedModule);
+    module->state = PREFETCH_LOADING;
+    g_hash_table_insert(table->modules, full_path, module);
+    g_mutex_unlock(&prefetch_lock);
+
+    source = load_module_source(full_path, &bytecode, &parse_name, NULL);
+
+    /* Bundled bytecode is already as cheap as it gets */
+    if (source != NULL && bytecode == NULL) {
+        script = (const char *) g_bytes_get_data(source, &len);
+        if (script != NULL && len > 0) {
+            script_len = len;
+            script = gjs_strip_unix_shebang(script, &script_len,
+                                            &start_line_number);
+            /* Invalid UTF-8 is left for SpiderMonkey to report */
+            chars = g_utf8_to_utf16(script, script_len, NULL, &n_chars, NULL);
+        }
+    }
+
+    if (source != NULL)
+        g_bytes_unref(source);
+    if (bytecode != NULL)
+        g_bytes_unref(bytecode);
+
+    gjs_debug(GJS_DEBUG_IMPORTER,
+              "Prefetched module '%s' from '%s': %s",
+              job->module_id, full_path, chars != NULL ? "ready" : "skipped");
+
+    g_mutex_lock(&prefetch_lock);
+    if (chars != NULL) {
+        module->state = PREFETCH_READY;
+        module->chars = chars;
+        module->n_chars = n_chars;
+        module->start_line_number = start_line_number;
+        module->parse_name = parse_name;
+        parse_name = NULL;
+    } else {
+        module->state = PREFETCH_DONE;
+    }
+    g_cond_broadcast(&prefetch_cond);
+    g_mutex_unlock(&prefetch_lock);
+
+ out:
+    g_mutex_lock(&prefetch_lock);
+    prefetch_table_unref(table);
+    g_mutex_unlock(&prefetch_lock);
+
+    g_free(parse_name);
+    g_strfreev(job->search_path);
+    g_free(job->module_id);
+    g_slice_free(PrefetchJob, job);
+}
+
+/* Returns the text of @full_path prefetched for @context, waiting for
+ * it if a worker is still loading it, or NULL if it was not prefetched.
+ * Either way the path is marked as imported.
+ */
+static PrefetchedModule *
+take_prefetched_module(JSContext  *context,
+                       const char *full_path)
+{
+    PrefetchTable *table;
+    PrefetchedModule *module;
+    PrefetchedModule *ret = NULL;
+
+    if (g_atomic_int_get(&n_prefetch_tables) == 0)
+        return NULL;
+
+    g_mutex_lock(&prefetch_lock);
+
+    if (prefetch_tables == NULL)
+        goto out;
+
+    table = (PrefetchTable *) g_hash_table_lookup(prefetch_tables, context);
+    if (table == NULL)
+        goto out;
+
+    module = (PrefetchedModule *) g_hash_table_lookup(table->modules, full_path);
+    if (module == NULL) {
+        if (table->unresolved > 0) {
+            module = g_slice_new0(PrefetchedModule);
+            module->state = PREFETCH_DONE;
+            g_hash_table_insert(table->modules, g_strdup(full_path), module);
+        }
+        goto out;
+    }
+
+    while (module->state == PREFETCH_LOADING)
+        g_cond_wait(&prefetch_cond, &prefetch_lock);
+
+    if (module->state == PREFETCH_READY) {
+        ret = g_slice_new0(PrefetchedModule);
+        *ret = *module;
+        module->state = PREFETCH_DONE;
+        module->chars = NULL;
+        module->parse_name = NULL;
+    }
+
+ out:
+    g_mutex_unlock(&prefetch_lock);
+    return ret;
+}
+
+static char **
+get_root_search_path(JSContext *context)
+{
+    jsval importer;
+    jsval search_path_val;
+    JSObject *search_path;
+    guint32 search_path_len;
+    guint32 i;
+    GPtrArray *dirs;
+    char *dirname;
+
+    importer = gjs_get_global_slot(context, GJS_GLOBAL_SLOT_IMPORTS);
+    if (!JSVAL_IS_OBJECT(importer) || JSVAL_IS_NULL(importer))
+        return NULL;
+
+    if (!JS_GetProperty(context, JSVAL_TO_OBJECT(importer), "searchPath", &search_path_val) ||
+        !JSVAL_IS_OBJECT(search_path_val) || JSVAL_IS_NULL(search_path_val))
+        return NULL;
+
+    search_path = JSVAL_TO_OBJECT(search_path_val);
+    if (!JS_IsArrayObject(context, search_path) ||
+        !JS_GetArrayLength(context, search_path, &search_path_len))
+        return NULL;
+
+    dirs = g_ptr_array_new();
+    for (i = 0; i < search_path_len; ++i) {
+        jsval elem = JSVAL_VOID;
+
+        if (!JS_GetElement(context, search_path, i, &elem) ||
+            !JSVAL_IS_STRING(elem))
+            continue;
+
+        if (gjs_string_to_utf8(context, elem, &dirname))
+            g_ptr_array_add(dirs, dirname);
+    }
+    g_ptr_array_add(dirs, NULL);
+
+    return (char **) g_ptr_array_free(dirs, FALSE);
+}
+
+/* Backs gjs_context_prefetch_modules(); the search path is snapshotted
+ * here, so later changes to imports.searchPath do not affect jobs that
+ * are already queued.
+ */
+void
+gjs_importer_prefetch_modules(JSContext          *context,
+                              const char * const *module_ids)
+{
+    char **search_path;
+    PrefetchTable *table;
+    PrefetchJob *job;
+    guint i;
+
+    JS_BeginRequest(context);
+    search_path = get_root_search_path(context);
+    JS_EndRequest(context);
+
+    if (search_path == NULL) {
+        gjs_debug(GJS_DEBUG_IMPORTER,
+                  "No root importer search path, not prefetching");
+        return;
+    }
+
+    g_mutex_lock(&prefetch_lock);
+
+    if (prefetch_pool == NULL) {
+        prefetch_tables = g_hash_table_new(NULL, NULL);
+        prefetch_pool = g_thread_pool_new(prefetch_module_thread, NULL,
+                                          g_get_num_processors(), FALSE, NULL);
+    }
+
+    table = (PrefetchTable *) g_hash_table_lookup(prefetch_tables, context);
+    if (table == NULL) {
+        table = prefetch_table_new();
+        g_hash_table_insert(prefetch_tables, context, table);
+        g_atomic_int_inc(&n_prefetch_tables);
+    }
+
+    for (i = 0; module_ids[i] != NULL; i++) {
+        job = g_slice_new(PrefetchJob);
+        job->table = table;
+        job->search_path = g_strdupv(search_path);
+        job->module_id = g_strdup(module_ids[i]);
+
+        table->ref_count++;
+        table->unresolved++;
+        g_thread_pool_push(prefetch_pool, job, NULL);
+    }
+
+    g_mutex_unlock(&prefetch_lock);
+
+    g_strfreev(search_path);
+}
+
+/* Drops what was prefetched for @context and not imported. Jobs still
+ * queued for it finish without loading anything.
+ */
+void
+gjs_importer_forget_prefetched_modules(JSContext *context)
+{
+    PrefetchTable *table;
+
+    g_mutex_lock(&prefetch_lock);
+
+    if (prefetch_tables != NULL) {
+        table = (PrefetchTable *) g_hash_table_lookup(prefetch_tables, context);
+        if (table != NULL) {
+            g_hash_table_remove(prefetch_tables, context);
+            g_atomic_int_add(&n_prefetch_tables, -1);
+            table->forgotten = TRUE;
+            prefetch_table_unref(table);
+        }
+    }
+
+    g_mutex_unlock(&prefetch_lock);
+}
+
 static JSBool
 import_file(JSContext  *context,
             const char *name,
-            GFile      *file,
+            const char *module_path,
             JSObject   *module_obj)
 {
     JSBool ret = JS_FALSE;
-    char *script = NULL;
+    GBytes *script_bytes;
+    GBytes *bytecode = NULL;
+    const char *script;
     char *full_path = NULL;
     gsize script_len = 0;
-    jsval script_retval;
     GError *error = NULL;
+    PrefetchedModule *prefetched;
+
+    gjs_import_trace_phase(context, GJS_IMPORT_PHASE_READ);
+
+    prefetched = take_prefetched_module(context, module_path);
+    if (prefetched != NULL) {
+        gjs_import_trace_set_file(context, module_path);
+        gjs_import_trace_phase(context, GJS_IMPORT_PHASE_EXECUTE);
+        ret = gjs_eval_ucs2_with_scope(context, module_obj,
+                                       (const jschar *) prefetched->chars,
+                                       prefetched->n_chars,
+                                       prefetched->parse_name,
+                                       prefetched->start_line_number,
+                                       NULL, NULL);
+        prefetched_module_free(prefetched);
+        return ret;
+    }
 
-    JS::CompileOptions options(context);
-
-    if (!(g_file_load_contents(file, NULL, &script, &script_len, NULL, &error))) {
+    script_bytes = load_module_source(module_path, &bytecode, &full_path, &error);
+    if (script_bytes == NULL) {
         if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY) &&
             !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NOT_DIRECTORY) &&
             !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
@@ -282,10 +853,22 @@ import_file(JSContext  *context,
         goto out;
     }
 
-    g_assert(script != NULL);
+    gjs_import_trace_set_file(context, module_path);
+
+    if (bytecode != NULL) {
+        gjs_import_trace_phase(context, GJS_IMPORT_PHASE_COMPILE);
+        if (eval_module_bytecode(context, module_obj, bytecode, &ret))
+            goto out;
 
-    full_path = g_file_get_parse_name (file);
+        gjs_debug(GJS_DEBUG_IMPORTER,
+                  "Failed to decode bytecode for '%s', using source",
+                  full_path);
+    }
+
+    script = (const char *) g_bytes_get_data(script_bytes, &script_len);
+    g_assert(script != NULL);
 
+    gjs_import_trace_phase(context, GJS_IMPORT_PHASE_EXECUTE);
     if (!gjs_eval_with_scope(context, module_obj, script, script_len,
                              full_path, NULL, NULL))
         goto out;
@@ -293,7 +876,11 @@ import_file(JSContext  *context,
     ret = JS_TRUE;
 
  out:
-    g_free(script);
+    /* Drops the mapping; the compiled script does not retain the source */
+    if (script_bytes != NULL)
+        g_bytes_unref(script_bytes);
+    if (bytecode != NULL)
+        g_bytes_unref(bytecode);
     g_free(full_path);
     return ret;
 }
@@ -306,7 +893,6 @@ load_module_init(JSContext  *context,
     JSObject *module_obj;
     JSBool found;
     jsid module_init_name;
-    GFile *file;
 
     /* First we check if js module has already been loaded  */
     module_init_name = gjs_runtime_get_const_string(JS_GetRuntime(context),
@@ -323,9 +909,13 @@ load_module_init(JSContext  *context,
     }
 
     module_obj = create_module_object (context);
-    file = g_file_new_for_commandline_arg(full_path);
-    if (!import_file (context, "__init__", file, module_obj))
+    gjs_import_trace_begin(context, "__init__");
+    if (!import_file (context, "__init__", full_path, module_obj)) {
+        /* Most directories have no __init__.js; don't record those */
+        gjs_import_trace_cancel(context);
         goto out;
+    }
+    gjs_import_trace_end(context, TRUE);
 
     if (!JS_DefinePropertyById(context, in_object,
                                module_init_name, OBJECT_TO_JSVAL(module_obj),
@@ -334,7 +924,6 @@ load_module_init(JSContext  *context,
         goto out;
 
  out:
-    g_object_unref (file);
     return module_obj;
 }
 
@@ -382,22 +971,30 @@ static JSBool
 import_file_on_module(JSContext  *context,
                       JSObject   *obj,
                       const char *name,
-                      GFile      *file)
+                      const char *full_path)
 {
     JSObject *module_obj;
     JSBool retval = JS_FALSE;
-    char *full_path = NULL;
+    char *parse_name = NULL;
+    GFile *gfile;
 
     module_obj = create_module_object (context);
 
     if (!define_import(context, obj, module_obj, name))
         goto out;
 
-    if (!import_file(context, name, file, module_obj))
+    if (!import_file(context, name, full_path, module_obj))
         goto out;
 
-    full_path = g_file_get_parse_name (file);
-    if (!define_meta_properties(context, module_obj, full_path, name, obj))
+    if (g_str_has_prefix(full_path, GJS_BUNDLE_URI_PREFIX)) {
+        parse_name = g_strdup(full_path);
+    } else {
+        gfile = g_file_new_for_commandline_arg(full_path);
+        parse_name = g_file_get_parse_name (gfile);
+        g_object_unref(gfile);
+    }
+
+    if (!define_meta_properties(context, module_obj, parse_name, name, obj))
         goto out;
 
     if (!seal_import(context, obj, name))
@@ -409,7 +1006,7 @@ import_file_on_module(JSContext  *context,
     if (!retval)
         cancel_import(context, obj, name);
 
-    g_free (full_path);
+    g_free (parse_name);
     return retval;
 }
 
@@ -430,8 +1027,7 @@ do_import(JSContext  *context,
     JSBool result;
     GPtrArray *directories;
     jsid search_path_name;
-    GFile *gfile;
-    gboolean exists;
+    gint64 timeline_start;
 
     search_path_name = gjs_runtime_get_const_string(JS_GetRuntime(context),
                                                     GJS_STRING_SEARCH_PATH);
@@ -458,6 +1054,10 @@ do_import(JSContext  *context,
 
     result = JS_FALSE;
 
+    gjs_import_trace_begin(context, name);
+    TRACE(GJS_IMPORT_START((char *) name));
+    timeline_start = gjs_timeline_begin();
+
     filename = g_strdup_printf("%s.js", name);
     full_path = NULL;
     directories = NULL;
@@ -504,8 +1104,7 @@ do_import(JSContext  *context,
         /* Try importing __init__.js and loading the symbol from it */
         if (full_path)
             g_free(full_path);
-        full_path = g_build_filename(dirname, MODULE_INIT_FILENAME,
-                                     NULL);
+        full_path = build_module_path(dirname, MODULE_INIT_FILENAME);
 
         module_obj = load_module_init(context, obj, full_path);
         if (module_obj != NULL) {
@@ -529,11 +1128,9 @@ do_import(JSContext  *context,
         /* Second try importing a directory (a sub-importer) */
         if (full_path)
             g_free(full_path);
-        full_path = g_build_filename(dirname, name,
-                                     NULL);
-        gfile = g_file_new_for_commandline_arg(full_path);
+        full_path = build_module_path(dirname, name);
 
-        if (g_file_query_file_type(gfile, (GFileQueryInfoFlags) 0, NULL) == G_FILE_TYPE_DIRECTORY) {
+        if (module_path_is_directory(full_path)) {
             gjs_debug(GJS_DEBUG_IMPORTER,
                       "Adding directory '%s' to child importer '%s'",
                       full_path, name);
@@ -545,8 +1142,6 @@ do_import(JSContext  *context,
             full_path = NULL;
         }
 
-        g_object_unref(gfile);
-
         /* If we just added to directories, we know we don't need to
          * check for a file.  If we added to directories on an earlier
          * iteration, we want to ignore any files later in the
@@ -559,28 +1154,21 @@ do_import(JSContext  *context,
 
         /* Third, if it's not a directory, try importing a file */
         g_free(full_path);
-        full_path = g_build_filename(dirname, filename,
-                                     NULL);
-        gfile = g_file_new_for_commandline_arg(full_path);
-        exists = g_file_query_exists(gfile, NULL);
+        full_path = build_module_path(dirname, filename);
 
-        if (!exists) {
+        if (!module_path_exists(full_path)) {
             gjs_debug(GJS_DEBUG_IMPORTER,
                       "JS import '%s' not found in %s",
                       name, dirname);
-
-            g_object_unref(gfile);
             continue;
         }
 
-        if (import_file_on_module (context, obj, name, gfile)) {
+        if (import_file_on_module (context, obj, name, full_path)) {
             gjs_debug(GJS_DEBUG_IMPORTER,
                       "successfully imported module '%s'", name);
             result = JS_TRUE;
         }
 
-        g_object_unref(gfile);
-
         /* Don't keep searching path if we fail to load the file for
          * reasons other than it doesn't exist... i.e. broken files
          * block searching for nonbroken ones
@@ -626,6 +1214,10 @@ do_import(JSContext  *context,
         gjs_throw(context, "No JS module '%s' found in search path", name);
     }
 
+    gjs_timeline_end("import", name, timeline_start);
+    TRACE(GJS_IMPORT_END((char *) name, result));
+    gjs_import_trace_end(context, result);
+
     return result;
 }
 
@@ -650,6 +1242,24 @@ importer_iterator_free(ImporterIterator *iter)
     g_slice_free(ImporterIterator, iter);
 }
 
+static void
+add_bundle_element(const char *filename,
+                   gboolean    is_directory,
+                   gpointer    user_data)
+{
+    ImporterIterator *iter = (ImporterIterator *) user_data;
+
+    /* skip hidden files and directories, and the module init file */
+    if (filename[0] == '.' || strcmp(filename, MODULE_INIT_FILENAME) == 0)
+        return;
+
+    if (is_directory)
+        g_ptr_array_add(iter->elements, g_strdup(filename));
+    else if (g_str_has_suffix(filename, ".js"))
+        g_ptr_array_add(iter->elements,
+                        g_strndup(filename, strlen(filename) - 3));
+}
+
 /*
  * Like JSEnumerateOp, but enum provides contextual information as follows:
  *
@@ -722,8 +1332,10 @@ importer_new_enumerate(JSContext  *context,
             char *dirname = NULL;
             char *init_path;
             const char *filename;
+            const char *inner_path;
             jsval elem;
             GDir *dir = NULL;
+            GjsBundle *bundle;
 
             elem = JSVAL_VOID;
             if (!JS_GetElement(context, search_path, i, &elem)) {
@@ -748,13 +1360,21 @@ importer_new_enumerate(JSContext  *context,
                 return JS_FALSE; /* Error message already set */
             }
 
-            init_path = g_build_filename(dirname, MODULE_INIT_FILENAME,
-                                         NULL);
+            init_path = build_module_path(dirname, MODULE_INIT_FILENAME);
 
             load_module_elements(context, *object, iter, init_path);
 
             g_free(init_path);
 
+            if (g_str_has_prefix(dirname, GJS_BUNDLE_URI_PREFIX)) {
+                bundle = gjs_bundle_get_for_uri(dirname, &inner_path);
+                if (bundle != NULL)
+                    gjs_bundle_list_directory(bundle, inner_path,
+                                              add_bundle_element, iter);
+                g_free(dirname);
+                continue;
+            }
+
             dir = g_dir_open(dirname, 0, NULL);
 
             if (!dir) {
@@ -917,6 +1537,7 @@ importer_finalize(JSFreeOp *fop,
         return; /* we are the prototype, not a real instance */
 
     GJS_DEC_COUNTER(importer);
+    GJS_COUNTER_REMOVE_BYTES(importer, sizeof(Importer));
     g_slice_free(Importer, priv);
 }
 
@@ -1001,6 +1622,7 @@ importer_new(JSContext *context,
     priv->is_root = is_root;
 
     GJS_INC_COUNTER(importer);
+    GJS_COUNTER_ADD_BYTES(importer, sizeof(Importer));
 
     g_assert(priv_from_js(context, importer) == NULL);
     JS_SetPrivate(importer, priv);
@@ -43,6 +43,9 @@ JSObject* gjs_define_importer      (JSContext   *context,
                                     const char  *importer_name,
                                     const char **initial_search_path,
                                     gboolean     add_standard_search_path);
+void      gjs_importer_prefetch_modules (JSContext          *context,
+                                         const char * const *module_ids);
+void      gjs_importer_forget_prefetched_modules (JSContext *context);
 
 
 G_END_DECLS
@@ -33,10 +33,13 @@
 #include "compat.h"
 #include "jsapi-private.h"
 #include "runtime.h"
+#include "mem.h"
 #include <gi/boxed.h>
 
 #include <string.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 static GMutex gc_lock;
 
@@ -1063,41 +1066,220 @@ gjs_parse_args (JSContext  *context,
     return JS_FALSE;
 }
 
+/* Memory sampling for gjs_maybe_gc(). It is meant to be called as often
+ * as every frame, so the process size is only read every
+ * sample_interval_ms, from a /proc/self/statm descriptor kept open
+ * for the purpose; in between, a check costs a clock read. The
+ * triggers and the time of the last sample are kept per runtime, since
+ * the GC heap size is.
+ */
+#define DEFAULT_GC_SAMPLE_INTERVAL_MS 100
+
+/* A collection is due when a size grows by this factor since the last
+ * one, and memory is under pressure when it has doubled.
+ */
+#define GC_TRIGGER_FACTOR 1.25
+#define GC_PRESSURE_FACTOR 1.6 /* times the trigger */
+
+struct _GjsGCSampler {
+    GjsGCSamplingStats stats;
+    gint64 last_sample_time;
+};
+
+GjsGCSampler *
+gjs_gc_sampler_new(void)
+{
+    GjsGCSampler *sampler = g_slice_new0(GjsGCSampler);
+
+    sampler->stats.sample_interval_ms = DEFAULT_GC_SAMPLE_INTERVAL_MS;
+    return sampler;
+}
+
+void
+gjs_gc_sampler_free(GjsGCSampler *sampler)
+{
+    g_slice_free(GjsGCSampler, sampler);
+}
+
 #ifdef __linux__
-static void
-_linux_get_self_process_size (gulong *vm_size,
-                              gulong *rss_size)
+static gboolean
+_linux_get_self_rss_bytes (gulong *rss_bytes)
 {
-    char *contents;
-    char *iter;
-    gsize len;
-    int i;
+    /* Shared by all runtimes, and pread() needs no locking. Stored
+     * offset by 2 so that a failed open() (-1) is still nonzero.
+     */
+    static gsize statm_fd_stored = 0;
+    int statm_fd;
+    char buf[128];
+    gssize len;
+    gulong size, resident;
+
+    if (g_once_init_enter(&statm_fd_stored)) {
+        int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+        g_once_init_leave(&statm_fd_stored, (gsize) (fd + 2));
+    }
+    statm_fd = (int) statm_fd_stored - 2;
+    if (statm_fd < 0)
+        return FALSE;
+
+    len = pread(statm_fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0)
+        return FALSE;
+    buf[len] = '\0';
 
-    *vm_size = *rss_size = 0;
+    /* size resident shared text lib data dt, in pages */
+    if (sscanf(buf, "%lu %lu", &size, &resident) != 2)
+        return FALSE;
+
+    *rss_bytes = resident * (gulong) sysconf(_SC_PAGESIZE);
+    return TRUE;
+}
+#endif
 
-    if (!g_file_get_contents ("/proc/self/stat", &contents, &len, NULL))
-        return;
+/* Checks @size against @trigger, moving the trigger on as the size
+ * crosses it or shrinks well below it. The first sample only sets the
+ * trigger, so starting up does not force a collection.
+ */
+static gboolean
+check_size_against_trigger(gulong   size,
+                           gulong  *trigger,
+                           gboolean *under_pressure)
+{
+    if (*trigger == 0) {
+        *trigger = (gulong) MIN(G_MAXULONG, size * GC_TRIGGER_FACTOR);
+        return FALSE;
+    }
 
-    iter = contents;
-    /* See "man proc" for where this 22 comes from */
-    for (i = 0; i < 22; i++) {
-        iter = strchr (iter, ' ');
-        if (!iter)
-            goto out;
-        iter++;
+    if (size > *trigger) {
+        if (size > GC_PRESSURE_FACTOR * *trigger)
+            *under_pressure = TRUE;
+        *trigger = (gulong) MIN(G_MAXULONG, size * GC_TRIGGER_FACTOR);
+        return TRUE;
     }
-    sscanf (iter, " %lu", vm_size);
-    iter = strchr (iter, ' ');
-    if (iter)
-        sscanf (iter, " %lu", rss_size);
 
- out:
-    g_free (contents);
+    /* If we've shrunk by 25%, lower the trigger */
+    if (size < 0.75 * *trigger)
+        *trigger = (gulong) (size * GC_TRIGGER_FACTOR);
+
+    return FALSE;
 }
 
-static gulong linux_rss_trigger;
+/**
+ * gjs_gc_memory_grew:
+ * @runtime: the runtime whose GC heap should be looked at
+ * @under_pressure_p: (out) (allow-none): set to %TRUE if memory has
+ *   grown well beyond the point where a collection was due
+ *
+ * Checks the resident size of the process and the size of the JS GC
+ * heap, together with the native memory held by wrappers (see
+ * gjs_memory_external_add()), against the sizes they had after the
+ * last collection, growth of 25% in either calling for a new one. In
+ * theory using RSS is bad if we get swapped out, since we may be
+ * overzealous in GC, but on the other hand, if swapping is going on,
+ * better to GC.
+ *
+ * Only the native memory held by @runtime's own wrappers counts
+ * towards its heap, since collecting @runtime can't free anybody
+ * else's. The resident size is deliberately for the whole process:
+ * it can't be split between runtimes, and any of them may be the one
+ * holding on to it.
+ *
+ * Sizes are only sampled every so often (see
+ * gjs_gc_set_sample_interval()); in between this returns %FALSE.
+ *
+ * Returns: %TRUE if a collection should be started
+ */
+gboolean
+gjs_gc_memory_grew(JSRuntime *runtime,
+                   gboolean  *under_pressure_p)
+{
+    GjsGCSampler *sampler;
+    GjsGCSamplingStats *stats;
+    gboolean ret = FALSE;
+    gboolean under_pressure = FALSE;
+    gint64 now;
+    gulong js_heap_bytes;
+
+    sampler = gjs_runtime_get_gc_sampler(runtime);
+    if (sampler == NULL)
+        goto out;
+    stats = &sampler->stats;
+
+    now = g_get_monotonic_time();
+
+    stats->n_checks++;
+
+    if (sampler->last_sample_time != 0 &&
+        now - sampler->last_sample_time < stats->sample_interval_ms * (gint64) 1000)
+        goto out;
+
+    sampler->last_sample_time = now;
+    stats->n_samples++;
+
+#ifdef __linux__
+    if (_linux_get_self_rss_bytes(&stats->rss_bytes) &&
+        check_size_against_trigger(stats->rss_bytes,
+                                   &stats->rss_trigger,
+                                   &under_pressure))
+        ret = TRUE;
 #endif
 
+    js_heap_bytes = JS_GetGCParameter(runtime, JSGC_BYTES);
+    stats->js_heap_bytes = js_heap_bytes;
+    stats->external_bytes = gjs_memory_get_runtime_external_bytes(runtime);
+
+    /* Native buffers held by wrappers only go away with the wrappers */
+    if (check_size_against_trigger(js_heap_bytes + stats->external_bytes,
+                                   &stats->js_heap_trigger,
+                                   &under_pressure))
+        ret = TRUE;
+
+    if (ret)
+        stats->n_triggered++;
+    if (under_pressure)
+        stats->n_under_pressure++;
+
+ out:
+    if (under_pressure_p)
+        *under_pressure_p = under_pressure;
+
+    return ret;
+}
+
+/**
+ * gjs_gc_set_sample_interval:
+ * @runtime: the runtime to change the interval for
+ * @interval_ms: minimum time between two looks at the process size;
+ *   0 samples on every call
+ */
+void
+gjs_gc_set_sample_interval(JSRuntime *runtime,
+                           guint      interval_ms)
+{
+    GjsGCSampler *sampler = gjs_runtime_get_gc_sampler(runtime);
+
+    g_return_if_fail(sampler != NULL);
+
+    sampler->stats.sample_interval_ms = interval_ms;
+}
+
+/**
+ * gjs_gc_get_sampling_stats:
+ * @runtime: the runtime to get the statistics of
+ * @stats: (out caller-allocates): filled in with the current thresholds,
+ *   the last sampled sizes and how many decisions have been made
+ */
+void
+gjs_gc_get_sampling_stats(JSRuntime          *runtime,
+                          GjsGCSamplingStats *stats)
+{
+    GjsGCSampler *sampler = gjs_runtime_get_gc_sampler(runtime);
+
+    g_return_if_fail(sampler != NULL);
+
+    *stats = sampler->stats;
+}
+
 /**
  * gjs_maybe_gc:
  *
@@ -1108,33 +1290,27 @@ gjs_maybe_gc (JSContext *context)
 {
     JS_MaybeGC(context);
 
-#ifdef __linux__
-    {
-        /* We initiate a GC if VM or RSS has grown by this much */
-        gulong vmsize;
-        gulong rss_size;
-
-        _linux_get_self_process_size (&vmsize, &rss_size);
-
-        /* linux_rss_trigger is initialized to 0, so currently
-         * we always do a full GC early.
-         *
-         * Here we see if the RSS has grown by 25% since
-         * our last look; if so, initiate a full GC.  In
-         * theory using RSS is bad if we get swapped out,
-         * since we may be overzealous in GC, but on the
-         * other hand, if swapping is going on, better
-         * to GC.
-         */
-        if (rss_size > linux_rss_trigger) {
-            linux_rss_trigger = (gulong) MIN(G_MAXULONG, rss_size * 1.25);
-            JS_GC(JS_GetRuntime(context));
-        } else if (rss_size < (0.75 * linux_rss_trigger)) {
-            /* If we've shrunk by 75%, lower the trigger */
-            linux_rss_trigger = (rss_size * 1.25);
-        }
-    }
-#endif
+    if (gjs_gc_memory_grew(JS_GetRuntime(context), NULL))
+        JS_GC(JS_GetRuntime(context));
+}
+
+/**
+ * gjs_gc_barrier:
+ * @runtime: the runtime @obj belongs to
+ * @obj: (allow-none): object a native structure is about to stop
+ *   pointing to, or a weak pointer that is about to be handed to JS
+ *
+ * Classes flagged with JSCLASS_IMPLEMENTS_BARRIERS must call this
+ * before dropping an edge that their trace hook reports, so that an
+ * incremental collection that has already scanned the structure does
+ * not lose track of @obj. Cheap unless incremental marking is going on.
+ */
+void
+gjs_gc_barrier(JSRuntime *runtime,
+               JSObject  *obj)
+{
+    if (obj != NULL && JS::IsIncrementalBarrierNeeded(runtime))
+        JS::IncrementalObjectBarrier(obj);
 }
 
 void
@@ -1172,12 +1348,19 @@ gjs_strip_unix_shebang(const char  *script,
                        gssize      *script_len,
                        int         *start_line_number_out)
 {
+    gssize len;
+
     g_assert(script_len);
 
+    /* The script need not be nul-terminated (it may be a mapped
+     * file), so never look past the given length.
+     */
+    len = *script_len >= 0 ? *script_len : (gssize) strlen(script);
+
     /* handle scripts with UNIX shebangs */
-    if (strncmp(script, "#!", 2) == 0) {
+    if (len >= 2 && strncmp(script, "#!", 2) == 0) {
         /* If we found a newline, advance the script by one line */
-        const char *s = (const char *) strstr (script, "\n");
+        const char *s = (const char *) memchr (script, '\n', len);
         if (s != NULL) {
             if (*script_len > 0)
                 *script_len -= (s + 1 - script);
@@ -1205,26 +1388,24 @@ gjs_strip_unix_shebang(const char  *script,
     return script;
 }
 
-JSBool
-gjs_eval_with_scope(JSContext    *context,
+/* Shared tail of gjs_eval_with_scope() and gjs_eval_ucs2_with_scope();
+ * exactly one of @utf8 and @chars is non-%NULL.
+ */
+static JSBool
+evaluate_with_scope(JSContext    *context,
                     JSObject     *object,
-                    const char   *script,
-                    gssize        script_len,
+                    const char   *utf8,
+                    const jschar *chars,
+                    gsize         length,
                     const char   *filename,
+                    int           start_line_number,
                     jsval        *retval_p,
                     GError      **error)
 {
     JSBool ret = JS_FALSE;
-    int start_line_number;
+    JSBool ok;
     jsval retval = JSVAL_VOID;
 
-    if (script_len < 0)
-        script_len = strlen(script);
-
-    script = gjs_strip_unix_shebang(script,
-                                    &script_len,
-                                    &start_line_number);
-
     /* log and clear exception if it's set (should not be, normally...) */
     if (gjs_log_exception(context)) {
         gjs_debug(GJS_DEBUG_CONTEXT,
@@ -1248,7 +1429,12 @@ gjs_eval_with_scope(JSContext    *context,
 
     js::RootedObject rootedObj(context, object);
 
-    if (!JS::Evaluate(context, rootedObj, options, script, script_len, &retval)) {
+    if (chars != NULL)
+        ok = JS::Evaluate(context, rootedObj, options, chars, length, &retval);
+    else
+        ok = JS::Evaluate(context, rootedObj, options, utf8, length, &retval);
+
+    if (!ok) {
         gjs_debug(GJS_DEBUG_CONTEXT,
                   "Script evaluation failed");
 
@@ -1279,3 +1465,48 @@ gjs_eval_with_scope(JSContext    *context,
     JS_EndRequest(context);
     return ret;
 }
+
+JSBool
+gjs_eval_with_scope(JSContext    *context,
+                    JSObject     *object,
+                    const char   *script,
+                    gssize        script_len,
+                    const char   *filename,
+                    jsval        *retval_p,
+                    GError      **error)
+{
+    int start_line_number;
+
+    if (script_len < 0)
+        script_len = strlen(script);
+
+    script = gjs_strip_unix_shebang(script,
+                                    &script_len,
+                                    &start_line_number);
+
+    return evaluate_with_scope(context, object, script, NULL, script_len,
+                               filename, start_line_number, retval_p, error);
+}
+
+/**
+ * gjs_eval_ucs2_with_scope:
+ *
+ * Like gjs_eval_with_scope(), but for a script that has already been
+ * converted to UTF-16 (and had any shebang line stripped, which is
+ * why the caller passes in the line number it starts at). This saves
+ * SpiderMonkey from inflating the script itself, so the conversion can
+ * be done ahead of time, off the main thread.
+ */
+JSBool
+gjs_eval_ucs2_with_scope(JSContext    *context,
+                         JSObject     *object,
+                         const jschar *chars,
+                         gsize         n_chars,
+                         const char   *filename,
+                         int           start_line_number,
+                         jsval        *retval_p,
+                         GError      **error)
+{
+    return evaluate_with_scope(context, object, NULL, chars, n_chars,
+                               filename, start_line_number, retval_p, error);
+}
@@ -372,6 +372,30 @@ void              gjs_unroot_value_locations  (JSContext        *context,
 /* Functions intended for more "internal" use */
 
 void gjs_maybe_gc (JSContext *context);
+gboolean gjs_gc_memory_grew (JSRuntime *runtime,
+                             gboolean  *under_pressure_p);
+
+typedef struct {
+    guint  n_checks;            /* calls to gjs_gc_memory_grew() */
+    guint  n_samples;           /* ... that looked at memory sizes */
+    guint  n_triggered;         /* ... that asked for a collection */
+    guint  n_under_pressure;    /* ... that found memory under pressure */
+    gulong rss_bytes;           /* last sampled resident size */
+    gulong rss_trigger;         /* resident size that triggers a collection */
+    gulong js_heap_bytes;       /* last sampled GC heap size */
+    gulong js_heap_trigger;     /* GC heap plus external size that triggers a collection */
+    gulong external_bytes;      /* last sampled gjs_memory_get_runtime_external_bytes() */
+    guint  sample_interval_ms;
+} GjsGCSamplingStats;
+
+GjsGCSampler *gjs_gc_sampler_new  (void);
+void gjs_gc_sampler_free          (GjsGCSampler       *sampler);
+void gjs_gc_set_sample_interval   (JSRuntime          *runtime,
+                                   guint               interval_ms);
+void gjs_gc_get_sampling_stats    (JSRuntime          *runtime,
+                                   GjsGCSamplingStats *stats);
+void gjs_gc_barrier (JSRuntime *runtime,
+                     JSObject  *obj);
 void gjs_enter_gc (void);
 void gjs_leave_gc (void);
 gboolean gjs_try_block_gc (void);
@@ -390,6 +414,14 @@ JSBool            gjs_eval_with_scope        (JSContext    *context,
                                               const char   *filename,
                                               jsval        *retval_p,
                                               GError      **error);
+JSBool            gjs_eval_ucs2_with_scope   (JSContext    *context,
+                                              JSObject     *object,
+                                              const jschar *chars,
+                                              gsize         n_chars,
+                                              const char   *filename,
+                                              int           start_line_number,
+                                              jsval        *retval_p,
+                                              GError      **error);
 
 /**
  * gjs_strip_unix_shebang:
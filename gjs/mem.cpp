@@ -27,9 +27,14 @@
 #include "compat.h"
 #include <util/log.h>
 
+#include <signal.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
 #define GJS_DEFINE_COUNTER(name)             \
     GjsMemCounter gjs_counter_ ## name = { \
-        0, #name                                \
+        0, 0, 0, #name                          \
     };
 
 
@@ -48,6 +53,7 @@ GJS_DEFINE_COUNTER(repo)
 GJS_DEFINE_COUNTER(resultset)
 GJS_DEFINE_COUNTER(weakhash)
 GJS_DEFINE_COUNTER(interface)
+GJS_DEFINE_COUNTER(trampoline)
 
 #define GJS_LIST_COUNTER(name) \
     & gjs_counter_ ## name
@@ -68,6 +74,119 @@ static GjsMemCounter* counters[] = {
     GJS_LIST_COUNTER(interface)
 };
 
+static GjsMemCounter* native_counters[] = {
+    GJS_LIST_COUNTER(trampoline)
+};
+
+static char *memory_dump_output = NULL;
+static guint memory_dump_counter = 0;
+static guint memory_dump_idle = 0;
+
+static volatile gsize external_bytes = 0;
+
+/* JSRuntime -> bytes held by its wrappers. Kept here rather than in
+ * the runtime's private data, which is gone before the last wrappers
+ * are finalized.
+ */
+static GMutex external_lock;
+static GHashTable *external_by_runtime = NULL;
+
+static void
+external_by_runtime_add(JSRuntime *runtime,
+                        gssize     delta)
+{
+    gsize bytes;
+
+    g_mutex_lock(&external_lock);
+    if (external_by_runtime == NULL)
+        external_by_runtime = g_hash_table_new(NULL, NULL);
+    bytes = GPOINTER_TO_SIZE(g_hash_table_lookup(external_by_runtime, runtime));
+    g_hash_table_insert(external_by_runtime, runtime,
+                        GSIZE_TO_POINTER(bytes + delta));
+    g_mutex_unlock(&external_lock);
+}
+
+/**
+ * gjs_memory_external_add:
+ * @context: the context the wrapper belongs to
+ * @bytes: size of the native memory the wrapper keeps alive
+ *
+ * Accounts @bytes to the JS runtime's malloc counter, so that wrappers
+ * holding large native buffers make a collection come sooner, as if
+ * the memory had been allocated by SpiderMonkey itself.
+ */
+void
+gjs_memory_external_add(JSContext *context,
+                        gsize      bytes)
+{
+    if (bytes == 0)
+        return;
+
+    g_atomic_pointer_add(&external_bytes, (gssize) bytes);
+    external_by_runtime_add(JS_GetRuntime(context), (gssize) bytes);
+    JS_updateMallocCounter(context, bytes);
+}
+
+/**
+ * gjs_memory_external_remove:
+ * @runtime: the runtime the wrapper belonged to
+ * @bytes: size previously passed to gjs_memory_external_add()
+ *
+ * Safe to call from finalizers.
+ */
+void
+gjs_memory_external_remove(JSRuntime *runtime,
+                           gsize      bytes)
+{
+    if (bytes == 0)
+        return;
+
+    g_atomic_pointer_add(&external_bytes, - (gssize) bytes);
+    external_by_runtime_add(runtime, - (gssize) bytes);
+}
+
+/* For the whole process */
+gsize
+gjs_memory_get_external_bytes(void)
+{
+    return (gsize) g_atomic_pointer_get(&external_bytes);
+}
+
+/**
+ * gjs_memory_get_runtime_external_bytes:
+ * @runtime: a #JSRuntime
+ *
+ * Returns: the native memory held by the wrappers of @runtime, which
+ *   only a collection in @runtime can free
+ */
+gsize
+gjs_memory_get_runtime_external_bytes(JSRuntime *runtime)
+{
+    gsize bytes = 0;
+
+    g_mutex_lock(&external_lock);
+    if (external_by_runtime != NULL)
+        bytes = GPOINTER_TO_SIZE(g_hash_table_lookup(external_by_runtime, runtime));
+    g_mutex_unlock(&external_lock);
+
+    return bytes;
+}
+
+/**
+ * gjs_memory_external_forget_runtime:
+ * @runtime: a destroyed #JSRuntime
+ *
+ * Drops what was accounted to @runtime, whose address may be reused.
+ */
+void
+gjs_memory_external_forget_runtime(JSRuntime *runtime)
+{
+    g_mutex_lock(&external_lock);
+    if (external_by_runtime != NULL)
+        g_hash_table_remove(external_by_runtime, runtime);
+    g_mutex_unlock(&external_lock);
+}
+
 void
 gjs_memory_report(const char *where,
                   gboolean    die_if_leaks)
@@ -84,7 +203,7 @@ gjs_memory_report(const char *where,
 
     total_objects = 0;
     for (i = 0; i < n_counters; ++i) {
-        total_objects += counters[i]->value;
+        total_objects += g_atomic_int_get(&counters[i]->value);
     }
 
     if (total_objects != GJS_GET_COUNTER(everything)) {
@@ -98,12 +217,177 @@ gjs_memory_report(const char *where,
 
     for (i = 0; i < n_counters; ++i) {
         gjs_debug(GJS_DEBUG_MEMORY,
-                  "    %12s = %d",
+                  "    %12s = %d (%" G_GSIZE_FORMAT " bytes)",
                   counters[i]->name,
-                  counters[i]->value);
+                  g_atomic_int_get(&counters[i]->value),
+                  (gsize) g_atomic_pointer_get(&counters[i]->bytes));
     }
 
+    for (i = 0; i < (int) G_N_ELEMENTS(native_counters); ++i) {
+        gjs_debug(GJS_DEBUG_MEMORY,
+                  "    %12s = %d (%" G_GSIZE_FORMAT " bytes, not JS objects)",
+                  native_counters[i]->name,
+                  g_atomic_int_get(&native_counters[i]->value),
+                  (gsize) g_atomic_pointer_get(&native_counters[i]->bytes));
+    }
+
+    gjs_debug(GJS_DEBUG_MEMORY,
+              "  %" G_GSIZE_FORMAT " bytes of native memory held by wrappers",
+              gjs_memory_get_external_bytes());
+
     if (die_if_leaks && GJS_GET_COUNTER(everything) > 0) {
         g_error("%s: JavaScript objects were leaked.", where);
     }
 }
+
+static void
+call_counter_func(GjsMemCounter     *counter,
+                  GjsMemCounterFunc  func,
+                  gpointer           user_data)
+{
+    func(counter->name,
+         g_atomic_int_get(&counter->value),
+         g_atomic_int_get(&counter->finalized),
+         (gsize) g_atomic_pointer_get(&counter->bytes),
+         user_data);
+}
+
+/**
+ * gjs_memory_foreach_counter:
+ * @func: called for each counter
+ * @user_data: passed to @func
+ *
+ * Calls @func with the number of wrappers of each kind alive, how many
+ * have been finalized so far, and the bytes they hold: their private
+ * structs plus any native payload, such as the struct a boxed wrapper
+ * owns. Counters that aren't JS objects, such as "trampoline" for the
+ * libffi closures behind JS callbacks, come last.
+ */
+void
+gjs_memory_foreach_counter(GjsMemCounterFunc func,
+                           gpointer          user_data)
+{
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(counters); ++i)
+        call_counter_func(counters[i], func, user_data);
+    for (i = 0; i < G_N_ELEMENTS(native_counters); ++i)
+        call_counter_func(native_counters[i], func, user_data);
+}
+
+static void
+append_counter_json(const char *name,
+                    int         count,
+                    int         finalized,
+                    gsize       bytes,
+                    gpointer    user_data)
+{
+    GString *json = (GString *) user_data;
+
+    g_string_append_printf(json,
+                           "    \"%s\": { \"count\": %d, \"finalized\": %d, "
+                           "\"bytes\": %" G_GSIZE_FORMAT " },\n",
+                           name, count, finalized, bytes);
+}
+
+/**
+ * gjs_memory_report_json:
+ *
+ * Returns: (transfer full): the counters of gjs_memory_foreach_counter()
+ * and the native memory reported with gjs_memory_external_add(), as a
+ * JSON object
+ */
+char *
+gjs_memory_report_json(void)
+{
+    GString *json;
+
+    json = g_string_new("{\n");
+    g_string_append_printf(json, "  \"pid\": %u,\n", (guint) getpid());
+    g_string_append_printf(json, "  \"time\": %" G_GINT64_FORMAT ",\n",
+                           g_get_real_time());
+    g_string_append(json, "  \"counters\": {\n");
+    gjs_memory_foreach_counter(append_counter_json, json);
+    /* no trailing comma in JSON */
+    g_string_truncate(json, json->len - 2);
+    g_string_append(json, "\n  },\n");
+    g_string_append_printf(json, "  \"external_bytes\": %" G_GSIZE_FORMAT "\n",
+                           gjs_memory_get_external_bytes());
+    g_string_append(json, "}\n");
+
+    return g_string_free(json, FALSE);
+}
+
+gboolean
+gjs_memory_dump_json(const char  *filename,
+                     GError     **error)
+{
+    char *json;
+    gboolean ret;
+
+    json = gjs_memory_report_json();
+    ret = g_file_set_contents(filename, json, -1, error);
+    g_free(json);
+
+    return ret;
+}
+
+static gboolean
+dump_memory_idle(gpointer user_data)
+{
+    char *filename;
+    GError *error = NULL;
+
+    memory_dump_idle = 0;
+
+    filename = g_strdup_printf("%s.%u.%u",
+                               memory_dump_output,
+                               (guint) getpid(),
+                               memory_dump_counter);
+    memory_dump_counter += 1;
+
+    if (!gjs_memory_dump_json(filename, &error)) {
+        g_printerr("Failed to write memory report: %s\n", error->message);
+        g_error_free(error);
+    }
+
+    g_free(filename);
+
+    return FALSE;
+}
+
+static void
+dump_memory_signal_handler(int signum)
+{
+    if (memory_dump_idle == 0)
+        memory_dump_idle = g_idle_add_full(G_PRIORITY_HIGH_IDLE,
+                                           dump_memory_idle,
+                                           NULL, NULL);
+}
+
+/**
+ * gjs_memory_init_dump_signal:
+ *
+ * If GJS_DEBUG_MEMORY_OUTPUT is set, makes SIGUSR2 write
+ * gjs_memory_report_json() to a file named after it, the process ID
+ * and a counter, from the main loop.
+ */
+void
+gjs_memory_init_dump_signal(void)
+{
+    const char *output;
+    struct sigaction sa;
+
+    if (memory_dump_output != NULL)
+        return;
+
+    output = g_getenv("GJS_DEBUG_MEMORY_OUTPUT");
+    if (output == NULL || *output == '\0')
+        return;
+
+    memory_dump_output = g_strdup(output);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = dump_memory_signal_handler;
+    sigaction(SIGUSR2, &sa, NULL);
+}
@@ -33,8 +33,13 @@
 
 G_BEGIN_DECLS
 
+/* All fields are updated atomically, since finalizers and the threads
+ * calling into GI can race on them.
+ */
 typedef struct {
-    unsigned int value;
+    volatile gint value;
+    volatile gint finalized;    /* total ever released, for GC statistics */
+    volatile gsize bytes;       /* private structs and native payload alive */
     const char *name;
 } GjsMemCounter;
 
@@ -57,24 +62,77 @@ GJS_DECLARE_COUNTER(resultset)
 GJS_DECLARE_COUNTER(weakhash)
 GJS_DECLARE_COUNTER(interface)
 
+/* Native allocations that aren't JS objects, so they don't count
+ * towards "everything" or leak checks.
+ */
+GJS_DECLARE_COUNTER(trampoline)
+
 #define GJS_INC_COUNTER(name)                \
     do {                                        \
-        gjs_counter_everything.value += 1;   \
-        gjs_counter_ ## name .value += 1;    \
+        g_atomic_int_inc(&gjs_counter_everything.value); \
+        g_atomic_int_inc(&gjs_counter_ ## name .value);  \
     } while (0)
 
 #define GJS_DEC_COUNTER(name)                \
     do {                                        \
-        gjs_counter_everything.value -= 1;   \
-        gjs_counter_ ## name .value -= 1;    \
+        g_atomic_int_add(&gjs_counter_everything.value, -1); \
+        g_atomic_int_inc(&gjs_counter_everything.finalized); \
+        g_atomic_int_add(&gjs_counter_ ## name .value, -1);  \
+        g_atomic_int_inc(&gjs_counter_ ## name .finalized);  \
+    } while (0)
+
+#define GJS_INC_NATIVE_COUNTER(name) \
+    g_atomic_int_inc(&gjs_counter_ ## name .value)
+
+#define GJS_DEC_NATIVE_COUNTER(name)                         \
+    do {                                                     \
+        g_atomic_int_add(&gjs_counter_ ## name .value, -1);  \
+        g_atomic_int_inc(&gjs_counter_ ## name .finalized);  \
     } while (0)
 
 #define GJS_GET_COUNTER(name) \
-    (gjs_counter_ ## name .value)
+    g_atomic_int_get(&gjs_counter_ ## name .value)
+
+#define GJS_GET_FINALIZED(name) \
+    g_atomic_int_get(&gjs_counter_ ## name .finalized)
+
+#define GJS_COUNTER_ADD_BYTES(name, n) \
+    g_atomic_pointer_add(&gjs_counter_ ## name .bytes, (gssize) (n))
+
+#define GJS_COUNTER_REMOVE_BYTES(name, n) \
+    g_atomic_pointer_add(&gjs_counter_ ## name .bytes, - (gssize) (n))
+
+#define GJS_GET_COUNTER_BYTES(name) \
+    ((gsize) g_atomic_pointer_get(&gjs_counter_ ## name .bytes))
 
 void gjs_memory_report(const char *where,
                        gboolean    die_if_leaks);
 
+/* Native memory owned by JS wrappers, which the GC heap size doesn't
+ * show; wrappers add what they hold when created and remove it again
+ * when finalized.
+ */
+void  gjs_memory_external_add       (JSContext *context,
+                                     gsize      bytes);
+void  gjs_memory_external_remove    (JSRuntime *runtime,
+                                     gsize      bytes);
+gsize gjs_memory_get_external_bytes (void);
+gsize gjs_memory_get_runtime_external_bytes (JSRuntime *runtime);
+void  gjs_memory_external_forget_runtime    (JSRuntime *runtime);
+
+typedef void (*GjsMemCounterFunc) (const char *name,
+                                   int         count,
+                                   int         finalized,
+                                   gsize       bytes,
+                                   gpointer    user_data);
+
+void      gjs_memory_foreach_counter (GjsMemCounterFunc   func,
+                                      gpointer            user_data);
+char     *gjs_memory_report_json     (void);
+gboolean  gjs_memory_dump_json       (const char         *filename,
+                                      GError            **error);
+void      gjs_memory_init_dump_signal (void);
+
 G_END_DECLS
 
 #endif  /* __GJS_MEM_H__ */
@@ -27,29 +27,132 @@
 #include "compat.h"
 #include "jsapi-util.h"
 
+#include <jsfriendapi.h>
+
+#include <errno.h>
+#include <pthread.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <string.h>
 
+/* There are two profilers in here. The instrumenting one hooks every
+ * call and execute and keeps exact call counts and times, but slows
+ * everything down a lot. The sampling one (GJS_DEBUG_PROFILER_MODE=sample)
+ * enables SpiderMonkey's pseudo-stack (SPS) instead: the engine keeps a
+ * cheap stack of labels for the running JS frames, a timer thread
+ * interrupts the JS thread with SIGPROF GJS_DEBUG_PROFILER_RATE times a
+ * second, and the handler copies the stack into a ring buffer that is
+ * folded into a call tree later, on the JS thread.
+ *
+ * Either can write a flat table, callgrind files for KCachegrind, or
+ * collapsed stacks for flame graphs; see GjsProfilerFormat. Every dump
+ * covers the time since the previous one.
+ */
+
 static GjsProfiler *global_profiler = NULL;
 static char        *global_profiler_output = NULL;
 static guint        global_profiler_output_counter = 0;
 static guint        global_profile_idle = 0;
+/* Changes whenever profiling starts or stops, so native calls that
+ * span that can tell their state is stale.
+ */
+static guint        global_profiler_session = 0;
+
+#define DEFAULT_SAMPLE_RATE 100   /* Hz */
+#define MAX_SAMPLE_RATE     10000
+
+/* Deeper stacks keep their outermost frames */
+#define SPS_STACK_SIZE      1024
+#define SAMPLE_MAX_DEPTH    128
+/* Slots for sample headers and frames, must be a power of 2 */
+#define SAMPLE_RING_SIZE    (1 << 16)
+
+#define COLLECT_INTERVAL_MS 250
 
 
 typedef struct _GjsProfileData     GjsProfileData;
 typedef struct _GjsProfileFunction GjsProfileFunction;
+typedef struct _GjsCallNode        GjsCallNode;
+
+typedef enum {
+    /* "file:line function calls self total"; sampling writes
+     * collapsed stacks instead */
+    GJS_PROFILER_FORMAT_TABLE,
+    GJS_PROFILER_FORMAT_CALLGRIND,
+    GJS_PROFILER_FORMAT_COLLAPSED
+} GjsProfilerFormat;
 
 struct _GjsProfiler {
     JSRuntime *runtime;
 
     GHashTable *by_file;    /* GjsProfileFunctionKey -> GjsProfileFunction */
+    GHashTable *by_script;  /* GjsProfileScriptKey -> GjsProfileScript */
+    GHashTable *by_native;  /* label -> GjsProfileNative */
+
+    /* GjsProfileScriptKey -> GjsProfileFunction, so that scripts that
+     * by_script forgot on a flush aren't named again. Like the SPS
+     * labels, only valid until the next GC slice.
+     */
+    GHashTable *resolved;
 
-    GjsProfileData *last_function_entered; /* weak ref to by_file */
+    GjsProfileData *last_function_entered; /* weak ref to by_script */
     int64_t         last_function_exit_time;
+
+    GjsProfilerFormat format;
+    gint64 window_start;
+
+    /* Call tree: sampling keys it by name, the instrumenting profiler
+     * by GjsProfileFunction and only keeps it for collapsed output.
+     */
+    GjsCallNode *root;
+    GjsCallNode *cursor;    /* instrumenting, innermost running call */
+
+    /* sampling mode */
+    gboolean sampling;
+    guint sample_interval_us;
+
+    js::ProfileEntry *sps_stack;
+    uint32_t sps_size;
+
+    /* Written by the signal handler, read on the JS thread. Each
+     * sample is a header slot holding the depth, then one label per
+     * frame, outermost first. head and tail only grow.
+     */
+    const char **ring;
+    volatile guint ring_head;
+    volatile guint ring_tail;
+    volatile guint n_samples;
+    volatile guint n_idle_samples;
+    volatile guint n_dropped_samples;
+
+    pthread_t js_thread;
+    GThread *timer_thread;
+    volatile gint timer_running;
+    guint collect_id;
+
+    /* SPS label -> name in names. The labels belong to the engine and
+     * are freed when their script is finalized, so this is only valid
+     * until the next GC slice.
+     */
+    GHashTable *labels;
+    GHashTable *names;      /* owned strings, set */
+};
+
+/* Samples, or microseconds for the instrumenting profiler */
+struct _GjsCallNode {
+    gconstpointer key;      /* name in GjsProfiler.names, or GjsProfileFunction */
+    GjsCallNode *parent;
+    guint64 self;
+    guint64 total;
+    GHashTable *children;   /* key -> GjsCallNode */
 };
 
+typedef struct {
+    unsigned call_count;
+    int64_t  total_time;
+} GjsProfileEdge;
+
 struct _GjsProfileData {
     /* runtime state tracking */
     GjsProfileData *caller;
@@ -74,8 +177,120 @@ struct _GjsProfileFunction {
     GjsProfileFunctionKey key;
 
     GjsProfileData profile;
+    GHashTable *callees;    /* GjsProfileFunction -> GjsProfileEdge */
+};
+
+/* What the call hooks look up on every call: no strings, only the
+ * script and function pointers. Names are only worked out when the
+ * counts are moved into a GjsProfileFunction, which has to happen
+ * before the GC can finalize the script or function.
+ */
+typedef struct {
+    JSScript   *script;
+    JSFunction *function;
+} GjsProfileScriptKey;
+
+/* Native calls, by their interned label */
+struct _GjsProfileNative {
+    const char *label;
+    unsigned    call_count;
+    int64_t     times[GJS_PROFILER_N_PHASES];
 };
 
+typedef struct {
+    GjsProfileScriptKey key;
+
+    const char *filename;   /* owned by the script */
+    unsigned    lineno;
+    GjsProfileFunction *resolved;
+
+    GjsProfileData profile;
+    GHashTable *callees;    /* GjsProfileScript -> GjsProfileEdge */
+} GjsProfileScript;
+
+#define SCRIPT_FROM_PROFILE(p) \
+    ((GjsProfileScript*) ((char*) (p) - G_STRUCT_OFFSET(GjsProfileScript, profile)))
+
+static void
+gjs_profile_add_edge(GHashTable **callees,
+                     gpointer     callee,
+                     unsigned     call_count,
+                     int64_t      total_time)
+{
+    GjsProfileEdge *edge;
+
+    if (*callees == NULL)
+        *callees = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+
+    edge = (GjsProfileEdge*) g_hash_table_lookup(*callees, callee);
+    if (edge == NULL) {
+        edge = g_new0(GjsProfileEdge, 1);
+        g_hash_table_insert(*callees, callee, edge);
+    }
+
+    edge->call_count += call_count;
+    edge->total_time += total_time;
+}
+
+static GjsCallNode *
+gjs_call_node_new(GjsCallNode   *parent,
+                  gconstpointer  key)
+{
+    GjsCallNode *node;
+
+    node = g_slice_new0(GjsCallNode);
+    node->parent = parent;
+    node->key = key;
+
+    return node;
+}
+
+static void
+gjs_call_node_free(GjsCallNode *node)
+{
+    if (node->children)
+        g_hash_table_destroy(node->children);
+    g_slice_free(GjsCallNode, node);
+}
+
+static GjsCallNode *
+gjs_call_node_get_child(GjsCallNode   *node,
+                        gconstpointer  key)
+{
+    GjsCallNode *child;
+
+    if (node->children == NULL)
+        node->children =
+            g_hash_table_new_full(NULL, NULL, NULL,
+                                  (GDestroyNotify) gjs_call_node_free);
+
+    child = (GjsCallNode *) g_hash_table_lookup(node->children, key);
+    if (child == NULL) {
+        child = gjs_call_node_new(node, key);
+        g_hash_table_insert(node->children, (gpointer) key, child);
+    }
+
+    return child;
+}
+
+/* Keeps the nodes, the instrumenting profiler may be inside them */
+static void
+gjs_call_node_reset(GjsCallNode *node)
+{
+    GHashTableIter iter;
+    gpointer value;
+
+    node->self = 0;
+    node->total = 0;
+
+    if (node->children == NULL)
+        return;
+
+    g_hash_table_iter_init(&iter, node->children);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+        gjs_call_node_reset((GjsCallNode*) value);
+}
+
 static guint
 gjs_profile_function_key_hash(gconstpointer keyp)
 {
@@ -123,75 +338,203 @@ gjs_profile_function_free(GjsProfileFunction *self)
 {
     g_free(self->key.filename);
     g_free(self->key.function_name);
+    if (self->callees)
+        g_hash_table_destroy(self->callees);
     g_slice_free(GjsProfileFunction, self);
 }
 
-static void
-gjs_profile_function_key_from_js(JSContext             *cx,
-                                 JSAbstractFramePtr     frame,
-                                 GjsProfileFunctionKey *key)
+static guint
+gjs_profile_script_key_hash(gconstpointer keyp)
 {
-    JSScript *script;
-    JSFunction *function;
-    JSString *function_name;
+    const GjsProfileScriptKey *key = (const GjsProfileScriptKey*) keyp;
 
-    /* We're not using the JSScript or JSFunction as the key since the script
-     * could be unloaded and addresses reused.
-     */
+    return GPOINTER_TO_UINT(key->script) ^
+        (GPOINTER_TO_UINT(key->function) >> 3);
+}
 
-    script = frame.script();
-    if (script != NULL) {
-        key->filename = (char*)JS_GetScriptFilename(cx, script);
-        key->lineno = JS_GetScriptBaseLineNumber(cx, script);
-    } else {
-        key->filename = (char*)"(native)";
-        key->lineno = 0;
-    }
+static gboolean
+gjs_profile_script_key_equal(gconstpointer ap,
+                             gconstpointer bp)
+{
+    const GjsProfileScriptKey *a = (const GjsProfileScriptKey*) ap;
+    const GjsProfileScriptKey *b = (const GjsProfileScriptKey*) bp;
+
+    return a->script == b->script && a->function == b->function;
+}
+
+static void
+gjs_profile_script_free(GjsProfileScript *self)
+{
+    if (self->callees)
+        g_hash_table_destroy(self->callees);
+    g_slice_free(GjsProfileScript, self);
+}
 
-    function = frame.maybeFun();
+static GjsProfileScript *
+gjs_profiler_lookup_script(GjsProfiler       *self,
+                           JSContext         *cx,
+                           JSAbstractFramePtr frame,
+                           gboolean           create_if_missing)
+{
+    GjsProfileScriptKey key;
+    GjsProfileScript *script;
+
+    key.script = frame.script();
     /* If function == NULL we're probably calling a GIRepositoryFunction object
      * (or other object with a 'call' method) and would be good to somehow
      * figure out the name of the called function.
      */
-    function_name = JS_GetFunctionId(function);
-    if (!function_name ||
-        !gjs_string_to_utf8(cx, STRING_TO_JSVAL(function_name), &key->function_name))
-        key->function_name = g_strdup("(unknown)");
+    key.function = frame.maybeFun();
+
+    script = (GjsProfileScript*) g_hash_table_lookup(self->by_script, &key);
+    if (script || !create_if_missing)
+        return script;
+
+    script = g_slice_new0(GjsProfileScript);
+    script->key = key;
+
+    /* Only pointer reads; the script owns the filename and is
+     * alive until we resolve it in gjs_profiler_flush_scripts().
+     */
+    if (key.script != NULL) {
+        script->filename = JS_GetScriptFilename(cx, key.script);
+        script->lineno = JS_GetScriptBaseLineNumber(cx, key.script);
+    } else {
+        script->filename = "(native)";
+        script->lineno = 0;
+    }
+    if (script->filename == NULL)
+        script->filename = "(unknown)";
+
+    g_hash_table_insert(self->by_script, &script->key, script);
+
+    return script;
+}
+
+static char *
+gjs_profiler_function_name(JSFunction *function)
+{
+    JSString *id;
+    const jschar *chars;
+    char *name = NULL;
+
+    if (function != NULL) {
+        id = JS_GetFunctionId(function);
+
+        /* Function ids are atoms, which are always flat, so this is
+         * safe from a GC callback.
+         */
+        if (id != NULL) {
+            chars = JS_GetFlatStringChars(JS_ASSERT_STRING_IS_FLAT(id));
+            name = g_utf16_to_utf8((const gunichar2*) chars,
+                                   JS_GetStringLength(id),
+                                   NULL, NULL, NULL);
+        }
+    }
 
-    g_assert(key->filename != NULL);
-    g_assert(key->function_name != NULL);
+    return name ? name : g_strdup("(unknown)");
 }
 
 static GjsProfileFunction *
-gjs_profiler_lookup_function(GjsProfiler       *self,
-                             JSContext         *cx,
-                             JSAbstractFramePtr frame,
-                             gboolean           create_if_missing)
+gjs_profiler_resolve_script(GjsProfiler      *self,
+                            GjsProfileScript *script)
 {
     GjsProfileFunctionKey key;
     GjsProfileFunction *function;
 
-    gjs_profile_function_key_from_js(cx, frame, &key);
+    if (script->resolved)
+        return script->resolved;
+
+    function = (GjsProfileFunction*) g_hash_table_lookup(self->resolved, &script->key);
+    if (function) {
+        script->resolved = function;
+        return function;
+    }
+
+    key.filename = (char*) script->filename;
+    key.lineno = script->lineno;
+    key.function_name = gjs_profiler_function_name(script->key.function);
 
     function = (GjsProfileFunction*) g_hash_table_lookup(self->by_file, &key);
-    if (function)
-        goto error;
+    if (function) {
+        g_free(key.function_name);
+    } else {
+        /* Passes ownership of key.function_name */
+        function = gjs_profile_function_new(&key);
+        g_hash_table_insert(self->by_file, &function->key, function);
+    }
+
+    g_hash_table_insert(self->resolved,
+                        g_memdup(&script->key, sizeof(GjsProfileScriptKey)),
+                        function);
+    script->resolved = function;
+    return function;
+}
+
+static void
+by_script_fold_one(gpointer key,
+                   gpointer value,
+                   gpointer user_data)
+{
+    GjsProfileScript *script = (GjsProfileScript*) value;
+    GjsProfiler *self = (GjsProfiler*) user_data;
+    GjsProfileData *p = &script->profile;
+    GjsProfileFunction *function;
+
+    if (p->call_count == 0 && script->callees == NULL)
+        return;
+
+    function = gjs_profiler_resolve_script(self, script);
+
+    function->profile.call_count += p->call_count;
+    function->profile.self_time += p->self_time;
+    function->profile.total_time += p->total_time;
+
+    p->call_count = 0;
+    p->self_time = 0;
+    p->total_time = 0;
+
+    if (script->callees) {
+        GHashTableIter iter;
+        gpointer callee, edgep;
 
-    if (!create_if_missing)
-        goto error;
+        g_hash_table_iter_init(&iter, script->callees);
+        while (g_hash_table_iter_next(&iter, &callee, &edgep)) {
+            GjsProfileEdge *edge = (GjsProfileEdge*) edgep;
 
-    function = gjs_profile_function_new(&key);
+            gjs_profile_add_edge(&function->callees,
+                                 gjs_profiler_resolve_script(self, (GjsProfileScript*) callee),
+                                 edge->call_count, edge->total_time);
+        }
+
+        g_hash_table_destroy(script->callees);
+        script->callees = NULL;
+    }
+}
 
-    g_hash_table_insert(self->by_file, &function->key, function);
+static gboolean
+by_script_is_done(gpointer key,
+                  gpointer value,
+                  gpointer user_data)
+{
+    GjsProfileScript *script = (GjsProfileScript*) value;
 
-    /* Don't free key.function_name if we get here since we passed its
-     * ownership to the new function.
+    /* Frames still on the stack keep their script and function
+     * alive, everything else may be finalized and its address reused.
      */
-    return function;
+    return script->profile.recurse_depth == 0;
+}
 
- error:
-    g_free(key.function_name);
-    return NULL;
+/* Folds the per-script counts and call edges into by_file and forgets
+ * scripts that aren't running. Called before every GC slice and before
+ * dumping. Everything is folded before anything is removed, since
+ * edges point at other scripts.
+ */
+static void
+gjs_profiler_flush_scripts(GjsProfiler *self)
+{
+    g_hash_table_foreach(self->by_script, by_script_fold_one, self);
+    g_hash_table_foreach_remove(self->by_script, by_script_is_done, NULL);
 }
 
 static void
@@ -201,15 +544,15 @@ gjs_profiler_log_call(GjsProfiler       *self,
                       JSBool             before,
                       JSBool            *ok)
 {
-    GjsProfileFunction *function;
+    GjsProfileScript *script;
     GjsProfileData *p;
     int64_t now;
 
-    function = gjs_profiler_lookup_function(self, cx, frame, before);
-    if (!function)
+    script = gjs_profiler_lookup_script(self, cx, frame, before);
+    if (!script)
         return;
 
-    p = &function->profile;
+    p = &script->profile;
     now = JS_Now();
 
     if (before) {
@@ -235,6 +578,10 @@ gjs_profiler_log_call(GjsProfiler       *self,
 
             p->caller = self->last_function_entered;
             self->last_function_entered = p;
+
+            if (self->cursor)
+                self->cursor = gjs_call_node_get_child(self->cursor,
+                                                       gjs_profiler_resolve_script(self, script));
         } else {
             g_assert(p->enter_time != 0);
         }
@@ -247,11 +594,17 @@ gjs_profiler_log_call(GjsProfiler       *self,
 
         p->recurse_depth -= 1;
         if (p->recurse_depth == 0) {
+            int64_t total_delta;
+
             g_assert(p->enter_time != 0);
 
-            delta = now - p->enter_time;
+            delta = total_delta = now - p->enter_time;
             p->total_time += delta;
 
+            if (p->caller)
+                gjs_profile_add_edge(&SCRIPT_FROM_PROFILE(p->caller)->callees,
+                                     script, 1, total_delta);
+
             /* two returns without function call in between */
             if (self->last_function_exit_time != 0) {
                 delta = now - self->last_function_exit_time;
@@ -262,6 +615,12 @@ gjs_profiler_log_call(GjsProfiler       *self,
 
             p->self_time += delta;
 
+            if (self->cursor && self->cursor->parent) {
+                self->cursor->self += delta;
+                self->cursor->total += total_delta;
+                self->cursor = self->cursor->parent;
+            }
+
             self->last_function_entered = p->caller;
             p->caller = NULL;
 
@@ -322,6 +681,8 @@ dump_profile_signal_handler(int signum)
                                               NULL, NULL);
 }
 
+static void gjs_profiler_sample(GjsProfiler *self, gboolean enabled);
+
 static void
 gjs_profiler_profile(GjsProfiler *self, gboolean enabled)
 {
@@ -343,20 +704,749 @@ gjs_profiler_profile(GjsProfiler *self, gboolean enabled)
         }
 
         global_profiler = self;
+        global_profiler_session++;
         g_assert(global_profiler_output != NULL);
 
+        self->window_start = g_get_monotonic_time();
+
+        if (self->sample_interval_us > 0) {
+            gjs_profiler_sample(self, TRUE);
+            return;
+        }
+
+        if (self->format == GJS_PROFILER_FORMAT_COLLAPSED) {
+            self->root = gjs_call_node_new(NULL, NULL);
+            self->cursor = self->root;
+        }
+
         /* "toplevel" execution */
         JS_SetExecuteHook(rt, gjs_profiler_execute_hook, self);
         /* function call */
         JS_SetCallHook(rt, gjs_profiler_call_hook, self);
     } else if (self == global_profiler) {
-        JS_SetExecuteHook(rt, NULL, NULL);
-        JS_SetCallHook(rt, NULL, NULL);
+        if (self->sampling) {
+            gjs_profiler_sample(self, FALSE);
+        } else {
+            JS_SetExecuteHook(rt, NULL, NULL);
+            JS_SetCallHook(rt, NULL, NULL);
+
+            if (self->root) {
+                gjs_call_node_free(self->root);
+                self->root = NULL;
+                self->cursor = NULL;
+            }
+        }
 
         global_profiler = NULL;
+        global_profiler_session++;
+    }
+}
+
+/* Runs in the signal handler on the JS thread: no locks, no
+ * allocation, nothing but loads and stores.
+ */
+static void
+gjs_profiler_take_sample(GjsProfiler *self)
+{
+    guint depth, head, tail, mask, i;
+
+    depth = MIN(*(volatile uint32_t *) &self->sps_size, (uint32_t) SPS_STACK_SIZE);
+    depth = MIN(depth, (guint) SAMPLE_MAX_DEPTH);
+
+    if (depth == 0) {
+        g_atomic_int_inc(&self->n_idle_samples);
+        return;
+    }
+
+    head = self->ring_head;
+    tail = g_atomic_int_get(&self->ring_tail);
+    if (SAMPLE_RING_SIZE - (head - tail) < depth + 1) {
+        g_atomic_int_inc(&self->n_dropped_samples);
+        return;
+    }
+
+    mask = SAMPLE_RING_SIZE - 1;
+    self->ring[head & mask] = (const char *) GUINT_TO_POINTER(depth);
+    for (i = 0; i < depth; i++) {
+        const char *label = self->sps_stack[i].label();
+        self->ring[(head + 1 + i) & mask] = label ? label : "(unknown)";
+    }
+
+    g_atomic_int_set(&self->ring_head, head + 1 + depth);
+    g_atomic_int_inc(&self->n_samples);
+}
+
+static void
+sample_signal_handler(int signum)
+{
+    GjsProfiler *self = global_profiler;
+    int saved_errno = errno;
+
+    if (self != NULL && self->sampling)
+        gjs_profiler_take_sample(self);
+
+    errno = saved_errno;
+}
+
+static gpointer
+sample_timer_thread(gpointer data)
+{
+    GjsProfiler *self = (GjsProfiler *) data;
+
+    while (g_atomic_int_get(&self->timer_running)) {
+        g_usleep(self->sample_interval_us);
+        pthread_kill(self->js_thread, SIGPROF);
+    }
+
+    return NULL;
+}
+
+static const char *
+gjs_profiler_intern_label(GjsProfiler *self,
+                          const char  *label)
+{
+    char *name;
+
+    name = (char *) g_hash_table_lookup(self->labels, label);
+    if (name != NULL)
+        return name;
+
+    name = (char *) g_hash_table_lookup(self->names, label);
+    if (name == NULL) {
+        /* ';' separates frames in the collapsed output */
+        name = g_strdelimit(g_strdup(label), ";", ',');
+        g_hash_table_add(self->names, name);
+    }
+
+    g_hash_table_insert(self->labels, (gpointer) label, name);
+
+    return name;
+}
+
+/* Folds the samples taken since the last call into the call tree.
+ * Must be called on the JS thread, before the engine frees the labels
+ * of finalized scripts; see gjs_profiler_gc_begin(). It also happens
+ * periodically from the main loop so the ring doesn't fill up.
+ */
+static void
+gjs_profiler_collect_samples(GjsProfiler *self)
+{
+    guint head, tail, mask;
+
+    if (!self->sampling)
+        return;
+
+    mask = SAMPLE_RING_SIZE - 1;
+    head = g_atomic_int_get(&self->ring_head);
+    tail = self->ring_tail;
+
+    while (tail != head) {
+        GjsCallNode *node = self->root;
+        guint depth, i;
+
+        depth = GPOINTER_TO_UINT(self->ring[tail & mask]);
+        node->total++;
+
+        for (i = 0; i < depth; i++) {
+            const char *name;
+
+            name = gjs_profiler_intern_label(self, self->ring[(tail + 1 + i) & mask]);
+            node = gjs_call_node_get_child(node, name);
+            node->total++;
+        }
+        node->self++;
+
+        tail += 1 + depth;
+    }
+
+    g_atomic_int_set(&self->ring_tail, tail);
+}
+
+/**
+ * gjs_profiler_gc_begin:
+ * @self: a #GjsProfiler
+ *
+ * Called at the start of every GC slice, to save whatever the profiler
+ * knows only by the address of a script or function before the GC
+ * finalizes it. Incremental sweeping finalizes in any slice, and the
+ * addresses can be reused before the cycle ends, so the SPS labels
+ * and the names of scripts are forgotten here too.
+ */
+void
+gjs_profiler_gc_begin(GjsProfiler *self)
+{
+    if (self->sampling) {
+        gjs_profiler_collect_samples(self);
+        g_hash_table_remove_all(self->labels);
+    } else {
+        gjs_profiler_flush_scripts(self);
+        g_hash_table_remove_all(self->resolved);
     }
 }
 
+static gboolean
+collect_samples_timeout(gpointer user_data)
+{
+    GjsProfiler *self = (GjsProfiler *) user_data;
+
+    gjs_profiler_collect_samples(self);
+
+    return TRUE;
+}
+
+static void
+gjs_profiler_sample(GjsProfiler *self, gboolean enabled)
+{
+    JSRuntime *rt = self->runtime;
+
+    if (enabled) {
+        static gboolean signal_handler_initialized = FALSE;
+
+        if (!signal_handler_initialized) {
+            struct sigaction sa;
+
+            signal_handler_initialized = TRUE;
+
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = sample_signal_handler;
+            sa.sa_flags = SA_RESTART;
+            sigemptyset(&sa.sa_mask);
+            sigaction(SIGPROF, &sa, NULL);
+        }
+
+        self->sps_stack = g_new0(js::ProfileEntry, SPS_STACK_SIZE);
+        self->ring = g_new0(const char *, SAMPLE_RING_SIZE);
+        self->labels = g_hash_table_new(NULL, NULL);
+        self->names = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, NULL);
+        self->root = gjs_call_node_new(NULL, "(root)");
+
+        js::SetRuntimeProfilingStack(rt, self->sps_stack, &self->sps_size,
+                                     SPS_STACK_SIZE);
+        js::EnableRuntimeProfilingStack(rt, true);
+
+        self->js_thread = pthread_self();
+        self->sampling = TRUE;
+
+        self->collect_id = g_timeout_add(COLLECT_INTERVAL_MS,
+                                         collect_samples_timeout, self);
+
+        g_atomic_int_set(&self->timer_running, TRUE);
+        self->timer_thread = g_thread_new("gjs-profiler",
+                                          sample_timer_thread, self);
+    } else if (self->sampling) {
+        g_atomic_int_set(&self->timer_running, FALSE);
+        g_thread_join(self->timer_thread);
+        self->timer_thread = NULL;
+
+        g_source_remove(self->collect_id);
+        self->collect_id = 0;
+
+        gjs_profiler_collect_samples(self);
+        self->sampling = FALSE;
+
+        js::EnableRuntimeProfilingStack(rt, false);
+        js::SetRuntimeProfilingStack(rt, NULL, NULL, 0);
+
+        gjs_call_node_free(self->root);
+        g_hash_table_destroy(self->labels);
+        g_hash_table_destroy(self->names);
+        g_free(self->ring);
+        g_free(self->sps_stack);
+        self->root = NULL;
+        self->labels = NULL;
+        self->names = NULL;
+        self->ring = NULL;
+        self->sps_stack = NULL;
+    }
+}
+
+/* Pushes a frame on the SPS stack; @label must stay valid as long as
+ * the process, since samples are only resolved later.
+ */
+static void
+gjs_profiler_push_frame(GjsProfiler *self,
+                        const char  *label)
+{
+    uint32_t size;
+
+    /* Like the engine, count frames past the end without storing them;
+     * the entry must be complete before the size covers it.
+     */
+    size = self->sps_size;
+    if (size < SPS_STACK_SIZE) {
+        volatile js::ProfileEntry &entry = self->sps_stack[size];
+        entry.setLabel(label);
+        entry.setStackAddress(&self->sps_stack[size]);
+        entry.setScript(NULL);
+    }
+    *(volatile uint32_t *) &self->sps_size = size + 1;
+}
+
+static void
+gjs_profiler_pop_frame(GjsProfiler *self)
+{
+    g_assert(self->sps_size > 0);
+
+    *(volatile uint32_t *) &self->sps_size = self->sps_size - 1;
+}
+
+static const char *phase_labels[GJS_PROFILER_N_PHASES] = {
+    "(marshal in)",
+    NULL,               /* the call itself is the native frame */
+    "(marshal out)"
+};
+
+static GjsProfileNative *
+gjs_profiler_lookup_native(GjsProfiler *self,
+                           const char  *label)
+{
+    GjsProfileNative *native;
+
+    native = (GjsProfileNative*) g_hash_table_lookup(self->by_native, label);
+    if (native == NULL) {
+        native = g_slice_new0(GjsProfileNative);
+        native->label = label;
+        g_hash_table_insert(self->by_native, (gpointer) label, native);
+    }
+
+    return native;
+}
+
+static void
+gjs_profile_native_free(GjsProfileNative *native)
+{
+    g_slice_free(GjsProfileNative, native);
+}
+
+/**
+ * gjs_profiler_is_active:
+ *
+ * Returns: %TRUE if a profiler is running, so it is worth working out
+ *   a label for gjs_profiler_native_begin()
+ */
+gboolean
+gjs_profiler_is_active(void)
+{
+    return global_profiler != NULL;
+}
+
+static inline gboolean
+native_call_is_current(GjsProfilerNativeCall *call)
+{
+    if (call->active && call->session != global_profiler_session)
+        call->active = FALSE;
+
+    return call->active;
+}
+
+/**
+ * gjs_profiler_native_begin:
+ * @call: (out caller-allocates): state of the call
+ * @runtime: the runtime the call is made from
+ * @label: name of the call, such as "Gtk.Widget.show"; must stay valid
+ *   as long as the process, see g_intern_string()
+ *
+ * Starts profiling a native call, in the %GJS_PROFILER_PHASE_MARSHAL_IN
+ * phase. The sampling profiler sees it as a frame named @label, with
+ * the marshalling phases as frames inside it; the instrumenting
+ * profiler times each phase. gjs_profiler_native_set_phase() and
+ * gjs_profiler_native_end() do nothing if @runtime was not being
+ * profiled.
+ */
+void
+gjs_profiler_native_begin(GjsProfilerNativeCall *call,
+                          JSRuntime             *runtime,
+                          const char            *label)
+{
+    GjsProfiler *self = global_profiler;
+
+    /* The SPS stack and the counts belong to the profiled runtime;
+     * calls made from any other one, on its own thread, stay out.
+     */
+    call->active = self != NULL && self->runtime == runtime;
+    if (!call->active)
+        return;
+
+    call->profiler = self;
+    call->session = global_profiler_session;
+    call->phase = GJS_PROFILER_PHASE_MARSHAL_IN;
+
+    if (self->sampling) {
+        gjs_profiler_push_frame(self, label);
+        gjs_profiler_push_frame(self, phase_labels[call->phase]);
+    } else {
+        call->native = gjs_profiler_lookup_native(self, label);
+        call->phase_start = g_get_monotonic_time();
+    }
+}
+
+void
+gjs_profiler_native_set_phase(GjsProfilerNativeCall *call,
+                              GjsProfilerPhase       phase)
+{
+    GjsProfiler *self = call->profiler;
+
+    /* A call that began before the profiler stopped, even if it was
+     * started again since, is not tracked: its frames and its
+     * GjsProfileNative may be gone.
+     */
+    if (!native_call_is_current(call))
+        return;
+
+    if (self->sampling) {
+        if (phase_labels[call->phase] != NULL)
+            gjs_profiler_pop_frame(self);
+        if (phase_labels[phase] != NULL)
+            gjs_profiler_push_frame(self, phase_labels[phase]);
+    } else {
+        gint64 now = g_get_monotonic_time();
+
+        call->native->times[call->phase] += now - call->phase_start;
+        call->phase_start = now;
+    }
+
+    call->phase = phase;
+}
+
+void
+gjs_profiler_native_end(GjsProfilerNativeCall *call)
+{
+    GjsProfiler *self = call->profiler;
+
+    if (!native_call_is_current(call))
+        return;
+
+    if (self->sampling) {
+        if (phase_labels[call->phase] != NULL)
+            gjs_profiler_pop_frame(self);
+        gjs_profiler_pop_frame(self);
+    } else {
+        call->native->times[call->phase] +=
+            g_get_monotonic_time() - call->phase_start;
+        call->native->call_count++;
+    }
+
+    call->active = FALSE;
+}
+
+static void
+gjs_profiler_append_node_name(GjsProfiler *self,
+                              GjsCallNode *node,
+                              GString     *str)
+{
+    if (self->sampling) {
+        g_string_append(str, (const char*) node->key);
+    } else {
+        GjsProfileFunction *function = (GjsProfileFunction*) node->key;
+
+        /* same as the SPS labels */
+        g_string_append_printf(str, "%s (%s:%u)",
+                               function->key.function_name,
+                               function->key.filename,
+                               function->key.lineno);
+    }
+}
+
+/* One line per distinct stack, "outer;inner;innermost count", as read
+ * by flamegraph.pl and most other flame graph tools. The count is the
+ * number of samples, or microseconds of self time.
+ */
+static void
+gjs_call_node_dump_collapsed(GjsProfiler *self,
+                             GjsCallNode *node,
+                             GString     *path,
+                             FILE        *fp)
+{
+    gsize len = path->len;
+    GHashTableIter iter;
+    gpointer child;
+
+    if (node->parent != NULL) {
+        gsize name_start;
+
+        if (node->parent->parent != NULL)
+            g_string_append_c(path, ';');
+        name_start = path->len;
+        gjs_profiler_append_node_name(self, node, path);
+        /* ';' separates frames */
+        g_strdelimit(path->str + name_start, ";", ',');
+
+        if (node->self > 0)
+            fprintf(fp, "%s %" G_GUINT64_FORMAT "\n", path->str, node->self);
+    }
+
+    if (node->children) {
+        g_hash_table_iter_init(&iter, node->children);
+        while (g_hash_table_iter_next(&iter, NULL, &child))
+            gjs_call_node_dump_collapsed(self, (GjsCallNode*) child, path, fp);
+    }
+
+    g_string_truncate(path, len);
+}
+
+/* Samples that found no JS running, or that the ring had no room for,
+ * are written as stacks of their own so that flame graphs show them.
+ */
+static void
+gjs_profiler_dump_collapsed(GjsProfiler *self,
+                            FILE        *fp)
+{
+    GString *path;
+    guint n_idle, n_dropped;
+
+    if (self->root == NULL) {
+        g_warning("The profiler was started without collapsed output");
+        return;
+    }
+
+    path = g_string_new(NULL);
+    gjs_call_node_dump_collapsed(self, self->root, path, fp);
+    g_string_free(path, TRUE);
+
+    if (self->sampling) {
+        n_idle = g_atomic_int_get(&self->n_idle_samples);
+        n_dropped = g_atomic_int_get(&self->n_dropped_samples);
+        if (n_idle > 0)
+            fprintf(fp, "(idle) %u\n", n_idle);
+        if (n_dropped > 0)
+            fprintf(fp, "(dropped) %u\n", n_dropped);
+    }
+}
+
+/* Splits an SPS label, "function (file:line)", for callgrind */
+static const char *
+parse_sps_label(const char *label,
+                char      **filename_p,
+                unsigned   *lineno_p)
+{
+    const char *open = strrchr(label, '(');
+    const char *colon = strrchr(label, ':');
+    gsize len = strlen(label);
+
+    if (open != NULL && open > label && colon != NULL && colon > open &&
+        label[len - 1] == ')') {
+        *filename_p = g_strndup(open + 1, colon - open - 1);
+        *lineno_p = strtoul(colon + 1, NULL, 10);
+    } else {
+        *filename_p = g_strdup("(native)");
+        *lineno_p = 0;
+    }
+
+    return label;
+}
+
+typedef struct {
+    guint64 self;
+    GHashTable *callees;    /* name -> guint64 inclusive samples */
+} GjsSampledFunction;
+
+static void
+gjs_sampled_function_free(GjsSampledFunction *function)
+{
+    if (function->callees)
+        g_hash_table_destroy(function->callees);
+    g_slice_free(GjsSampledFunction, function);
+}
+
+/* Sums the call tree up by name, which is what callgrind wants */
+static void
+gjs_call_node_sum_by_name(GjsCallNode *node,
+                          GHashTable  *by_name)
+{
+    GjsSampledFunction *function = NULL;
+    GHashTableIter iter;
+    gpointer childp;
+
+    if (node->parent != NULL) {
+        function = (GjsSampledFunction*) g_hash_table_lookup(by_name, node->key);
+        if (function == NULL) {
+            function = g_slice_new0(GjsSampledFunction);
+            g_hash_table_insert(by_name, (gpointer) node->key, function);
+        }
+        function->self += node->self;
+    }
+
+    if (node->children == NULL)
+        return;
+
+    g_hash_table_iter_init(&iter, node->children);
+    while (g_hash_table_iter_next(&iter, NULL, &childp)) {
+        GjsCallNode *child = (GjsCallNode*) childp;
+
+        if (function != NULL) {
+            guint64 *total;
+
+            if (function->callees == NULL)
+                function->callees = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+
+            total = (guint64*) g_hash_table_lookup(function->callees, child->key);
+            if (total == NULL) {
+                total = g_new0(guint64, 1);
+                g_hash_table_insert(function->callees, (gpointer) child->key, total);
+            }
+            *total += child->total;
+        }
+
+        gjs_call_node_sum_by_name(child, by_name);
+    }
+}
+
+static void
+gjs_profiler_dump_callgrind_header(GjsProfiler *self,
+                                   FILE        *fp,
+                                   const char  *event)
+{
+    fprintf(fp, "# callgrind format\n");
+    fprintf(fp, "version: 1\n");
+    fprintf(fp, "creator: gjs %s\n", PACKAGE_VERSION);
+    fprintf(fp, "pid: %u\n", (guint) getpid());
+    if (g_get_prgname())
+        fprintf(fp, "cmd: %s\n", g_get_prgname());
+    fprintf(fp, "desc: Window: %.3f s\n",
+            (g_get_monotonic_time() - self->window_start) / (double) G_USEC_PER_SEC);
+    if (self->sampling)
+        fprintf(fp, "desc: Samples: %u taken, %u idle, %u dropped\n",
+                g_atomic_int_get(&self->n_samples),
+                g_atomic_int_get(&self->n_idle_samples),
+                g_atomic_int_get(&self->n_dropped_samples));
+    fprintf(fp, "positions: line\n");
+    fprintf(fp, "events: %s\n\n", event);
+}
+
+/* The sampling profiler doesn't count calls, so calls= is 0 */
+static void
+gjs_profiler_dump_callgrind_samples(GjsProfiler *self,
+                                    FILE        *fp)
+{
+    GHashTable *by_name;
+    GHashTableIter iter, callee_iter;
+    gpointer name, value, callee, total;
+    char *filename;
+    unsigned lineno;
+
+    gjs_profiler_dump_callgrind_header(self, fp, "Samples");
+
+    by_name = g_hash_table_new_full(NULL, NULL, NULL,
+                                    (GDestroyNotify) gjs_sampled_function_free);
+    gjs_call_node_sum_by_name(self->root, by_name);
+
+    g_hash_table_iter_init(&iter, by_name);
+    while (g_hash_table_iter_next(&iter, &name, &value)) {
+        GjsSampledFunction *function = (GjsSampledFunction*) value;
+
+        parse_sps_label((const char*) name, &filename, &lineno);
+        fprintf(fp, "fl=%s\nfn=%s\n%u %" G_GUINT64_FORMAT "\n",
+                filename, (const char*) name, lineno, function->self);
+        g_free(filename);
+
+        if (function->callees == NULL)
+            continue;
+
+        g_hash_table_iter_init(&callee_iter, function->callees);
+        while (g_hash_table_iter_next(&callee_iter, &callee, &total)) {
+            unsigned callee_lineno;
+
+            parse_sps_label((const char*) callee, &filename, &callee_lineno);
+            fprintf(fp, "cfl=%s\ncfn=%s\ncalls=0 %u\n%u %" G_GUINT64_FORMAT "\n",
+                    filename, (const char*) callee, callee_lineno,
+                    lineno, *(guint64*) total);
+            g_free(filename);
+        }
+        fprintf(fp, "\n");
+    }
+
+    g_hash_table_destroy(by_name);
+}
+
+static void
+by_file_dump_callgrind_one(gpointer key,
+                           gpointer value,
+                           gpointer user_data)
+{
+    GjsProfileFunction *function = (GjsProfileFunction*) value;
+    FILE *fp = (FILE*) user_data;
+    GHashTableIter iter;
+    gpointer calleep, edgep;
+
+    if (function->profile.call_count == 0 && function->callees == NULL)
+        return;
+
+    fprintf(fp, "fl=%s\nfn=%s\n%u %" G_GINT64_FORMAT "\n",
+            function->key.filename, function->key.function_name,
+            function->key.lineno, function->profile.self_time);
+
+    if (function->callees != NULL) {
+        g_hash_table_iter_init(&iter, function->callees);
+        while (g_hash_table_iter_next(&iter, &calleep, &edgep)) {
+            GjsProfileFunction *callee = (GjsProfileFunction*) calleep;
+            GjsProfileEdge *edge = (GjsProfileEdge*) edgep;
+
+            fprintf(fp, "cfl=%s\ncfn=%s\ncalls=%u %u\n%u %" G_GINT64_FORMAT "\n",
+                    callee->key.filename, callee->key.function_name,
+                    edge->call_count, callee->key.lineno,
+                    function->key.lineno, edge->total_time);
+        }
+    }
+    fprintf(fp, "\n");
+}
+
+/* The native call's own cost is the C function, and it calls its
+ * marshalling phases.
+ */
+static void
+by_native_dump_callgrind_one(gpointer key,
+                             gpointer value,
+                             gpointer user_data)
+{
+    GjsProfileNative *native = (GjsProfileNative*) value;
+    FILE *fp = (FILE*) user_data;
+    static const struct {
+        GjsProfilerPhase phase;
+        const char *suffix;
+    } marshal_phases[] = {
+        { GJS_PROFILER_PHASE_MARSHAL_IN, "(marshal in)" },
+        { GJS_PROFILER_PHASE_MARSHAL_OUT, "(marshal out)" }
+    };
+    guint i;
+
+    if (native->call_count == 0)
+        return;
+
+    fprintf(fp, "fl=(native)\nfn=%s\n0 %" G_GINT64_FORMAT "\n",
+            native->label, native->times[GJS_PROFILER_PHASE_CALL]);
+    for (i = 0; i < G_N_ELEMENTS(marshal_phases); i++)
+        fprintf(fp, "cfn=%s %s\ncalls=%u 0\n0 %" G_GINT64_FORMAT "\n",
+                native->label, marshal_phases[i].suffix, native->call_count,
+                native->times[marshal_phases[i].phase]);
+    fprintf(fp, "\n");
+
+    for (i = 0; i < G_N_ELEMENTS(marshal_phases); i++)
+        fprintf(fp, "fn=%s %s\n0 %" G_GINT64_FORMAT "\n\n",
+                native->label, marshal_phases[i].suffix,
+                native->times[marshal_phases[i].phase]);
+}
+
+static void
+gjs_profiler_dump_callgrind(GjsProfiler *self,
+                            FILE        *fp)
+{
+    if (self->sampling) {
+        gjs_profiler_dump_callgrind_samples(self, fp);
+        return;
+    }
+
+    gjs_profiler_dump_callgrind_header(self, fp, "Time");
+    fprintf(fp, "# Time is in microseconds\n\n");
+
+    g_hash_table_foreach(self->by_file,
+                         by_file_dump_callgrind_one,
+                         fp);
+    g_hash_table_foreach(self->by_native,
+                         by_native_dump_callgrind_one,
+                         fp);
+}
+
 static void
 by_file_reset_one(gpointer key,
                   gpointer value,
@@ -370,14 +1460,47 @@ by_file_reset_one(gpointer key,
     p->call_count = 0;
     p->self_time  = 0;
     p->total_time = 0;
+
+    if (function->callees)
+        g_hash_table_remove_all(function->callees);
+}
+
+static void
+by_native_reset_one(gpointer key,
+                    gpointer value,
+                    gpointer user_data)
+{
+    GjsProfileNative *native = (GjsProfileNative*) value;
+
+    native->call_count = 0;
+    memset(native->times, 0, sizeof(native->times));
 }
 
 void
 gjs_profiler_reset(GjsProfiler *self)
 {
+    self->window_start = g_get_monotonic_time();
+
+    if (self->sampling) {
+        gjs_profiler_collect_samples(self);
+        gjs_call_node_free(self->root);
+        self->root = gjs_call_node_new(NULL, "(root)");
+        g_atomic_int_set(&self->n_samples, 0);
+        g_atomic_int_set(&self->n_idle_samples, 0);
+        g_atomic_int_set(&self->n_dropped_samples, 0);
+        return;
+    }
+
+    if (self->root)
+        gjs_call_node_reset(self->root);
+
+    gjs_profiler_flush_scripts(self);
     g_hash_table_foreach(self->by_file,
                          by_file_reset_one,
                          NULL);
+    g_hash_table_foreach(self->by_native,
+                         by_native_reset_one,
+                         NULL);
 }
 
 static void
@@ -406,6 +1529,44 @@ by_file_dump_one(gpointer key,
     by_file_reset_one(key, value, user_data);
 }
 
+/* Native calls get a row for the call itself, whose self time is the
+ * time spent in C (including any callbacks it made) and whose total
+ * includes marshalling, then one row per marshalling phase. The JS
+ * caller's self time still includes all of it.
+ */
+static void
+by_native_dump_one(gpointer key,
+                   gpointer value,
+                   gpointer user_data)
+{
+    GjsProfileNative *native = (GjsProfileNative*) value;
+    FILE *fp = (FILE*) user_data;
+    int64_t total;
+
+    if (native->call_count == 0)
+        return;
+
+    total = native->times[GJS_PROFILER_PHASE_MARSHAL_IN] +
+        native->times[GJS_PROFILER_PHASE_CALL] +
+        native->times[GJS_PROFILER_PHASE_MARSHAL_OUT];
+
+    fprintf(fp, "(native):0\t%s\t%u\t%.2f\t%.2f\n",
+            native->label, native->call_count,
+            native->times[GJS_PROFILER_PHASE_CALL] / 1000.,
+            total / 1000.);
+    fprintf(fp, "(native):0\t%s (marshal in)\t%u\t%.2f\t%.2f\n",
+            native->label, native->call_count,
+            native->times[GJS_PROFILER_PHASE_MARSHAL_IN] / 1000.,
+            native->times[GJS_PROFILER_PHASE_MARSHAL_IN] / 1000.);
+    fprintf(fp, "(native):0\t%s (marshal out)\t%u\t%.2f\t%.2f\n",
+            native->label, native->call_count,
+            native->times[GJS_PROFILER_PHASE_MARSHAL_OUT] / 1000.,
+            native->times[GJS_PROFILER_PHASE_MARSHAL_OUT] / 1000.);
+
+    /* reset counters so that next dump is delta from previous */
+    by_native_reset_one(key, value, user_data);
+}
+
 void
 gjs_profiler_dump(GjsProfiler *self)
 {
@@ -424,14 +1585,68 @@ gjs_profiler_dump(GjsProfiler *self)
     if (!fp)
         return;
 
-    /* file:line function calls self total */
-    fprintf(fp, "file:line\tfunction\tcalls\tself\ttotal\n");
+    if (self->sampling)
+        gjs_profiler_collect_samples(self);
+    else
+        gjs_profiler_flush_scripts(self);
+
+    switch (self->format) {
+    case GJS_PROFILER_FORMAT_CALLGRIND:
+        gjs_profiler_dump_callgrind(self, fp);
+        break;
+    case GJS_PROFILER_FORMAT_COLLAPSED:
+        gjs_profiler_dump_collapsed(self, fp);
+        break;
+    case GJS_PROFILER_FORMAT_TABLE:
+        if (self->sampling) {
+            gjs_profiler_dump_collapsed(self, fp);
+            break;
+        }
 
-    g_hash_table_foreach(self->by_file,
-                         by_file_dump_one,
-                         fp);
+        /* file:line function calls self total */
+        fprintf(fp, "file:line\tfunction\tcalls\tself\ttotal\n");
+
+        g_hash_table_foreach(self->by_file,
+                             by_file_dump_one,
+                             fp);
+        g_hash_table_foreach(self->by_native,
+                             by_native_dump_one,
+                             fp);
+        break;
+    }
 
     fclose(fp);
+
+    /* start a new window, so that next dump is delta from previous */
+    gjs_profiler_reset(self);
+}
+
+/* GJS_DEBUG_PROFILER_FORMAT, or else the suffix of the output name,
+ * such as "/tmp/app.callgrind" or "/tmp/app.folded".
+ */
+static GjsProfilerFormat
+gjs_profiler_get_format(const char *output)
+{
+    const char *format = g_getenv("GJS_DEBUG_PROFILER_FORMAT");
+
+    if (format != NULL) {
+        if (strcmp(format, "callgrind") == 0)
+            return GJS_PROFILER_FORMAT_CALLGRIND;
+        if (strcmp(format, "collapsed") == 0)
+            return GJS_PROFILER_FORMAT_COLLAPSED;
+        if (strcmp(format, "table") != 0)
+            g_warning("Unknown GJS_DEBUG_PROFILER_FORMAT '%s', expected "
+                      "'table', 'callgrind' or 'collapsed'", format);
+        return GJS_PROFILER_FORMAT_TABLE;
+    }
+
+    if (g_str_has_suffix(output, ".callgrind"))
+        return GJS_PROFILER_FORMAT_CALLGRIND;
+    if (g_str_has_suffix(output, ".collapsed") ||
+        g_str_has_suffix(output, ".folded"))
+        return GJS_PROFILER_FORMAT_COLLAPSED;
+
+    return GJS_PROFILER_FORMAT_TABLE;
 }
 
 GjsProfiler *
@@ -439,6 +1654,7 @@ gjs_profiler_new(JSRuntime *runtime)
 {
     GjsProfiler *self;
     const char  *profiler_output;
+    const char  *profiler_mode;
 
     /* FIXME: can handle only one runtime at the moment */
     g_return_val_if_fail(global_profiler == NULL, NULL);
@@ -450,6 +1666,18 @@ gjs_profiler_new(JSRuntime *runtime)
                               gjs_profile_function_key_equal,
                               NULL,
                               (GDestroyNotify)gjs_profile_function_free);
+    self->by_script =
+        g_hash_table_new_full(gjs_profile_script_key_hash,
+                              gjs_profile_script_key_equal,
+                              NULL,
+                              (GDestroyNotify)gjs_profile_script_free);
+    self->by_native =
+        g_hash_table_new_full(NULL, NULL, NULL,
+                              (GDestroyNotify)gjs_profile_native_free);
+    self->resolved =
+        g_hash_table_new_full(gjs_profile_script_key_hash,
+                              gjs_profile_script_key_equal,
+                              g_free, NULL);
 
     profiler_output = g_getenv("GJS_DEBUG_PROFILER_OUTPUT");
     if (profiler_output != NULL) {
@@ -457,6 +1685,23 @@ gjs_profiler_new(JSRuntime *runtime)
             global_profiler_output = g_strdup(profiler_output);
         }
 
+        profiler_mode = g_getenv("GJS_DEBUG_PROFILER_MODE");
+        if (g_strcmp0(profiler_mode, "sample") == 0) {
+            const char *rate_env = g_getenv("GJS_DEBUG_PROFILER_RATE");
+            guint rate = DEFAULT_SAMPLE_RATE;
+
+            if (rate_env != NULL)
+                rate = CLAMP(g_ascii_strtoull(rate_env, NULL, 10),
+                             1, MAX_SAMPLE_RATE);
+            self->sample_interval_us = G_USEC_PER_SEC / rate;
+        } else if (profiler_mode != NULL &&
+                   strcmp(profiler_mode, "instrument") != 0) {
+            g_warning("Unknown GJS_DEBUG_PROFILER_MODE '%s', "
+                      "expected 'instrument' or 'sample'", profiler_mode);
+        }
+
+        self->format = gjs_profiler_get_format(profiler_output);
+
         gjs_profiler_profile(self, TRUE);
         g_assert(global_profiler == self);
     }
@@ -470,6 +1715,9 @@ gjs_profiler_free(GjsProfiler *self)
     gjs_profiler_profile(self, FALSE);
     g_assert(global_profiler == NULL);
 
+    g_hash_table_destroy(self->resolved);
+    g_hash_table_destroy(self->by_native);
+    g_hash_table_destroy(self->by_script);
     g_hash_table_destroy(self->by_file);
     g_slice_free(GjsProfiler, self);
 }
@@ -37,6 +37,39 @@ void         gjs_profiler_reset(GjsProfiler *self);
 
 void gjs_profiler_dump   (GjsProfiler *self);
 
+void gjs_profiler_gc_begin (GjsProfiler *self);
+
+/* Phases of a native call: for a GI function, converting the JS
+ * arguments, the C function itself and converting the results back;
+ * for a callback into JS, converting the C arguments, the JS function
+ * and converting its return value.
+ */
+typedef enum {
+    GJS_PROFILER_PHASE_MARSHAL_IN,
+    GJS_PROFILER_PHASE_CALL,
+    GJS_PROFILER_PHASE_MARSHAL_OUT,
+    GJS_PROFILER_N_PHASES
+} GjsProfilerPhase;
+
+typedef struct _GjsProfileNative GjsProfileNative;
+
+typedef struct {
+    gboolean          active;
+    GjsProfiler      *profiler;
+    guint             session;
+    GjsProfilerPhase  phase;
+    gint64            phase_start;
+    GjsProfileNative *native;
+} GjsProfilerNativeCall;
+
+gboolean gjs_profiler_is_active        (void);
+void     gjs_profiler_native_begin     (GjsProfilerNativeCall *call,
+                                        JSRuntime             *runtime,
+                                        const char            *label);
+void     gjs_profiler_native_set_phase (GjsProfilerNativeCall *call,
+                                        GjsProfilerPhase       phase);
+void     gjs_profiler_native_end       (GjsProfilerNativeCall *call);
+
 G_END_DECLS
 
 #endif /* __GJS_PROFILER_H__ */
@@ -38,6 +38,8 @@
 typedef struct {
     JSContext *context;
     jsid const_strings[GJS_STRING_LAST];
+    GjsGCSampler *gc_sampler;
+    GjsImportTrace *import_trace;
 } GjsRuntimeData;
 
 /* Keep this consistent with GjsConstString */
@@ -73,6 +75,47 @@ gjs_runtime_get_context(JSRuntime *runtime)
     return get_data(runtime)->context;
 }
 
+/**
+ * gjs_runtime_get_gc_sampler:
+ * @runtime: a #JSRuntime
+ *
+ * Gets the memory sampling state gjs_gc_memory_grew() keeps for this
+ * runtime.
+ *
+ * Return value: the sampler, or %NULL if GJS hasn't been initialized
+ * for the runtime.
+ */
+GjsGCSampler *
+gjs_runtime_get_gc_sampler(JSRuntime *runtime)
+{
+    GjsRuntimeData *data = get_data(runtime);
+
+    return data ? data->gc_sampler : NULL;
+}
+
+/**
+ * gjs_runtime_get_import_trace:
+ * @runtime: a #JSRuntime
+ *
+ * Gets the trace recording the imports done in this runtime.
+ *
+ * Return value: the trace, or %NULL if imports aren't being traced
+ */
+GjsImportTrace *
+gjs_runtime_get_import_trace(JSRuntime *runtime)
+{
+    GjsRuntimeData *data = get_data(runtime);
+
+    return data ? data->import_trace : NULL;
+}
+
+void
+gjs_runtime_set_import_trace(JSRuntime      *runtime,
+                             GjsImportTrace *trace)
+{
+    get_data(runtime)->import_trace = trace;
+}
+
 jsid
 gjs_runtime_get_const_string(JSRuntime      *runtime,
                              GjsConstString  name)
@@ -108,6 +151,8 @@ gjs_runtime_init_for_context(JSRuntime *runtime,
     data->context = context;
     for (i = 0; i < GJS_STRING_LAST; i++)
         data->const_strings[i] = gjs_intern_string_to_id(context, const_strings[i]);
+    data->gc_sampler = gjs_gc_sampler_new();
+    data->import_trace = NULL;
 
     JS_SetRuntimePrivate(runtime, data);
 }
@@ -115,5 +160,8 @@ gjs_runtime_init_for_context(JSRuntime *runtime,
 void
 gjs_runtime_deinit(JSRuntime *runtime)
 {
-    g_free(get_data(runtime));
+    GjsRuntimeData *data = get_data(runtime);
+
+    gjs_gc_sampler_free(data->gc_sampler);
+    g_free(data);
 }
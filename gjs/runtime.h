@@ -24,6 +24,9 @@
 #ifndef __GJS_RUNTIME_H__
 #define __GJS_RUNTIME_H__
 
+typedef struct _GjsGCSampler GjsGCSampler;
+typedef struct _GjsImportTrace GjsImportTrace;
+
 typedef enum {
   GJS_STRING_CONSTRUCTOR,
   GJS_STRING_PROTOTYPE,
@@ -53,6 +56,10 @@ void        gjs_runtime_init_for_context     (JSRuntime       *runtime,
 void        gjs_runtime_deinit               (JSRuntime       *runtime);
 
 JSContext*  gjs_runtime_get_context          (JSRuntime       *runtime);
+GjsGCSampler* gjs_runtime_get_gc_sampler     (JSRuntime       *runtime);
+GjsImportTrace* gjs_runtime_get_import_trace (JSRuntime       *runtime);
+void        gjs_runtime_set_import_trace     (JSRuntime       *runtime,
+                                              GjsImportTrace  *trace);
 jsid        gjs_runtime_get_const_string     (JSRuntime       *runtime,
                                               GjsConstString   string);
 
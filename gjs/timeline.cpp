@@ -0,0 +1,348 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include "timeline.h"
+
+#include <util/log.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* About 2 MB of events, a few seconds of a busy main loop */
+#define DEFAULT_N_EVENTS (1 << 16)
+#define MAX_N_EVENTS     (1 << 24)
+
+typedef struct {
+    const char *category;       /* owned by the strings table */
+    const char *name;           /* owned by the strings table */
+    gint64 start;
+    gint64 duration;            /* -1 for an instant event */
+} GjsTimelineEvent;
+
+struct _GjsTimeline {
+    char *output;
+    guint output_counter;
+    gint64 start;
+
+    /* Ring of the most recent events, in the order they finished */
+    GjsTimelineEvent *events;
+    guint n_events_max;
+    guint head;                 /* where the next event goes */
+    guint n_events;
+    guint64 n_dropped;
+
+    /* The names used by events in the ring, with how many use each.
+     * Scripts can make up names, so these are released with the events
+     * rather than interned for good.
+     */
+    GHashTable *strings;
+};
+
+static GjsTimeline *global_timeline = NULL;
+
+gboolean
+gjs_timeline_is_active(void)
+{
+    return global_timeline != NULL;
+}
+
+typedef struct {
+    guint refs;
+    char str[1];
+} TimelineString;
+
+static const char *
+timeline_ref_string(GjsTimeline *self,
+                    const char  *str)
+{
+    TimelineString *tstr;
+    gsize len;
+
+    tstr = (TimelineString *) g_hash_table_lookup(self->strings, str);
+    if (tstr == NULL) {
+        len = strlen(str);
+        tstr = (TimelineString *) g_malloc(G_STRUCT_OFFSET(TimelineString, str) + len + 1);
+        tstr->refs = 0;
+        memcpy(tstr->str, str, len + 1);
+        g_hash_table_insert(self->strings, tstr->str, tstr);
+    }
+
+    tstr->refs++;
+    return tstr->str;
+}
+
+static void
+timeline_unref_string(GjsTimeline *self,
+                      const char  *str)
+{
+    TimelineString *tstr = (TimelineString *) g_hash_table_lookup(self->strings, str);
+
+    if (--tstr->refs == 0)
+        g_hash_table_remove(self->strings, str);
+}
+
+static void
+timeline_record(GjsTimeline *self,
+                const char  *category,
+                const char  *name,
+                gint64       start,
+                gint64       duration)
+{
+    GjsTimelineEvent *event = &self->events[self->head];
+
+    /* Overwriting the oldest event */
+    if (self->n_events == self->n_events_max) {
+        timeline_unref_string(self, event->category);
+        timeline_unref_string(self, event->name);
+    }
+
+    event->category = timeline_ref_string(self, category);
+    event->name = timeline_ref_string(self, name);
+    event->start = start;
+    event->duration = duration;
+
+    self->head = (self->head + 1) % self->n_events_max;
+    if (self->n_events < self->n_events_max)
+        self->n_events++;
+    else
+        self->n_dropped++;
+}
+
+/**
+ * gjs_timeline_begin:
+ *
+ * Returns: the time to pass to gjs_timeline_end() when the event is
+ * over, or 0 if no timeline is recording
+ */
+gint64
+gjs_timeline_begin(void)
+{
+    if (G_LIKELY(global_timeline == NULL))
+        return 0;
+
+    return g_get_monotonic_time();
+}
+
+/* Records an event lasting from @start, as returned by
+ * gjs_timeline_begin(), until now. Events nest by time in the viewer,
+ * so the end of an inner event must come before the end of the outer
+ * one.
+ */
+void
+gjs_timeline_end(const char *category,
+                 const char *name,
+                 gint64      start)
+{
+    GjsTimeline *self = global_timeline;
+
+    if (G_LIKELY(self == NULL) || start == 0)
+        return;
+
+    timeline_record(self, category, name, start, g_get_monotonic_time() - start);
+}
+
+void
+gjs_timeline_mark(const char *category,
+                  const char *name)
+{
+    GjsTimeline *self = global_timeline;
+
+    if (G_LIKELY(self == NULL))
+        return;
+
+    timeline_record(self, category, name, g_get_monotonic_time(), -1);
+}
+
+static void
+dump_json_string(FILE       *fp,
+                 const char *str)
+{
+    const char *p;
+
+    fputc('"', fp);
+    for (p = str; *p != '\0'; p++) {
+        switch (*p) {
+        case '"':
+            fputs("\\\"", fp);
+            break;
+        case '\\':
+            fputs("\\\\", fp);
+            break;
+        default:
+            if ((guchar) *p < 0x20)
+                fprintf(fp, "\\u%04x", (guchar) *p);
+            else
+                fputc(*p, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/**
+ * gjs_timeline_dump:
+ * @self: a #GjsTimeline
+ * @error: return location for a #GError
+ *
+ * Writes the events in the ring to a new file named
+ * "<output>.<pid>.<counter>", as Chrome trace event JSON for
+ * chrome://tracing, and empties the ring. Times are microseconds since
+ * the timeline started, so the files of one run line up.
+ *
+ * Returns: %FALSE if the file couldn't be written
+ */
+gboolean
+gjs_timeline_dump(GjsTimeline  *self,
+                  GError      **error)
+{
+    guint pid = (guint) getpid();
+    char *filename;
+    FILE *fp;
+    guint i, first;
+    gboolean ret;
+
+    filename = g_strdup_printf("%s.%u.%u", self->output, pid, self->output_counter);
+    self->output_counter++;
+
+    fp = fopen(filename, "w");
+    if (fp == NULL) {
+        int errsv = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errsv),
+                    "Failed to open %s: %s", filename, g_strerror(errsv));
+        g_free(filename);
+        return FALSE;
+    }
+
+    fprintf(fp, "{\"traceEvents\":[\n"
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":1,"
+            "\"args\":{\"name\":\"JS\"}}", pid);
+
+    first = (self->head + self->n_events_max - self->n_events) % self->n_events_max;
+    for (i = 0; i < self->n_events; i++) {
+        GjsTimelineEvent *event = &self->events[(first + i) % self->n_events_max];
+
+        fputs(",\n{\"name\":", fp);
+        dump_json_string(fp, event->name);
+        fputs(",\"cat\":", fp);
+        dump_json_string(fp, event->category);
+
+        if (event->duration < 0)
+            fprintf(fp, ",\"ph\":\"i\",\"s\":\"t\",\"pid\":%u,\"tid\":1,"
+                    "\"ts\":%" G_GINT64_FORMAT "}",
+                    pid, event->start - self->start);
+        else
+            fprintf(fp, ",\"ph\":\"X\",\"pid\":%u,\"tid\":1,"
+                    "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT "}",
+                    pid, event->start - self->start, event->duration);
+    }
+
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\","
+            "\"otherData\":{\"droppedEvents\":%" G_GUINT64_FORMAT "}}\n",
+            self->n_dropped);
+
+    ret = !ferror(fp);
+    if (fclose(fp) != 0)
+        ret = FALSE;
+
+    if (!ret)
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_IO,
+                    "Failed to write timeline to %s", filename);
+    else
+        gjs_debug(GJS_DEBUG_CONTEXT, "Wrote %u timeline events to %s",
+                  self->n_events, filename);
+
+    self->n_events = 0;
+    self->n_dropped = 0;
+    g_hash_table_remove_all(self->strings);
+
+    g_free(filename);
+    return ret;
+}
+
+/**
+ * gjs_timeline_new:
+ * @output: prefix of the files to write the timeline to, or %NULL to
+ *   use $GJS_DEBUG_TIMELINE_OUTPUT
+ *
+ * The ring holds $GJS_DEBUG_TIMELINE_EVENTS events if set.
+ *
+ * Returns: a new timeline that records from now on, or %NULL if no
+ * output was given or another timeline is already recording.
+ */
+GjsTimeline *
+gjs_timeline_new(const char *output)
+{
+    GjsTimeline *self;
+    const char *n_events_env;
+
+    if (output == NULL)
+        output = g_getenv("GJS_DEBUG_TIMELINE_OUTPUT");
+    if (output == NULL || *output == '\0')
+        return NULL;
+
+    if (global_timeline != NULL) {
+        gjs_debug(GJS_DEBUG_CONTEXT,
+                  "Timeline already recording, not recording to '%s'", output);
+        return NULL;
+    }
+
+    self = g_slice_new0(GjsTimeline);
+    self->output = g_strdup(output);
+    self->start = g_get_monotonic_time();
+
+    self->n_events_max = DEFAULT_N_EVENTS;
+    n_events_env = g_getenv("GJS_DEBUG_TIMELINE_EVENTS");
+    if (n_events_env != NULL)
+        self->n_events_max = CLAMP(g_ascii_strtoull(n_events_env, NULL, 10),
+                                   1, MAX_N_EVENTS);
+    self->events = g_new(GjsTimelineEvent, self->n_events_max);
+    self->strings = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+
+    global_timeline = self;
+
+    return self;
+}
+
+/* Writes out whatever is left in the ring */
+void
+gjs_timeline_free(GjsTimeline *self)
+{
+    GError *error = NULL;
+
+    g_assert(global_timeline == self);
+    global_timeline = NULL;
+
+    if (self->n_events > 0 && !gjs_timeline_dump(self, &error)) {
+        gjs_debug(GJS_DEBUG_CONTEXT, "%s", error->message);
+        g_error_free(error);
+    }
+
+    g_hash_table_destroy(self->strings);
+    g_free(self->events);
+    g_free(self->output);
+    g_slice_free(GjsTimeline, self);
+}
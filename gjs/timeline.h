@@ -0,0 +1,56 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GJS_TIMELINE_H__
+#define __GJS_TIMELINE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Records context startup, main loop dispatch, evaluation, imports,
+ * closure calls and GC on one timeline, written out as Chrome trace
+ * event JSON. Events go to a fixed size ring, so a long running
+ * program keeps only the most recent ones. Only one timeline can be
+ * recording in the process at a time, and only from the JS thread; the
+ * calls below are no-ops when there is none.
+ */
+typedef struct _GjsTimeline GjsTimeline;
+
+GjsTimeline *gjs_timeline_new  (const char   *output);
+void         gjs_timeline_free (GjsTimeline  *self);
+gboolean     gjs_timeline_dump (GjsTimeline  *self,
+                                GError      **error);
+
+gboolean gjs_timeline_is_active (void);
+
+gint64 gjs_timeline_begin (void);
+void   gjs_timeline_end   (const char *category,
+                           const char *name,
+                           gint64      start);
+void   gjs_timeline_mark  (const char *category,
+                           const char *name);
+
+G_END_DECLS
+
+#endif /* __GJS_TIMELINE_H__ */
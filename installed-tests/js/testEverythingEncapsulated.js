@@ -184,7 +184,7 @@ function testVariantConstructor() {
     JSUnit.assertEquals('asig', unpacked[2]);
     JSUnit.assertTrue(unpacked[3] instanceof GLib.Variant);
     JSUnit.assertEquals('variant', unpacked[3].deep_unpack());
-    JSUnit.assertTrue(unpacked[4] instanceof Array);
+    JSUnit.assertTrue(unpacked[4] instanceof Uint32Array);
     JSUnit.assertEquals(2, unpacked[4].length);
 }
 
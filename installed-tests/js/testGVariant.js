@@ -0,0 +1,144 @@
+// tests for packing and unpacking GLib.Variant
+
+const JSUnit = imports.jsUnit;
+const ByteArray = imports.byteArray;
+const GLib = imports.gi.GLib;
+
+function testScalars() {
+    JSUnit.assertEquals(true, new GLib.Variant('b', 1).deep_unpack());
+    JSUnit.assertEquals(255, new GLib.Variant('y', 255).deep_unpack());
+    JSUnit.assertEquals(-42, new GLib.Variant('n', -42).deep_unpack());
+    JSUnit.assertEquals(11, new GLib.Variant('i', 10.5).deep_unpack());
+    JSUnit.assertEquals(4294967295, new GLib.Variant('u', 4294967295).deep_unpack());
+    JSUnit.assertEquals(-1234567890123, new GLib.Variant('x', -1234567890123).deep_unpack());
+    JSUnit.assertEquals(0.5, new GLib.Variant('d', 0.5).deep_unpack());
+    JSUnit.assertEquals('/org/gnome/gjs', new GLib.Variant('o', '/org/gnome/gjs').deep_unpack());
+    JSUnit.assertEquals('a{sv}', new GLib.Variant('g', 'a{sv}').deep_unpack());
+}
+
+function testOutOfRange() {
+    JSUnit.assertRaises(function() { new GLib.Variant('y', 256); });
+    JSUnit.assertRaises(function() { new GLib.Variant('q', -1); });
+    JSUnit.assertRaises(function() { new GLib.Variant('o', 'not a path'); });
+    JSUnit.assertRaises(function() { new GLib.Variant('u', NaN); });
+    JSUnit.assertRaises(function() { new GLib.Variant('u', Math.pow(2, 32)); });
+    JSUnit.assertRaises(function() { new GLib.Variant('x', NaN); });
+    JSUnit.assertRaises(function() { new GLib.Variant('x', Math.pow(2, 63)); });
+    JSUnit.assertRaises(function() { new GLib.Variant('t', NaN); });
+    JSUnit.assertRaises(function() { new GLib.Variant('t', Math.pow(2, 64)); });
+    JSUnit.assertEquals(-Math.pow(2, 63), new GLib.Variant('x', -Math.pow(2, 63)).unpack());
+}
+
+function testInvalidSignature() {
+    JSUnit.assertRaises(function() { new GLib.Variant('', 1); });
+    JSUnit.assertRaises(function() { new GLib.Variant('ii', 1); });
+    JSUnit.assertRaises(function() { new GLib.Variant('(i', [1]); });
+    JSUnit.assertRaises(function() { new GLib.Variant('a{vs}', {}); });
+    JSUnit.assertRaises(function() { new GLib.Variant('(si)', ['too few']); });
+}
+
+function testDictionary() {
+    let v = new GLib.Variant('a{sv}', { hello: new GLib.Variant('s', 'world'),
+                                        answer: new GLib.Variant('i', 42) });
+    JSUnit.assertEquals(2, v.n_children());
+
+    let unpacked = v.deep_unpack();
+    JSUnit.assertTrue(unpacked.hello instanceof GLib.Variant);
+    JSUnit.assertEquals('world', unpacked.hello.deep_unpack());
+    JSUnit.assertEquals(42, unpacked.answer.deep_unpack());
+
+    // keys come from property names, so they are converted back
+    let ints = new GLib.Variant('a{ib}', { 1: true, 2: false }).deep_unpack();
+    JSUnit.assertEquals(true, ints[1]);
+    JSUnit.assertEquals(false, ints[2]);
+}
+
+function testShallowUnpack() {
+    let v = new GLib.Variant('(sa{si})', ['string', { one: 1 }]);
+
+    let shallow = v.unpack();
+    JSUnit.assertTrue(shallow[0] instanceof GLib.Variant);
+    JSUnit.assertEquals('string', shallow[0].unpack());
+
+    let dict = shallow[1].unpack();
+    JSUnit.assertTrue(dict.one instanceof GLib.Variant);
+    JSUnit.assertEquals(1, dict.one.unpack());
+
+    let deep = v.deep_unpack();
+    JSUnit.assertEquals('string', deep[0]);
+    JSUnit.assertEquals(1, deep[1].one);
+}
+
+function testMaybe() {
+    JSUnit.assertEquals(5, new GLib.Variant('mi', 5).deep_unpack());
+    JSUnit.assertEquals(null, new GLib.Variant('mi', null).deep_unpack());
+    JSUnit.assertEquals(null, new GLib.Variant('ms', undefined).unpack());
+}
+
+function testArrays() {
+    let strv = new GLib.Variant('as', ['a', 'b', 'c']);
+    JSUnit.assertEquals('b', strv.deep_unpack()[1]);
+    JSUnit.assertEquals(0, new GLib.Variant('ai', []).deep_unpack().length);
+
+    let nested = new GLib.Variant('aai', [[1, 2], [3]]).deep_unpack();
+    JSUnit.assertEquals(2, nested.length);
+    JSUnit.assertEquals(3, nested[1][0]);
+
+    // shallow unpacking still gives the elements as variants
+    let shallow = new GLib.Variant('ai', [1, 2]).unpack();
+    JSUnit.assertTrue(shallow instanceof Array);
+    JSUnit.assertEquals(2, shallow[1].unpack());
+}
+
+function testTypedArrays() {
+    let ints = new GLib.Variant('ai', [1, -2, 3]).deep_unpack();
+    JSUnit.assertTrue(ints instanceof Int32Array);
+    JSUnit.assertEquals(3, ints.length);
+    JSUnit.assertEquals(-2, ints[1]);
+
+    JSUnit.assertTrue(new GLib.Variant('an', [1]).deep_unpack() instanceof Int16Array);
+    JSUnit.assertTrue(new GLib.Variant('aq', [1]).deep_unpack() instanceof Uint16Array);
+    JSUnit.assertTrue(new GLib.Variant('au', [1]).deep_unpack() instanceof Uint32Array);
+    JSUnit.assertTrue(new GLib.Variant('ad', [0.5]).deep_unpack() instanceof Float64Array);
+    JSUnit.assertEquals(0, new GLib.Variant('ad', []).deep_unpack().length);
+
+    let int64s = new GLib.Variant('ax', [-1234567890123, 5]).deep_unpack();
+    JSUnit.assertTrue(int64s instanceof Float64Array);
+    JSUnit.assertEquals(-1234567890123, int64s[0]);
+
+    // packing from a typed array of the same type, another type, and
+    // a Float64Array for 64-bit integers
+    let samples = new Float64Array([0.25, 0.5, 0.75]);
+    let v = new GLib.Variant('ad', samples);
+    JSUnit.assertTrue(v.equal(new GLib.Variant('ad', [0.25, 0.5, 0.75])));
+    JSUnit.assertTrue(new GLib.Variant('ai', new Int16Array([1, 2])).equal(new GLib.Variant('ai', [1, 2])));
+    JSUnit.assertTrue(new GLib.Variant('at', new Float64Array([7])).equal(new GLib.Variant('at', [7])));
+    JSUnit.assertRaises(function() { new GLib.Variant('at', new Float64Array([-1])); });
+    JSUnit.assertRaises(function() { new GLib.Variant('at', new Float64Array([NaN])); });
+    JSUnit.assertRaises(function() { new GLib.Variant('at', new Float64Array([Math.pow(2, 64)])); });
+    JSUnit.assertRaises(function() { new GLib.Variant('ax', new Float64Array([Math.pow(2, 63)])); });
+
+    let bytes = new GLib.Variant('ay', new Uint8Array([97, 98]));
+    JSUnit.assertEquals('ab', bytes.deep_unpack().toString());
+}
+
+function testByteString() {
+    let fromByteArray = new GLib.Variant('ay', ByteArray.fromString('abc'));
+    let fromArray = new GLib.Variant('ay', [97, 98, 99]);
+    let fromString = new GLib.Variant('ay', 'abc');
+    JSUnit.assertTrue(fromByteArray.equal(fromArray));
+    JSUnit.assertTrue(fromByteArray.equal(fromString));
+
+    let unpacked = fromArray.deep_unpack();
+    JSUnit.assertTrue(unpacked instanceof ByteArray.ByteArray);
+    JSUnit.assertEquals('abc', unpacked.toString());
+}
+
+function testRoundTrip() {
+    let value = ['name', [1, 2, 3], { key: new GLib.Variant('b', true) }, [['x', 1.5]]];
+    let v = new GLib.Variant('(saua{sv}a(sd))', value);
+    JSUnit.assertEquals('(saua{sv}a(sd))', v.get_type_string());
+    JSUnit.assertTrue(v.equal(new GLib.Variant(v.get_type_string(), v.deep_unpack())));
+}
+
+JSUnit.gjstestRun(this, JSUnit.setUp, JSUnit.tearDown);
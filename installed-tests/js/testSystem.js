@@ -14,5 +14,54 @@ function testVersion() {
     JSUnit.assert(System.version >= 13600);
 }
 
+function testGCStats() {
+    System.gc();
+    let stats = System.gcStats();
+    JSUnit.assert(stats.length > 0);
+
+    let last = stats[stats.length - 1];
+    JSUnit.assertEquals('api', last.reason);
+    JSUnit.assert(last.endTime >= last.startTime);
+    JSUnit.assert(last.slices >= 1);
+    JSUnit.assert(last.finalized.total >= 0);
+
+    System.gc();
+    let next = System.gcStats(1);
+    JSUnit.assertEquals(1, next.length);
+    JSUnit.assert(next[0].id > last.id);
+    JSUnit.assertEquals('api', next[0].reason);
+}
+
+function testGCStatsKeepAlive() {
+    const Gio = imports.gi.Gio;
+
+    // The keep-alive object holds the wrappers of GObjects that
+    // something besides their wrapper has a reference to; here, the
+    // action group holds one to each action.
+    const N_ACTIONS = 1000;
+    let group = new Gio.SimpleActionGroup();
+    for (let i = 0; i < N_ACTIONS; i++)
+        group.add_action(new Gio.SimpleAction({ name: 'test' + i }));
+
+    System.gc();
+    let last = System.gcStats(1)[0];
+    JSUnit.assert(last.keepAliveTraced >= N_ACTIONS);
+    JSUnit.assert(last.keepAliveTraceTime > 0);
+}
+
+function testMemoryCounters() {
+    // Define the class first, its prototype is counted too
+    const GDate = imports.gi.GLib.Date;
+
+    let before = System.memoryCounters();
+    let boxed = new GDate();
+    let after = System.memoryCounters();
+
+    JSUnit.assertEquals(before.boxed.count + 1, after.boxed.count);
+    JSUnit.assert(after.boxed.bytes > before.boxed.bytes);
+    JSUnit.assert(after.object.count >= 0);
+    JSUnit.assert(after.externalBytes >= 0);
+}
+
 JSUnit.gjstestRun(this, JSUnit.setUp, JSUnit.tearDown);
 
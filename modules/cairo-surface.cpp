@@ -33,6 +33,7 @@ typedef struct {
     JSContext       *context;
     JSObject        *object;
     cairo_surface_t *surface;
+    gsize            external_size; /* image data, see gjs_memory_external_add() */
 } GjsCairoSurface;
 
 GJS_DEFINE_PROTO_ABSTRACT("CairoSurface", cairo_surface)
@@ -47,6 +48,7 @@ gjs_cairo_surface_finalize(JSFreeOp *fop,
     if (priv == NULL)
         return;
     cairo_surface_destroy(priv->surface);
+    gjs_memory_external_remove(fop->runtime(), priv->external_size);
     g_slice_free(GjsCairoSurface, priv);
 }
 
@@ -158,6 +160,13 @@ gjs_cairo_surface_construct(JSContext       *context,
     priv->context = context;
     priv->object = object;
     priv->surface = cairo_surface_reference(surface);
+
+    /* The pixel data of image surfaces lives as long as the wrapper does */
+    if (cairo_surface_get_type(surface) == CAIRO_SURFACE_TYPE_IMAGE) {
+        priv->external_size = (gsize) cairo_image_surface_get_stride(surface) *
+            cairo_image_surface_get_height(surface);
+        gjs_memory_external_add(context, priv->external_size);
+    }
 }
 
 /**
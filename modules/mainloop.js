@@ -23,6 +23,7 @@
 
 const GLib = imports.gi.GLib;
 const GObject = imports.gi.GObject;
+const System = imports.system;
 
 var _mainLoops = {};
 
@@ -46,9 +47,28 @@ function quit(name) {
     loop.quit();
 }
 
+// When a timeline is recording, marks where a source was added and
+// puts each dispatch of it on the timeline
+function _traceSource(kind, handler) {
+    if (!System.timelineActive())
+        return handler;
+
+    let name = kind + ' ' + (handler.name || '(anonymous)');
+    System.timelineMark('mainloop', name + ' added');
+
+    return function() {
+        let start = System.timelineBegin();
+        try {
+            return handler.apply(this, arguments);
+        } finally {
+            System.timelineEnd('mainloop', name, start);
+        }
+    };
+}
+
 function idle_source(handler) {
     let s = GLib.idle_source_new();
-    GObject.source_set_closure(s, handler);
+    GObject.source_set_closure(s, _traceSource('idle', handler));
     return s;
 }
 
@@ -58,13 +78,13 @@ function idle_add(handler) {
 
 function timeout_source(timeout, handler) {
     let s = GLib.timeout_source_new(timeout);
-    GObject.source_set_closure(s, handler);
+    GObject.source_set_closure(s, _traceSource('timeout ' + timeout + 'ms', handler));
     return s;
 }
 
 function timeout_seconds_source(timeout, handler) {
     let s = GLib.timeout_source_new_seconds(timeout);
-    GObject.source_set_closure(s, handler);
+    GObject.source_set_closure(s, _traceSource('timeout ' + timeout + 's', handler));
     return s;
 }
 
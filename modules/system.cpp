@@ -29,6 +29,8 @@
 
 #include <gjs/gjs-module.h>
 #include <gi/object.h>
+#include <gjs/timeline.h>
+#include <gi/usage.h>
 #include "system.h"
 
 static JSBool
@@ -102,7 +104,363 @@ gjs_gc(JSContext *context,
     jsval *argv = JS_ARGV(cx, vp);
     if (!gjs_parse_args(context, "gc", "", argc, argv))
         return JS_FALSE;
-    JS_GC(JS_GetRuntime(context));
+    gjs_context_gc((GjsContext*) JS_GetContextPrivate(context));
+    return JS_TRUE;
+}
+
+static JSBool
+define_number(JSContext  *context,
+              JSObject   *obj,
+              const char *name,
+              double      value)
+{
+    jsval v;
+
+    if (!JS_NewNumberValue(context, value, &v))
+        return JS_FALSE;
+
+    return JS_DefineProperty(context, obj, name, v,
+                             NULL, NULL, JSPROP_ENUMERATE);
+}
+
+static JSObject *
+gc_record_to_object(JSContext   *context,
+                    GjsGCRecord *record)
+{
+    JSObject *obj;
+    JSObject *finalized;
+    jsval reason;
+
+    obj = JS_NewObject(context, NULL, NULL, NULL);
+    if (obj == NULL)
+        return NULL;
+    JS_AddObjectRoot(context, &obj);
+
+    finalized = JS_NewObject(context, NULL, NULL, NULL);
+    if (finalized == NULL ||
+        !JS_DefineProperty(context, obj, "finalized", OBJECT_TO_JSVAL(finalized),
+                           NULL, NULL, JSPROP_ENUMERATE))
+        goto fail;
+
+    if (!gjs_string_from_utf8(context, record->reason, -1, &reason) ||
+        !JS_DefineProperty(context, obj, "reason", reason,
+                           NULL, NULL, JSPROP_ENUMERATE))
+        goto fail;
+
+    /* Times are in milliseconds, like Date.now() differences */
+    if (!define_number(context, obj, "id", record->id) ||
+        !define_number(context, obj, "startTime", record->start_time / 1000.) ||
+        !define_number(context, obj, "endTime", record->end_time / 1000.) ||
+        !define_number(context, obj, "pauseTime", record->pause_time / 1000.) ||
+        !define_number(context, obj, "maxSliceTime", record->max_slice_time / 1000.) ||
+        !define_number(context, obj, "heapBytesBefore", record->heap_bytes_before) ||
+        !define_number(context, obj, "heapBytesAfter", record->heap_bytes_after) ||
+        !define_number(context, obj, "slices", record->n_slices) ||
+        !define_number(context, obj, "keepAliveTraceTime", record->keep_alive_trace_time / 1000.) ||
+        !define_number(context, obj, "keepAliveTraced", record->n_keep_alive_traced) ||
+        !define_number(context, finalized, "object", record->n_finalized_objects) ||
+        !define_number(context, finalized, "boxed", record->n_finalized_boxed) ||
+        !define_number(context, finalized, "gerror", record->n_finalized_gerrors) ||
+        !define_number(context, finalized, "closure", record->n_finalized_closures) ||
+        !define_number(context, finalized, "function", record->n_finalized_functions) ||
+        !define_number(context, finalized, "param", record->n_finalized_params) ||
+        !define_number(context, finalized, "total", record->n_finalized_total))
+        goto fail;
+
+    JS_RemoveObjectRoot(context, &obj);
+    return obj;
+
+ fail:
+    JS_RemoveObjectRoot(context, &obj);
+    return NULL;
+}
+
+typedef struct {
+    JSContext *context;
+    JSObject *result;
+    gboolean failed;
+} CounterData;
+
+static void
+add_counter_to_object(const char *name,
+                      int         count,
+                      int         finalized,
+                      gsize       bytes,
+                      gpointer    user_data)
+{
+    CounterData *data = (CounterData *) user_data;
+    JSObject *counter;
+
+    if (data->failed)
+        return;
+
+    counter = JS_NewObject(data->context, NULL, NULL, NULL);
+    if (counter == NULL ||
+        !JS_DefineProperty(data->context, data->result, name, OBJECT_TO_JSVAL(counter),
+                           NULL, NULL, JSPROP_ENUMERATE) ||
+        !define_number(data->context, counter, "count", count) ||
+        !define_number(data->context, counter, "finalized", finalized) ||
+        !define_number(data->context, counter, "bytes", bytes))
+        data->failed = TRUE;
+}
+
+/* memoryCounters() returns { kind: { count, finalized, bytes } } for
+ * each kind of wrapper, see gjs_memory_foreach_counter().
+ */
+static JSBool
+gjs_memory_counters(JSContext *context,
+                    unsigned   argc,
+                    jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    CounterData data;
+    JSBool ret = JS_FALSE;
+
+    if (!gjs_parse_args(context, "memoryCounters", "", argc, argv))
+        return JS_FALSE;
+
+    data.context = context;
+    data.failed = FALSE;
+    data.result = JS_NewObject(context, NULL, NULL, NULL);
+    if (data.result == NULL)
+        return JS_FALSE;
+    JS_AddObjectRoot(context, &data.result);
+
+    gjs_memory_foreach_counter(add_counter_to_object, &data);
+    if (data.failed)
+        goto out;
+
+    if (!define_number(context, data.result, "externalBytes",
+                       gjs_memory_get_external_bytes()))
+        goto out;
+
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(data.result));
+    ret = JS_TRUE;
+
+ out:
+    JS_RemoveObjectRoot(context, &data.result);
+    return ret;
+}
+
+static JSBool
+gjs_dump_heap_func(JSContext *context,
+                   unsigned   argc,
+                   jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    char *filename;
+    GError *error = NULL;
+    JSBool ret = JS_FALSE;
+
+    if (!gjs_parse_args(context, "dumpHeap", "F", argc, argv,
+                        "filename", &filename))
+        return JS_FALSE;
+
+    if (!gjs_context_dump_heap((GjsContext*) JS_GetContextPrivate(context),
+                               filename, &error)) {
+        gjs_throw_g_error(context, error);
+        goto out;
+    }
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    ret = JS_TRUE;
+
+ out:
+    g_free(filename);
+    return ret;
+}
+
+/* As many as a GjsContext keeps */
+#define MAX_GC_RECORDS 128
+
+/* gcStats([max]) returns records for the most recent collections,
+ * oldest first; see gjs_context_get_gc_records().
+ */
+static JSBool
+gjs_gc_stats(JSContext *context,
+             unsigned   argc,
+             jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    gint32 max = G_MAXINT32;
+    GjsGCRecord *records;
+    guint n_records;
+    guint i;
+    JSObject *array;
+    JSBool ret = JS_FALSE;
+
+    if (!gjs_parse_args(context, "gcStats", "|i", argc, argv, "max", &max))
+        return JS_FALSE;
+
+    if (max < 0) {
+        gjs_throw(context, "gcStats() needs a positive number of records");
+        return JS_FALSE;
+    }
+
+    records = g_new(GjsGCRecord, MIN(max, MAX_GC_RECORDS));
+    n_records = gjs_context_get_gc_records((GjsContext*) JS_GetContextPrivate(context),
+                                           records, MIN(max, MAX_GC_RECORDS));
+
+    array = JS_NewArrayObject(context, 0, NULL);
+    if (array == NULL)
+        goto out;
+    JS_AddObjectRoot(context, &array);
+
+    for (i = 0; i < n_records; i++) {
+        JSObject *record_obj;
+        jsval value;
+
+        record_obj = gc_record_to_object(context, &records[i]);
+        if (record_obj == NULL)
+            goto out_root;
+
+        value = OBJECT_TO_JSVAL(record_obj);
+        if (!JS_SetElement(context, array, i, &value))
+            goto out_root;
+    }
+
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(array));
+    ret = JS_TRUE;
+
+ out_root:
+    JS_RemoveObjectRoot(context, &array);
+ out:
+    g_free(records);
+    return ret;
+}
+
+/* dumpGIUsage(filename) writes what GJS_DEBUG_GI_USAGE_OUTPUT recorded
+ * so far, see gi/usage.h
+ */
+static JSBool
+gjs_dump_gi_usage_func(JSContext *context,
+                       unsigned   argc,
+                       jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    char *filename;
+    GError *error = NULL;
+    JSBool ret = JS_FALSE;
+
+    if (!gjs_parse_args(context, "dumpGIUsage", "F", argc, argv,
+                        "filename", &filename))
+        return JS_FALSE;
+
+    if (!gjs_gi_usage_dump(filename, &error)) {
+        gjs_throw_g_error(context, error);
+        goto out;
+    }
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    ret = JS_TRUE;
+
+ out:
+    g_free(filename);
+    return ret;
+}
+
+static JSBool
+gjs_dump_timeline_func(JSContext *context,
+                       unsigned   argc,
+                       jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    GError *error = NULL;
+
+    if (!gjs_parse_args(context, "dumpTimeline", "", argc, argv))
+        return JS_FALSE;
+
+    if (!gjs_context_dump_timeline((GjsContext*) JS_GetContextPrivate(context),
+                                   &error)) {
+        gjs_throw_g_error(context, error);
+        return JS_FALSE;
+    }
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+/* timelineActive(), timelineBegin(), timelineEnd() and timelineMark()
+ * let JS code put its own events on the timeline, see gjs/timeline.h.
+ * They cost a call each when no timeline is recording.
+ */
+static JSBool
+gjs_timeline_active(JSContext *context,
+                    unsigned   argc,
+                    jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+
+    if (!gjs_parse_args(context, "timelineActive", "", argc, argv))
+        return JS_FALSE;
+
+    JS_SET_RVAL(context, vp, BOOLEAN_TO_JSVAL(gjs_timeline_is_active()));
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_timeline_begin_func(JSContext *context,
+                        unsigned   argc,
+                        jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    jsval retval;
+
+    if (!gjs_parse_args(context, "timelineBegin", "", argc, argv))
+        return JS_FALSE;
+
+    if (!JS_NewNumberValue(context, (double) gjs_timeline_begin(), &retval))
+        return JS_FALSE;
+
+    JS_SET_RVAL(context, vp, retval);
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_timeline_end_func(JSContext *context,
+                      unsigned   argc,
+                      jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    char *category;
+    char *name;
+    gint64 start;
+
+    if (!gjs_parse_args(context, "timelineEnd", "sst", argc, argv,
+                        "category", &category,
+                        "name", &name,
+                        "start", &start))
+        return JS_FALSE;
+
+    gjs_timeline_end(category, name, start);
+
+    g_free(category);
+    g_free(name);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_timeline_mark_func(JSContext *context,
+                       unsigned   argc,
+                       jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    char *category;
+    char *name;
+
+    if (!gjs_parse_args(context, "timelineMark", "ss", argc, argv,
+                        "category", &category,
+                        "name", &name))
+        return JS_FALSE;
+
+    gjs_timeline_mark(category, name);
+
+    g_free(category);
+    g_free(name);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
     return JS_TRUE;
 }
 
@@ -124,6 +482,15 @@ static JSFunctionSpec module_funcs[] = {
     { "refcount", JSOP_WRAPPER (gjs_refcount), 1, GJS_MODULE_PROP_FLAGS },
     { "breakpoint", JSOP_WRAPPER (gjs_breakpoint), 0, GJS_MODULE_PROP_FLAGS },
     { "gc", JSOP_WRAPPER (gjs_gc), 0, GJS_MODULE_PROP_FLAGS },
+    { "gcStats", JSOP_WRAPPER (gjs_gc_stats), 0, GJS_MODULE_PROP_FLAGS },
+    { "memoryCounters", JSOP_WRAPPER (gjs_memory_counters), 0, GJS_MODULE_PROP_FLAGS },
+    { "dumpHeap", JSOP_WRAPPER (gjs_dump_heap_func), 1, GJS_MODULE_PROP_FLAGS },
+    { "dumpGIUsage", JSOP_WRAPPER (gjs_dump_gi_usage_func), 1, GJS_MODULE_PROP_FLAGS },
+    { "dumpTimeline", JSOP_WRAPPER (gjs_dump_timeline_func), 0, GJS_MODULE_PROP_FLAGS },
+    { "timelineActive", JSOP_WRAPPER (gjs_timeline_active), 0, GJS_MODULE_PROP_FLAGS },
+    { "timelineBegin", JSOP_WRAPPER (gjs_timeline_begin_func), 0, GJS_MODULE_PROP_FLAGS },
+    { "timelineEnd", JSOP_WRAPPER (gjs_timeline_end_func), 3, GJS_MODULE_PROP_FLAGS },
+    { "timelineMark", JSOP_WRAPPER (gjs_timeline_mark_func), 2, GJS_MODULE_PROP_FLAGS },
     { "exit", JSOP_WRAPPER (gjs_exit), 0, GJS_MODULE_PROP_FLAGS },
     { NULL },
 };
@@ -0,0 +1,38 @@
+// -*- mode: js; js-indent-level: 4; indent-tabs-mode: nil -*-
+// ByteArray conversions
+
+const ByteArray = imports.byteArray;
+
+const STRING = new Array(65).join('0123456789abcdef');
+
+const benchmarks = {
+    'from-string': function(n) {
+        for (let i = 0; i < n; i++)
+            ByteArray.fromString(STRING);
+    },
+
+    'to-string': function(n) {
+        let array = ByteArray.fromString(STRING);
+        for (let i = 0; i < n; i++)
+            array.toString();
+    },
+
+    'to-gbytes': function(n) {
+        let array = ByteArray.fromString(STRING);
+        for (let i = 0; i < n; i++)
+            array.toGBytes();
+    },
+
+    'from-gbytes': function(n) {
+        let bytes = ByteArray.fromString(STRING).toGBytes();
+        for (let i = 0; i < n; i++)
+            ByteArray.fromGBytes(bytes);
+    },
+
+    'index': function(n) {
+        let array = ByteArray.fromString(STRING);
+        let length = array.length;
+        for (let i = 0; i < n; i++)
+            array[i % length] = array[(i + 1) % length];
+    },
+};
@@ -0,0 +1,95 @@
+// -*- mode: js; js-indent-level: 4; indent-tabs-mode: nil -*-
+// Calls, properties, boxed fields and object wrapping through GI
+
+const GIMarshallingTests = imports.gi.GIMarshallingTests;
+const Regress = imports.gi.Regress;
+
+const CONST_STR = "const ♥ utf8";
+
+const benchmarks = {
+    'scalar-call': function(n) {
+        for (let i = 0; i < n; i++)
+            Regress.test_int32(i);
+    },
+
+    'no-arg-call': function(n) {
+        for (let i = 0; i < n; i++)
+            GIMarshallingTests.int_return_max();
+    },
+
+    'string-in': function(n) {
+        for (let i = 0; i < n; i++)
+            Regress.test_utf8_const_in(CONST_STR);
+    },
+
+    'string-return': function(n) {
+        for (let i = 0; i < n; i++)
+            Regress.test_utf8_nonconst_return();
+    },
+
+    'out-arg': function(n) {
+        for (let i = 0; i < n; i++)
+            Regress.test_utf8_out();
+    },
+
+    'array-in': function(n) {
+        let array = [1, 2, 3, 4];
+        for (let i = 0; i < n; i++)
+            Regress.test_array_int_in(array);
+    },
+
+    'array-out': function(n) {
+        for (let i = 0; i < n; i++)
+            Regress.test_array_int_full_out();
+    },
+
+    'property-get': function(n) {
+        let o = new Regress.TestObj({ int: 42 });
+        for (let i = 0; i < n; i++)
+            o.int;
+    },
+
+    'property-set': function(n) {
+        let o = new Regress.TestObj();
+        for (let i = 0; i < n; i++)
+            o.int = i;
+    },
+
+    'boxed-new': function(n) {
+        for (let i = 0; i < n; i++)
+            new Regress.TestStructA();
+    },
+
+    'boxed-field-get': function(n) {
+        let struct = new Regress.TestStructA({ some_int: 42 });
+        for (let i = 0; i < n; i++)
+            struct.some_int;
+    },
+
+    'boxed-field-set': function(n) {
+        let struct = new Regress.TestStructA();
+        for (let i = 0; i < n; i++)
+            struct.some_int = i;
+    },
+
+    'object-new': function(n) {
+        for (let i = 0; i < n; i++)
+            new Regress.TestObj();
+    },
+
+    'object-wrap': function(n) {
+        for (let i = 0; i < n; i++)
+            GIMarshallingTests.Object.full_return();
+    },
+
+    'object-rewrap': function(n) {
+        for (let i = 0; i < n; i++)
+            GIMarshallingTests.Object.none_return();
+    },
+
+    'callback': function(n) {
+        let callback = function() { return 42; };
+        for (let i = 0; i < n; i++)
+            Regress.test_callback(callback);
+    },
+};
@@ -0,0 +1,35 @@
+// -*- mode: js; js-indent-level: 4; indent-tabs-mode: nil -*-
+// GObject signal connection, emission and delivery
+
+const Regress = imports.gi.Regress;
+
+const benchmarks = {
+    'connect-disconnect': function(n) {
+        let o = new Regress.TestObj();
+        let handler = function() {};
+        for (let i = 0; i < n; i++)
+            o.disconnect(o.connect('test', handler));
+    },
+
+    'emit-unconnected': function(n) {
+        let o = new Regress.TestObj();
+        for (let i = 0; i < n; i++)
+            o.emit('test');
+    },
+
+    'emit-deliver': function(n) {
+        let o = new Regress.TestObj();
+        let count = 0;
+        o.connect('test', function() { count++; });
+        for (let i = 0; i < n; i++)
+            o.emit('test');
+    },
+
+    'emit-deliver-notify': function(n) {
+        let o = new Regress.TestObj();
+        let count = 0;
+        o.connect('notify::int', function() { count++; });
+        for (let i = 0; i < n; i++)
+            o.int = i;
+    },
+};
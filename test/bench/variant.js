@@ -0,0 +1,54 @@
+// -*- mode: js; js-indent-level: 4; indent-tabs-mode: nil -*-
+// GVariant packing and unpacking through the GLib override
+
+const GLib = imports.gi.GLib;
+
+const DICT = { 'hello': new GLib.Variant('s', 'world'),
+               'answer': new GLib.Variant('i', 42),
+               'ratio': new GLib.Variant('d', 0.5) };
+
+const benchmarks = {
+    'pack-scalar': function(n) {
+        for (let i = 0; i < n; i++)
+            new GLib.Variant('i', i);
+    },
+
+    'pack-struct': function(n) {
+        for (let i = 0; i < n; i++)
+            new GLib.Variant('(sidb)', ['string', i, 0.5, true]);
+    },
+
+    'pack-dict': function(n) {
+        for (let i = 0; i < n; i++)
+            new GLib.Variant('a{sv}', DICT);
+    },
+
+    'pack-int-array': function(n) {
+        let array = [];
+        for (let i = 0; i < 256; i++)
+            array.push(i);
+        for (let i = 0; i < n; i++)
+            new GLib.Variant('ai', array);
+    },
+
+    'unpack-struct': function(n) {
+        let v = new GLib.Variant('(sidb)', ['string', 42, 0.5, true]);
+        for (let i = 0; i < n; i++)
+            v.deep_unpack();
+    },
+
+    'unpack-dict': function(n) {
+        let v = new GLib.Variant('a{sv}', DICT);
+        for (let i = 0; i < n; i++)
+            v.deep_unpack();
+    },
+
+    'unpack-int-array': function(n) {
+        let array = [];
+        for (let i = 0; i < 256; i++)
+            array.push(i);
+        let v = new GLib.Variant('ai', array);
+        for (let i = 0; i < n; i++)
+            v.deep_unpack();
+    },
+};
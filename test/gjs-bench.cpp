@@ -0,0 +1,554 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Micro-benchmarks for the GI bridge.
+ *
+ * Each .js file in the benchmark directory defines a `benchmarks`
+ * object mapping names to functions taking an iteration count; the
+ * function does its own setup and then performs the operation being
+ * measured that many times. A few benchmarks that need a fresh
+ * context for every operation (module imports) are written in C
+ * below instead.
+ *
+ * Every benchmark is calibrated until one run takes at least
+ * --min-time, then run --runs times. We report the fastest and the
+ * median time per operation, and the number of malloc() calls per
+ * operation, SpiderMonkey's included. Run with G_SLICE=always-malloc to
+ * include slice allocations in the count; "make bench" does this for
+ * you.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <gio/gio.h>
+#include <gjs/gjs-module.h>
+#include <util/glib.h>
+
+static char *filter = NULL;
+static int min_time = 200;
+static int n_runs = 5;
+static char *json_output = NULL;
+static char **benchmark_paths = NULL;
+
+static GOptionEntry entries[] = {
+    { "filter", 'f', 0, G_OPTION_ARG_STRING, &filter, "Only run benchmarks whose name matches PATTERN", "PATTERN" },
+    { "min-time", 't', 0, G_OPTION_ARG_INT, &min_time, "Run each benchmark for at least MS milliseconds", "MS" },
+    { "runs", 'r', 0, G_OPTION_ARG_INT, &n_runs, "Repeat each benchmark N times", "N" },
+    { "json", 'j', 0, G_OPTION_ARG_FILENAME, &json_output, "Also write the results to FILE as JSON", "FILE" },
+    { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &benchmark_paths, NULL, "[FILE|DIR...]" },
+    { NULL }
+};
+
+/* Allocation counting. With glibc we interpose malloc() for the whole
+ * process, so that every library's allocations are counted, on any
+ * thread. Elsewhere the count is not available and is left out of the
+ * results.
+ */
+static volatile gint n_allocs = 0;
+
+#ifdef __GLIBC__
+#define COUNTING_ALLOCS 1
+
+extern "C" {
+
+extern void *__libc_malloc(size_t n_bytes);
+extern void *__libc_calloc(size_t n_blocks, size_t n_block_bytes);
+extern void *__libc_realloc(void *mem, size_t n_bytes);
+
+void *
+malloc(size_t n_bytes) __THROW
+{
+    g_atomic_int_inc(&n_allocs);
+    return __libc_malloc(n_bytes);
+}
+
+void *
+calloc(size_t n_blocks,
+       size_t n_block_bytes) __THROW
+{
+    g_atomic_int_inc(&n_allocs);
+    return __libc_calloc(n_blocks, n_block_bytes);
+}
+
+void *
+realloc(void   *mem,
+        size_t  n_bytes) __THROW
+{
+    if (mem == NULL)
+        g_atomic_int_inc(&n_allocs);
+    return __libc_realloc(mem, n_bytes);
+}
+
+}
+#else
+#define COUNTING_ALLOCS 0
+#endif
+
+typedef struct _Benchmark Benchmark;
+
+/* Performs @n_ops operations, storing the time they took in
+ * @elapsed_p and the allocations they made in @allocs_p. JS
+ * benchmarks are timed as a whole, so any setup done inside the
+ * function is counted too, spread over the @n_ops operations; C
+ * benchmarks leave context creation and destruction out.
+ */
+typedef gboolean (*BenchmarkRunFunc) (Benchmark *bench,
+                                      guint64    n_ops,
+                                      gint64    *elapsed_p,
+                                      guint     *allocs_p);
+
+struct _Benchmark {
+    char *name;
+    BenchmarkRunFunc run;
+    GjsContext *context;   /* JS benchmarks: the context the file was loaded in */
+    char *key;             /* JS benchmarks: property of `benchmarks` */
+    const char *script;    /* C benchmarks: evaluated once per operation */
+};
+
+typedef struct {
+    const char *name;
+    guint64 n_ops;
+    double ns_per_op_min;
+    double ns_per_op_median;
+    double allocs_per_op;
+} BenchmarkResult;
+
+static gboolean
+run_js_benchmark(Benchmark *bench,
+                 guint64    n_ops,
+                 gint64    *elapsed_p,
+                 guint     *allocs_p)
+{
+    JSContext *context;
+    JSObject *global;
+    jsval benchmarks_val, func_val, arg, rval;
+    gint64 start;
+    guint allocs_start;
+    gboolean ret = FALSE;
+
+    context = (JSContext *) gjs_context_get_native_context(bench->context);
+    global = JS_GetGlobalObject(context);
+
+    JS_BeginRequest(context);
+    JSAutoCompartment ac(context, global);
+
+    if (!JS_GetProperty(context, global, "benchmarks", &benchmarks_val) ||
+        !JSVAL_IS_OBJECT(benchmarks_val) || JSVAL_IS_NULL(benchmarks_val) ||
+        !JS_GetProperty(context, JSVAL_TO_OBJECT(benchmarks_val),
+                        bench->key, &func_val) ||
+        !JS_NewNumberValue(context, (double) n_ops, &arg)) {
+        gjs_log_exception(context);
+        goto out;
+    }
+
+    allocs_start = g_atomic_int_get(&n_allocs);
+    start = g_get_monotonic_time();
+
+    if (!gjs_call_function_value(context, global, func_val, 1, &arg, &rval)) {
+        gjs_log_exception(context);
+        goto out;
+    }
+
+    *elapsed_p = (g_get_monotonic_time() - start) * 1000;
+    *allocs_p = g_atomic_int_get(&n_allocs) - allocs_start;
+    ret = TRUE;
+
+ out:
+    JS_EndRequest(context);
+    return ret;
+}
+
+static gboolean
+run_context_benchmark(Benchmark *bench,
+                      guint64    n_ops,
+                      gint64    *elapsed_p,
+                      guint     *allocs_p)
+{
+    guint64 i;
+
+    *elapsed_p = 0;
+    *allocs_p = 0;
+
+    for (i = 0; i < n_ops; i++) {
+        GjsContext *js_context;
+        GError *error = NULL;
+        gint64 start;
+        guint allocs_start;
+        int code;
+        gboolean success;
+
+        js_context = gjs_context_new();
+
+        allocs_start = g_atomic_int_get(&n_allocs);
+        start = g_get_monotonic_time();
+
+        success = gjs_context_eval(js_context, bench->script, -1,
+                                   "<benchmark>", &code, &error);
+
+        *elapsed_p += (g_get_monotonic_time() - start) * 1000;
+        *allocs_p += g_atomic_int_get(&n_allocs) - allocs_start;
+
+        g_object_unref(js_context);
+
+        if (!success) {
+            g_printerr("%s: %s\n", bench->name, error->message);
+            g_error_free(error);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static const struct {
+    const char *name;
+    const char *script;
+} context_benchmarks[] = {
+    { "import/gi-namespace", "imports.gi.GIMarshallingTests;" },
+    { "import/module", "imports.lang;" },
+    { "import/mainloop", "imports.mainloop;" }
+};
+
+static void
+benchmark_free(Benchmark *bench)
+{
+    g_free(bench->name);
+    g_free(bench->key);
+    if (bench->context)
+        g_object_unref(bench->context);
+    g_slice_free(Benchmark, bench);
+}
+
+static gboolean
+benchmark_selected(const char *name)
+{
+    return filter == NULL || g_pattern_match_simple(filter, name);
+}
+
+/* Loads @path into a context of its own and appends a Benchmark for
+ * each selected property of its `benchmarks` object.
+ */
+static gboolean
+load_benchmark_file(GPtrArray  *benchmarks,
+                    const char *path,
+                    GError    **error)
+{
+    GjsContext *js_context;
+    JSContext *context;
+    JSObject *global;
+    JSObject *props_iter;
+    jsval benchmarks_val;
+    jsid prop_id;
+    char *basename, *prefix;
+    char *key;
+    int code;
+    gboolean ret = FALSE;
+
+    js_context = gjs_context_new();
+    if (!gjs_context_eval_file(js_context, path, &code, error)) {
+        g_object_unref(js_context);
+        return FALSE;
+    }
+
+    basename = g_path_get_basename(path);
+    prefix = g_strndup(basename, strlen(basename) - strlen(".js"));
+    g_free(basename);
+
+    context = (JSContext *) gjs_context_get_native_context(js_context);
+    global = JS_GetGlobalObject(context);
+
+    JS_BeginRequest(context);
+    JSAutoCompartment ac(context, global);
+
+    if (!JS_GetProperty(context, global, "benchmarks", &benchmarks_val) ||
+        !JSVAL_IS_OBJECT(benchmarks_val) || JSVAL_IS_NULL(benchmarks_val)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                    "%s does not define a benchmarks object", path);
+        goto out;
+    }
+
+    props_iter = JS_NewPropertyIterator(context, JSVAL_TO_OBJECT(benchmarks_val));
+    if (props_iter == NULL) {
+        gjs_log_exception(context);
+        goto out;
+    }
+
+    prop_id = JSID_VOID;
+    if (!JS_NextProperty(context, props_iter, &prop_id))
+        goto out;
+
+    while (!JSID_IS_VOID(prop_id)) {
+        if (gjs_get_string_id(context, prop_id, &key)) {
+            char *name = g_strconcat(prefix, "/", key, NULL);
+
+            if (benchmark_selected(name)) {
+                Benchmark *bench = g_slice_new0(Benchmark);
+
+                bench->name = name;
+                bench->run = run_js_benchmark;
+                bench->context = (GjsContext *) g_object_ref(js_context);
+                bench->key = key;
+                g_ptr_array_add(benchmarks, bench);
+            } else {
+                g_free(name);
+                g_free(key);
+            }
+        }
+
+        prop_id = JSID_VOID;
+        if (!JS_NextProperty(context, props_iter, &prop_id))
+            goto out;
+    }
+
+    ret = TRUE;
+
+ out:
+    JS_EndRequest(context);
+    g_free(prefix);
+    g_object_unref(js_context);
+    return ret;
+}
+
+static int
+compare_filenames(gconstpointer a,
+                  gconstpointer b)
+{
+    return strcmp(*(const char * const *) a, *(const char * const *) b);
+}
+
+static gboolean
+load_benchmarks(GPtrArray  *benchmarks,
+                const char *path,
+                GError    **error)
+{
+    GDir *dir;
+    const char *filename;
+    GPtrArray *filenames;
+    gboolean ret = TRUE;
+    guint i;
+
+    if (!g_file_test(path, G_FILE_TEST_IS_DIR))
+        return load_benchmark_file(benchmarks, path, error);
+
+    dir = g_dir_open(path, 0, error);
+    if (dir == NULL)
+        return FALSE;
+
+    filenames = g_ptr_array_new_with_free_func(g_free);
+    while ((filename = g_dir_read_name(dir))) {
+        if (filename[0] != '.' && g_str_has_suffix(filename, ".js"))
+            g_ptr_array_add(filenames, g_build_filename(path, filename, NULL));
+    }
+    g_dir_close(dir);
+
+    /* Run in a stable order so results line up between builds */
+    g_ptr_array_sort(filenames, compare_filenames);
+
+    for (i = 0; ret && i < filenames->len; i++)
+        ret = load_benchmark_file(benchmarks,
+                                  (const char *) filenames->pdata[i], error);
+
+    g_ptr_array_free(filenames, TRUE);
+    return ret;
+}
+
+static int
+compare_doubles(gconstpointer a,
+                gconstpointer b)
+{
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+
+    return da < db ? -1 : da > db ? 1 : 0;
+}
+
+static gboolean
+run_benchmark(Benchmark       *bench,
+              BenchmarkResult *result)
+{
+    gint64 target = (gint64) min_time * 1000000;
+    guint64 n_ops = 1;
+    gint64 elapsed;
+    guint allocs, min_allocs = G_MAXUINT;
+    double *times;
+    int i;
+
+    /* Warm up and calibrate; grow the iteration count until a single
+     * run is long enough to time reliably.
+     */
+    for (;;) {
+        if (!bench->run(bench, n_ops, &elapsed, &allocs))
+            return FALSE;
+        if (elapsed >= target || n_ops >= G_MAXUINT32)
+            break;
+
+        if (elapsed <= 0)
+            n_ops *= 100;
+        else
+            n_ops = MAX(n_ops * 2, MIN(n_ops * 100, (guint64) (n_ops * 1.2 * target / elapsed)));
+    }
+
+    times = g_new(double, n_runs);
+    for (i = 0; i < n_runs; i++) {
+        if (bench->context)
+            gjs_context_gc(bench->context);
+
+        if (!bench->run(bench, n_ops, &elapsed, &allocs)) {
+            g_free(times);
+            return FALSE;
+        }
+
+        times[i] = (double) elapsed / n_ops;
+        min_allocs = MIN(min_allocs, allocs);
+    }
+    qsort(times, n_runs, sizeof(double), compare_doubles);
+
+    result->name = bench->name;
+    result->n_ops = n_ops;
+    result->ns_per_op_min = times[0];
+    result->ns_per_op_median = times[n_runs / 2];
+    result->allocs_per_op = (double) min_allocs / n_ops;
+
+    g_free(times);
+    return TRUE;
+}
+
+static char *
+results_to_json(GArray *results)
+{
+    GString *json;
+    guint i;
+
+    json = g_string_new("{\n");
+    g_string_append_printf(json, "  \"version\": \"%s\",\n", PACKAGE_VERSION);
+    g_string_append_printf(json, "  \"min_time_ms\": %d,\n", min_time);
+    g_string_append_printf(json, "  \"runs\": %d,\n", n_runs);
+    g_string_append(json, "  \"benchmarks\": [");
+
+    for (i = 0; i < results->len; i++) {
+        BenchmarkResult *result = &g_array_index(results, BenchmarkResult, i);
+
+        g_string_append_printf(json,
+                               "%s\n    { \"name\": \"%s\", \"iterations\": %" G_GUINT64_FORMAT
+                               ", \"ns_per_op\": %.1f, \"ns_per_op_median\": %.1f",
+                               i == 0 ? "" : ",",
+                               result->name, result->n_ops,
+                               result->ns_per_op_min, result->ns_per_op_median);
+        if (COUNTING_ALLOCS)
+            g_string_append_printf(json, ", \"allocs_per_op\": %.2f", result->allocs_per_op);
+        g_string_append(json, " }");
+    }
+
+    g_string_append(json, results->len > 0 ? "\n  ]\n}\n" : "]\n}\n");
+
+    return g_string_free(json, FALSE);
+}
+
+int
+main(int    argc,
+     char **argv)
+{
+    GOptionContext *option_context;
+    GError *error = NULL;
+    GPtrArray *benchmarks;
+    GArray *results;
+    const char *default_paths[] = { GJS_BENCH_DIR, NULL };
+    const char * const *paths;
+    int status = 0;
+    guint i;
+
+    option_context = g_option_context_new(NULL);
+    g_option_context_set_summary(option_context,
+                                 "Run micro-benchmarks of the GI bridge, reporting "
+                                 "nanoseconds and allocations per operation.");
+    g_option_context_add_main_entries(option_context, entries, NULL);
+    if (!g_option_context_parse(option_context, &argc, &argv, &error))
+        g_error("option parsing failed: %s", error->message);
+    g_option_context_free(option_context);
+
+    if (min_time <= 0 || n_runs <= 0)
+        g_error("--min-time and --runs must be positive");
+
+    benchmarks = g_ptr_array_new_with_free_func((GDestroyNotify) benchmark_free);
+
+    paths = benchmark_paths ? (const char * const *) benchmark_paths : default_paths;
+    for (i = 0; paths[i] != NULL; i++) {
+        if (!load_benchmarks(benchmarks, paths[i], &error))
+            g_error("Failed to load benchmarks from %s: %s", paths[i], error->message);
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(context_benchmarks); i++) {
+        Benchmark *bench;
+
+        if (!benchmark_selected(context_benchmarks[i].name))
+            continue;
+
+        bench = g_slice_new0(Benchmark);
+        bench->name = g_strdup(context_benchmarks[i].name);
+        bench->run = run_context_benchmark;
+        bench->script = context_benchmarks[i].script;
+        g_ptr_array_add(benchmarks, bench);
+    }
+
+    results = g_array_new(FALSE, FALSE, sizeof(BenchmarkResult));
+
+    g_print("# name\tns/op\tmedian ns/op\tallocs/op\titerations\n");
+    for (i = 0; i < benchmarks->len; i++) {
+        Benchmark *bench = (Benchmark *) benchmarks->pdata[i];
+        BenchmarkResult result;
+
+        if (!run_benchmark(bench, &result)) {
+            g_printerr("%s: failed\n", bench->name);
+            status = 1;
+            continue;
+        }
+
+        if (COUNTING_ALLOCS)
+            g_print("%s\t%.1f\t%.1f\t%.2f\t%" G_GUINT64_FORMAT "\n",
+                    result.name, result.ns_per_op_min, result.ns_per_op_median,
+                    result.allocs_per_op, result.n_ops);
+        else
+            g_print("%s\t%.1f\t%.1f\t-\t%" G_GUINT64_FORMAT "\n",
+                    result.name, result.ns_per_op_min, result.ns_per_op_median,
+                    result.n_ops);
+        g_array_append_val(results, result);
+    }
+
+    if (json_output != NULL) {
+        char *json = results_to_json(results);
+
+        if (!g_file_set_contents(json_output, json, -1, &error)) {
+            g_printerr("Failed to write %s: %s\n", json_output, error->message);
+            g_clear_error(&error);
+            status = 1;
+        }
+        g_free(json);
+    }
+
+    g_array_free(results, TRUE);
+    g_ptr_array_free(benchmarks, TRUE);
+
+    return status;
+}
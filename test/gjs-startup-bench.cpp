@@ -0,0 +1,575 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  Endless Mobile, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Startup time benchmark.
+ *
+ * Launches gjs-console on a few representative workloads many times
+ * and reports how long each phase of startup took. The phases other
+ * than the total come from the timeline gjs-console records when
+ * $GJS_DEBUG_TIMELINE_OUTPUT is set:
+ *
+ *   context   constructing the GjsContext, importer setup included
+ *   importer  creating and defining the root importer
+ *   first-gi  the first import of imports.gi
+ *   eval      evaluating the workload's script
+ *   total     wall clock time from spawning the process until it exits
+ *
+ * The page cache is warmed by a run that is not counted, so "cold"
+ * here means a fresh process rather than a cold disk. When run
+ * uninstalled the total includes libtool's wrapper script; only
+ * compare against baselines from the same kind of build.
+ *
+ * With --baseline, the medians are compared with a file written by
+ * --write-baseline and the program fails if any phase got slower by
+ * more than --tolerance percent plus --slack milliseconds.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <girepository.h>
+
+typedef enum {
+    PHASE_CONTEXT,
+    PHASE_IMPORTER,
+    PHASE_FIRST_GI,
+    PHASE_EVAL,
+    PHASE_TOTAL,
+    N_PHASES
+} Phase;
+
+enum {
+    WORKLOAD_EMPTY,
+    WORKLOAD_GI,
+    WORKLOAD_GTK,
+    WORKLOAD_MODULES,
+    WORKLOAD_LARGE_SCRIPT,
+    N_WORKLOADS
+};
+
+static const char *phase_names[N_PHASES] = {
+    "context",
+    "importer",
+    "first-gi",
+    "eval",
+    "total"
+};
+
+typedef struct {
+    const char *name;
+    char *script;         /* passed with -c */
+    char *script_file;    /* or run as a file */
+    const char *skip_reason;
+    GArray *times[N_PHASES];  /* of double, milliseconds */
+} Workload;
+
+static char *gjs_console = NULL;
+static int n_runs = 20;
+static char *filter = NULL;
+static char *baseline = NULL;
+static char *write_baseline = NULL;
+static double tolerance = 20.0;
+static double slack = 2.0;
+
+static GOptionEntry entries[] = {
+    { "gjs", 0, 0, G_OPTION_ARG_FILENAME, &gjs_console, "Run PROGRAM instead of the gjs-console in the build tree", "PROGRAM" },
+    { "runs", 'r', 0, G_OPTION_ARG_INT, &n_runs, "Launch each workload N times", "N" },
+    { "filter", 'f', 0, G_OPTION_ARG_STRING, &filter, "Only run workloads whose name matches PATTERN", "PATTERN" },
+    { "baseline", 'b', 0, G_OPTION_ARG_FILENAME, &baseline, "Fail if slower than the medians stored in FILE", "FILE" },
+    { "write-baseline", 'w', 0, G_OPTION_ARG_FILENAME, &write_baseline, "Store the medians in FILE", "FILE" },
+    { "tolerance", 't', 0, G_OPTION_ARG_DOUBLE, &tolerance, "Allow phases to get PERCENT slower than the baseline", "PERCENT" },
+    { "slack", 's', 0, G_OPTION_ARG_DOUBLE, &slack, "Also allow MS milliseconds on top, for phases too short to time reliably", "MS" },
+    { NULL }
+};
+
+static GRegex *event_regex = NULL;
+
+/* Events are written one per line, see gjs_timeline_dump() */
+static void
+parse_timeline(const char *contents,
+               double      times[N_PHASES])
+{
+    GMatchInfo *match_info;
+
+    g_regex_match(event_regex, contents, (GRegexMatchFlags) 0, &match_info);
+    while (g_match_info_matches(match_info)) {
+        char *name = g_match_info_fetch(match_info, 1);
+        char *category = g_match_info_fetch(match_info, 2);
+        char *dur = g_match_info_fetch(match_info, 3);
+        double ms = g_ascii_strtoull(dur, NULL, 10) / 1000.0;
+
+        if (strcmp(category, "startup") == 0) {
+            if (strcmp(name, "context") == 0)
+                times[PHASE_CONTEXT] = ms;
+            else if (strcmp(name, "importer") == 0)
+                times[PHASE_IMPORTER] = ms;
+        } else if (strcmp(category, "import") == 0 && strcmp(name, "gi") == 0) {
+            if (times[PHASE_FIRST_GI] < 0)
+                times[PHASE_FIRST_GI] = ms;
+        } else if (strcmp(category, "eval") == 0) {
+            /* Only gjs_context_eval() records these; take the script */
+            times[PHASE_EVAL] = MAX(times[PHASE_EVAL], ms);
+        }
+
+        g_free(name);
+        g_free(category);
+        g_free(dur);
+        g_match_info_next(match_info, NULL);
+    }
+    g_match_info_free(match_info);
+}
+
+/* Reads and removes the timeline files gjs-console left in @tmpdir */
+static gboolean
+collect_timelines(const char *tmpdir,
+                  double      times[N_PHASES],
+                  GError    **error)
+{
+    GDir *dir;
+    const char *filename;
+    gboolean ret = TRUE;
+
+    dir = g_dir_open(tmpdir, 0, error);
+    if (dir == NULL)
+        return FALSE;
+
+    while ((filename = g_dir_read_name(dir))) {
+        char *path;
+        char *contents;
+
+        if (!g_str_has_prefix(filename, "timeline."))
+            continue;
+
+        path = g_build_filename(tmpdir, filename, NULL);
+        if (ret && g_file_get_contents(path, &contents, NULL, error)) {
+            parse_timeline(contents, times);
+            g_free(contents);
+        } else {
+            ret = FALSE;
+        }
+        g_unlink(path);
+        g_free(path);
+    }
+    g_dir_close(dir);
+
+    return ret;
+}
+
+static gboolean
+run_once(Workload   *workload,
+         const char *tmpdir,
+         double      times[N_PHASES],
+         GError    **error)
+{
+    char **envp;
+    char *timeline_output;
+    const char *argv[4];
+    gint64 start;
+    int status;
+    int i;
+    gboolean ret = FALSE;
+
+    for (i = 0; i < N_PHASES; i++)
+        times[i] = -1;
+
+    timeline_output = g_build_filename(tmpdir, "timeline", NULL);
+    envp = g_get_environ();
+    envp = g_environ_setenv(envp, "GJS_DEBUG_TIMELINE_OUTPUT", timeline_output, TRUE);
+    envp = g_environ_setenv(envp, "GJS_DEBUG_TIMELINE_EVENTS", "4096", TRUE);
+
+    argv[0] = gjs_console;
+    if (workload->script_file != NULL) {
+        argv[1] = workload->script_file;
+        argv[2] = NULL;
+    } else {
+        argv[1] = "-c";
+        argv[2] = workload->script;
+        argv[3] = NULL;
+    }
+
+    start = g_get_monotonic_time();
+    if (!g_spawn_sync(NULL, (char **) argv, envp,
+                      (GSpawnFlags) (G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL),
+                      NULL, NULL, NULL, NULL, &status, error))
+        goto out;
+    times[PHASE_TOTAL] = (g_get_monotonic_time() - start) / 1000.0;
+
+    if (!g_spawn_check_exit_status(status, error))
+        goto out;
+
+    ret = collect_timelines(tmpdir, times, error);
+
+ out:
+    g_strfreev(envp);
+    g_free(timeline_output);
+    return ret;
+}
+
+static double
+percentile(GArray *times,
+           double  p)
+{
+    int rank = (int) ceil(p / 100 * times->len);
+
+    return g_array_index(times, double, CLAMP(rank, 1, (int) times->len) - 1);
+}
+
+static int
+compare_strings(gconstpointer a,
+                gconstpointer b)
+{
+    return strcmp(*(const char * const *) a, *(const char * const *) b);
+}
+
+static int
+compare_doubles(gconstpointer a,
+                gconstpointer b)
+{
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+
+    return da < db ? -1 : da > db ? 1 : 0;
+}
+
+static void
+add_module_imports(GString    *script,
+                   const char *dirname,
+                   const char *prefix)
+{
+    GDir *dir;
+    const char *filename;
+    GPtrArray *names;
+    guint i;
+
+    dir = g_dir_open(dirname, 0, NULL);
+    if (dir == NULL)
+        return;
+
+    names = g_ptr_array_new_with_free_func(g_free);
+    while ((filename = g_dir_read_name(dir)))
+        g_ptr_array_add(names, g_strdup(filename));
+    g_dir_close(dir);
+    g_ptr_array_sort(names, compare_strings);
+
+    for (i = 0; i < names->len; i++) {
+        const char *name = (const char *) names->pdata[i];
+        char *path = g_build_filename(dirname, name, NULL);
+
+        /* Overrides are applied by imports.gi, not imported themselves */
+        if (g_file_test(path, G_FILE_TEST_IS_DIR) && strcmp(name, "overrides") != 0) {
+            char *sub_prefix = g_strconcat(prefix, name, ".", NULL);
+            add_module_imports(script, path, sub_prefix);
+            g_free(sub_prefix);
+        } else if (g_str_has_suffix(name, ".js")) {
+            /* Some modules depend on optional features, such as cairo */
+            g_string_append_printf(script, "try { imports.%s%.*s; } catch (e) {}\n",
+                                   prefix, (int) (strlen(name) - 3), name);
+        }
+        g_free(path);
+    }
+
+    g_ptr_array_free(names, TRUE);
+}
+
+/* A script of a realistic shape that is big enough for compiling it to
+ * show up: lots of small functions and an object literal, then a few
+ * calls into them.
+ */
+static char *
+write_large_script(const char *tmpdir)
+{
+    GString *script;
+    char *path;
+    int i;
+
+    script = g_string_new(NULL);
+    for (i = 0; i < 5000; i++)
+        g_string_append_printf(script,
+                               "function f%d(a, b) {\n"
+                               "    let s = 'f%d' + a;\n"
+                               "    if (b > %d)\n"
+                               "        return [s, b - %d];\n"
+                               "    return { name: s, value: a * b + %d };\n"
+                               "}\n",
+                               i, i, i, i, i);
+
+    g_string_append(script, "const table = {\n");
+    for (i = 0; i < 5000; i++)
+        g_string_append_printf(script, "    key%d: [%d, 'value%d', f%d],\n", i, i, i, i);
+    g_string_append(script, "};\n");
+
+    g_string_append(script,
+                    "for (let i = 0; i < 5000; i += 500)\n"
+                    "    table['key' + i][2](i, 2);\n");
+
+    path = g_build_filename(tmpdir, "large.js", NULL);
+    if (!g_file_set_contents(path, script->str, script->len, NULL)) {
+        g_free(path);
+        path = NULL;
+    }
+
+    g_string_free(script, TRUE);
+    return path;
+}
+
+static gboolean
+have_gtk3(void)
+{
+    GList *versions, *l;
+    gboolean found = FALSE;
+
+    versions = g_irepository_enumerate_versions(NULL, "Gtk");
+    for (l = versions; l != NULL; l = l->next) {
+        if (strcmp((const char *) l->data, "3.0") == 0)
+            found = TRUE;
+        g_free(l->data);
+    }
+    g_list_free(versions);
+
+    return found;
+}
+
+static void
+init_workloads(Workload   *workloads,
+               const char *tmpdir)
+{
+    GString *modules;
+    int i;
+
+    memset(workloads, 0, N_WORKLOADS * sizeof(Workload));
+
+    workloads[WORKLOAD_EMPTY].name = "empty";
+    workloads[WORKLOAD_EMPTY].script = g_strdup("");
+
+    workloads[WORKLOAD_GI].name = "gi";
+    workloads[WORKLOAD_GI].script = g_strdup("imports.gi.GObject; imports.gi.Gio;");
+
+    workloads[WORKLOAD_GTK].name = "gtk";
+    workloads[WORKLOAD_GTK].script = g_strdup("imports.gi.versions.Gtk = '3.0'; imports.gi.Gtk;");
+    if (!have_gtk3())
+        workloads[WORKLOAD_GTK].skip_reason = "no Gtk 3.0 typelib";
+
+    modules = g_string_new(NULL);
+    add_module_imports(modules, GJS_MODULES_DIR, "");
+    workloads[WORKLOAD_MODULES].name = "modules";
+    workloads[WORKLOAD_MODULES].script = g_string_free(modules, FALSE);
+
+    workloads[WORKLOAD_LARGE_SCRIPT].name = "large-script";
+    workloads[WORKLOAD_LARGE_SCRIPT].script_file = write_large_script(tmpdir);
+    if (workloads[WORKLOAD_LARGE_SCRIPT].script_file == NULL)
+        workloads[WORKLOAD_LARGE_SCRIPT].skip_reason = "couldn't write the script";
+
+    for (i = 0; i < N_WORKLOADS; i++) {
+        int j;
+
+        for (j = 0; j < N_PHASES; j++)
+            workloads[i].times[j] = g_array_new(FALSE, FALSE, sizeof(double));
+    }
+}
+
+/* Prints the statistics of @workload, comparing them with @baseline_file
+ * if given. Returns %FALSE if a phase regressed.
+ */
+static gboolean
+report_workload(Workload *workload,
+                GKeyFile *baseline_file,
+                GKeyFile *new_baseline_file)
+{
+    gboolean ret = TRUE;
+    int i;
+
+    for (i = 0; i < N_PHASES; i++) {
+        GArray *times = workload->times[i];
+        double median;
+
+        if (times->len == 0)
+            continue;
+
+        g_array_sort(times, compare_doubles);
+        median = percentile(times, 50);
+
+        g_print("%-14s %-10s %9.2f %9.2f %9.2f %9.2f %9.2f",
+                workload->name, phase_names[i], median,
+                percentile(times, 90), percentile(times, 99),
+                g_array_index(times, double, 0),
+                g_array_index(times, double, times->len - 1));
+
+        if (baseline_file != NULL &&
+            g_key_file_has_key(baseline_file, workload->name, phase_names[i], NULL)) {
+            double base = g_key_file_get_double(baseline_file, workload->name,
+                                                phase_names[i], NULL);
+            double limit = base * (1 + tolerance / 100) + slack;
+
+            g_print(" %9.2f %+7.1f%%", base,
+                    base > 0 ? (median - base) * 100 / base : 0.0);
+            if (median > limit) {
+                g_print("  REGRESSION (limit %.2f)", limit);
+                ret = FALSE;
+            }
+        }
+        g_print("\n");
+
+        if (new_baseline_file != NULL)
+            g_key_file_set_double(new_baseline_file, workload->name,
+                                  phase_names[i], median);
+    }
+
+    return ret;
+}
+
+int
+main(int    argc,
+     char **argv)
+{
+    GOptionContext *option_context;
+    GError *error = NULL;
+    GKeyFile *baseline_file = NULL;
+    GKeyFile *new_baseline_file = NULL;
+    Workload workloads[N_WORKLOADS];
+    char *tmpdir;
+    gboolean regressed = FALSE;
+    int status = 0;
+    int i;
+
+    option_context = g_option_context_new(NULL);
+    g_option_context_set_summary(option_context,
+                                 "Measure how long gjs-console takes to start up "
+                                 "on a few representative workloads.");
+    g_option_context_add_main_entries(option_context, entries, NULL);
+    if (!g_option_context_parse(option_context, &argc, &argv, &error))
+        g_error("option parsing failed: %s", error->message);
+    g_option_context_free(option_context);
+
+    if (n_runs <= 0 || tolerance < 0 || slack < 0)
+        g_error("option parsing failed: --runs must be positive and "
+                "--tolerance and --slack can't be negative");
+
+    if (gjs_console == NULL)
+        gjs_console = g_strdup(GJS_CONSOLE);
+
+    if (baseline != NULL) {
+        baseline_file = g_key_file_new();
+        if (!g_key_file_load_from_file(baseline_file, baseline,
+                                       G_KEY_FILE_NONE, &error))
+            g_error("Failed to load baseline %s: %s", baseline, error->message);
+    }
+    if (write_baseline != NULL)
+        new_baseline_file = g_key_file_new();
+
+    event_regex = g_regex_new("^\\{\"name\":\"((?:[^\"\\\\]|\\\\.)*)\",\"cat\":\"([^\"]*)\","
+                              "\"ph\":\"X\",.*\"dur\":(\\d+)\\},?$",
+                              G_REGEX_MULTILINE, (GRegexMatchFlags) 0, NULL);
+    g_assert(event_regex != NULL);
+
+    tmpdir = g_dir_make_tmp("gjs-startup-XXXXXX", &error);
+    if (tmpdir == NULL)
+        g_error("Failed to create a temporary directory: %s", error->message);
+
+    init_workloads(workloads, tmpdir);
+
+    g_print("# milliseconds over %d runs\n", n_runs);
+    g_print("%-14s %-10s %9s %9s %9s %9s %9s%s\n",
+            "# workload", "phase", "median", "p90", "p99", "min", "max",
+            baseline_file ? "  baseline  change" : "");
+
+    for (i = 0; i < N_WORKLOADS; i++) {
+        Workload *workload = &workloads[i];
+        double times[N_PHASES];
+        int run;
+
+        if (filter != NULL && !g_pattern_match_simple(filter, workload->name))
+            continue;
+
+        if (workload->skip_reason != NULL) {
+            g_print("%-14s skipped: %s\n", workload->name, workload->skip_reason);
+            continue;
+        }
+
+        /* Warm up the page cache */
+        if (!run_once(workload, tmpdir, times, &error)) {
+            g_printerr("%s: %s\n", workload->name, error->message);
+            g_clear_error(&error);
+            status = 1;
+            continue;
+        }
+
+        for (run = 0; run < n_runs; run++) {
+            int j;
+
+            if (!run_once(workload, tmpdir, times, &error)) {
+                g_printerr("%s: %s\n", workload->name, error->message);
+                g_clear_error(&error);
+                status = 1;
+                break;
+            }
+
+            for (j = 0; j < N_PHASES; j++) {
+                if (times[j] >= 0)
+                    g_array_append_val(workload->times[j], times[j]);
+            }
+        }
+
+        if (!report_workload(workload, baseline_file, new_baseline_file)) {
+            regressed = TRUE;
+            status = 1;
+        }
+    }
+
+    if (new_baseline_file != NULL) {
+        char *data = g_key_file_to_data(new_baseline_file, NULL, NULL);
+
+        if (!g_file_set_contents(write_baseline, data, -1, &error)) {
+            g_printerr("Failed to write %s: %s\n", write_baseline, error->message);
+            g_clear_error(&error);
+            status = 1;
+        }
+        g_free(data);
+        g_key_file_free(new_baseline_file);
+    }
+
+    if (baseline_file != NULL) {
+        if (regressed)
+            g_printerr("Startup got slower than the baseline in %s\n", baseline);
+        g_key_file_free(baseline_file);
+    }
+
+    for (i = 0; i < N_WORKLOADS; i++) {
+        int j;
+
+        if (workloads[i].script_file != NULL)
+            g_unlink(workloads[i].script_file);
+        g_free(workloads[i].script);
+        g_free(workloads[i].script_file);
+        for (j = 0; j < N_PHASES; j++)
+            g_array_free(workloads[i].times[j], TRUE);
+    }
+    g_rmdir(tmpdir);
+    g_free(tmpdir);
+    g_regex_unref(event_regex);
+
+    return status;
+}
@@ -24,9 +24,17 @@
 #include <config.h>
 #include <glib.h>
 #include <glib-object.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
 #include <gjs/gjs-module.h>
+#include <gjs/bundle.h>
 #include <util/glib.h>
 #include <util/crash.h>
+#include <util/log.h>
+#include <gi/usage.h>
 
 typedef struct _GjsUnitTestFixture GjsUnitTestFixture;
 
@@ -350,6 +358,940 @@ gjstest_test_strip_shebang_return_null_for_just_shebang(void)
     g_assert(line_number == -1);
 }
 
+static void
+gjstest_test_strip_shebang_stop_at_script_len(void)
+{
+    /* Mapped scripts are not nul-terminated; the newline past the
+     * given length must not be found.
+     */
+    const char *script = "#!foo\nbar";
+    gssize     script_len = 5;
+    int        line_number = 1;
+
+    const char *stripped = gjs_strip_unix_shebang(script,
+                                                  &script_len,
+                                                  &line_number);
+
+    g_assert(stripped == NULL);
+    g_assert(script_len == 0);
+    g_assert(line_number == -1);
+}
+
+static void
+gjstest_test_func_gjs_context_eval_file(void)
+{
+    GjsContext *context;
+    GError *error = NULL;
+    char *filename;
+    int fd;
+    int estatus = 0;
+    const char script[] = "#!/usr/bin/gjs\n40 + 2;\n";
+
+    fd = g_file_open_tmp("gjs-test-eval-XXXXXX.js", &filename, &error);
+    g_assert_no_error(error);
+    g_assert(write(fd, script, sizeof(script) - 1) == sizeof(script) - 1);
+    close(fd);
+
+    context = gjs_context_new();
+    if (!gjs_context_eval_file(context, filename, &estatus, &error))
+        g_error("%s", error->message);
+    g_assert_cmpint(estatus, ==, 42);
+
+    g_unlink(filename);
+    g_assert(!gjs_context_eval_file(context, filename, &estatus, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+    g_clear_error(&error);
+
+    g_object_unref(context);
+    g_free(filename);
+}
+
+static void
+add_bundle_source(GjsBundleBuilder *builder,
+                  const char       *path,
+                  const char       *source)
+{
+    GBytes *bytes = g_bytes_new_static(source, strlen(source));
+    gjs_bundle_builder_add(builder, path, bytes, NULL);
+    g_bytes_unref(bytes);
+}
+
+static void
+gjstest_test_func_gjs_bundle_import(void)
+{
+    GjsBundleBuilder *builder;
+    GjsBundle *bundle;
+    GjsContext *context;
+    GError *error = NULL;
+    GBytes *source;
+    char *filename;
+    char *search_path[2];
+    int fd;
+    int estatus = 0;
+
+    fd = g_file_open_tmp("gjs-test-bundle-XXXXXX", &filename, &error);
+    g_assert_no_error(error);
+    close(fd);
+
+    /* added out of order on purpose; the builder sorts them */
+    builder = gjs_bundle_builder_new(NULL);
+    add_bundle_source(builder, "sub/deep/c.js", "var c = 3;");
+    add_bundle_source(builder, "a.js", "var a = 1;");
+    add_bundle_source(builder, "sub/b.js", "var b = 2;");
+    g_assert(gjs_bundle_builder_write(builder, filename, &error));
+    g_assert_no_error(error);
+    gjs_bundle_builder_free(builder);
+
+    bundle = gjs_bundle_new(filename, &error);
+    g_assert_no_error(error);
+    g_assert_cmpuint(gjs_bundle_get_n_entries(bundle), ==, 3);
+    g_assert(gjs_bundle_is_directory(bundle, "sub"));
+    g_assert(gjs_bundle_is_directory(bundle, "sub/deep"));
+    g_assert(!gjs_bundle_is_directory(bundle, "a.js"));
+    g_assert(!gjs_bundle_lookup(bundle, "sub", NULL, NULL));
+    g_assert(gjs_bundle_lookup(bundle, "sub/b.js", &source, NULL));
+    g_assert_cmpuint(g_bytes_get_size(source), ==, strlen("var b = 2;"));
+    g_bytes_unref(source);
+    gjs_bundle_unref(bundle);
+
+    search_path[0] = g_strconcat(GJS_BUNDLE_URI_PREFIX, filename, NULL);
+    search_path[1] = NULL;
+    context = gjs_context_new_with_search_path(search_path);
+    if (!gjs_context_eval(context,
+                          "imports.a.a + imports.sub.b.b + imports.sub.deep.c.c",
+                          -1, "<input>", &estatus, &error))
+        g_error("%s", error->message);
+    g_assert_cmpint(estatus, ==, 6);
+    g_object_unref(context);
+
+    g_unlink(filename);
+    g_free(search_path[0]);
+    g_free(filename);
+}
+
+static void
+gjstest_test_func_gjs_bundle_bytecode(void)
+{
+    GjsBundleBuilder *builder;
+    GjsContext *context;
+    JSContext *cx;
+    GError *error = NULL;
+    GBytes *source;
+    GBytes *compiled;
+    GBytes *stale;
+    char *filename;
+    char *search_path[2];
+    const char *script = "var d = 4; function getD() { return d; }";
+    const char *fallback = "var d = 3; function getD() { return 5; }";
+    int fd;
+    int estatus = 0;
+
+    fd = g_file_open_tmp("gjs-test-bundle-XXXXXX", &filename, &error);
+    g_assert_no_error(error);
+    close(fd);
+
+    context = gjs_context_new();
+    cx = (JSContext *) gjs_context_get_native_context(context);
+    source = g_bytes_new_static(script, strlen(script));
+    compiled = gjs_bundle_compile_module(cx, "d.js", source);
+    g_assert(compiled != NULL);
+    g_bytes_unref(source);
+    g_object_unref(context);
+
+    /* The stored source differs from what the bytecode was made from,
+     * so the result shows which of the two was run.
+     */
+    builder = gjs_bundle_builder_new(JS_GetImplementationVersion());
+    source = g_bytes_new_static(fallback, strlen(fallback));
+    gjs_bundle_builder_add(builder, "d.js", source, compiled);
+    stale = g_bytes_new_static("garbage", strlen("garbage"));
+    gjs_bundle_builder_add(builder, "e.js", source, stale);
+    g_assert(gjs_bundle_builder_write(builder, filename, &error));
+    g_assert_no_error(error);
+    gjs_bundle_builder_free(builder);
+    g_bytes_unref(stale);
+    g_bytes_unref(source);
+    g_bytes_unref(compiled);
+
+    search_path[0] = g_strconcat(GJS_BUNDLE_URI_PREFIX, filename, NULL);
+    search_path[1] = NULL;
+    context = gjs_context_new_with_search_path(search_path);
+    if (!gjs_context_eval(context, "imports.d.getD()",
+                          -1, "<input>", &estatus, &error))
+        g_error("%s", error->message);
+    g_assert_cmpint(estatus, ==, 4);
+    /* Bytecode that doesn't decode falls back to the source */
+    if (!gjs_context_eval(context, "imports.e.getD()",
+                          -1, "<input>", &estatus, &error))
+        g_error("%s", error->message);
+    g_assert_cmpint(estatus, ==, 5);
+    g_object_unref(context);
+
+    g_unlink(filename);
+    g_free(search_path[0]);
+    g_free(filename);
+}
+
+static void
+gjstest_test_func_gjs_context_prefetch_modules(void)
+{
+    GjsContext *context;
+    GError *error = NULL;
+    char *dirname;
+    char *subdir;
+    char *top_path;
+    char *m_path;
+    char *search_path[2];
+    const char *module_ids[] = { "top", "sub.m", "sub.missing", "sub", NULL };
+    int estatus = 0;
+
+    dirname = g_dir_make_tmp("gjs-test-prefetch-XXXXXX", &error);
+    g_assert_no_error(error);
+    subdir = g_build_filename(dirname, "sub", NULL);
+    g_assert(g_mkdir(subdir, 0700) == 0);
+
+    top_path = g_build_filename(dirname, "top.js", NULL);
+    g_file_set_contents(top_path, "var y = 2;", -1, &error);
+    g_assert_no_error(error);
+    /* Non-ASCII text and a shebang, to check the conversion off-thread */
+    m_path = g_build_filename(subdir, "m.js", NULL);
+    g_file_set_contents(m_path,
+                        "#!/usr/bin/gjs\nvar s = '\xc3\xa9t\xc3\xa9';\nvar x = 37 + s.length;",
+                        -1, &error);
+    g_assert_no_error(error);
+
+    search_path[0] = dirname;
+    search_path[1] = NULL;
+    context = gjs_context_new_with_search_path(search_path);
+    gjs_context_prefetch_modules(context, module_ids);
+    if (!gjs_context_eval(context,
+                          "imports.sub.m.x + imports.top.y",
+                          -1, "<input>", &estatus, &error))
+        g_error("%s", error->message);
+    g_assert_cmpint(estatus, ==, 42);
+    g_object_unref(context);
+
+    /* Each context gets its own prefetched copy; dropping a context
+     * with jobs still queued for it is fine too
+     */
+    context = gjs_context_new_with_search_path(search_path);
+    gjs_context_prefetch_modules(context, module_ids);
+    if (!gjs_context_eval(context,
+                          "imports.sub.m.x + imports.top.y",
+                          -1, "<input>", &estatus, &error))
+        g_error("%s", error->message);
+    g_assert_cmpint(estatus, ==, 42);
+    g_object_unref(context);
+
+    context = gjs_context_new_with_search_path(search_path);
+    gjs_context_prefetch_modules(context, module_ids);
+    g_object_unref(context);
+
+    g_unlink(m_path);
+    g_unlink(top_path);
+    g_rmdir(subdir);
+    g_rmdir(dirname);
+    g_free(m_path);
+    g_free(top_path);
+    g_free(subdir);
+    g_free(dirname);
+}
+
+static void
+gjstest_test_func_gjs_context_import_trace(void)
+{
+    GjsContext *context;
+    GjsContext *other;
+    GError *error = NULL;
+    char *dirname;
+    char *a_path;
+    char *b_path;
+    char *trace_path;
+    char *other_trace_path;
+    char *trace;
+    char *search_path[2];
+    int estatus = 0;
+
+    dirname = g_dir_make_tmp("gjs-test-import-trace-XXXXXX", &error);
+    g_assert_no_error(error);
+
+    a_path = g_build_filename(dirname, "a.js", NULL);
+    g_file_set_contents(a_path, "var a = imports.b.b + 1;", -1, &error);
+    g_assert_no_error(error);
+    b_path = g_build_filename(dirname, "b.js", NULL);
+    g_file_set_contents(b_path, "var b = 1;", -1, &error);
+    g_assert_no_error(error);
+    trace_path = g_build_filename(dirname, "trace.txt", NULL);
+    other_trace_path = g_build_filename(dirname, "other-trace.txt", NULL);
+
+    search_path[0] = dirname;
+    search_path[1] = NULL;
+    context = (GjsContext *) g_object_new(GJS_TYPE_CONTEXT,
+                                          "search-path", search_path,
+                                          "import-trace-output", trace_path,
+                                          NULL);
+    /* Each runtime has a trace of its own */
+    other = (GjsContext *) g_object_new(GJS_TYPE_CONTEXT,
+                                        "search-path", search_path,
+                                        "import-trace-output", other_trace_path,
+                                        NULL);
+    if (!gjs_context_eval(context, "imports.a.a", -1, "<input>", &estatus, &error))
+        g_error("%s", error->message);
+    g_assert_cmpint(estatus, ==, 2);
+    if (!gjs_context_eval(other, "imports.b.b", -1, "<input>", &estatus, &error))
+        g_error("%s", error->message);
+    g_assert_cmpint(estatus, ==, 1);
+    /* The trace is written out when the context goes away */
+    g_object_unref(other);
+    g_object_unref(context);
+
+    g_file_get_contents(trace_path, &trace, NULL, &error);
+    g_assert_no_error(error);
+    g_assert(strstr(trace, "execute") != NULL);
+    /* b is imported from inside a, so it is nested under it */
+    g_assert(strstr(trace, "  a (") != NULL);
+    g_assert(strstr(trace, "    b (") != NULL);
+    g_free(trace);
+
+    g_file_get_contents(other_trace_path, &trace, NULL, &error);
+    g_assert_no_error(error);
+    g_assert(strstr(trace, "  b (") != NULL);
+    g_assert(strstr(trace, "  a (") == NULL);
+    g_free(trace);
+
+    g_unlink(other_trace_path);
+    g_unlink(trace_path);
+    g_unlink(b_path);
+    g_unlink(a_path);
+    g_rmdir(dirname);
+    g_free(other_trace_path);
+    g_free(trace_path);
+    g_free(b_path);
+    g_free(a_path);
+    g_free(dirname);
+}
+
+static void
+gjstest_test_func_gjs_context_timeline(void)
+{
+    GjsContext *context;
+    GError *error = NULL;
+    char *dirname;
+    char *prefix;
+    char *dump_path;
+    char *timeline;
+    GDir *dir;
+    const char *entry;
+    int estatus = 0;
+
+    dirname = g_dir_make_tmp("gjs-test-timeline-XXXXXX", &error);
+    g_assert_no_error(error);
+    prefix = g_build_filename(dirname, "timeline.json", NULL);
+
+    context = (GjsContext *) g_object_new(GJS_TYPE_CONTEXT,
+                                          "timeline-output", prefix,
+                                          NULL);
+    if (!gjs_context_eval(context,
+                          "const Mainloop = imports.mainloop;\n"
+                          "Mainloop.idle_add(function tick() {\n"
+                          "    Mainloop.quit('timeline');\n"
+                          "    return false;\n"
+                          "});\n"
+                          "Mainloop.run('timeline');\n"
+                          "0;",
+                          -1, "<timeline>", &estatus, &error))
+        g_error("%s", error->message);
+    g_assert_cmpint(estatus, ==, 0);
+
+    if (!gjs_context_dump_timeline(context, &error))
+        g_error("%s", error->message);
+
+    dump_path = g_strdup_printf("%s.%u.0", prefix, (guint) getpid());
+    g_file_get_contents(dump_path, &timeline, NULL, &error);
+    g_assert_no_error(error);
+    g_assert(g_str_has_prefix(timeline, "{\"traceEvents\":["));
+    g_assert(strstr(timeline, "{\"name\":\"<timeline>\",\"cat\":\"eval\",\"ph\":\"X\"") != NULL);
+    g_assert(strstr(timeline, "{\"name\":\"mainloop\",\"cat\":\"import\"") != NULL);
+    g_assert(strstr(timeline, "{\"name\":\"idle tick added\",\"cat\":\"mainloop\",\"ph\":\"i\"") != NULL);
+    g_assert(strstr(timeline, "{\"name\":\"idle tick\",\"cat\":\"mainloop\",\"ph\":\"X\"") != NULL);
+    g_assert(strstr(timeline, "\"cat\":\"closure\"") != NULL);
+    g_free(timeline);
+    g_free(dump_path);
+
+    g_object_unref(context);
+
+    /* The context writes out anything recorded since on the way out */
+    dir = g_dir_open(dirname, 0, &error);
+    g_assert_no_error(error);
+    while ((entry = g_dir_read_name(dir)) != NULL) {
+        char *path = g_build_filename(dirname, entry, NULL);
+        g_unlink(path);
+        g_free(path);
+    }
+    g_dir_close(dir);
+
+    g_rmdir(dirname);
+    g_free(prefix);
+    g_free(dirname);
+}
+
+/* The profiler only reads its output name from the environment once per
+ * process, so all the profiler tests write to the same place.
+ */
+static char *
+profile_dirname(void)
+{
+    return g_strdup_printf("%s/gjs-test-profile-%u", g_get_tmp_dir(), (guint) getpid());
+}
+
+static GjsContext *
+profiled_context_new(const char *mode,
+                     const char *format)
+{
+    GjsContext *context;
+    char *dirname;
+    char *prefix;
+
+    dirname = profile_dirname();
+    g_assert(g_mkdir_with_parents(dirname, 0700) == 0);
+    prefix = g_build_filename(dirname, "profile", NULL);
+
+    g_setenv("GJS_DEBUG_PROFILER_OUTPUT", prefix, TRUE);
+    g_setenv("GJS_DEBUG_PROFILER_MODE", mode, TRUE);
+    g_setenv("GJS_DEBUG_PROFILER_FORMAT", format, TRUE);
+    g_setenv("GJS_DEBUG_PROFILER_RATE", "1000", TRUE);
+    context = gjs_context_new();
+    g_unsetenv("GJS_DEBUG_PROFILER_OUTPUT");
+    g_unsetenv("GJS_DEBUG_PROFILER_MODE");
+    g_unsetenv("GJS_DEBUG_PROFILER_FORMAT");
+    g_unsetenv("GJS_DEBUG_PROFILER_RATE");
+
+    g_free(prefix);
+    g_free(dirname);
+    return context;
+}
+
+/* Asks for a dump the way a user would, with SIGUSR1, and returns it */
+static char *
+profile_dump(void)
+{
+    GError *error = NULL;
+    char *dirname;
+    char *path = NULL;
+    char *contents;
+    const char *entry;
+    GDir *dir;
+
+    dirname = profile_dirname();
+
+    raise(SIGUSR1);
+    while (path == NULL) {
+        g_main_context_iteration(NULL, TRUE);
+
+        dir = g_dir_open(dirname, 0, &error);
+        g_assert_no_error(error);
+        entry = g_dir_read_name(dir);
+        if (entry != NULL)
+            path = g_build_filename(dirname, entry, NULL);
+        g_dir_close(dir);
+    }
+
+    g_file_get_contents(path, &contents, NULL, &error);
+    g_assert_no_error(error);
+
+    g_unlink(path);
+    g_rmdir(dirname);
+    g_free(path);
+    g_free(dirname);
+    return contents;
+}
+
+static void
+gjstest_test_func_gjs_profiler_sample(void)
+{
+    GjsContext *context;
+    GError *error = NULL;
+    char *profile;
+    int estatus = 0;
+
+    context = profiled_context_new("sample", "collapsed");
+    if (!gjs_context_eval(context,
+                          "function spin() {\n"
+                          "    let start = Date.now(), n = 0;\n"
+                          "    while (Date.now() - start < 200)\n"
+                          "        n++;\n"
+                          "    return n;\n"
+                          "}\n"
+                          "spin() > 0 ? 0 : 1;",
+                          -1, "<sample>", &estatus, &error))
+        g_error("%s", error->message);
+    g_assert_cmpint(estatus, ==, 0);
+
+    /* "outer;inner count", with spin() on most of the stacks */
+    profile = profile_dump();
+    g_assert(strstr(profile, "spin (<sample>:1)") != NULL);
+    g_assert(g_regex_match_simple("^\\S.* [0-9]+$", profile, G_REGEX_MULTILINE, (GRegexMatchFlags) 0));
+    g_free(profile);
+
+    g_object_unref(context);
+}
+
+static void
+gjstest_test_func_gjs_profiler_instrument(void)
+{
+    GjsContext *context;
+    GError *error = NULL;
+    char *profile;
+
+    context = profiled_context_new("instrument", "table");
+    if (!gjs_context_eval(context,
+                          "function f() { return 1; }\n"
+                          "for (let i = 0; i < 5; i++) f();",
+                          -1, "<profile>", NULL, &error))
+        g_error("%s", error->message);
+
+    /* Counts are kept by script until a GC, then folded by name */
+    gjs_context_gc(context);
+    if (!gjs_context_eval(context,
+                          "for (let i = 0; i < 5; i++) f();",
+                          -1, "<more>", NULL, &error))
+        g_error("%s", error->message);
+
+    profile = profile_dump();
+    g_assert(g_str_has_prefix(profile, "file:line\tfunction\tcalls\tself\ttotal\n"));
+    g_assert(strstr(profile, "\n<profile>:1\tf\t10\t") != NULL);
+    g_free(profile);
+
+    /* Each dump covers the time since the last one */
+    profile = profile_dump();
+    g_assert(strstr(profile, "\tf\t") == NULL);
+    g_free(profile);
+
+    g_object_unref(context);
+}
+
+static void
+gjstest_test_func_gjs_profiler_native(void)
+{
+    GjsContext *context;
+    GError *error = NULL;
+    char *profile;
+
+    context = profiled_context_new("instrument", "table");
+    if (!gjs_context_eval(context,
+                          "const GLib = imports.gi.GLib;\n"
+                          "for (let i = 0; i < 3; i++)\n"
+                          "    GLib.get_user_name();\n"
+                          "let loop = new GLib.MainLoop(null, false);\n"
+                          "GLib.idle_add(GLib.PRIORITY_DEFAULT, function() {\n"
+                          "    loop.quit();\n"
+                          "    return false;\n"
+                          "});\n"
+                          "loop.run();",
+                          -1, "<native>", NULL, &error))
+        g_error("%s", error->message);
+
+    /* A row for the call, then one per marshalling phase */
+    profile = profile_dump();
+    g_assert(strstr(profile, "\n(native):0\tGLib.get_user_name\t3\t") != NULL);
+    g_assert(strstr(profile, "\n(native):0\tGLib.get_user_name (marshal in)\t3\t") != NULL);
+    g_assert(strstr(profile, "\n(native):0\tGLib.get_user_name (marshal out)\t3\t") != NULL);
+    /* Callbacks into JS are native calls too */
+    g_assert(strstr(profile, "\n(native):0\tGLib.SourceFunc\t1\t") != NULL);
+    g_free(profile);
+
+    g_object_unref(context);
+}
+
+static void
+gjstest_test_func_gjs_profiler_collapsed(void)
+{
+    GjsContext *context;
+    GError *error = NULL;
+    GRegex *regex;
+    GMatchInfo *match_info;
+    char *profile;
+    int n_matches = 0;
+
+    context = profiled_context_new("instrument", "collapsed");
+    if (!gjs_context_eval(context,
+                          "function inner() { let n = 0; for (let i = 0; i < 10000; i++) n += i; return n; }\n"
+                          "function outer() { return inner(); }\n"
+                          "for (let i = 0; i < 5; i++) outer();",
+                          -1, "<collapsed>", NULL, &error))
+        g_error("%s", error->message);
+
+    /* Calls after a GC go on the same stack */
+    gjs_context_gc(context);
+    if (!gjs_context_eval(context, "outer();", -1, "<collapsed>", NULL, &error))
+        g_error("%s", error->message);
+
+    /* "outer;inner microseconds", frames named as the SPS labels are */
+    profile = profile_dump();
+    regex = g_regex_new(";outer \\(<collapsed>:2\\);inner \\(<collapsed>:1\\) [0-9]+$",
+                        G_REGEX_MULTILINE, (GRegexMatchFlags) 0, NULL);
+    g_regex_match(regex, profile, (GRegexMatchFlags) 0, &match_info);
+    while (g_match_info_matches(match_info)) {
+        n_matches++;
+        g_match_info_next(match_info, NULL);
+    }
+    g_match_info_free(match_info);
+    g_regex_unref(regex);
+    g_assert_cmpint(n_matches, ==, 1);
+    g_free(profile);
+
+    g_object_unref(context);
+}
+
+static void
+gjstest_test_func_gjs_gi_usage(void)
+{
+    GjsContext *context;
+    GError *error = NULL;
+    char *report;
+    int estatus = 0;
+
+    gjs_gi_usage_enable();
+    g_assert(gjs_gi_usage_is_active());
+
+    context = gjs_context_new();
+    if (!gjs_context_eval(context,
+                          "const GLib = imports.gi.GLib;\n"
+                          "const Gio = imports.gi.Gio;\n"
+                          "GLib.get_user_name();\n"
+                          "GLib.get_user_name();\n"
+                          "let action = new Gio.SimpleAction({ name: 'usage' });\n"
+                          "let activated = 0;\n"
+                          "action.connect('activate', function() { activated++; });\n"
+                          "action.activate(null);\n"
+                          "action.emit('activate', null);\n"
+                          "action.enabled = false;\n"
+                          "action.enabled = true;\n"
+                          "activated == 2 ? 0 : 1;",
+                          -1, "<gi-usage>", &estatus, &error))
+        g_error("%s", error->message);
+    g_assert_cmpint(estatus, ==, 0);
+
+    report = gjs_gi_usage_report_json();
+    g_assert(strstr(report, "\"GLib.get_user_name\": { \"resolved\": 1, \"invoked\": 2,") != NULL);
+    g_assert(strstr(report, "\"Gio.SimpleAction.activate\": { \"resolved\": 1, \"invoked\": 1,") != NULL);
+    /* Both activations reach the handler, but only one was emitted from JS */
+    g_assert(strstr(report, "\"GSimpleAction::activate\": { \"resolved\": 1, \"invoked\": 2,") != NULL);
+    g_assert(strstr(report, "\"GSimpleAction::activate\": { \"resolved\": 0, \"invoked\": 1,") != NULL);
+    g_assert(strstr(report, "\"GSimpleAction:enabled\": { \"resolved\": 1, \"invoked\": 2,") != NULL);
+    g_free(report);
+
+    g_object_unref(context);
+}
+
+static void
+gjstest_test_func_gjs_context_pool(void)
+{
+    GjsContextPool *pool;
+    GjsContextPoolStats stats;
+    GjsContext *first;
+    GjsContext *second;
+    GjsContext *extra;
+    GjsContext *outer;
+    GError *error = NULL;
+    const char *preload[] = { "lang", NULL };
+    const char *broken_preload[] = { "nonexistentModule", NULL };
+    int estatus = 0;
+
+    outer = gjs_context_get_current();
+
+    pool = gjs_context_pool_new(2, NULL, preload, &error);
+    g_assert_no_error(error);
+    g_assert_cmpuint(gjs_context_pool_get_n_idle(pool), ==, 2);
+    /* Idle contexts are not current */
+    g_assert(gjs_context_get_current() == outer);
+
+    first = gjs_context_pool_acquire(pool, &error);
+    g_assert_no_error(error);
+    g_assert(gjs_context_get_current() == first);
+    if (!gjs_context_eval(first,
+                          "leaked = 1; var declared = 2; imports.lang.Class ? 0 : 1;",
+                          -1, "<input>", &estatus, &error))
+        g_error("%s", error->message);
+    g_assert_cmpint(estatus, ==, 0);
+
+    second = gjs_context_pool_acquire(pool, &error);
+    g_assert_no_error(error);
+    /* A miss creates a new context */
+    extra = gjs_context_pool_acquire(pool, &error);
+    g_assert_no_error(error);
+    g_assert(first != second && second != extra && first != extra);
+
+    gjs_context_pool_release(pool, extra);
+    gjs_context_pool_release(pool, second);
+    /* The pool is full, so this one is dropped */
+    gjs_context_pool_release(pool, first);
+    g_assert(gjs_context_get_current() == outer);
+
+    gjs_context_pool_get_stats(pool, &stats);
+    g_assert_cmpuint(stats.hits, ==, 2);
+    g_assert_cmpuint(stats.misses, ==, 1);
+    g_assert_cmpuint(stats.resets, ==, 2);
+    g_assert_cmpuint(stats.discards, ==, 1);
+
+    /* A reused context has lost the globals its last user added */
+    first = gjs_context_pool_acquire(pool, &error);
+    g_assert_no_error(error);
+    g_assert(first == second);
+    if (!gjs_context_eval(first,
+                          "leaked = 1; var declared = 2;", -1, "<input>", NULL, &error))
+        g_error("%s", error->message);
+    gjs_context_pool_release(pool, first);
+
+    first = gjs_context_pool_acquire(pool, &error);
+    g_assert_no_error(error);
+    g_assert(first == second);
+    if (!gjs_context_eval(first,
+                          "typeof leaked == 'undefined' && declared === undefined ? 0 : 1",
+                          -1, "<input>", &estatus, &error))
+        g_error("%s", error->message);
+    g_assert_cmpint(estatus, ==, 0);
+    gjs_context_pool_release(pool, first);
+
+    /* Releasing out of order leaves the other context current */
+    first = gjs_context_pool_acquire(pool, &error);
+    g_assert_no_error(error);
+    second = gjs_context_pool_acquire(pool, &error);
+    g_assert_no_error(error);
+    gjs_context_pool_release(pool, first);
+    g_assert(gjs_context_get_current() == second);
+    gjs_context_pool_release(pool, second);
+    g_assert(gjs_context_get_current() == outer);
+
+    gjs_context_pool_free(pool);
+
+    /* An empty pool only preloads on a miss, where failure is reported */
+    pool = gjs_context_pool_new(0, NULL, broken_preload, &error);
+    g_assert_no_error(error);
+    g_assert(gjs_context_pool_acquire(pool, &error) == NULL);
+    g_assert(error != NULL);
+    g_clear_error(&error);
+    gjs_context_pool_free(pool);
+}
+
+static void
+gjstest_test_func_gjs_context_incremental_gc(void)
+{
+    GjsContext *context;
+    GError *error = NULL;
+    gboolean incremental;
+    guint budget;
+    int i;
+
+    context = (GjsContext *) g_object_new(GJS_TYPE_CONTEXT,
+                                          "incremental-gc", TRUE,
+                                          "gc-slice-budget", 5,
+                                          NULL);
+    g_object_get(context,
+                 "incremental-gc", &incremental,
+                 "gc-slice-budget", &budget,
+                 NULL);
+    g_assert(incremental);
+    g_assert_cmpuint(budget, ==, 5);
+
+    for (i = 0; i < 10; i++) {
+        if (!gjs_context_eval(context,
+                              "let a = []; for (let i = 0; i < 10000; i++) a.push({ i: i });",
+                              -1, "<input>", NULL, &error))
+            g_error("%s", error->message);
+        gjs_context_maybe_gc(context);
+    }
+
+    /* Let any slices scheduled above run to completion */
+    while (g_main_context_iteration(NULL, FALSE))
+        ;
+
+    gjs_context_gc(context);
+    g_object_unref(context);
+}
+
+static void
+gjstest_test_func_gjs_context_runtime_params(void)
+{
+    GjsContext *context;
+    JSRuntime *runtime;
+    GError *error = NULL;
+    gboolean incremental;
+    char *gc_mode;
+
+    context = (GjsContext *) g_object_new(GJS_TYPE_CONTEXT,
+                                          "max-heap-bytes", 64 * 1024 * 1024,
+                                          "native-stack-quota", 512 * 1024,
+                                          "gc-mode", "compartment",
+                                          "gc-dynamic-heap-growth", TRUE,
+                                          "gc-high-frequency-heap-growth-max", 200,
+                                          NULL);
+    runtime = JS_GetRuntime((JSContext *) gjs_context_get_native_context(context));
+    g_assert_cmpuint(JS_GetGCParameter(runtime, JSGC_MAX_BYTES), ==, 64 * 1024 * 1024);
+    g_assert_cmpuint(JS_GetGCParameter(runtime, JSGC_MODE), ==, JSGC_MODE_COMPARTMENT);
+    g_assert_cmpuint(JS_GetGCParameter(runtime, JSGC_DYNAMIC_HEAP_GROWTH), ==, 1);
+    g_assert_cmpuint(JS_GetGCParameter(runtime, JSGC_HIGH_FREQUENCY_HEAP_GROWTH_MAX), ==, 200);
+
+    if (!gjs_context_eval(context, "let a = []; for (let i = 0; i < 1000; i++) a.push({});",
+                          -1, "<input>", NULL, &error))
+        g_error("%s", error->message);
+    gjs_context_gc(context);
+    g_object_unref(context);
+
+    /* gc-mode and incremental-gc describe the same thing */
+    context = (GjsContext *) g_object_new(GJS_TYPE_CONTEXT,
+                                          "gc-mode", "incremental",
+                                          NULL);
+    g_object_get(context, "incremental-gc", &incremental, NULL);
+    g_assert(incremental);
+    g_object_unref(context);
+
+    context = (GjsContext *) g_object_new(GJS_TYPE_CONTEXT,
+                                          "incremental-gc", TRUE,
+                                          NULL);
+    g_object_get(context, "gc-mode", &gc_mode, NULL);
+    g_assert_cmpstr(gc_mode, ==, "incremental");
+    g_free(gc_mode);
+    g_object_unref(context);
+}
+
+static void
+gjstest_test_func_gjs_gc_sampling(void)
+{
+    GjsContext *context, *other;
+    JSRuntime *runtime, *other_runtime;
+    GjsGCSamplingStats before, after, other_stats;
+
+    context = gjs_context_new();
+    runtime = JS_GetRuntime((JSContext *) gjs_context_get_native_context(context));
+    other = gjs_context_new();
+    other_runtime = JS_GetRuntime((JSContext *) gjs_context_get_native_context(other));
+
+    gjs_gc_set_sample_interval(runtime, 0);
+    gjs_gc_get_sampling_stats(runtime, &before);
+    gjs_context_maybe_gc(context);
+    gjs_gc_get_sampling_stats(runtime, &after);
+    g_assert_cmpuint(after.n_checks, ==, before.n_checks + 1);
+    g_assert_cmpuint(after.n_samples, ==, before.n_samples + 1);
+    g_assert_cmpuint(after.js_heap_bytes, >, 0);
+    g_assert_cmpuint(after.js_heap_trigger, >, 0);
+
+    /* Another runtime keeps its own interval and triggers */
+    gjs_gc_get_sampling_stats(other_runtime, &other_stats);
+    g_assert_cmpuint(other_stats.n_checks, ==, 0);
+    g_assert_cmpuint(other_stats.js_heap_trigger, ==, 0);
+    g_assert_cmpuint(other_stats.sample_interval_ms, !=, 0);
+
+    /* Within the interval, nothing is read */
+    gjs_gc_set_sample_interval(runtime, 60 * 60 * 1000);
+    gjs_context_maybe_gc(context);
+    gjs_context_maybe_gc(context);
+    before = after;
+    gjs_gc_get_sampling_stats(runtime, &after);
+    g_assert_cmpuint(after.n_checks, ==, before.n_checks + 2);
+    g_assert_cmpuint(after.n_samples, ==, before.n_samples);
+    g_assert_cmpuint(after.sample_interval_ms, ==, 60 * 60 * 1000);
+
+    /* ... but that doesn't hold back the other runtime */
+    gjs_context_maybe_gc(other);
+    gjs_gc_get_sampling_stats(other_runtime, &other_stats);
+    g_assert_cmpuint(other_stats.n_samples, ==, 1);
+
+    g_object_unref(other);
+    g_object_unref(context);
+}
+
+static void
+gjstest_test_func_gjs_mem_external(void)
+{
+    GjsContext *context;
+    GError *error = NULL;
+    gsize initial;
+
+    context = gjs_context_new();
+    initial = gjs_memory_get_external_bytes();
+
+    if (!gjs_context_eval(context,
+                          "const ByteArray = imports.byteArray;\n"
+                          "let big = new ByteArray.ByteArray(1024 * 1024);\n"
+                          "big.length = 2 * 1024 * 1024;\n",
+                          -1, "<input>", NULL, &error))
+        g_error("%s", error->message);
+    g_assert_cmpuint(gjs_memory_get_external_bytes(), >=, initial + 2 * 1024 * 1024);
+
+    if (!gjs_context_eval(context, "big = null;",
+                          -1, "<input>", NULL, &error))
+        g_error("%s", error->message);
+    gjs_context_gc(context);
+    g_assert_cmpuint(gjs_memory_get_external_bytes(), <, initial + 1024 * 1024);
+
+    g_object_unref(context);
+}
+
+static void
+gjstest_test_func_gjs_mem_report_json(void)
+{
+    GjsContext *context;
+    char *json;
+
+    context = gjs_context_new();
+
+    json = gjs_memory_report_json();
+    g_assert(g_str_has_prefix(json, "{"));
+    g_assert(strstr(json, "\"counters\"") != NULL);
+    g_assert(strstr(json, "\"importer\": { \"count\": ") != NULL);
+    g_assert(strstr(json, "\"trampoline\"") != NULL);
+    g_assert(strstr(json, "\"external_bytes\"") != NULL);
+    g_assert(strstr(json, ",\n  }") == NULL);
+    g_free(json);
+
+    g_object_unref(context);
+}
+
+static void
+gjstest_test_func_gjs_context_dump_heap(void)
+{
+    GjsContext *context;
+    GError *error = NULL;
+    char *filename;
+    char *contents;
+    int fd;
+
+    fd = g_file_open_tmp("gjs-heap-XXXXXX", &filename, &error);
+    g_assert_no_error(error);
+    close(fd);
+
+    context = gjs_context_new();
+    if (!gjs_context_eval(context,
+                          "const GObject = imports.gi.GObject;\n"
+                          "let kept = new GObject.Object();\n",
+                          -1, "<input>", NULL, &error))
+        g_error("%s", error->message);
+
+    if (!gjs_context_dump_heap(context, filename, &error))
+        g_error("%s", error->message);
+
+    if (!g_file_get_contents(filename, &contents, NULL, &error))
+        g_error("%s", error->message);
+    g_assert(g_str_has_prefix(contents, "# gjs heap snapshot 1 "));
+    g_assert(strstr(contents, "\nR ") != NULL);
+    g_assert(strstr(contents, "\nE ") != NULL);
+    /* "kept" may still be held by its toggle ref, pending toggles only
+     * run from the main loop */
+    g_assert(strstr(contents, " gobject=GObject\n") != NULL ||
+             strstr(contents, " gobject=GObject toggle-root\n") != NULL);
+    g_assert(strstr(contents, " gobject=GObject prototype") != NULL);
+    g_free(contents);
+
+    g_assert(!gjs_context_dump_heap(context, "/nonexistent/heap", &error));
+    g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+    g_clear_error(&error);
+
+    g_object_unref(context);
+    g_unlink(filename);
+    g_free(filename);
+}
+
 static void
 gjstest_test_context_pushed_on_creation(void)
 {
@@ -392,6 +1334,36 @@ gjstest_test_pop_context(void)
     g_object_unref(context);
 }
 
+static int
+count_evaluation(int *counter)
+{
+    return ++(*counter);
+}
+
+static void
+gjstest_test_func_util_log_disabled_topic(void)
+{
+    guint32 saved;
+    int counter = 0;
+
+    /* Make sure the environment has been looked at, so that the mask
+     * we restore is the real one and not the all-enabled placeholder
+     */
+    gjs_debug(GJS_DEBUG_CONTEXT, "log test");
+    saved = gjs_debug_enabled_topics;
+
+    gjs_debug_enabled_topics = saved & ~(1u << GJS_DEBUG_CONTEXT);
+    gjs_debug(GJS_DEBUG_CONTEXT, "evaluated %d", count_evaluation(&counter));
+    g_assert_cmpint(counter, ==, 0);
+
+    gjs_debug_enabled_topics = saved | (1u << GJS_DEBUG_CONTEXT);
+    gjs_debug(GJS_DEBUG_CONTEXT, "evaluated %d", count_evaluation(&counter));
+    g_assert_cmpint(counter, ==, 1);
+
+    gjs_debug_enabled_topics = saved;
+    gjs_debug_flush();
+}
+
 int
 main(int    argc,
      char **argv)
@@ -402,6 +1374,24 @@ main(int    argc,
 
     g_test_add_func("/gjs/context/construct/destroy", gjstest_test_func_gjs_context_construct_destroy);
     g_test_add_func("/gjs/context/construct/eval", gjstest_test_func_gjs_context_construct_eval);
+    g_test_add_func("/gjs/context/eval_file", gjstest_test_func_gjs_context_eval_file);
+    g_test_add_func("/gjs/bundle/import", gjstest_test_func_gjs_bundle_import);
+    g_test_add_func("/gjs/bundle/bytecode", gjstest_test_func_gjs_bundle_bytecode);
+    g_test_add_func("/gjs/context/prefetch_modules", gjstest_test_func_gjs_context_prefetch_modules);
+    g_test_add_func("/gjs/context/import_trace", gjstest_test_func_gjs_context_import_trace);
+    g_test_add_func("/gjs/context/timeline", gjstest_test_func_gjs_context_timeline);
+    g_test_add_func("/gjs/gi/usage", gjstest_test_func_gjs_gi_usage);
+    g_test_add_func("/gjs/profiler/sample", gjstest_test_func_gjs_profiler_sample);
+    g_test_add_func("/gjs/profiler/instrument", gjstest_test_func_gjs_profiler_instrument);
+    g_test_add_func("/gjs/profiler/native", gjstest_test_func_gjs_profiler_native);
+    g_test_add_func("/gjs/profiler/collapsed", gjstest_test_func_gjs_profiler_collapsed);
+    g_test_add_func("/gjs/context/pool", gjstest_test_func_gjs_context_pool);
+    g_test_add_func("/gjs/context/incremental_gc", gjstest_test_func_gjs_context_incremental_gc);
+    g_test_add_func("/gjs/context/runtime_params", gjstest_test_func_gjs_context_runtime_params);
+    g_test_add_func("/gjs/context/dump_heap", gjstest_test_func_gjs_context_dump_heap);
+    g_test_add_func("/gjs/gc/sampling", gjstest_test_func_gjs_gc_sampling);
+    g_test_add_func("/gjs/mem/external", gjstest_test_func_gjs_mem_external);
+    g_test_add_func("/gjs/mem/report_json", gjstest_test_func_gjs_mem_report_json);
     g_test_add_func("/gjs/context/fixture", gjstest_test_func_gjs_context_fixture);
     g_test_add_func("/gjs/jsapi/util/array", gjstest_test_func_gjs_jsapi_util_array);
     g_test_add_func("/gjs/jsapi/util/error/throw", gjstest_test_func_gjs_jsapi_util_error_throw);
@@ -409,11 +1399,13 @@ main(int    argc,
     g_test_add_func("/gjs/jsutil/strip_shebang/no_shebang", gjstest_test_strip_shebang_no_advance_for_no_shebang);
     g_test_add_func("/gjs/jsutil/strip_shebang/have_shebang", gjstest_test_strip_shebang_advance_for_shebang);
     g_test_add_func("/gjs/jsutil/strip_shebang/only_shebang", gjstest_test_strip_shebang_return_null_for_just_shebang);
+    g_test_add_func("/gjs/jsutil/strip_shebang/script_len", gjstest_test_strip_shebang_stop_at_script_len);
     g_test_add_func("/gjs/context_stack/creation", gjstest_test_context_pushed_on_creation);
     g_test_add_func("/gjs/context_stack/removed_on_deletion", gjstest_test_context_removed_on_deletion);
     g_test_add_func("/gjs/context_stack/all_removed_on_deletion", gjstest_test_all_instances_removed_on_deletion);
     g_test_add_func("/gjs/context_stack/pop_context", gjstest_test_pop_context);
     g_test_add_func("/gjs/stack/dump", gjstest_test_func_gjs_stack_dump);
+    g_test_add_func("/util/log/disabled_topic", gjstest_test_func_util_log_disabled_topic);
     g_test_add_func("/util/glib/strv/concat/null", gjstest_test_func_util_glib_strv_concat_null);
     g_test_add_func("/util/glib/strv/concat/pointers", gjstest_test_func_util_glib_strv_concat_pointers);
 
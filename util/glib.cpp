@@ -22,11 +22,17 @@
  */
 
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "glib.h"
 
 #include <config.h>
 
+#include <glib/gstdio.h>
+
 typedef struct {
     void *key;
     void *value;
@@ -127,6 +133,97 @@ gjs_g_strv_concat(char ***strv_array, int len)
     return (char**)g_ptr_array_free(array, FALSE);
 }
 
+static void
+mapped_file_unref(gpointer data)
+{
+    g_mapped_file_unref((GMappedFile *) data);
+}
+
+/** gjs_g_file_load_bytes:
+ *
+ * Load the contents of @file. Local files are mapped into memory
+ * rather than copied into a heap buffer, so the returned bytes share
+ * their pages with the page cache; the mapping goes away as soon as
+ * the last reference to the returned #GBytes is dropped. Other files
+ * (for example resource:// URIs) are loaded with g_file_load_contents().
+ *
+ * Failures to open the file are reported in the %G_IO_ERROR domain in
+ * both cases, so callers can check for %G_IO_ERROR_NOT_FOUND and
+ * friends regardless of how the file was loaded.
+ *
+ * Note that the returned data is not guaranteed to be nul-terminated.
+ *
+ * @file: the file to load
+ * @error: return location for a #GError
+ *
+ * @return: a new #GBytes, or %NULL on error
+ */
+GBytes*
+gjs_g_file_load_bytes(GFile   *file,
+                      GError **error)
+{
+    char *path;
+    char *contents;
+    gsize length;
+    GMappedFile *mapped;
+    struct stat buf;
+    int fd;
+    int saved_errno;
+
+    path = g_file_get_path(file);
+    if (path == NULL) {
+        if (!g_file_load_contents(file, NULL, &contents, &length, NULL, error))
+            return NULL;
+        return g_bytes_new_take(contents, length);
+    }
+
+    fd = g_open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        saved_errno = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                    "Failed to open file '%s': %s",
+                    path, g_strerror(saved_errno));
+        g_free(path);
+        return NULL;
+    }
+
+    if (fstat(fd, &buf) < 0) {
+        saved_errno = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                    "Failed to get attributes of file '%s': %s",
+                    path, g_strerror(saved_errno));
+        goto fail;
+    }
+
+    if (S_ISDIR(buf.st_mode)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY,
+                    "Can't load file '%s': is a directory", path);
+        goto fail;
+    }
+
+    mapped = g_mapped_file_new_from_fd(fd, FALSE, error);
+    if (mapped == NULL)
+        goto fail;
+
+    close(fd);
+    g_free(path);
+
+    /* An empty file maps to NULL contents */
+    if (g_mapped_file_get_length(mapped) == 0) {
+        g_mapped_file_unref(mapped);
+        return g_bytes_new_static("", 0);
+    }
+
+    return g_bytes_new_with_free_func(g_mapped_file_get_contents(mapped),
+                                      g_mapped_file_get_length(mapped),
+                                      mapped_file_unref, mapped);
+
+ fail:
+    close(fd);
+    g_free(path);
+    return NULL;
+}
+
 gchar *
 _gjs_g_utf8_make_valid (const gchar *name)
 {
@@ -25,6 +25,7 @@
 #define __GJS_UTIL_GLIB_H__
 
 #include <glib.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -39,6 +40,9 @@ gboolean gjs_g_hash_table_steal_one  (GHashTable  *hash,
 char**   gjs_g_strv_concat           (char      ***strv_array,
                                       int          len);
 
+GBytes*  gjs_g_file_load_bytes       (GFile       *file,
+                                      GError     **error);
+
 G_END_DECLS
 
 #endif  /* __GJS_UTIL_GLIB_H__ */
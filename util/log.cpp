@@ -33,225 +33,281 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#define PREFIX_LENGTH 12
+
+/* Messages to a log file are appended to a buffer that a thread writes
+ * out, so logging costs a printf instead of a write and a flush. The
+ * writer wakes up every LOG_FLUSH_INTERVAL_US or when
+ * LOG_FLUSH_THRESHOLD bytes are waiting; loggers only wait for it when
+ * it falls LOG_BUFFER_MAX behind.
+ */
+#define LOG_FLUSH_INTERVAL_US (100 * 1000)
+#define LOG_FLUSH_THRESHOLD (64 * 1024)
+#define LOG_BUFFER_MAX (1024 * 1024)
+
+guint32 gjs_debug_enabled_topics = G_MAXUINT32;
+
+static const char *topic_prefixes[] = {
+    "MARK",             /* GJS_DEBUG_STRACE_TIMESTAMP */
+    "JS GI USE",
+    "JS MEMORY",
+    "JS CTX",
+    "JS IMPORT",
+    "JS NATIVE",
+    "JS KP ALV",
+    "JS G REPO",
+    "JS G NS",
+    "JS G OBJ",
+    "JS G FUNC",
+    "JS G CLSR",
+    "JS G BXD",
+    "JS G ENUM",
+    "JS G PRM",
+    "JS DB",
+    "JS RS",
+    "JS WEAK",
+    "JS MAINLOOP",
+    "JS PROPS",
+    "JS SCOPE",
+    "JS HTTP",
+    "JS BYTE ARRAY",
+    "JS G ERR",
+};
+
+G_STATIC_ASSERT(G_N_ELEMENTS(topic_prefixes) == GJS_DEBUG_N_TOPICS);
+
+static FILE *logfp = NULL;
+static gboolean print_timestamp = FALSE;
+static GTimer *timer = NULL;
+
+static GThread *writer_thread = NULL;
+static GMutex buffer_lock;
+static GCond buffer_cond;       /* signalled when there is a lot to write */
+static GCond drained_cond;      /* signalled when the buffer was taken */
+static GString *buffer = NULL;  /* protected by buffer_lock */
+/* Held while writing, so that chunks go out in order */
+static GMutex write_lock;
+static GString *writing = NULL; /* protected by write_lock */
+
 /* prefix is allowed if it's in the ;-delimited environment variable
  * GJS_DEBUG_TOPICS or if that variable is not set.
  */
 static gboolean
-is_allowed_prefix (const char *prefix)
+is_allowed_prefix (char      **prefixes,
+                   const char *prefix)
 {
-    static const char *topics = NULL;
-    static char **prefixes = NULL;
-    gboolean found = FALSE;
     int i;
 
-    if (topics == NULL) {
-        topics = g_getenv("GJS_DEBUG_TOPICS");
-
-        if (!topics)
-            return TRUE;
-
-        /* We never really free this, should be gone when the process exits */
-        prefixes = g_strsplit(topics, ";", -1);
-    }
-
     if (!prefixes)
         return TRUE;
 
     for (i = 0; prefixes[i] != NULL; i++) {
-        if (!strcmp(prefixes[i], prefix)) {
-            found = TRUE;
-            break;
-        }
+        if (!strcmp(prefixes[i], prefix))
+            return TRUE;
     }
 
-    return found;
+    return FALSE;
 }
 
-#define PREFIX_LENGTH 12
-
 static void
 write_to_stream(FILE       *logfp,
                 const char *prefix,
                 const char *s)
 {
-    /* seek to end to avoid truncating in case we're using shared logfile */
-    (void)fseek(logfp, 0, SEEK_END);
-
     fprintf(logfp, "%*s: %s", PREFIX_LENGTH, prefix, s);
     if (!g_str_has_suffix(s, "\n"))
         fputs("\n", logfp);
     fflush(logfp);
 }
 
+static void
+write_to_buffer(const char *prefix,
+                const char *s)
+{
+    g_mutex_lock(&buffer_lock);
+
+    while (buffer->len > LOG_BUFFER_MAX) {
+        g_cond_signal(&buffer_cond);
+        g_cond_wait(&drained_cond, &buffer_lock);
+    }
+
+    g_string_append_printf(buffer, "%*s: %s", PREFIX_LENGTH, prefix, s);
+    if (!g_str_has_suffix(s, "\n"))
+        g_string_append_c(buffer, '\n');
+
+    if (buffer->len >= LOG_FLUSH_THRESHOLD)
+        g_cond_signal(&buffer_cond);
+
+    g_mutex_unlock(&buffer_lock);
+}
+
+/**
+ * gjs_debug_flush:
+ *
+ * Writes out the messages still waiting for the log writer thread.
+ * Called at exit; a crash loses the last LOG_FLUSH_INTERVAL_US or so
+ * of the log.
+ */
 void
-gjs_debug(GjsDebugTopic topic,
-          const char   *format,
-          ...)
+gjs_debug_flush(void)
 {
-    static FILE *logfp = NULL;
-    static gboolean debug_log_enabled = FALSE;
-    static gboolean strace_timestamps = FALSE;
-    static gboolean checked_for_timestamp = FALSE;
-    static gboolean print_timestamp = FALSE;
-    static GTimer *timer = NULL;
-    const char *prefix;
-    va_list args;
-    char *s;
+    GString *tmp;
 
-    if (!checked_for_timestamp) {
-        print_timestamp = gjs_environment_variable_is_set("GJS_DEBUG_TIMESTAMP");
-        checked_for_timestamp = TRUE;
+    if (writer_thread == NULL)
+        return;
+
+    g_mutex_lock(&write_lock);
+
+    g_mutex_lock(&buffer_lock);
+    tmp = buffer;
+    buffer = writing;
+    writing = tmp;
+    g_cond_broadcast(&drained_cond);
+    g_mutex_unlock(&buffer_lock);
+
+    if (writing->len > 0) {
+        fwrite(writing->str, 1, writing->len, logfp);
+        fflush(logfp);
+        g_string_truncate(writing, 0);
     }
 
-    if (print_timestamp && !timer) {
-        timer = g_timer_new();
+    g_mutex_unlock(&write_lock);
+}
+
+static gpointer
+log_writer_thread_func(gpointer data)
+{
+    while (TRUE) {
+        gint64 deadline = g_get_monotonic_time() + LOG_FLUSH_INTERVAL_US;
+
+        g_mutex_lock(&buffer_lock);
+        while (buffer->len < LOG_FLUSH_THRESHOLD &&
+               g_cond_wait_until(&buffer_cond, &buffer_lock, deadline))
+            ;
+        g_mutex_unlock(&buffer_lock);
+
+        gjs_debug_flush();
     }
 
-    if (logfp == NULL) {
-        const char *debug_output = g_getenv("GJS_DEBUG_OUTPUT");
-        if (debug_output != NULL &&
-            strcmp(debug_output, "stderr") == 0) {
-            debug_log_enabled = TRUE;
-        } else if (debug_output != NULL) {
-            const char *log_file;
-            char *free_me;
-            char *c;
-
-            /* Allow debug-%u.log for per-pid logfiles as otherwise log
-             * messages from multiple processes can overwrite each other.
-             *
-             * (printf below should be safe as we check '%u' is the only format
-             * string)
-             */
-            c = strchr((char *) debug_output, '%');
-            if (c && c[1] == 'u' && !strchr(c+1, '%')) {
-                free_me = g_strdup_printf(debug_output, (guint)getpid());
-                log_file = free_me;
-            } else {
-                log_file = debug_output;
-                free_me = NULL;
-            }
+    return NULL;
+}
 
-            /* avoid truncating in case we're using shared logfile */
-            logfp = fopen(log_file, "a");
-            if (!logfp)
-                fprintf(stderr, "Failed to open log file `%s': %s\n",
-                        log_file, g_strerror(errno));
+/* Works out from the environment which topics are logged, and where to */
+static void
+log_init(void)
+{
+    const char *debug_output;
+    const char *topics;
+    char **prefixes = NULL;
+    gboolean debug_log_enabled = FALSE;
+    guint32 enabled = 0;
+    int i;
 
-            g_free(free_me);
+    print_timestamp = gjs_environment_variable_is_set("GJS_DEBUG_TIMESTAMP");
+    if (print_timestamp)
+        timer = g_timer_new();
 
-            debug_log_enabled = TRUE;
+    debug_output = g_getenv("GJS_DEBUG_OUTPUT");
+    if (debug_output != NULL &&
+        strcmp(debug_output, "stderr") == 0) {
+        debug_log_enabled = TRUE;
+    } else if (debug_output != NULL) {
+        const char *log_file;
+        char *free_me;
+        char *c;
+
+        /* Allow debug-%u.log for per-pid logfiles as otherwise log
+         * messages from multiple processes can overwrite each other.
+         *
+         * (printf below should be safe as we check '%u' is the only format
+         * string)
+         */
+        c = strchr((char *) debug_output, '%');
+        if (c && c[1] == 'u' && !strchr(c+1, '%')) {
+            free_me = g_strdup_printf(debug_output, (guint)getpid());
+            log_file = free_me;
+        } else {
+            log_file = debug_output;
+            free_me = NULL;
         }
 
-        if (logfp == NULL)
-            logfp = stderr;
+        /* avoid truncating in case we're using shared logfile; append
+         * mode also makes every write go to the current end
+         */
+        logfp = fopen(log_file, "a");
+        if (!logfp)
+            fprintf(stderr, "Failed to open log file `%s': %s\n",
+                    log_file, g_strerror(errno));
 
-        strace_timestamps = gjs_environment_variable_is_set("GJS_STRACE_TIMESTAMPS");
-    }
+        g_free(free_me);
 
-    /* only strace timestamps if debug
-     * log wasn't specifically switched on
-     */
-    if (!debug_log_enabled &&
-        topic != GJS_DEBUG_STRACE_TIMESTAMP)
-        return;
+        debug_log_enabled = TRUE;
+    }
 
-    switch (topic) {
-    case GJS_DEBUG_STRACE_TIMESTAMP:
-        /* return early if strace timestamps are disabled, avoiding
-         * printf format overhead and so forth.
+    if (logfp != NULL) {
+        buffer = g_string_sized_new(LOG_FLUSH_THRESHOLD);
+        writing = g_string_sized_new(LOG_FLUSH_THRESHOLD);
+        writer_thread = g_thread_new("gjs-log", log_writer_thread_func, NULL);
+        atexit(gjs_debug_flush);
+    } else {
+        /* stderr is written directly, to keep its order with
+         * everything else printed there
          */
-        if (!strace_timestamps)
-            return;
-        /* this is a special magic topic for use with
-         * git clone http://www.gnome.org/~federico/git/performance-scripts.git
-         * http://www.gnome.org/~federico/news-2006-03.html#timeline-tools
+        logfp = stderr;
+    }
+
+    topics = g_getenv("GJS_DEBUG_TOPICS");
+    if (topics)
+        prefixes = g_strsplit(topics, ";", -1);
+
+    for (i = 0; i < GJS_DEBUG_N_TOPICS; i++) {
+        if (!is_allowed_prefix(prefixes, topic_prefixes[i]))
+            continue;
+
+        /* only strace timestamps if debug log wasn't specifically
+         * switched on
          */
-        prefix = "MARK";
-        break;
-    case GJS_DEBUG_GI_USAGE:
-        prefix = "JS GI USE";
-        break;
-    case GJS_DEBUG_MEMORY:
-        prefix = "JS MEMORY";
-        break;
-    case GJS_DEBUG_CONTEXT:
-        prefix = "JS CTX";
-        break;
-    case GJS_DEBUG_IMPORTER:
-        prefix = "JS IMPORT";
-        break;
-    case GJS_DEBUG_NATIVE:
-        prefix = "JS NATIVE";
-        break;
-    case GJS_DEBUG_KEEP_ALIVE:
-        prefix = "JS KP ALV";
-        break;
-    case GJS_DEBUG_GREPO:
-        prefix = "JS G REPO";
-        break;
-    case GJS_DEBUG_GNAMESPACE:
-        prefix = "JS G NS";
-        break;
-    case GJS_DEBUG_GOBJECT:
-        prefix = "JS G OBJ";
-        break;
-    case GJS_DEBUG_GFUNCTION:
-        prefix = "JS G FUNC";
-        break;
-    case GJS_DEBUG_GCLOSURE:
-        prefix = "JS G CLSR";
-        break;
-    case GJS_DEBUG_GBOXED:
-        prefix = "JS G BXD";
-        break;
-    case GJS_DEBUG_GENUM:
-        prefix = "JS G ENUM";
-        break;
-    case GJS_DEBUG_GPARAM:
-        prefix = "JS G PRM";
-        break;
-    case GJS_DEBUG_DATABASE:
-        prefix = "JS DB";
-        break;
-    case GJS_DEBUG_RESULTSET:
-        prefix = "JS RS";
-        break;
-    case GJS_DEBUG_WEAK_HASH:
-        prefix = "JS WEAK";
-        break;
-    case GJS_DEBUG_MAINLOOP:
-        prefix = "JS MAINLOOP";
-        break;
-    case GJS_DEBUG_PROPS:
-        prefix = "JS PROPS";
-        break;
-    case GJS_DEBUG_SCOPE:
-        prefix = "JS SCOPE";
-        break;
-    case GJS_DEBUG_HTTP:
-        prefix = "JS HTTP";
-        break;
-    case GJS_DEBUG_BYTE_ARRAY:
-        prefix = "JS BYTE ARRAY";
-        break;
-    case GJS_DEBUG_GERROR:
-        prefix = "JS G ERR";
-        break;
-    default:
-        prefix = "???";
-        break;
+        if (i == GJS_DEBUG_STRACE_TIMESTAMP) {
+            if (gjs_environment_variable_is_set("GJS_STRACE_TIMESTAMPS"))
+                enabled |= 1u << i;
+        } else if (debug_log_enabled) {
+            enabled |= 1u << i;
+        }
+    }
+
+    g_strfreev(prefixes);
+
+    gjs_debug_enabled_topics = enabled;
+}
+
+static void
+gjs_debug_valist(GjsDebugTopic topic,
+                 const char   *format,
+                 va_list       args)
+{
+    static gsize initialized = 0;
+    const char *prefix;
+    char *s;
+
+    if (g_once_init_enter(&initialized)) {
+        log_init();
+        g_once_init_leave(&initialized, 1);
     }
 
-    if (!is_allowed_prefix(prefix))
+    if (!gjs_debug_topic_enabled(topic))
         return;
 
-    va_start (args, format);
+    prefix = topic_prefixes[topic];
+
     s = g_strdup_vprintf (format, args);
-    va_end (args);
 
     if (topic == GJS_DEBUG_STRACE_TIMESTAMP) {
-        /* Put a magic string in strace output */
+        /* this is a special magic topic for use with
+         * git clone http://www.gnome.org/~federico/git/performance-scripts.git
+         * http://www.gnome.org/~federico/news-2006-03.html#timeline-tools
+         *
+         * Put a magic string in strace output
+         */
         char *s2;
         s2 = g_strdup_printf("%s: gjs: %s",
                              prefix, s);
@@ -283,8 +339,39 @@ gjs_debug(GjsDebugTopic topic,
             previous = total;
         }
 
-        write_to_stream(logfp, prefix, s);
+        if (writer_thread != NULL)
+            write_to_buffer(prefix, s);
+        else
+            write_to_stream(logfp, prefix, s);
     }
 
     g_free(s);
 }
+
+/* Use the gjs_debug() macro rather than calling this directly */
+void
+gjs_debug_printf(GjsDebugTopic topic,
+                 const char   *format,
+                 ...)
+{
+    va_list args;
+
+    va_start (args, format);
+    gjs_debug_valist(topic, format, args);
+    va_end (args);
+}
+
+/* Out of line version of the gjs_debug() macro, for binaries built
+ * before it was one; the parentheses keep the macro from expanding.
+ */
+void
+(gjs_debug)(GjsDebugTopic topic,
+            const char   *format,
+            ...)
+{
+    va_list args;
+
+    va_start (args, format);
+    gjs_debug_valist(topic, format, args);
+    va_end (args);
+}
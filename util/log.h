@@ -31,7 +31,7 @@ G_BEGIN_DECLS
 /* The idea of this is to be able to have one big log file for the entire
  * environment, and grep out what you care about. So each module or app
  * should have its own entry in the enum. Be sure to add new enum entries
- * to the switch in log.c
+ * to the prefix table in log.cpp
  */
 typedef enum {
     GJS_DEBUG_STRACE_TIMESTAMP,
@@ -58,6 +58,7 @@ typedef enum {
     GJS_DEBUG_HTTP,
     GJS_DEBUG_BYTE_ARRAY,
     GJS_DEBUG_GERROR,
+    GJS_DEBUG_N_TOPICS
 } GjsDebugTopic;
 
 /* These defines are because we have some pretty expensive and
@@ -151,9 +152,35 @@ typedef enum {
 #define gjs_debug_gsignal(format...)
 #endif
 
-void gjs_debug(GjsDebugTopic topic,
-               const char   *format,
-               ...) G_GNUC_PRINTF (2, 3);
+/* Bit n is set if topic n is logged. Until the environment has been
+ * looked at, all bits are set so that the first message of each topic
+ * goes to gjs_debug_printf(), which works out the real mask.
+ */
+extern guint32 gjs_debug_enabled_topics;
+
+G_STATIC_ASSERT(GJS_DEBUG_N_TOPICS <= 32);
+
+#define gjs_debug_topic_enabled(topic) \
+    G_UNLIKELY((gjs_debug_enabled_topics & (1u << (topic))) != 0)
+
+void (gjs_debug)(GjsDebugTopic topic,
+                 const char   *format,
+                 ...) G_GNUC_PRINTF (2, 3);
+
+/* A macro so that a disabled topic costs a test and a branch, without
+ * evaluating the arguments.
+ */
+#define gjs_debug(topic, ...)                          \
+    G_STMT_START {                                     \
+        if (gjs_debug_topic_enabled(topic))            \
+            gjs_debug_printf((topic), __VA_ARGS__);    \
+    } G_STMT_END
+
+void gjs_debug_printf(GjsDebugTopic topic,
+                      const char   *format,
+                      ...) G_GNUC_PRINTF (2, 3);
+
+void gjs_debug_flush(void);
 
 G_END_DECLS
 